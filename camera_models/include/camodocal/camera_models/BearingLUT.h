@@ -0,0 +1,53 @@
+#ifndef BEARINGLUT_H
+#define BEARINGLUT_H
+
+#include <boost/shared_ptr.hpp>
+#include <eigen3/Eigen/Dense>
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+#include "Camera.h"
+
+namespace camodocal
+{
+
+/**
+ * \brief Table of unit bearings of a camera, sampled every step pixels and built once.
+ *
+ * Lifting a pixel is a bilinear interpolation of the four surrounding nodes instead of
+ * the iterative/polynomial inversion of the camera model. Pixels outside the image or
+ * next to nodes where the model has no valid bearing fall back to the exact camera.
+ */
+class BearingLUT
+{
+    public:
+    BearingLUT( const CameraConstPtr& camera, int step = 1 );
+
+    // Unit bearing of pixel p
+    void liftProjective( const Eigen::Vector2d& p, Eigen::Vector3d& P ) const;
+    //%output P
+
+    void liftProjectiveBatch( const std::vector< cv::Point2f >& pts,
+                              std::vector< Eigen::Vector3d >& bearings ) const;
+    std::vector< Eigen::Vector3d > liftProjectiveBatch( const std::vector< cv::Point2f >& pts ) const;
+
+    const CameraConstPtr& camera( void ) const { return m_camera; }
+    int step( void ) const { return m_step; }
+
+    private:
+    // Returns false when one of the nodes is invalid or p is outside the table
+    bool interpolate( double x, double y, Eigen::Vector3d& P ) const;
+
+    CameraConstPtr m_camera;
+    int m_step;
+    int m_cols;
+    int m_rows;
+    std::vector< float > m_bearings; // m_rows x m_cols x 3
+    std::vector< uint8_t > m_valid;
+};
+
+typedef boost::shared_ptr< BearingLUT > BearingLUTPtr;
+typedef boost::shared_ptr< const BearingLUT > BearingLUTConstPtr;
+}
+
+#endif
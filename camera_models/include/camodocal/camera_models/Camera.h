@@ -113,6 +113,17 @@ class Camera
     virtual void spaceToPlane( const Eigen::Vector3d& P, Eigen::Vector2d& p ) const = 0;
     //%output p
 
+    // Jacobians of a batch projection, one row per point (SoA):
+    // du/dx du/dy du/dz dv/dx dv/dy dv/dz
+    typedef Eigen::Matrix< double, Eigen::Dynamic, 6 > BatchJacobian;
+
+    // Projects the columns of P to the image plane, and calculates the
+    // jacobians when J is not null. The default calls spaceToPlane per point
+    // and differentiates numerically
+    virtual void spaceToPlaneBatch( const Eigen::Matrix3Xd& P, Eigen::Matrix2Xd& p, BatchJacobian* J = nullptr ) const;
+    //%output p
+    //%output J
+
     // Projects 3D points to the image plane (Pi function)
     // and calculates jacobian
     // virtual void spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p,
@@ -108,6 +108,12 @@ public:
     //%output p
     //%output J
 
+    // spaceToPlane of the columns of P, with analytic jacobians
+    void spaceToPlaneBatch(const Eigen::Matrix3Xd& P, Eigen::Matrix2Xd& p,
+                           BatchJacobian* J = nullptr) const;
+    //%output p
+    //%output J
+
     void undistToPlane(const Eigen::Vector2d& p_u, Eigen::Vector2d& p) const;
     //%output p
 
@@ -232,6 +232,9 @@ class PolyFisheyeCamera : public Camera
 
     void spaceToPlane( const Eigen::Vector3d& P, Eigen::Vector2d& p, Eigen::Matrix< double, 2, 3 >& J ) const;
 
+    // spaceToPlane of the columns of P, with analytic jacobians
+    void spaceToPlaneBatch( const Eigen::Matrix3Xd& P, Eigen::Matrix2Xd& p, BatchJacobian* J = nullptr ) const;
+
     void estimateIntrinsics( const cv::Size& boardSize,
                              const std::vector< std::vector< cv::Point3f > >& objectPoints,
                              const std::vector< std::vector< cv::Point2f > >& imagePoints );
@@ -0,0 +1,111 @@
+#include "camodocal/camera_models/BearingLUT.h"
+
+#include <cmath>
+
+namespace camodocal
+{
+
+BearingLUT::BearingLUT( const CameraConstPtr& camera, int step )
+ : m_camera( camera )
+ , m_step( std::max( step, 1 ) )
+{
+    int width  = camera->imageWidth( );
+    int height = camera->imageHeight( );
+    // Nodes at 0, step, 2*step... with the last one at or beyond the last pixel
+    m_cols = ( width - 1 + m_step - 1 ) / m_step + 1;
+    m_rows = ( height - 1 + m_step - 1 ) / m_step + 1;
+    m_bearings.resize( m_rows * m_cols * 3, 0.0f );
+    m_valid.resize( m_rows * m_cols, 0 );
+
+#pragma omp parallel for
+    for ( int i = 0; i < m_rows; ++i )
+    {
+        for ( int j = 0; j < m_cols; ++j )
+        {
+            Eigen::Vector3d P;
+            m_camera->liftProjective( Eigen::Vector2d( j * m_step, i * m_step ), P );
+            double norm = P.norm( );
+            if ( !std::isfinite( norm ) || norm < 1e-12 )
+            {
+                continue;
+            }
+            P /= norm;
+            int idx                  = i * m_cols + j;
+            m_bearings[idx * 3]      = P.x( );
+            m_bearings[idx * 3 + 1]  = P.y( );
+            m_bearings[idx * 3 + 2]  = P.z( );
+            m_valid[idx]             = 1;
+        }
+    }
+}
+
+bool
+BearingLUT::interpolate( double x, double y, Eigen::Vector3d& P ) const
+{
+    double gx = x / m_step;
+    double gy = y / m_step;
+    if ( !( gx >= 0 && gy >= 0 && gx <= m_cols - 1 && gy <= m_rows - 1 ) )
+    {
+        return false;
+    }
+    int j0 = std::min( (int)gx, m_cols - 2 );
+    int i0 = std::min( (int)gy, m_rows - 2 );
+    if ( j0 < 0 || i0 < 0 )
+    {
+        // Single row or column table
+        return false;
+    }
+    double tx = gx - j0;
+    double ty = gy - i0;
+    int idx   = i0 * m_cols + j0;
+    if ( !( m_valid[idx] && m_valid[idx + 1] && m_valid[idx + m_cols] && m_valid[idx + m_cols + 1] ) )
+    {
+        return false;
+    }
+    const float* b00 = m_bearings.data( ) + idx * 3;
+    const float* b01 = b00 + 3;
+    const float* b10 = b00 + m_cols * 3;
+    const float* b11 = b10 + 3;
+    double w00 = ( 1 - tx ) * ( 1 - ty ), w01 = tx * ( 1 - ty );
+    double w10 = ( 1 - tx ) * ty, w11 = tx * ty;
+    for ( int k = 0; k < 3; ++k )
+    {
+        P[k] = w00 * b00[k] + w01 * b01[k] + w10 * b10[k] + w11 * b11[k];
+    }
+    P.normalize( );
+    return true;
+}
+
+void
+BearingLUT::liftProjective( const Eigen::Vector2d& p, Eigen::Vector3d& P ) const
+{
+    if ( !interpolate( p.x( ), p.y( ), P ) )
+    {
+        m_camera->liftProjective( p, P );
+        P.normalize( );
+    }
+}
+
+void
+BearingLUT::liftProjectiveBatch( const std::vector< cv::Point2f >& pts,
+                                 std::vector< Eigen::Vector3d >& bearings ) const
+{
+    bearings.resize( pts.size( ) );
+    for ( size_t i = 0; i < pts.size( ); ++i )
+    {
+        if ( !interpolate( pts[i].x, pts[i].y, bearings[i] ) )
+        {
+            m_camera->liftProjective( Eigen::Vector2d( pts[i].x, pts[i].y ), bearings[i] );
+            bearings[i].normalize( );
+        }
+    }
+}
+
+std::vector< Eigen::Vector3d >
+BearingLUT::liftProjectiveBatch( const std::vector< cv::Point2f >& pts ) const
+{
+    std::vector< Eigen::Vector3d > bearings;
+    liftProjectiveBatch( pts, bearings );
+    return bearings;
+}
+}
@@ -140,6 +140,39 @@ Camera::estimateExtrinsics(const std::vector<cv::Point3f>& objectPoints,
     cv::solvePnP(objectPoints, Ms, cv::Mat::eye(3, 3, CV_64F), cv::noArray(), rvec, tvec);
 }
 
+void
+Camera::spaceToPlaneBatch(const Eigen::Matrix3Xd& P, Eigen::Matrix2Xd& p, BatchJacobian* J) const
+{
+    p.resize(2, P.cols());
+    if (J)
+    {
+        J->resize(P.cols(), 6);
+    }
+    for (int i = 0; i < P.cols(); ++i)
+    {
+        Eigen::Vector2d p_i;
+        spaceToPlane(P.col(i), p_i);
+        p.col(i) = p_i;
+        if (!J)
+        {
+            continue;
+        }
+        // Central differences
+        double h = 1e-6 * std::max(1.0, P.col(i).norm());
+        for (int k = 0; k < 3; ++k)
+        {
+            Eigen::Vector3d P_plus = P.col(i), P_minus = P.col(i);
+            P_plus(k) += h;
+            P_minus(k) -= h;
+            Eigen::Vector2d p_plus, p_minus;
+            spaceToPlane(P_plus, p_plus);
+            spaceToPlane(P_minus, p_minus);
+            (*J)(i, k) = (p_plus(0) - p_minus(0)) / (2 * h);
+            (*J)(i, 3 + k) = (p_plus(1) - p_minus(1)) / (2 * h);
+        }
+    }
+}
+
 double
 Camera::reprojectionDist(const Eigen::Vector3d& P1, const Eigen::Vector3d& P2) const
 {
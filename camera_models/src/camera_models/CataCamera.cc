@@ -728,6 +728,79 @@ CataCamera::spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p,
 }
 #endif
 
+/**
+ * \brief Project the columns of P to the image plane, with the Jacobians
+ *        when J is not null
+ *
+ * The distortion is applied inline, branch free, so that the compiler can
+ * vectorize the loops.
+ */
+void
+CataCamera::spaceToPlaneBatch(const Eigen::Matrix3Xd& P, Eigen::Matrix2Xd& p,
+                              BatchJacobian* J) const
+{
+    const int n = P.cols();
+    // Zero coefficients when m_noDistortion
+    const double k1 = mParameters.k1(), k2 = mParameters.k2(), p1 = mParameters.p1(), p2 = mParameters.p2();
+    const double xi = mParameters.xi();
+    const double gamma1 = mParameters.gamma1(), gamma2 = mParameters.gamma2(), u0 = mParameters.u0(), v0 = mParameters.v0();
+    p.resize(2, n);
+    const double* src = P.data();
+    double* dst = p.data();
+
+    for (int i = 0; i < n; ++i)
+    {
+        double x = src[3 * i], y = src[3 * i + 1], z = src[3 * i + 2];
+        // Project points to the normalised plane
+        double norm = sqrt(x * x + y * y + z * z);
+        double inv_denom = 1.0 / (z + xi * norm);
+        double mx = x * inv_denom, my = y * inv_denom;
+
+        double mx2 = mx * mx, my2 = my * my, mxy = mx * my;
+        double rho2 = mx2 + my2;
+        double rad_dist = k1 * rho2 + k2 * rho2 * rho2;
+        double dx = mx + mx * rad_dist + 2.0 * p1 * mxy + p2 * (rho2 + 2.0 * mx2);
+        double dy = my + my * rad_dist + 2.0 * p2 * mxy + p1 * (rho2 + 2.0 * my2);
+        dst[2 * i] = gamma1 * dx + u0;
+        dst[2 * i + 1] = gamma2 * dy + v0;
+    }
+    if (!J)
+    {
+        return;
+    }
+
+    // Separate loop, a branch in the projection loop would prevent its vectorization
+    J->resize(n, 6);
+    double* J_data = J->data();
+    for (int i = 0; i < n; ++i)
+    {
+        double x = src[3 * i], y = src[3 * i + 1], z = src[3 * i + 2];
+        double norm = sqrt(x * x + y * y + z * z);
+        double inv_denom = 1.0 / (z + xi * norm);
+        double mx = x * inv_denom, my = y * inv_denom;
+
+        double mx2 = mx * mx, my2 = my * my, mxy = mx * my;
+        double rho2 = mx2 + my2;
+        double rad_dist = k1 * rho2 + k2 * rho2 * rho2;
+        double drad = 2.0 * k1 + 4.0 * k2 * rho2;
+        double dxdmx = 1.0 + rad_dist + drad * mx2 + 2.0 * p1 * my + 6.0 * p2 * mx;
+        double dxdmy = drad * mxy + 2.0 * p1 * mx + 2.0 * p2 * my;
+        double dydmx = dxdmy;
+        double dydmy = 1.0 + rad_dist + drad * my2 + 6.0 * p1 * my + 2.0 * p2 * mx;
+        // d = z + xi * norm, dmx/dP = ((1, 0, 0) - mx * dd/dP) / d, dmy/dP = ((0, 1, 0) - my * dd/dP) / d
+        double xi_norm = xi / norm;
+        double ddx = xi_norm * x, ddy = xi_norm * y, ddz = 1.0 + xi_norm * z;
+        double dmxdx = (1.0 - mx * ddx) * inv_denom, dmxdy = -mx * ddy * inv_denom, dmxdz = -mx * ddz * inv_denom;
+        double dmydx = -my * ddx * inv_denom, dmydy = (1.0 - my * ddy) * inv_denom, dmydz = -my * ddz * inv_denom;
+        J_data[i] = gamma1 * (dxdmx * dmxdx + dxdmy * dmydx);
+        J_data[n + i] = gamma1 * (dxdmx * dmxdy + dxdmy * dmydy);
+        J_data[2 * n + i] = gamma1 * (dxdmx * dmxdz + dxdmy * dmydz);
+        J_data[3 * n + i] = gamma2 * (dydmx * dmxdx + dydmy * dmydx);
+        J_data[4 * n + i] = gamma2 * (dydmx * dmxdy + dydmy * dmydy);
+        J_data[5 * n + i] = gamma2 * (dydmx * dmxdz + dydmy * dmydz);
+    }
+}
+
 /** 
  * \brief Projects an undistorted 2D point p_u to the image plane
  *
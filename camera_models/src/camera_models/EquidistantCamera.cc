@@ -481,6 +481,70 @@ EquidistantCamera::spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p,
          mParameters.mv() * p_u(1) + mParameters.v0();
 }
 
+/**
+ * \brief Project the columns of P to the image plane, with the Jacobians
+ *        when J is not null
+ *
+ * theta = atan2(rho, z) and (cos(phi), sin(phi)) = (x, y) / rho replace the
+ * acos, atan2, cos and sin of spaceToPlane. The loops are branch free so that
+ * the compiler can vectorize them.
+ */
+void
+EquidistantCamera::spaceToPlaneBatch(const Eigen::Matrix3Xd& P, Eigen::Matrix2Xd& p,
+                                     BatchJacobian* J) const
+{
+    const int n = P.cols();
+    const double k2 = mParameters.k2(), k3 = mParameters.k3(), k4 = mParameters.k4(), k5 = mParameters.k5();
+    const double mu = mParameters.mu(), mv = mParameters.mv(), u0 = mParameters.u0(), v0 = mParameters.v0();
+    p.resize(2, n);
+    const double* src = P.data();
+    double* dst = p.data();
+
+    for (int i = 0; i < n; ++i)
+    {
+        double x = src[3 * i], y = src[3 * i + 1], z = src[3 * i + 2];
+        double rho = sqrt(x * x + y * y);
+        double theta = atan2(rho, z);
+        double theta2 = theta * theta;
+        double r = theta * (1.0 + theta2 * (k2 + theta2 * (k3 + theta2 * (k4 + theta2 * k5))));
+        // r(theta) / rho, 1 / z on the optical axis
+        double s = rho < 1e-12 ? 1.0 / z : r / rho;
+        dst[2 * i] = mu * s * x + u0;
+        dst[2 * i + 1] = mv * s * y + v0;
+    }
+    if (!J)
+    {
+        return;
+    }
+
+    // Separate loop, a branch in the projection loop would prevent its vectorization
+    J->resize(n, 6);
+    double* J_data = J->data();
+    for (int i = 0; i < n; ++i)
+    {
+        double x = src[3 * i], y = src[3 * i + 1], z = src[3 * i + 2];
+        double rho2 = x * x + y * y;
+        double rho = sqrt(rho2);
+        double theta = atan2(rho, z);
+        double theta2 = theta * theta;
+        double r = theta * (1.0 + theta2 * (k2 + theta2 * (k3 + theta2 * (k4 + theta2 * k5))));
+        double dr = 1.0 + theta2 * (3.0 * k2 + theta2 * (5.0 * k3 + theta2 * (7.0 * k4 + theta2 * 9.0 * k5)));
+        bool axis = rho < 1e-12;
+        double s = axis ? 1.0 / z : r / rho;
+        // ds/dx = x * a, ds/dy = y * a, ds/dz = dr * dtheta/dz / rho
+        double inv_norm2 = 1.0 / (rho2 + z * z);
+        double rho2_safe = axis ? 1.0 : rho2;
+        double a = axis ? 0.0 : (dr * z * inv_norm2 - s) / rho2_safe;
+        double dsdz = -dr * inv_norm2;
+        J_data[i] = mu * (s + x * x * a);
+        J_data[n + i] = mu * x * y * a;
+        J_data[2 * n + i] = mu * x * dsdz;
+        J_data[3 * n + i] = mv * x * y * a;
+        J_data[4 * n + i] = mv * (s + y * y * a);
+        J_data[5 * n + i] = mv * y * dsdz;
+    }
+}
+
 /** 
  * \brief Projects an undistorted 2D point p_u to the image plane
  *
@@ -608,6 +608,72 @@ PinholeCamera::spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p,
 }
 #endif
 
+/**
+ * \brief Project the columns of P to the image plane, with the Jacobians
+ *        when J is not null
+ *
+ * The distortion is applied inline, branch free, so that the compiler can
+ * vectorize the loops.
+ */
+void
+PinholeCamera::spaceToPlaneBatch(const Eigen::Matrix3Xd& P, Eigen::Matrix2Xd& p,
+                                 BatchJacobian* J) const
+{
+    const int n = P.cols();
+    // Zero coefficients when m_noDistortion
+    const double k1 = mParameters.k1(), k2 = mParameters.k2(), p1 = mParameters.p1(), p2 = mParameters.p2();
+    const double fx = mParameters.fx(), fy = mParameters.fy(), cx = mParameters.cx(), cy = mParameters.cy();
+    p.resize(2, n);
+    const double* src = P.data();
+    double* dst = p.data();
+
+    for (int i = 0; i < n; ++i)
+    {
+        double x = src[3 * i], y = src[3 * i + 1], z = src[3 * i + 2];
+        // Project points to the normalised plane
+        double inv_z = 1.0 / z;
+        double mx = x * inv_z, my = y * inv_z;
+
+        double mx2 = mx * mx, my2 = my * my, mxy = mx * my;
+        double rho2 = mx2 + my2;
+        double rad_dist = k1 * rho2 + k2 * rho2 * rho2;
+        double dx = mx + mx * rad_dist + 2.0 * p1 * mxy + p2 * (rho2 + 2.0 * mx2);
+        double dy = my + my * rad_dist + 2.0 * p2 * mxy + p1 * (rho2 + 2.0 * my2);
+        dst[2 * i] = fx * dx + cx;
+        dst[2 * i + 1] = fy * dy + cy;
+    }
+    if (!J)
+    {
+        return;
+    }
+
+    // Separate loop, a branch in the projection loop would prevent its vectorization
+    J->resize(n, 6);
+    double* J_data = J->data();
+    for (int i = 0; i < n; ++i)
+    {
+        double x = src[3 * i], y = src[3 * i + 1], z = src[3 * i + 2];
+        double inv_z = 1.0 / z;
+        double mx = x * inv_z, my = y * inv_z;
+
+        double mx2 = mx * mx, my2 = my * my, mxy = mx * my;
+        double rho2 = mx2 + my2;
+        double rad_dist = k1 * rho2 + k2 * rho2 * rho2;
+        double drad = 2.0 * k1 + 4.0 * k2 * rho2;
+        double dxdmx = 1.0 + rad_dist + drad * mx2 + 2.0 * p1 * my + 6.0 * p2 * mx;
+        double dxdmy = drad * mxy + 2.0 * p1 * mx + 2.0 * p2 * my;
+        double dydmx = dxdmy;
+        double dydmy = 1.0 + rad_dist + drad * my2 + 6.0 * p1 * my + 2.0 * p2 * mx;
+        // dmx/dP = (1, 0, -mx) / z, dmy/dP = (0, 1, -my) / z
+        J_data[i] = fx * dxdmx * inv_z;
+        J_data[n + i] = fx * dxdmy * inv_z;
+        J_data[2 * n + i] = -fx * (dxdmx * mx + dxdmy * my) * inv_z;
+        J_data[3 * n + i] = fy * dydmx * inv_z;
+        J_data[4 * n + i] = fy * dydmy * inv_z;
+        J_data[5 * n + i] = -fy * (dydmx * mx + dydmy * my) * inv_z;
+    }
+}
+
 /**
  * \brief Projects an undistorted 2D point p_u to the image plane
  *
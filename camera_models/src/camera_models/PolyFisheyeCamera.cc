@@ -167,7 +167,7 @@ PolyFisheyeCamera::spaceToPlane( const Eigen::Vector3d& P, Eigen::Vector2d& p )
 
         // Apply generalised projection matrix
         p( 0 ) = mParameters.A11( ) * theta * cos_phi /*p_u( 0 )*/ + mParameters.u0( );
-        p( 1 ) = mParameters.A22( ) * theta * cos_phi /*p_u( 1 )*/ + mParameters.v0( );
+        p( 1 ) = mParameters.A22( ) * theta * sin_phi /*p_u( 1 )*/ + mParameters.v0( );
     }
 }
 
@@ -179,6 +179,89 @@ PolyFisheyeCamera::spaceToPlane( const Eigen::Vector3d& P, Eigen::Vector2d& p, f
     p = p_tmp * image_scalse; // p is with resize
 }
 
+/**
+ * \brief Project the columns of P to the image plane, with the Jacobians
+ *        when J is not null
+ *
+ * theta = atan2(rho, z) and (cos(phi), sin(phi)) = (x, y) / rho replace the
+ * acos of spaceToPlane. In fast mode r(theta) is the table lookup of
+ * spaceToPlane, which does not vectorize; the Jacobians are those of the
+ * polynomial the table approximates.
+ */
+void
+PolyFisheyeCamera::spaceToPlaneBatch( const Eigen::Matrix3Xd& P, Eigen::Matrix2Xd& p, BatchJacobian* J ) const
+{
+    const int n = P.cols( );
+    // Without distortion r(theta) = theta
+    const bool distortion = mParameters.isDistortion( );
+    const double k2 = distortion ? mParameters.k2( ) : 0.0, k3 = distortion ? mParameters.k3( ) : 0.0,
+                 k4 = distortion ? mParameters.k4( ) : 0.0, k5 = distortion ? mParameters.k5( ) : 0.0,
+                 k6 = distortion ? mParameters.k6( ) : 0.0, k7 = distortion ? mParameters.k7( ) : 0.0;
+    const double A11 = mParameters.A11( ), A12 = distortion ? mParameters.A12( ) : 0.0, A22 = mParameters.A22( );
+    const double u0 = mParameters.u0( ), v0 = mParameters.v0( );
+    p.resize( 2, n );
+    const double* src = P.data( );
+    double* dst       = p.data( );
+
+    if ( distortion && mParameters.isFast( ) == 1 )
+    {
+        for ( int i = 0; i < n; ++i )
+        {
+            double x = src[3 * i], y = src[3 * i + 1], z = src[3 * i + 2];
+            double rho   = sqrt( x * x + y * y );
+            double theta = atan2( rho, z );
+            double s     = rho < 1e-12 ? 1.0 / z : fastCalc->r( theta ) / rho;
+            dst[2 * i]     = A11 * s * x + A12 * s * y + u0;
+            dst[2 * i + 1] = A22 * s * y + v0;
+        }
+    }
+    else
+    {
+        for ( int i = 0; i < n; ++i )
+        {
+            double x = src[3 * i], y = src[3 * i + 1], z = src[3 * i + 2];
+            double rho   = sqrt( x * x + y * y );
+            double theta = atan2( rho, z );
+            double r = theta * ( 1.0 + theta * ( k2 + theta * ( k3 + theta * ( k4 + theta * ( k5 + theta * ( k6 + theta * k7 ) ) ) ) ) );
+            // r(theta) / rho, 1 / z on the optical axis
+            double s = rho < 1e-12 ? 1.0 / z : r / rho;
+            dst[2 * i]     = A11 * s * x + A12 * s * y + u0;
+            dst[2 * i + 1] = A22 * s * y + v0;
+        }
+    }
+    if ( !J )
+        return;
+
+    // Separate loop, a branch in the projection loop would prevent its vectorization
+    J->resize( n, 6 );
+    double* J_data = J->data( );
+    for ( int i = 0; i < n; ++i )
+    {
+        double x = src[3 * i], y = src[3 * i + 1], z = src[3 * i + 2];
+        double rho2  = x * x + y * y;
+        double rho   = sqrt( rho2 );
+        double theta = atan2( rho, z );
+        double r = theta * ( 1.0 + theta * ( k2 + theta * ( k3 + theta * ( k4 + theta * ( k5 + theta * ( k6 + theta * k7 ) ) ) ) ) );
+        double dr = 1.0 + theta * ( 2.0 * k2 + theta * ( 3.0 * k3 + theta * ( 4.0 * k4
+                  + theta * ( 5.0 * k5 + theta * ( 6.0 * k6 + theta * 7.0 * k7 ) ) ) ) );
+        bool axis = rho < 1e-12;
+        double s  = axis ? 1.0 / z : r / rho;
+        // ds/dx = x * a, ds/dy = y * a, ds/dz = dr * dtheta/dz / rho
+        double inv_norm2 = 1.0 / ( rho2 + z * z );
+        double rho2_safe = axis ? 1.0 : rho2;
+        double a         = axis ? 0.0 : ( dr * z * inv_norm2 - s ) / rho2_safe;
+        double dsdz      = -dr * inv_norm2;
+        double dpuxdx = s + x * x * a, dpuxdy = x * y * a, dpuxdz = x * dsdz;
+        double dpuydx = dpuxdy, dpuydy = s + y * y * a, dpuydz = y * dsdz;
+        J_data[i]         = A11 * dpuxdx + A12 * dpuydx;
+        J_data[n + i]     = A11 * dpuxdy + A12 * dpuydy;
+        J_data[2 * n + i] = A11 * dpuxdz + A12 * dpuydz;
+        J_data[3 * n + i] = A22 * dpuydx;
+        J_data[4 * n + i] = A22 * dpuydy;
+        J_data[5 * n + i] = A22 * dpuydz;
+    }
+}
+
 /**
  * \brief Project a 3D point to the image plane and calculate Jacobian
  *
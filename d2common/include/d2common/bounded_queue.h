@@ -0,0 +1,101 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace D2Common {
+enum class QueueFullPolicy {
+    DropOldest, //Discard the oldest item, for stages where only the latest data matters
+    Block //The producer waits for space, nothing is lost
+};
+
+//FIFO of bounded capacity connecting two pipeline stages
+template <typename T>
+class BoundedQueue {
+    std::deque<T> items;
+    mutable std::mutex lock;
+    std::condition_variable not_empty, not_full;
+    size_t capacity;
+    QueueFullPolicy policy;
+    bool closed = false;
+    size_t dropped = 0;
+    size_t pushed = 0;
+public:
+    BoundedQueue(size_t _capacity, QueueFullPolicy _policy):
+        capacity(std::max<size_t>(_capacity, 1)), policy(_policy) {}
+
+    //Returns false if the queue is closed
+    bool push(T item) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (policy == QueueFullPolicy::Block) {
+            not_full.wait(guard, [&] { return closed || items.size() < capacity; });
+        }
+        if (closed) {
+            return false;
+        }
+        while (items.size() >= capacity) {
+            items.pop_front();
+            dropped++;
+        }
+        items.emplace_back(std::move(item));
+        pushed++;
+        guard.unlock();
+        not_empty.notify_one();
+        return true;
+    }
+
+    //Waits for an item. Returns false once the queue is closed and empty
+    bool pop(T & item) {
+        std::unique_lock<std::mutex> guard(lock);
+        not_empty.wait(guard, [&] { return closed || !items.empty(); });
+        return popLocked(guard, item);
+    }
+
+    //Same as pop but gives up after timeout
+    template <typename Rep, typename Period>
+    bool popFor(T & item, const std::chrono::duration<Rep, Period> & timeout) {
+        std::unique_lock<std::mutex> guard(lock);
+        not_empty.wait_for(guard, timeout, [&] { return closed || !items.empty(); });
+        return popLocked(guard, item);
+    }
+
+    //Wakes up all the waiting producers and consumers; the remaining items can still be popped
+    void close() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closed = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return items.size();
+    }
+
+    size_t droppedCount() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return dropped;
+    }
+
+    size_t pushedCount() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return pushed;
+    }
+
+private:
+    bool popLocked(std::unique_lock<std::mutex> & guard, T & item) {
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        guard.unlock();
+        not_full.notify_one();
+        return true;
+    }
+};
+}
@@ -6,10 +6,22 @@
 #include "d2imu.h"
 
 namespace D2Common {
-inline FrameIdType generateKeyframeId(ros::Time stamp, int self_id) {
+inline int & keyframeCount() {
     static int keyframe_count = 0;
+    return keyframe_count;
+}
+
+inline FrameIdType generateKeyframeId(ros::Time stamp, int self_id) {
     int t_ms = 0;//stamp.toSec()*1000;
-    return (t_ms%100000)*10000 + self_id*1000000 + keyframe_count++;
+    return (t_ms%100000)*10000 + self_id*1000000 + keyframeCount()++;
+}
+
+//Keyframe ids restored from a previous run are not generated again
+inline void reserveKeyframeId(FrameIdType frame_id, int self_id) {
+    int count = frame_id - self_id*1000000;
+    if (count >= keyframeCount()) {
+        keyframeCount() = count + 1;
+    }
 }
 
 inline CamIdType generateCameraId(int self_id, int index) {
@@ -98,6 +110,19 @@ struct VisualImageDesc {
     int image_height = 0;
     double cur_td = 0;
 
+    //Bytes held by the buffers of this image
+    size_t memorySize() const {
+        size_t size = sizeof(LandmarkPerFrame)*landmarks.size() + sizeof(float)*(image_desc.size() +
+            landmark_descriptor.size() + landmark_scores.size()) + image.size();
+        if (!raw_image.empty()) {
+            size += raw_image.total()*raw_image.elemSize();
+        }
+        if (!raw_depth_image.empty()) {
+            size += raw_depth_image.total()*raw_depth_image.elemSize();
+        }
+        return size;
+    }
+
     void printSize() {
         printf("Dir %d Landmarks: %d:", camera_index, landmarks.size());
         int size = 0;
@@ -363,6 +388,14 @@ struct VisualImageDescArray {
         }
     }
 
+    size_t memorySize() const {
+        size_t size = sizeof(VisualImageDescArray);
+        for (auto & image : images) {
+            size += sizeof(VisualImageDesc) + image.memorySize();
+        }
+        return size;
+    }
+
     void printSize() {
         printf("Frame id %ld landmark num %d image num %ld:\n", frame_id, landmarkNum(), images.size());
         for (auto & image : images) {
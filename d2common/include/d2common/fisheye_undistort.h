@@ -5,6 +5,7 @@
 #include <camodocal/camera_models/PinholeCamera.h>
 
 #include <d2common/utils.hpp>
+#include <d2common/remap_fused.h>
 #include <opencv2/core/cuda.hpp>
 #include <opencv2/cudawarping.hpp>
 
@@ -16,6 +17,9 @@
 #include "sensor_msgs/Image.h"
 #include <opencv2/cudaarithm.hpp>
 #include <opencv2/cudaimgproc.hpp>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace D2Common {
 
@@ -53,6 +57,7 @@ class FisheyeUndist {
     Eigen::Vector3d cameraRotation;
     bool enable_cuda = false;
     int cam_id = 0;
+    std::string map_cache_dir;  // Undistortion maps are cached here when not empty
 
     double raw_width;
     double raw_height;
@@ -66,12 +71,14 @@ class FisheyeUndist {
     std::vector<cv::cuda::GpuMat> photometics_gpu_bgr;
 
     FisheyeUndist(const std::string &camera_config_file, int _id, double _fov,
-                  bool _enable_cuda = true, int imgWidth = 600)
+                  bool _enable_cuda = true, int imgWidth = 600,
+                  const std::string &_map_cache_dir = "")
         : imgWidth(imgWidth),
           fov(_fov),
           cameraRotation(0, 0, 0),
           enable_cuda(_enable_cuda),
-          cam_id(_id) {
+          cam_id(_id),
+          map_cache_dir(_map_cache_dir) {
         cam = camodocal::CameraFactory::instance()->generateCameraFromYamlFile(
             camera_config_file);
         raw_width = cam->imageWidth();
@@ -89,17 +96,20 @@ class FisheyeUndist {
                 undistMapsGPUY.push_back(cv::cuda::GpuMat(maps[1]));
             }
         }
+        convertMapsToFixedPoint();
     }
 
     FisheyeUndist(camodocal::CameraPtr cam, int _id, double _fov,
                   bool _enable_cuda = true,
                   UndistortType mode = UndistortPinhole5, int imgWidth = 600,
-                  int imgHeight = 200, cv::Mat photomertic=cv::Mat())
+                  int imgHeight = 200, cv::Mat photomertic=cv::Mat(),
+                  const std::string &_map_cache_dir = "")
         : imgWidth(imgWidth),
           fov(_fov),
           cameraRotation(0, 0, 0),
           enable_cuda(_enable_cuda),
-          cam_id(_id) {
+          cam_id(_id),
+          map_cache_dir(_map_cache_dir) {
         raw_width = cam->imageWidth();
         raw_height = cam->imageHeight();
         fisheye2cam_pt = cv::Mat::zeros(raw_width, raw_height, CV_32FC2);
@@ -124,6 +134,7 @@ class FisheyeUndist {
                 undistMapsGPUY.push_back(cv::cuda::GpuMat(maps[1]));
             }
         }
+        convertMapsToFixedPoint();
         if (!photomertic.empty()) {
             auto _photometics = undist_all(photomertic, true);
             auto _photometics_gpu = undist_all_cuda(photomertic, true);
@@ -258,37 +269,16 @@ class FisheyeUndist {
         bool disable[5] = {0};
         disable[0] = !enable_top;
         disable[5] = !enable_rear;
-        if (use_rgb) {
-#pragma omp parallel for num_threads(5)
-            for (unsigned int i = 0; i < undistMaps.size(); i++) {
-                if (!disable[i]) {
-                    cv::remap(image, ret[i], undistMaps[i].first,
-                              undistMaps[i].second, REMAP_FUNC);
-                    if (photometics.size() > 0) {
-                        cv::multiply(ret[i], photometics[i], ret[i]);
-                    }
-                }
-            }
-            return ret;
-        } else {
-            cv::Mat gray;
-            if (image.channels() == 3)
-                cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
-            else
-                gray = image;
-#pragma omp parallel for num_threads(5)
-            for (unsigned int i = 0; i < undistMaps.size(); i++) {
-                if (!disable[i]) {
-                    cv::remap(gray, ret[i], undistMaps[i].first,
-                              undistMaps[i].second, REMAP_FUNC);
-                    if (photometics.size() > 0) {
-                        cv::multiply(ret[i], photometics[i], ret[i]);
-                    }
+        // Gray conversion, remap and photometric gain in one pass, parallel over row tiles of each view
+        for (unsigned int i = 0; i < undistMaps.size(); i++) {
+            if (!disable[i]) {
+                cv::Mat gain;
+                if (photometics.size() > 0) {
+                    gain = use_rgb && image.channels() == 3 ? photometics_bgr[i] : photometics[i];
                 }
+                remapFused(image, ret[i], undistMaps[i].first, undistMaps[i].second, gain, !use_rgb);
             }
-            return ret;
         }
-
         return ret;
     }
 
@@ -562,54 +552,49 @@ class FisheyeUndist {
                                                 Eigen::Quaterniond rotation,
                                                 const unsigned &imgWidth,
                                                 const unsigned &imgHeight) {
-        cv::Mat map = cv::Mat(imgHeight, imgWidth, CV_32FC2);
-        ROS_DEBUG("Generating map of size (%d,%d)", map.size[0], map.size[1]);
-        ROS_DEBUG("Perspective facing (%.2f,%.2f,%.2f)",
-                  (rotation * Eigen::Vector3d(0, 0, 1))[0],
-                  (rotation * Eigen::Vector3d(0, 0, 1))[1],
-                  (rotation * Eigen::Vector3d(0, 0, 1))[2]);
-        for (unsigned int x = 0; x < imgWidth; x++)
-            for (unsigned int y = 0; y < imgHeight; y++) {
-                Eigen::Vector3d objPoint;
-                p_vcam->liftProjective(Eigen::Vector2d(x, y), objPoint);
-                Eigen::Vector2d imgPoint;
-                p_cam->spaceToPlane(objPoint, imgPoint);
-
-                map.at<cv::Vec2f>(cv::Point(x, y)) =
-                    cv::Vec2f(imgPoint.x(), imgPoint.y());
-                if (!isnan(imgPoint.x()) && !isnan(imgPoint.y()) &&
-                    imgPoint.x() >= 0 && imgPoint.x() <= raw_width &&
-                    imgPoint.y() >= 0 && imgPoint.y() <= raw_height) {
-                    auto &pt = fisheye2cam_pt.at<cv::Vec2f>(
-                        cv::Point(imgPoint.x(), imgPoint.y()));
-                    fisheye2cam_id.at<uint8_t>(
-                        cv::Point(imgPoint.x(), imgPoint.y())) = _id;
-                    pt[0] = x;
-                    pt[1] = y;
+        int kind = 1;
+        unsigned size[2] = {imgWidth, imgHeight};
+        uint64_t key = hashBytes(&kind, sizeof(kind));
+        key = hashCamera(p_cam, key);
+        key = hashCamera(p_vcam, key);
+        key = hashBytes(rotation.coeffs().data(), 4 * sizeof(double), key);
+        key = hashBytes(size, sizeof(size), key);
+        key = hashBytes(&fov, sizeof(fov), key);
+        cv::Mat map;
+        bool cached = loadMapCache(key, imgWidth, imgHeight, map);
+        if (!cached) {
+            map = cv::Mat(imgHeight, imgWidth, CV_32FC2);
+            ROS_DEBUG("Generating map of size (%d,%d)", map.size[0], map.size[1]);
+            ROS_DEBUG("Perspective facing (%.2f,%.2f,%.2f)",
+                      (rotation * Eigen::Vector3d(0, 0, 1))[0],
+                      (rotation * Eigen::Vector3d(0, 0, 1))[1],
+                      (rotation * Eigen::Vector3d(0, 0, 1))[2]);
+#pragma omp parallel for schedule(dynamic)
+            for (int y = 0; y < (int)imgHeight; y++) {
+                auto *row = map.ptr<cv::Vec2f>(y);
+                // One row is projected in a batch
+                Eigen::Matrix3Xd objPoints(3, imgWidth);
+                for (unsigned int x = 0; x < imgWidth; x++) {
+                    Eigen::Vector3d objPoint;
+                    p_vcam->liftProjective(Eigen::Vector2d(x, y), objPoint);
+                    objPoints.col(x) = objPoint;
+                }
+                Eigen::Matrix2Xd imgPoints;
+                p_cam->spaceToPlaneBatch(objPoints, imgPoints);
+                for (unsigned int x = 0; x < imgWidth; x++) {
+                    row[x] = cv::Vec2f(imgPoints(0, x), imgPoints(1, x));
                 }
             }
+            saveMapCache(key, map);
+        }
+        fillFisheye2Cam(_id, map);
 
         ROS_DEBUG("Upper corners: (%.2f, %.2f), (%.2f, %.2f)",
                   map.at<cv::Vec2f>(cv::Point(0, 0))[0],
                   map.at<cv::Vec2f>(cv::Point(0, 0))[1],
                   map.at<cv::Vec2f>(cv::Point(imgWidth - 1, 0))[0],
                   map.at<cv::Vec2f>(cv::Point(imgWidth - 1, 0))[1]);
-
-        Eigen::Vector3d objPoint =
-            rotation * Eigen::Vector3d(((double)0 - (double)imgWidth / 2),
-                                       ((double)0 - (double)imgHeight / 2),
-                                       f_center);
-        // std::cout << objPoint << std::endl;
-
-        objPoint =
-            rotation * Eigen::Vector3d(((double)imgWidth / 2),
-                                       ((double)0 - (double)imgHeight / 2),
-                                       f_center);
-        // std::cout << objPoint << std::endl;
-        cv::Mat map1, map2;
-        cv::convertMaps(map, cv::Mat(), map1, map2, CV_16SC2);
         return std::make_pair(map, cv::Mat());
-        // return std::make_pair(map1, map2);
     }
 
     std::pair<cv::Mat, cv::Mat> genOneUndistMap(int _id,
@@ -618,57 +603,161 @@ class FisheyeUndist {
                                                 const unsigned &imgWidth,
                                                 const unsigned &imgHeight,
                                                 const double &f_center) {
-        cv::Mat map = cv::Mat(imgHeight, imgWidth, CV_32FC2);
-        ROS_DEBUG("Generating map of size (%d,%d)", map.size[0], map.size[1]);
-        ROS_DEBUG("Perspective facing (%.2f,%.2f,%.2f)",
-                  (rotation * Eigen::Vector3d(0, 0, 1))[0],
-                  (rotation * Eigen::Vector3d(0, 0, 1))[1],
-                  (rotation * Eigen::Vector3d(0, 0, 1))[2]);
-        for (unsigned int x = 0; x < imgWidth; x++)
-            for (unsigned int y = 0; y < imgHeight; y++) {
-                Eigen::Vector3d objPoint =
-                    rotation *
-                    Eigen::Vector3d(((double)x - (double)imgWidth / 2),
-                                    ((double)y - (double)imgHeight / 2),
-                                    f_center);
-                Eigen::Vector2d imgPoint;
-                p_cam->spaceToPlane(objPoint, imgPoint);
-
-                map.at<cv::Vec2f>(cv::Point(x, y)) =
-                    cv::Vec2f(imgPoint.x(), imgPoint.y());
-                if (!isnan(imgPoint.x()) && !isnan(imgPoint.y()) &&
-                    imgPoint.x() >= 0 && imgPoint.x() <= raw_width &&
-                    imgPoint.y() >= 0 && imgPoint.y() <= raw_height) {
-                    auto &pt = fisheye2cam_pt.at<cv::Vec2f>(
-                        cv::Point(imgPoint.x(), imgPoint.y()));
-                    fisheye2cam_id.at<uint8_t>(
-                        cv::Point(imgPoint.x(), imgPoint.y())) = _id;
-                    pt[0] = x;
-                    pt[1] = y;
+        int kind = 0;
+        unsigned size[2] = {imgWidth, imgHeight};
+        uint64_t key = hashBytes(&kind, sizeof(kind));
+        key = hashCamera(p_cam, key);
+        key = hashBytes(rotation.coeffs().data(), 4 * sizeof(double), key);
+        key = hashBytes(size, sizeof(size), key);
+        key = hashBytes(&f_center, sizeof(f_center), key);
+        key = hashBytes(&fov, sizeof(fov), key);
+        cv::Mat map;
+        bool cached = loadMapCache(key, imgWidth, imgHeight, map);
+        if (!cached) {
+            map = cv::Mat(imgHeight, imgWidth, CV_32FC2);
+            ROS_DEBUG("Generating map of size (%d,%d)", map.size[0], map.size[1]);
+            ROS_DEBUG("Perspective facing (%.2f,%.2f,%.2f)",
+                      (rotation * Eigen::Vector3d(0, 0, 1))[0],
+                      (rotation * Eigen::Vector3d(0, 0, 1))[1],
+                      (rotation * Eigen::Vector3d(0, 0, 1))[2]);
+#pragma omp parallel for schedule(dynamic)
+            for (int y = 0; y < (int)imgHeight; y++) {
+                auto *row = map.ptr<cv::Vec2f>(y);
+                // One row is projected in a batch
+                Eigen::Matrix3Xd objPoints(3, imgWidth);
+                for (unsigned int x = 0; x < imgWidth; x++) {
+                    objPoints.col(x) =
+                        rotation *
+                        Eigen::Vector3d(((double)x - (double)imgWidth / 2),
+                                        ((double)y - (double)imgHeight / 2),
+                                        f_center);
+                }
+                Eigen::Matrix2Xd imgPoints;
+                p_cam->spaceToPlaneBatch(objPoints, imgPoints);
+                for (unsigned int x = 0; x < imgWidth; x++) {
+                    row[x] = cv::Vec2f(imgPoints(0, x), imgPoints(1, x));
                 }
             }
+            saveMapCache(key, map);
+        }
+        fillFisheye2Cam(_id, map);
 
         ROS_DEBUG("Upper corners: (%.2f, %.2f), (%.2f, %.2f)",
                   map.at<cv::Vec2f>(cv::Point(0, 0))[0],
                   map.at<cv::Vec2f>(cv::Point(0, 0))[1],
                   map.at<cv::Vec2f>(cv::Point(imgWidth - 1, 0))[0],
                   map.at<cv::Vec2f>(cv::Point(imgWidth - 1, 0))[1]);
-
-        Eigen::Vector3d objPoint =
-            rotation * Eigen::Vector3d(((double)0 - (double)imgWidth / 2),
-                                       ((double)0 - (double)imgHeight / 2),
-                                       f_center);
-        // std::cout << objPoint << std::endl;
-
-        objPoint =
-            rotation * Eigen::Vector3d(((double)imgWidth / 2),
-                                       ((double)0 - (double)imgHeight / 2),
-                                       f_center);
-        // std::cout << objPoint << std::endl;
-        cv::Mat map1, map2;
-        cv::convertMaps(map, cv::Mat(), map1, map2, CV_16SC2);
         return std::make_pair(map, cv::Mat());
-        // return std::make_pair(map1, map2);
+    }
+
+    // cv::remap converts float maps to fixed point on every call, so keep the
+    // CV_16SC2 + CV_16UC1 maps for the CPU path. Output of INTER_LINEAR is identical.
+    void convertMapsToFixedPoint() {
+        for (auto &maps : undistMaps) {
+            if (maps.first.type() == CV_32FC2) {
+                cv::Mat map1, map2;
+                cv::convertMaps(maps.first, cv::Mat(), map1, map2, CV_16SC2);
+                maps = std::make_pair(map1, map2);
+            }
+        }
+    }
+
+   protected:
+    // The inverse mapping is written serially in the original column major order,
+    // later pixels overwrite earlier ones.
+    void fillFisheye2Cam(int _id, const cv::Mat &map) {
+        for (int x = 0; x < map.cols; x++)
+            for (int y = 0; y < map.rows; y++) {
+                auto &imgPoint = map.at<cv::Vec2f>(y, x);
+                if (!isnan(imgPoint[0]) && !isnan(imgPoint[1]) &&
+                    imgPoint[0] >= 0 && imgPoint[0] <= raw_width &&
+                    imgPoint[1] >= 0 && imgPoint[1] <= raw_height) {
+                    auto &pt = fisheye2cam_pt.at<cv::Vec2f>(
+                        cv::Point(imgPoint[0], imgPoint[1]));
+                    fisheye2cam_id.at<uint8_t>(
+                        cv::Point(imgPoint[0], imgPoint[1])) = _id;
+                    pt[0] = x;
+                    pt[1] = y;
+                }
+            }
+    }
+
+    // FNV-1a
+    static uint64_t hashBytes(const void *data, size_t size,
+                              uint64_t hash = 14695981039346656037ULL) {
+        auto bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Salt of the map cache keys. Bump it when the generated maps or the file
+    // layout change, so maps cached by an older build are not reused.
+    // 2: batched spaceToPlane projection
+    static const int MAP_CACHE_VERSION = 2;
+
+    static uint64_t hashCamera(camodocal::CameraPtr p_cam, uint64_t hash) {
+        std::vector<double> params;
+        p_cam->writeParameters(params);
+        int header[4] = {MAP_CACHE_VERSION, (int)p_cam->modelType(),
+                         p_cam->imageWidth(), p_cam->imageHeight()};
+        hash = hashBytes(header, sizeof(header), hash);
+        return hashBytes(params.data(), params.size() * sizeof(double), hash);
+    }
+
+    std::string mapCachePath(uint64_t key) const {
+        char name[64];
+        snprintf(name, sizeof(name), "/undist_map_%016lx.bin", (unsigned long)key);
+        return map_cache_dir + name;
+    }
+
+    bool loadMapCache(uint64_t key, int width, int height, cv::Mat &map) const {
+        if (map_cache_dir.empty()) {
+            return false;
+        }
+        std::ifstream file(mapCachePath(key), std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        uint64_t file_key = 0;
+        int header[3] = {0};
+        file.read((char *)&file_key, sizeof(file_key));
+        file.read((char *)header, sizeof(header));
+        if (!file || file_key != key || header[0] != height ||
+            header[1] != width || header[2] != CV_32FC2) {
+            printf("[FisheyeUndist] Ignore invalid map cache %s\n", mapCachePath(key).c_str());
+            return false;
+        }
+        map = cv::Mat(height, width, CV_32FC2);
+        file.read((char *)map.data, map.total() * map.elemSize());
+        if (!file) {
+            printf("[FisheyeUndist] Ignore truncated map cache %s\n", mapCachePath(key).c_str());
+            map = cv::Mat();
+            return false;
+        }
+        return true;
+    }
+
+    void saveMapCache(uint64_t key, const cv::Mat &map) const {
+        if (map_cache_dir.empty()) {
+            return;
+        }
+        mkdir(map_cache_dir.c_str(), 0755);
+        //Write to a temporary file first so a concurrent start never reads a partial map
+        auto path = mapCachePath(key);
+        auto tmp_path = path + ".tmp" + std::to_string(getpid());
+        std::ofstream file(tmp_path, std::ios::binary);
+        int header[3] = {map.rows, map.cols, map.type()};
+        file.write((const char *)&key, sizeof(key));
+        file.write((const char *)header, sizeof(header));
+        file.write((const char *)map.data, map.total() * map.elemSize());
+        file.close();
+        if (!file || rename(tmp_path.c_str(), path.c_str()) != 0) {
+            printf("[FisheyeUndist] Failed to write map cache %s\n", path.c_str());
+            remove(tmp_path.c_str());
+        }
     }
 };
 }  // namespace D2Common
\ No newline at end of file
@@ -0,0 +1,16 @@
+#pragma once
+#include <opencv2/core/core.hpp>
+
+namespace D2Common {
+// Single pass version of
+//   cvtColor(src, gray, COLOR_BGR2GRAY) (when to_gray and src is 3 channels)
+//   remap(gray, dst, map1, map2, INTER_LINEAR, BORDER_CONSTANT)
+//   dst = dst * gain (rounded and saturated back to 8 bits)
+// for 8 bit images and the fixed point maps of cv::convertMaps (CV_16SC2 + CV_16UC1).
+// gain is empty or CV_32F of the output size, either one channel applied to all or one per output channel.
+// Gray conversion is done per interpolation tap with the fixed point weights of cvtColor, so the
+// result matches the separate calls without the intermediate images. Rows are processed in parallel tiles.
+// Other types fall back to the separate OpenCV calls.
+void remapFused(const cv::Mat & src, cv::Mat & dst, const cv::Mat & map1, const cv::Mat & map2,
+    const cv::Mat & gain = cv::Mat(), bool to_gray = false);
+}
@@ -0,0 +1,195 @@
+#include <d2common/remap_fused.h>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/core/version.hpp>
+#include <vector>
+
+#ifndef CV_SIMD_SCALABLE
+#define CV_SIMD_SCALABLE 0
+#endif
+
+namespace D2Common {
+// Fixed point layout of cv::remap: map2 holds the fractional offsets on a 32x32 grid, so the four
+// weights sum to 1 << 10
+static const int REMAP_FRAC_BITS = 5;
+static const int REMAP_FRAC_MASK = (1 << REMAP_FRAC_BITS) - 1;
+static const int REMAP_WEIGHT_BITS = 2 * REMAP_FRAC_BITS;
+static const int REMAP_TILE_ROWS = 16;
+
+// Same as cvtColor(COLOR_BGR2GRAY) for 8 bit images
+static inline int grayBGR(const uchar * p) {
+    return (p[0] * 1868 + p[1] * 9617 + p[2] * 4899 + (1 << 13)) >> 14;
+}
+
+// OpenCV 4.8 replaced nlanes and the operators of the universal intrinsics by VTraits and v_add, v_mul...
+// The sizeless vectors of scalable backends (CV_SIMD_SCALABLE) don't fit blendRow and use the scalar loop
+#if CV_SIMD && !CV_SIMD_SCALABLE
+#define REMAP_FUSED_SIMD 1
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 8)
+static inline int lanesS32() { return cv::VTraits<cv::v_int32>::vlanes(); }
+static inline cv::v_int32 addS32(const cv::v_int32 & a, const cv::v_int32 & b) { return cv::v_add(a, b); }
+static inline cv::v_int32 subS32(const cv::v_int32 & a, const cv::v_int32 & b) { return cv::v_sub(a, b); }
+static inline cv::v_int32 mulS32(const cv::v_int32 & a, const cv::v_int32 & b) { return cv::v_mul(a, b); }
+static inline cv::v_float32 mulF32(const cv::v_float32 & a, const cv::v_float32 & b) { return cv::v_mul(a, b); }
+#else
+static inline int lanesS32() { return cv::v_int32::nlanes; }
+static inline cv::v_int32 addS32(const cv::v_int32 & a, const cv::v_int32 & b) { return a + b; }
+static inline cv::v_int32 subS32(const cv::v_int32 & a, const cv::v_int32 & b) { return a - b; }
+static inline cv::v_int32 mulS32(const cv::v_int32 & a, const cv::v_int32 & b) { return a * b; }
+static inline cv::v_float32 mulF32(const cv::v_float32 & a, const cv::v_float32 & b) { return a * b; }
+#endif
+#endif
+
+struct RemapRowBuffer {
+    // Four taps and the fractional offsets of each output element
+    std::vector<int> p00, p01, p10, p11, fx, fy;
+    RemapRowBuffer(int n): p00(n), p01(n), p10(n), p11(n), fx(n), fy(n) {}
+};
+
+// Pixel (x, y) of src, zero outside the image like BORDER_CONSTANT
+static inline int tap(const cv::Mat & src, int x, int y, int c, bool gray) {
+    if ((unsigned) x >= (unsigned) src.cols || (unsigned) y >= (unsigned) src.rows) {
+        return 0;
+    }
+    const uchar * p = src.ptr<uchar>(y) + x * src.channels();
+    return gray ? grayBGR(p) : p[c];
+}
+
+static void gatherRow(const cv::Mat & src, const short * m1, const ushort * m2, int cols, int cn, bool gray,
+        RemapRowBuffer & buf) {
+    const int src_cn = src.channels();
+    const size_t step = src.step[0];
+    for (int x = 0; x < cols; x++) {
+        const int sx = m1[x * 2], sy = m1[x * 2 + 1];
+        const int fx = m2[x] & REMAP_FRAC_MASK, fy = (m2[x] >> REMAP_FRAC_BITS) & REMAP_FRAC_MASK;
+        const int k = x * cn;
+        if ((unsigned) sx < (unsigned) (src.cols - 1) && (unsigned) sy < (unsigned) (src.rows - 1)) {
+            const uchar * p0 = src.ptr<uchar>(sy) + sx * src_cn;
+            const uchar * p1 = p0 + step;
+            if (gray) {
+                buf.p00[k] = grayBGR(p0);
+                buf.p01[k] = grayBGR(p0 + 3);
+                buf.p10[k] = grayBGR(p1);
+                buf.p11[k] = grayBGR(p1 + 3);
+            } else {
+                for (int c = 0; c < cn; c++) {
+                    buf.p00[k + c] = p0[c];
+                    buf.p01[k + c] = p0[src_cn + c];
+                    buf.p10[k + c] = p1[c];
+                    buf.p11[k + c] = p1[src_cn + c];
+                }
+            }
+        } else {
+            for (int c = 0; c < cn; c++) {
+                buf.p00[k + c] = tap(src, sx, sy, c, gray);
+                buf.p01[k + c] = tap(src, sx + 1, sy, c, gray);
+                buf.p10[k + c] = tap(src, sx, sy + 1, c, gray);
+                buf.p11[k + c] = tap(src, sx + 1, sy + 1, c, gray);
+            }
+        }
+        for (int c = 0; c < cn; c++) {
+            buf.fx[k + c] = fx;
+            buf.fy[k + c] = fy;
+        }
+    }
+}
+
+static void blendRow(const RemapRowBuffer & buf, const float * gain, int n, uchar * dst) {
+    const int one = 1 << REMAP_FRAC_BITS;
+    const int half = 1 << (REMAP_WEIGHT_BITS - 1);
+    int k = 0;
+#ifdef REMAP_FUSED_SIMD
+    using namespace cv;
+    const int VL = lanesS32();
+    const v_int32 v_one = vx_setall_s32(one), v_half = vx_setall_s32(half);
+    for (; k <= n - 2 * VL; k += 2 * VL) {
+        v_int32 out[2];
+        for (int h = 0; h < 2; h++) {
+            const int j = k + h * VL;
+            v_int32 fx = vx_load(buf.fx.data() + j), fy = vx_load(buf.fy.data() + j);
+            v_int32 ifx = subS32(v_one, fx), ify = subS32(v_one, fy);
+            v_int32 s = addS32(addS32(mulS32(vx_load(buf.p00.data() + j), mulS32(ifx, ify)),
+                    mulS32(vx_load(buf.p01.data() + j), mulS32(fx, ify))),
+                addS32(mulS32(vx_load(buf.p10.data() + j), mulS32(ifx, fy)),
+                    mulS32(vx_load(buf.p11.data() + j), mulS32(fx, fy))));
+            s = v_shr<REMAP_WEIGHT_BITS>(addS32(s, v_half));
+            if (gain) {
+                s = v_round(mulF32(v_cvt_f32(s), vx_load(gain + j)));
+            }
+            out[h] = s;
+        }
+        v_pack_u_store(dst + k, v_pack(out[0], out[1]));
+    }
+    vx_cleanup();
+#endif
+    for (; k < n; k++) {
+        const int fx = buf.fx[k], fy = buf.fy[k];
+        int s = (buf.p00[k] * (one - fx) * (one - fy) + buf.p01[k] * fx * (one - fy) +
+            buf.p10[k] * (one - fx) * fy + buf.p11[k] * fx * fy + half) >> REMAP_WEIGHT_BITS;
+        if (gain) {
+            s = cvRound((float) s * gain[k]);
+        }
+        dst[k] = cv::saturate_cast<uchar>(s);
+    }
+}
+
+static void remapSeparate(const cv::Mat & src, cv::Mat & dst, const cv::Mat & map1, const cv::Mat & map2,
+        const cv::Mat & gain, bool to_gray) {
+    cv::Mat input = src;
+    if (to_gray && src.channels() == 3) {
+        cv::cvtColor(src, input, cv::COLOR_BGR2GRAY);
+    }
+    cv::Mat output;
+    cv::remap(input, output, map1, map2, cv::INTER_LINEAR);
+    if (!gain.empty()) {
+        cv::Mat gains = gain;
+        if (gain.channels() != output.channels()) {
+            std::vector<cv::Mat> channels(output.channels(), gain);
+            cv::merge(channels, gains);
+        }
+        int type = output.type();
+        output.convertTo(output, CV_32F);
+        cv::multiply(output, gains, output, 1.0, CV_32FC(output.channels()));
+        output.convertTo(output, type);
+    }
+    dst = output;
+}
+
+void remapFused(const cv::Mat & src, cv::Mat & dst, const cv::Mat & map1, const cv::Mat & map2,
+        const cv::Mat & gain, bool to_gray) {
+    bool supported = src.depth() == CV_8U && (src.channels() == 1 || src.channels() == 3) &&
+        map1.type() == CV_16SC2 && map2.type() == CV_16UC1 && map2.size() == map1.size() &&
+        (gain.empty() || (gain.depth() == CV_32F && gain.size() == map1.size()));
+    const bool gray = to_gray && src.channels() == 3;
+    const int cn = gray ? 1 : src.channels();
+    supported = supported && (gain.empty() || gain.channels() == 1 || gain.channels() == cn);
+    if (!supported) {
+        remapSeparate(src, dst, map1, map2, gain, to_gray);
+        return;
+    }
+    const int rows = map1.rows, cols = map1.cols;
+    const int n = cols * cn;
+    // Replicated gains for multi channel outputs
+    cv::Mat gains = gain;
+    if (!gain.empty() && gain.channels() != cn) {
+        std::vector<cv::Mat> channels(cn, gain);
+        cv::merge(channels, gains);
+    }
+    // Not written in place, dst may share its data with src
+    cv::Mat output(rows, cols, CV_8UC(cn));
+    const int tiles = (rows + REMAP_TILE_ROWS - 1) / REMAP_TILE_ROWS;
+#pragma omp parallel
+    {
+        RemapRowBuffer buf(n);
+#pragma omp for schedule(dynamic)
+        for (int t = 0; t < tiles; t++) {
+            const int y1 = std::min(rows, (t + 1) * REMAP_TILE_ROWS);
+            for (int y = t * REMAP_TILE_ROWS; y < y1; y++) {
+                gatherRow(src, map1.ptr<short>(y), map2.ptr<ushort>(y), cols, cn, gray, buf);
+                blendRow(buf, gains.empty() ? nullptr : gains.ptr<float>(y), n, output.ptr<uchar>(y));
+            }
+        }
+    }
+    dst = output;
+}
+}
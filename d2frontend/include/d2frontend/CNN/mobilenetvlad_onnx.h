@@ -7,30 +7,18 @@ namespace D2FrontEnd {
 using D2Common::Utility::TicToc;
 class MobileNetVLADONNX: public ONNXInferenceGeneric {
 protected:
-    std::array<float, NETVLAD_DESC_RAW_SIZE> results_;
-    std::array<int64_t, 2> output_shape_;
-    std::array<int64_t, 4> input_shape_;
     Eigen::MatrixXf pca_comp_T;
     Eigen::VectorXf pca_mean;
 public:
     const int descriptor_size = 4096;
-    MobileNetVLADONNX(std::string engine_path, int _width, int _height, bool use_tensorrt = true, 
-                bool use_fp16 = true, bool use_int8 = false, std::string int8_calib_table_name = ""): 
-            ONNXInferenceGeneric(engine_path, "image:0", "descriptor:0", _width, _height, 
-                    use_tensorrt, use_fp16, use_int8, int8_calib_table_name),
-            output_shape_{1, NETVLAD_DESC_RAW_SIZE},
-            input_shape_{1, _height, _width, 1},
-            results_{0}
+    MobileNetVLADONNX(std::string engine_path, int _width, int _height, 
+                const ONNXInferenceConfig & onnx_config = ONNXInferenceConfig()): 
+            ONNXInferenceGeneric(engine_path, "image:0", {"descriptor:0"}, _width, _height, onnx_config)
     {
         std::cout << "Trying to init MobileNetVLADONNX@" << engine_path << 
-            " tensorrt " << use_tensorrt << " fp16 " << use_fp16 << " int8 " << use_int8 << 
+            " provider " << (int)onnx_config.provider << " fp16 " << onnx_config.enable_fp16 << " int8 " << onnx_config.enable_int8 << 
             " pca " << params->enable_pca_netvlad << std::endl;
-        input_image = new float[width*height];
-        auto memory_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
-        input_tensor_ = Ort::Value::CreateTensor<float>(memory_info,
-               input_image, width*height, input_shape_.data(), 4);
-        output_tensor_ = Ort::Value::CreateTensor<float>(memory_info,
-            results_.data(), results_.size(), output_shape_.data(), output_shape_.size());
+        bindTensors({1, _height, _width, 1}, {{1, NETVLAD_DESC_RAW_SIZE}});
         if (params->enable_pca_netvlad) {
             printf("[D2FrontEnd] Loading PCA for MobileNetVLADONNX: %s\n", params->pca_netvlad.c_str());
             auto pca = load_csv_mat_eigen(params->pca_netvlad);
@@ -45,8 +33,13 @@ public:
         }
     }
 
-    std::vector<float> inference(const cv::Mat & input) {
-        TicToc tic;
+    void bindBatch(int batch) {
+        if (bound_batch_ != batch) {
+            bindTensors({batch, height, width, 1}, {{batch, NETVLAD_DESC_RAW_SIZE}});
+        }
+    }
+
+    void preprocess(const cv::Mat & input, float * dst) const {
         cv::Mat _input;
         if (input.channels() == 3) {
             cv::cvtColor(input, _input, cv::COLOR_BGR2GRAY);
@@ -56,20 +49,56 @@ public:
         if (_input.rows != height || _input.cols != width) {
             cv::resize(_input, _input, cv::Size(width, height));
         } 
-        _input.convertTo(_input, CV_32F); // DO NOT SCALING HERE
-        doInference(_input.data, 1);
-        if (params->enable_perf_output) {
-            printf("MobileNetVLADONNX::inference() took %f ms\n", tic.toc());
-        }
+        cv::Mat input_bound(height, width, CV_32F, dst);
+        _input.convertTo(input_bound, CV_32F); // DO NOT SCALING HERE
+    }
+
+    std::vector<float> postprocess(const float * output) const {
         // Perform PCA if neccasary
         if (pca_comp_T.rows() > 0) {
-            Eigen::Map<Eigen::VectorXf> desc(results_.data(), results_.size());
+            Eigen::Map<const Eigen::VectorXf> desc(output, NETVLAD_DESC_RAW_SIZE);
             Eigen::VectorXf desc_pca = pca_comp_T * (desc - pca_mean);
             // Normalize and return
             desc_pca /= desc_pca.norm();
             return std::vector<float>(desc_pca.data(), desc_pca.data() + desc_pca.size());
         }
-        return std::vector<float>(results_.begin(), results_.end());
+        return std::vector<float>(output, output + NETVLAD_DESC_RAW_SIZE);
+    }
+
+    std::vector<float> inference(const cv::Mat & input) {
+        TicToc tic;
+        bindBatch(1);
+        preprocess(input, inputBuffer());
+        run();
+        if (params->enable_perf_output) {
+            printf("MobileNetVLADONNX::inference() took %f ms\n", tic.toc());
+        }
+        return postprocess(outputBuffer());
+    }
+
+    //Stack the images into one batch, falls back to per-image runs for models with a fixed batch of 1
+    std::vector<std::vector<float>> inference(const std::vector<cv::Mat> & inputs) {
+        std::vector<std::vector<float>> descs;
+        int batch = inputs.size();
+        if (!supportsBatch() || batch <= 1) {
+            for (auto & input : inputs) {
+                descs.emplace_back(inference(input));
+            }
+            return descs;
+        }
+        TicToc tic;
+        bindBatch(batch);
+        for (int i = 0; i < batch; i++) {
+            preprocess(inputs[i], inputBuffer() + i*width*height);
+        }
+        run();
+        if (params->enable_perf_output) {
+            printf("MobileNetVLADONNX::inference() batch %d took %f ms\n", batch, tic.toc());
+        }
+        for (int i = 0; i < batch; i++) {
+            descs.emplace_back(postprocess(outputBuffer() + i*NETVLAD_DESC_RAW_SIZE));
+        }
+        return descs;
     }
 };
 }
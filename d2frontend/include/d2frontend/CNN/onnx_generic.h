@@ -2,45 +2,150 @@
 #include "CNN_generic.h"
 #include <onnxruntime_cxx_api.h>
 namespace D2FrontEnd {
+enum class ONNXExecutionProvider {
+    CPU = 0,
+    CUDA,
+    TensorRT
+};
+
+//Returns false for an unknown name. An empty name keeps the old behavior of cnn_enable_tensorrt.
+inline bool parseONNXExecutionProvider(const std::string & name, bool enable_tensorrt, ONNXExecutionProvider & provider) {
+    if (name.empty()) {
+        provider = enable_tensorrt ? ONNXExecutionProvider::TensorRT : ONNXExecutionProvider::CUDA;
+    } else if (name == "cpu" || name == "CPU") {
+        provider = ONNXExecutionProvider::CPU;
+    } else if (name == "cuda" || name == "CUDA") {
+        provider = ONNXExecutionProvider::CUDA;
+    } else if (name == "tensorrt" || name == "TensorRT") {
+        provider = ONNXExecutionProvider::TensorRT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+struct ONNXInferenceConfig {
+    ONNXExecutionProvider provider = ONNXExecutionProvider::CUDA;
+    int intra_op_threads = 1;
+    int inter_op_threads = 1;
+    int device_id = 0;
+    bool enable_fp16 = true;
+    bool enable_int8 = false;
+    std::string int8_calib_table_name;
+};
+
+//GPU config from the former use_tensorrt/use_fp16/use_int8 arguments
+inline ONNXInferenceConfig gpuONNXConfig(bool use_tensorrt, bool use_fp16 = true, bool use_int8 = false) {
+    ONNXInferenceConfig config;
+    config.provider = use_tensorrt ? ONNXExecutionProvider::TensorRT : ONNXExecutionProvider::CUDA;
+    config.enable_fp16 = use_fp16;
+    config.enable_int8 = use_int8;
+    return config;
+}
+
 class ONNXInferenceGeneric: public CNNInferenceGeneric {
 protected:
     Ort::Value input_tensor_{nullptr};
-    Ort::Value output_tensor_{nullptr};
+    std::vector<Ort::Value> output_tensors_;
     Ort::Env env;
     Ort::Session * session_ = nullptr;
-    std::string output_name;
+    Ort::IoBinding * io_binding_ = nullptr;
+    std::vector<std::string> output_names_;
+    //Persistent buffers bound to the session, input_image points into input_buffer_
+    std::vector<float> input_buffer_;
+    std::vector<std::vector<float>> output_buffers_;
     float * input_image = nullptr;
     char engine_folder [256] = {0};
     char int8_calib_table_name_c [256] = {0};
+    ONNXInferenceConfig onnx_config;
+    int model_batch_ = 1; // Batch dim of the model input, -1 when exported with a dynamic batch
+    int bound_batch_ = 0; // Batch of the currently bound tensors
 public:
-    ONNXInferenceGeneric(std::string engine_path, std::string input_blob_name, std::string output_blob_name, int _width, int _height,
-            bool use_tensorrt, bool use_fp16, bool use_int8, std::string int8_calib_table_name = ""):
-        CNNInferenceGeneric(input_blob_name, _width, _height), output_name(output_blob_name) {
-        init(engine_path, use_tensorrt, use_fp16, use_int8, int8_calib_table_name) ;
+    ONNXInferenceGeneric(std::string engine_path, std::string input_blob_name, std::vector<std::string> output_blob_names,
+            int _width, int _height, const ONNXInferenceConfig & config):
+        CNNInferenceGeneric(input_blob_name, _width, _height), output_names_(output_blob_names), onnx_config(config) {
+        init(engine_path, config);
+    }
+
+    virtual ~ONNXInferenceGeneric() {
+        delete io_binding_;
+        delete session_;
+    }
+
+    //Allocate the input and output buffers and bind them to the session once.
+    void bindTensors(const std::vector<int64_t> & input_shape, const std::vector<std::vector<int64_t>> & output_shapes) {
+        auto memory_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
+        auto numel = [](const std::vector<int64_t> & shape) {
+            int64_t n = 1;
+            for (auto s : shape) {
+                n *= s;
+            }
+            return n;
+        };
+        bound_batch_ = input_shape[0];
+        input_buffer_.resize(numel(input_shape));
+        input_image = input_buffer_.data();
+        input_tensor_ = Ort::Value::CreateTensor<float>(memory_info, input_buffer_.data(), input_buffer_.size(),
+                input_shape.data(), input_shape.size());
+        output_buffers_.resize(output_shapes.size());
+        output_tensors_.clear();
+        for (unsigned int i = 0; i < output_shapes.size(); i++) {
+            output_buffers_[i].resize(numel(output_shapes[i]));
+            output_tensors_.emplace_back(Ort::Value::CreateTensor<float>(memory_info, output_buffers_[i].data(),
+                    output_buffers_[i].size(), output_shapes[i].data(), output_shapes[i].size()));
+        }
+        io_binding_->ClearBoundInputs();
+        io_binding_->ClearBoundOutputs();
+        io_binding_->BindInput(m_InputBlobName.c_str(), input_tensor_);
+        for (unsigned int i = 0; i < output_names_.size(); i++) {
+            io_binding_->BindOutput(output_names_[i].c_str(), output_tensors_[i]);
+        }
+    }
+
+    //Models exported with a fixed batch of 1 must be run image by image.
+    bool supportsBatch() const {
+        return model_batch_ < 0;
+    }
+
+    //Preprocessing may write directly into this buffer, then call run().
+    float * inputBuffer() {
+        return input_image;
+    }
+
+    const float * outputBuffer(int i = 0) const {
+        return output_buffers_[i].data();
+    }
+
+    void run() {
+        session_->Run(Ort::RunOptions{nullptr}, *io_binding_);
     }
 
     virtual void doInference(const unsigned char* input, const uint32_t batchSize) override {
-        const char* input_names[] = {m_InputBlobName.c_str()};
-        const char* output_names[] = {output_name.c_str()};
-        memcpy(input_image, input, width*height*sizeof(float));
-        session_->Run(Ort::RunOptions{nullptr}, input_names, &input_tensor_, 1, output_names, &output_tensor_, 1);
+        if ((const float*)input != input_image) {
+            memcpy(input_image, input, input_buffer_.size()*sizeof(float));
+        }
+        run();
     }
 
-    void init(const std::string & engine_path, bool onnx_with_tensorrt, bool enable_fp16, bool enable_int8, std::string int8_calib_table_name = "") {
+    void init(const std::string & engine_path, const ONNXInferenceConfig & config) {
         Ort::SessionOptions session_options;
-        session_options.SetIntraOpNumThreads(1);
+        session_options.SetIntraOpNumThreads(config.intra_op_threads);
+        session_options.SetInterOpNumThreads(config.inter_op_threads);
+        if (config.inter_op_threads > 1) {
+            session_options.SetExecutionMode(ExecutionMode::ORT_PARALLEL);
+        }
         session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
 
-        if (onnx_with_tensorrt) {
+        if (config.provider == ONNXExecutionProvider::TensorRT) {
             int pn = engine_path.find_last_of('/');
             std::string configPath = engine_path.substr(0, pn);
             memcpy(engine_folder, configPath.c_str(), configPath.size());
-            memcpy(int8_calib_table_name_c, int8_calib_table_name.c_str(), int8_calib_table_name.size());
+            memcpy(int8_calib_table_name_c, config.int8_calib_table_name.c_str(), config.int8_calib_table_name.size());
             OrtTensorRTProviderOptions tensorrt_options{};
-            tensorrt_options.device_id = 0;
+            tensorrt_options.device_id = config.device_id;
             tensorrt_options.has_user_compute_stream = 0;
-            tensorrt_options.trt_fp16_enable = enable_fp16;
-            tensorrt_options.trt_int8_enable = enable_int8;
+            tensorrt_options.trt_fp16_enable = config.enable_fp16;
+            tensorrt_options.trt_int8_enable = config.enable_int8;
             tensorrt_options.trt_max_workspace_size = 1 * 1024 * 1024 * 1024;
             tensorrt_options.trt_engine_cache_enable = 1;
             tensorrt_options.trt_engine_cache_path = engine_folder;
@@ -48,20 +153,28 @@ public:
             tensorrt_options.trt_min_subgraph_size = 5;
             tensorrt_options.trt_int8_use_native_calibration_table = 0;
             tensorrt_options.trt_int8_calibration_table_name = int8_calib_table_name_c;
-            tensorrt_options.trt_dump_subgraphs = 0; 
+            tensorrt_options.trt_dump_subgraphs = 0;
             session_options.AppendExecutionProvider_TensorRT(tensorrt_options);
-            printf("ONNX will use TensorRT for inference INT8 %d FP16 %d cache path %s\n", enable_int8, enable_fp16, engine_folder);
+            printf("ONNX will use TensorRT for inference INT8 %d FP16 %d cache path %s\n", config.enable_int8, config.enable_fp16, engine_folder);
         }
 
-        OrtCUDAProviderOptions options;
-        options.device_id = 0;
-        options.arena_extend_strategy = 0;
-        options.gpu_mem_limit = 1 * 1024 * 1024 * 1024;
-        options.cudnn_conv_algo_search = OrtCudnnConvAlgoSearch::OrtCudnnConvAlgoSearchExhaustive;
-        options.do_copy_in_default_stream = 1;
-        session_options.AppendExecutionProvider_CUDA(options);
+        if (config.provider == ONNXExecutionProvider::TensorRT || config.provider == ONNXExecutionProvider::CUDA) {
+            OrtCUDAProviderOptions options;
+            options.device_id = config.device_id;
+            options.arena_extend_strategy = 0;
+            options.gpu_mem_limit = 1 * 1024 * 1024 * 1024;
+            options.cudnn_conv_algo_search = OrtCudnnConvAlgoSearch::OrtCudnnConvAlgoSearchExhaustive;
+            options.do_copy_in_default_stream = 1;
+            session_options.AppendExecutionProvider_CUDA(options);
+        } else {
+            printf("ONNX will use CPU for inference intra_op_threads %d inter_op_threads %d\n",
+                config.intra_op_threads, config.inter_op_threads);
+        }
 
         session_ = new Ort::Session(env, engine_path.c_str(), session_options);
+        io_binding_ = new Ort::IoBinding(*session_);
+        auto input_shape = session_->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        model_batch_ = input_shape.size() > 0 ? input_shape[0] : 1;
     }
 };
 }
@@ -13,6 +13,8 @@ class SuperGlueOnnx {
 
     void init(const std::string & engine_path);
     void resetTensors();
+protected:
+    SuperGlueOnnx(): env(nullptr) {} //For subclasses replacing the network
 public:
     SuperGlueOnnx(const std::string & engine_path);
     virtual std::vector<cv::DMatch> inference(const std::vector<cv::Point2f> kpts0, const std::vector<cv::Point2f> kpts1, 
@@ -1,6 +1,8 @@
 #pragma once
+#ifdef USE_TORCH
 #include <ATen/ATen.h>
 #include <torch/csrc/api/include/torch/types.h>
+#endif
 #include <opencv2/opencv.hpp>
 #include <Eigen/Eigen>
 
@@ -8,7 +10,20 @@
 
 namespace D2FrontEnd {
 void getKeyPoints(const cv::Mat & prob, float threshold, int nms_dist, std::vector<cv::Point2f> &keypoints, std::vector<float>& scores, int width, int height, int max_num);
+//Single pass threshold, local maximum test in the (2*nms_dist+1)^2 window and top-k, bucketed in a grid_rows x grid_cols grid
+//to keep the features spread. Each cell keeps up to max_num/cells keypoints, the rest of the budget goes to the best
+//remaining candidates. With a 1x1 grid this is the global top-k. Keypoints are sorted by score.
+void getKeyPointsGrid(const cv::Mat & prob, float threshold, int nms_dist, int grid_rows, int grid_cols,
+        std::vector<cv::Point2f> &keypoints, std::vector<float>& scores, int max_num);
+//Bilinear sampling of the SP_DESC_RAW_LEN x height/8 x width/8 descriptor map at the keypoints,
+//same as grid_sampler with align_corners=false and zero padding. As the torch path, each channel is L2 normalized
+//across the keypoints, then each descriptor is L2 normalized after the optional PCA.
+void computeDescriptors(const float * desc_map, const std::vector<cv::Point2f> &keypoints, 
+        std::vector<float> & local_descriptors, int width, int height, 
+        const Eigen::MatrixXf & pca_comp_T, const Eigen::RowVectorXf & pca_mean);
+#ifdef USE_TORCH
 void computeDescriptors(const torch::Tensor & mProb, const torch::Tensor & desc,
         const std::vector<cv::Point2f> &keypoints, std::vector<float> & local_descriptors, int width, int height, 
         const Eigen::MatrixXf & pca_comp_T, const Eigen::RowVectorXf & pca_mean);
+#endif
 }
\ No newline at end of file
@@ -5,25 +5,27 @@ namespace D2FrontEnd {
 class SuperPointONNX: public ONNXInferenceGeneric {
     Eigen::MatrixXf pca_comp_T;
     Eigen::RowVectorXf pca_mean;
-    float * results_desc_ = nullptr;
-    float * results_semi_ = nullptr;
-    std::array<int64_t, 4> output_shape_desc_;
-    std::array<int64_t, 3> output_shape_semi_;
-    std::array<int64_t, 4> input_shape_;
-    std::vector<Ort::Value> output_tensors_;
     int max_num = 200;
     int nms_dist = 10;
+    void bindBatch(int batch);
+    void preprocess(const cv::Mat & input, float * dst) const;
+    void postprocess(float * semi, float * desc, std::vector<cv::Point2f> & keypoints, 
+        std::vector<float> & local_descriptors, std::vector<float> & scores);
 public:
     double thres = 0.015;
+    //Keypoints are bucketed in a grid_rows x grid_cols grid to keep them spread over the image
+    int grid_rows = 1;
+    int grid_cols = 1;
     SuperPointONNX(std::string engine_path, 
         int _nms_dist,
         std::string _pca_comp,
         std::string _pca_mean,
-        int _width, int _height, float _thres = 0.015, int _max_num = 200, bool use_tensorrt = true, 
-        bool use_fp16 = true, bool use_int8 = false, std::string int8_calib_table_name = "");
+        int _width, int _height, float _thres = 0.015, int _max_num = 200, 
+        const ONNXInferenceConfig & onnx_config = ONNXInferenceConfig());
 
-    
     void inference(const cv::Mat & input, std::vector<cv::Point2f> & keypoints, std::vector<float> & local_descriptors, std::vector<float> & scores);
-    void doInference(const unsigned char* input, const uint32_t batchSize) override;
+    //Stack the images into one batch, falls back to per-image runs for models with a fixed batch of 1
+    void inference(const std::vector<cv::Mat> & inputs, std::vector<std::vector<cv::Point2f>> & keypoints, 
+        std::vector<std::vector<float>> & local_descriptors, std::vector<std::vector<float>> & scores);
 };
 }
\ No newline at end of file
@@ -2,8 +2,15 @@
 
 #include "d2frontend_params.h"
 #include "d2landmark_manager.h"
+#include "keyframe_desc_matrix.h"
+#include "visualization_sink.h"
+#include "utils.h"
 #include <unordered_map>
+#include <unordered_set>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <memory>
 #include <d2common/d2frontend_types.h>
 
 using namespace Eigen;
@@ -32,6 +39,11 @@ struct D2FTConfig {
     bool double_counting_common_feature = false;
     bool enable_superglue_local = false;
     bool enable_superglue_remote = false;
+    //Try KNN first and only run SuperGlue when the KNN matching is not confident
+    bool enable_superglue_gate = false;
+    double superglue_gate_thres = 0.5;
+    int superglue_gate_min_matches = 50; //Fewer KNN matches lower the score
+    double superglue_gate_pred_dist = 20.0; //Pixels between the match and the prediction to count as consistent
     bool enable_knn_match = true;
     bool enable_search_local_aera = true;
     bool enable_motion_prediction_local = false;
@@ -42,6 +54,17 @@ struct D2FTConfig {
     std::string superglue_model_path;
     double landmark_distance_assumption = 2.0; // For uninitialized landmark, assume it is 3m away
     int frame_step = 2;
+    LandmarkRetention landmark_retention;
+};
+
+struct MatchDecision {
+    FrameIdType frame_a = -1;
+    FrameIdType frame_b = -1;
+    int drone_b = -1;
+    int camera_index_a = -1;
+    int camera_index_b = -1;
+    MatchQuality knn_quality; //Left default when the gate was not evaluated
+    bool superglue = false;
 };
 
 struct TrackReport {
@@ -52,6 +75,9 @@ struct TrackReport {
     double ft_time = 0.0;
     int stereo_point_num = 0;
     int remote_matched_num = 0;
+    int superglue_num = 0;
+    int superglue_skipped_num = 0;
+    std::vector<MatchDecision> match_decisions;
 
     void compose(const TrackReport & report) {
         sum_parallex += report.sum_parallex;
@@ -59,6 +85,18 @@ struct TrackReport {
         long_track_num += report.long_track_num;
         unmatched_num += report.unmatched_num;
         remote_matched_num += report.remote_matched_num;
+        superglue_num += report.superglue_num;
+        superglue_skipped_num += report.superglue_skipped_num;
+        match_decisions.insert(match_decisions.end(), report.match_decisions.begin(), report.match_decisions.end());
+    }
+
+    void addDecision(const MatchDecision & decision) {
+        if (decision.superglue) {
+            superglue_num++;
+        } else {
+            superglue_skipped_num++;
+        }
+        match_decisions.emplace_back(decision);
     }
 
     double meanParallex() const {
@@ -74,6 +112,44 @@ struct LKImageInfo {
     std::vector<cv::cuda::GpuMat> pyr;
 };
 
+//What drawToImage needs from the tracker state, copied on the tracking thread
+struct TrackVizImage {
+    cv::Mat image; //Shares the raw image data
+    std::vector<uint8_t> compressed_image; //Decoded on the visualization thread for remote frames
+    std::vector<cv::Point2f> pts;
+    std::vector<bool> is_superpoint;
+    std::vector<LandmarkIdType> ids; //-1 when not tracked by the landmark manager
+    std::vector<cv::Point2f> prev_pts;
+    std::vector<bool> has_prev;
+    std::vector<cv::Point2f> predictions;
+    std::vector<cv::Point2f> predictions_matched;
+    int camera_index = 0;
+    int drone_id = 0;
+    bool is_right = false;
+    bool is_remote = false;
+};
+
+struct TrackVizFrame {
+    enum Layout {
+        SINGLE = 0,
+        SIDE_BY_SIDE, //images[0] | images[1] | ...
+        QUAD //images[0] | images[1] over images[2] | images[3]
+    };
+    std::vector<TrackVizImage> images;
+    Layout layout = SINGLE;
+    bool is_keyframe = false;
+    TrackReport report;
+    int keyframe_count = 0;
+    int frame_count = 0;
+};
+
+struct TrackerMemoryStats {
+    LandmarkMemoryStats landmarks;
+    size_t keyframe_num = 0;
+    size_t remote_to_local_num = 0;
+    size_t local_to_remote_num = 0;
+};
+
 class SuperGlueOnnx;
 
 class D2FeatureTracker {
@@ -93,19 +169,29 @@ protected:
     D2FTConfig _config;
     double image_width = 0.0;
     double search_radius = 0.0;
-    int reference_frame_id = 0;
+    std::atomic<int> reference_frame_id{0};
 
     std::vector<VisualImageDescArray> current_keyframes;
+    KeyframeDescMatrix keyframe_descs; // Global descriptors of current_keyframes
     LandmarkManager * lmanager = nullptr;
     int keyframe_count = 0;
-    int frame_count = 0;
+    std::atomic<int> frame_count{0}; //Local and remote frames
     bool inited = false;
     std::map<int, LKImageInfo> prev_lk_info; //frame.camera_index->image
     std::pair<bool, LandmarkPerFrame> createLKLandmark(const VisualImageDesc & frame, cv::Point2f pt, LandmarkIdType landmark_id = -1);
-    std::recursive_mutex track_lock;
-    std::recursive_mutex keyframe_lock;
-    std::recursive_mutex lmanager_lock;
-    
+    //Lock order: local_track_lock or a remote drone lock, keyframe_lock, lmanager_lock, remote_id_lock, viz_lock, superglue_lock
+    std::mutex local_track_lock; //Local frames are tracked in order; also owns prev_lk_info
+    std::mutex remote_drone_locks_lock;
+    std::map<int, std::unique_ptr<std::mutex>> remote_drone_locks; //Frames of one remote drone are tracked in order, drones in parallel
+    mutable std::shared_mutex keyframe_lock; //current_keyframes, keyframe_descs and keyframe_count
+    mutable std::shared_mutex lmanager_lock;
+    mutable std::shared_mutex remote_id_lock; //remote_to_local and local_to_remote
+    mutable std::mutex viz_lock; //landmark_predictions_viz and landmark_predictions_matched_viz
+    std::mutex superglue_lock; //SuperGlueOnnx reuses its tensors between inferences
+    typedef std::shared_lock<std::shared_mutex> SharedGuard;
+    typedef std::unique_lock<std::shared_mutex> UniqueGuard;
+    std::mutex & remoteDroneLock(int drone_id);
+
     std::map<int, std::vector<cv::Point2f>> landmark_predictions_viz;
     std::map<int, std::vector<cv::Point2f>> landmark_predictions_matched_viz;
 
@@ -123,24 +209,31 @@ protected:
 
     void draw(const VisualImageDesc & frame, bool is_keyframe, const TrackReport & report) const;
     void draw(const VisualImageDesc & lframe, VisualImageDesc & rframe, bool is_keyframe, const TrackReport & report) const;
-    void draw(const VisualImageDescArray & frames, bool is_keyframe, const TrackReport & report) const;
+    void draw(const VisualImageDescArray & frames, bool is_keyframe, const TrackReport & report,
+        TrackVizFrame::Layout layout=TrackVizFrame::QUAD) const;
     void drawRemote(const VisualImageDescArray & frames, const TrackReport & report) const;
     void cvtRemoteLandmarkId(VisualImageDesc & frame) const;
-    cv::Mat drawToImage(const VisualImageDesc & frame, bool is_keyframe, const TrackReport & report, bool is_right=false, bool is_remote=false) const;
+    void compactRemoteIds(const std::vector<LandmarkIdType> & removed);
+    TrackVizImage snapshotImage(const VisualImageDesc & frame, bool is_right=false, bool is_remote=false) const;
+    TrackVizFrame snapshotFrame(TrackVizFrame::Layout layout, bool is_keyframe, const TrackReport & report) const;
+    cv::Mat drawToImage(const TrackVizImage & viz, const TrackVizFrame & frame) const;
+    void renderFrame(TrackVizFrame & frame) const;
+    VisualizationSink<TrackVizFrame> * viz_sink = nullptr; //Renders and shows the track images off the tracking thread
     std::unordered_map<LandmarkIdType, LandmarkIdType> remote_to_local; // Remote landmark id to local;
     std::unordered_map<LandmarkIdType, std::unordered_map<int, LandmarkIdType>> local_to_remote; // local landmark id to remote drone and id;
-    typedef std::lock_guard<std::recursive_mutex> Guard;
     SuperGlueOnnx * superglue = nullptr;
     bool matchLocalFeatures(const VisualImageDesc & img_desc_a, const VisualImageDesc & img_desc_b, std::vector<int> & ids_down_to_up, 
-        const MatchLocalFeatureParams & param);
+        const MatchLocalFeatureParams & param, MatchDecision * decision = nullptr);
     std::vector<cv::Point2f> predictLandmarks(const VisualImageDesc & img_desc_a, 
             const Swarm::Pose & cam_pose_a, const Swarm::Pose & cam_pose_b, bool use_extrinsic=false) const;
 public:
     D2FeatureTracker(D2FTConfig config);
+    ~D2FeatureTracker();
     bool trackLocalFrames(VisualImageDescArray & frames);
     bool trackRemoteFrames(VisualImageDescArray & frames);
     void updatebySldWin(const std::vector<VINSFrame*> sld_win);
     void updatebyLandmarkDB(const std::map<LandmarkIdType, LandmarkPerId> & vins_landmark_db);
+    TrackerMemoryStats memoryStats() const;
     std::vector<camodocal::CameraPtr> cams;
 };
 
@@ -4,6 +4,7 @@
 #include <chrono> 
 #include <Eigen/Eigen>
 #include <thread>
+#include <atomic>
 #include <nav_msgs/Odometry.h>
 #include <mutex>
 #include <swarm_msgs/ImageArrayDescriptor.h>
@@ -11,6 +12,7 @@
 #include <sensor_msgs/CompressedImage.h>
 #include <sensor_msgs/Image.h>
 #include "d2common/d2frontend_types.h"
+#include "d2common/bounded_queue.h"
 #include "d2frontend_params.h"
 #include <message_filters/subscriber.h>
 #include <message_filters/time_synchronizer.h>
@@ -39,8 +41,7 @@ protected:
     Eigen::Vector3d last_keyframe_position = Eigen::Vector3d(10000, 10000, 10000);
 
     std::set<ros::Time> received_keyframe_stamps;
-    std::queue<VisualImageDescArray> loop_queue;
-    std::mutex loop_lock;
+    BoundedQueue<VisualImageDescArray> * loop_queue = nullptr;
     image_transport::ImageTransport * it_;
 
     virtual void backendFrameCallback(const VisualImageDescArray & viokf) {};
@@ -67,8 +68,20 @@ protected:
     virtual void processRemoteImage(VisualImageDescArray & frame_desc, bool succ_track);
 
     void processStereoframe(const StereoFrame & stereoframe);
+    void trackFrame(VisualImageDescArray & vframearry, double t_start);
     void loopDetectionThread();
 
+    //Staged pipeline: callback (decode) -> descriptor thread (undistort, CNN) -> tracking thread (tracking, keyframe dispatch)
+    BoundedQueue<StereoFrame> * raw_frame_queue = nullptr;
+    BoundedQueue<VisualImageDescArray> * desc_frame_queue = nullptr;
+    std::thread th_desc, th_track;
+    std::atomic<bool> stopping{false};
+    void descriptorThread();
+    void trackingThread();
+    //Closes the queues and joins the frontend threads. Derived classes overriding the callbacks of the tracking
+    //thread should call it in their destructor, before their members are gone
+    void stopPipeline();
+
     void addToLoopQueue(const VisualImageDescArray & viokf);
 
     ros::Subscriber remote_img_sub;
@@ -86,6 +99,7 @@ protected:
     ros::Timer timer, loop_timer;
 public:
     D2Frontend ();
+    virtual ~D2Frontend();
     virtual Swarm::Pose getMotionPredict(double stamp) const {return Swarm::Pose();};
     
 protected:
@@ -31,6 +31,8 @@
 namespace camodocal {
 class Camera;
 typedef boost::shared_ptr< Camera > CameraPtr;
+class BearingLUT;
+typedef boost::shared_ptr< BearingLUT > BearingLUTPtr;
 }
 
 namespace D2Common {
@@ -87,6 +89,9 @@ struct D2FrontendParams {
     bool show = false;
     bool debug_plot_superpoint_features = false;
     bool enable_loop = true;
+    bool enable_frontend_pipeline = false; //Run descriptor extraction and tracking in separate threads
+    int frontend_queue_size = 2;
+    int loop_queue_size = 100; //Keyframes waiting for loop detection with the pipeline; unbounded without it
     bool enable_network = true;
     bool verbose = false;
     bool print_network_status = false;
@@ -99,6 +104,7 @@ struct D2FrontendParams {
     double undistort_fov = 200;
     int width_undistort = 800;
     int height_undistort = 400;
+    std::string undistort_map_cache_dir; //Cache of undistortion maps, disabled when empty
     bool enable_undistort_image; //Undistort image before feature detection
     double focal_length = 460.0;
     std::vector<Swarm::Pose> extrinsics;
@@ -108,6 +114,8 @@ struct D2FrontendParams {
     std::vector<std::string> camera_config_paths;
     std::vector<camodocal::CameraPtr> camera_ptrs;
     std::vector<camodocal::CameraPtr> raw_camera_ptrs;
+    std::vector<camodocal::BearingLUTPtr> bearing_luts; //Same order as camera_ptrs, empty when disabled
+    int bearing_lut_step = 0; //Pixel step of the bearing lookup tables, 0 to lift with the camera models
     std::vector<D2Common::FisheyeUndist*> undistortors;
     std::vector<int> camera_seq;
 
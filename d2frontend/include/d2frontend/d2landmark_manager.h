@@ -1,21 +1,64 @@
 #pragma once
 #include "d2common/d2landmarks.h"
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace D2Common;
 #define MAX_FEATURE_NUM 10000000
 
 namespace D2FrontEnd {
+//Landmarks not observed for too long are evicted, negative to disable
+struct LandmarkRetention {
+    int max_age_frames = -1; //Frames since the last observation
+    double max_age_sec = -1;
+    int max_landmarks = -1; //Cap, least recently observed landmarks go first; the newest frame is always kept
+    int max_evicted_ids = 100000; //Latest evicted ids remembered to refuse late observations of them
+    bool enabled() const {
+        return max_age_frames > 0 || max_age_sec > 0 || max_landmarks > 0;
+    }
+};
+
+struct LandmarkMemoryStats {
+    size_t landmark_num = 0;
+    size_t observation_num = 0;
+    size_t frame_num = 0; //Frames in related_landmarks
+    size_t bytes = 0; //Estimated, including the containers
+    size_t evicted_num = 0; //Since creation
+    size_t refused_num = 0; //Observations of evicted landmarks refused, since creation
+};
+
 class LandmarkManager {
 protected:
+    struct Recency {
+        std::list<LandmarkIdType>::iterator it;
+        int last_frame_seq = 0;
+        double last_stamp = 0;
+    };
     std::map<FrameIdType, std::map<LandmarkIdType, int>> related_landmarks;
     std::map<LandmarkIdType, LandmarkPerId> landmark_db;
     int count = 0;
     typedef std::lock_guard<std::recursive_mutex> Guard;
     mutable std::recursive_mutex state_lock;
+    //Recency of the landmarks, only kept when retention is enabled
+    LandmarkRetention retention;
+    std::list<LandmarkIdType> lru; //Most recently observed first
+    std::unordered_map<LandmarkIdType, Recency> recency;
+    FrameIdType last_frame_id = -1;
+    int frame_seq = 0;
+    size_t evicted_num = 0;
+    std::unordered_set<LandmarkIdType> evicted_ids;
+    std::deque<LandmarkIdType> evicted_order; //Oldest first, bounded by max_evicted_ids
+    size_t refused_num = 0;
+    void touch(const LandmarkPerFrame & lm);
+    void forget(LandmarkIdType landmark_id);
+    void evictLandmark(LandmarkIdType landmark_id);
 public:
     int total_lm_per_frame_num = 0;
     virtual int addLandmark(const LandmarkPerFrame & lm);
-    virtual void updateLandmark(const LandmarkPerFrame & lm);
+    //False if the landmark was evicted: the observation is not recorded, the caller should treat it as untracked
+    virtual bool updateLandmark(const LandmarkPerFrame & lm);
     LandmarkPerId & at(LandmarkIdType i) {
         return landmark_db.at(i);
     }
@@ -43,6 +86,10 @@ public:
     std::vector<LandmarkPerId> getInitializedLandmarks(int min_tracks) const;
     FrameIdType getLandmarkBaseFrame(LandmarkIdType landmark_id) const;
     bool hasLandmark(LandmarkIdType landmark_id) const;
+    void setRetention(const LandmarkRetention & _retention);
+    //Evicts the landmarks out of the retention at stamp, returns their ids
+    std::vector<LandmarkIdType> evict(double stamp);
+    LandmarkMemoryStats memoryStats() const;
 
 };
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+#include <faiss/Index.h>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace D2FrontEnd {
+
+enum GlobalIndexType {
+    GLOBAL_INDEX_FLAT = 0, //Exhaustive inner product scan
+    GLOBAL_INDEX_HNSW, //Graph index, logarithmic query time
+    GLOBAL_INDEX_IVF //Flat until ivf_train_size descriptors are added, then inverted lists trained on them
+};
+
+struct GlobalIndexConfig {
+    GlobalIndexType type = GLOBAL_INDEX_FLAT;
+    int hnsw_m = 32; //Neighbors per node
+    int hnsw_ef_construction = 40;
+    int hnsw_ef_search = 64; //Larger is slower with a better recall
+    int ivf_nlist = 64;
+    int ivf_nprobe = 8; //Lists visited by a query
+    int ivf_train_size = 2560; //Warm-up count; faiss wants at least 39 * nlist training points
+    double hnsw_rebuild_ratio = 0.5; //HNSW can't remove: rebuilt when this ratio of its nodes are removed
+};
+
+// Inner product index of global (NetVLAD) descriptors. Labels are assigned in insertion order for every index type
+// and are not reused after removal.
+// Not thread safe: add, remove and search must not run concurrently.
+class GlobalDescIndex {
+    int dims;
+    GlobalIndexConfig config;
+    std::unique_ptr<faiss::Index> quantizer; //IVF only, outlives index
+    std::unique_ptr<faiss::Index> storage; //Flat or HNSW index wrapped by the id map, outlives index
+    std::unique_ptr<faiss::Index> index; //IndexIDMap2 over storage, or IVF with ids
+    std::unordered_set<faiss::idx_t> tombstones; //Removed from the HNSW index, filtered from the results
+    faiss::idx_t next_label = 0;
+    faiss::Index * createStorage() const;
+    void trainIVF();
+    void rebuildHNSW();
+    //Ids and descriptors stored by the id map
+    void liveDescriptors(std::vector<faiss::idx_t> & ids, std::vector<float> & descs) const;
+public:
+    GlobalDescIndex(int dims, const GlobalIndexConfig & config = GlobalIndexConfig());
+    ~GlobalDescIndex();
+    faiss::idx_t add(const float * desc);
+    bool remove(faiss::idx_t label);
+    // k most similar descriptors of each of the n queries (n x dims), n x k results with similarity descending;
+    // missing results have label -1
+    void search(int n, const float * queries, int k, float * similarity, faiss::idx_t * labels) const;
+    void search(const float * query, int k, float * similarity, faiss::idx_t * labels) const {
+        search(1, query, k, similarity, labels);
+    }
+    int64_t size() const {
+        return index->ntotal - tombstones.size();
+    }
+    //Label of the next descriptor added
+    faiss::idx_t nextLabel() const {
+        return next_label;
+    }
+    //False for IVF during the warm-up
+    bool isApproximate() const;
+    const GlobalIndexConfig & getConfig() const {
+        return config;
+    }
+};
+
+}
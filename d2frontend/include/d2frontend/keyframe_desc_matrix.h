@@ -0,0 +1,52 @@
+#pragma once
+#include <d2common/d2frontend_types.h>
+#include <vector>
+
+namespace D2FrontEnd {
+using D2Common::FrameIdType;
+using D2Common::VisualImageDescArray;
+
+struct KeyframeDescMatch {
+    FrameIdType frame_id;
+    int image_index; // Image of the keyframe
+    int query_index; // Column of the queries
+    double similarity;
+};
+
+// Contiguous row-major matrix of keyframe global (NetVLAD) descriptors.
+// One row per image of each keyframe, rows are kept in insertion order.
+class KeyframeDescMatrix {
+    struct FrameEntry {
+        FrameIdType frame_id;
+        int row_start;
+        int row_num;
+        bool alive;
+    };
+    int dims = 0;
+    std::vector<float> data; // rows x dims, row-major
+    std::vector<uint8_t> row_valid; // Row has a descriptor of the right size
+    std::vector<FrameEntry> frames; // Order by insertion, oldest first
+    int dead_rows = 0;
+    int alive_frames = 0;
+    void compact();
+public:
+    KeyframeDescMatrix(int _dims = 0): dims(_dims) {}
+    void setDims(int _dims);
+    void addFrame(const VisualImageDescArray & frame);
+    void removeFrame(FrameIdType frame_id);
+    void clear();
+    // Similarity of all rows with num_query queries (dims x num_query, col-major), rows x num_query, in one GEMM.
+    Eigen::MatrixXf similarity(const float * queries, int num_query) const;
+    // First k (keyframe image, query) pairs with similarity >= thres, in the order of the per-keyframe search it
+    // replaces: newest keyframe first, then its images in image_order (index order if empty), then the queries.
+    std::vector<KeyframeDescMatch> matchNewest(const float * queries, int num_query, double thres, int k,
+            const std::vector<int> & image_order = std::vector<int>()) const;
+    int rows() const {
+        return data.size() / std::max(dims, 1);
+    }
+    int frameNum() const {
+        return alive_frames;
+    }
+};
+
+}
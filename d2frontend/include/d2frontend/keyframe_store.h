@@ -0,0 +1,73 @@
+#pragma once
+#include <d2common/d2frontend_types.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace D2FrontEnd {
+using D2Common::FrameIdType;
+using D2Common::VisualImageDescArray;
+
+//Zero copy view of a stored keyframe, valid until the next append
+struct KeyframeRecordView {
+    FrameIdType frame_id = -1;
+    int drone_id = -1;
+    double stamp = 0;
+    Swarm::Pose pose_drone;
+    int desc_num = 0; //Images with a global descriptor
+    const int32_t * desc_images = nullptr; //Image index of each descriptor
+    const float * descs = nullptr; //desc_num x dims, row-major, in the mapped file
+    const uint8_t * blob = nullptr; //LCM encoded keyframe without global descriptors
+    size_t blob_size = 0;
+};
+
+// Append-only keyframe file read through mmap, with an offset index in path + ".idx".
+// Opening maps the file and reads the index and the record headers; the payloads are only touched when viewed or loaded.
+// Removed and replaced records stay in the file until compact.
+// Not thread safe.
+class KeyframeStore {
+    std::string path;
+    int dims;
+    int fd = -1;
+    int idx_fd = -1;
+    const uint8_t * mapped = nullptr;
+    size_t mapped_size = 0;
+    size_t file_size = 0;
+    struct RecordLocation {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+    std::unordered_map<FrameIdType, RecordLocation> records;
+    std::vector<FrameIdType> order; //First insertion order, may hold removed ids
+    size_t live_bytes = 0; //Records in the index
+    bool remap();
+    void appendIndex(FrameIdType frame_id, int64_t offset);
+public:
+    KeyframeStore(const std::string & path, int dims);
+    ~KeyframeStore();
+    //Creates the store if missing
+    bool open();
+    //Global descriptors of desc_images are stored for rebuilding the index
+    bool append(const VisualImageDescArray & frame, const std::vector<int> & desc_images);
+    bool remove(FrameIdType frame_id);
+    bool updatePose(FrameIdType frame_id, const Swarm::Pose & pose);
+    bool has(FrameIdType frame_id) const {
+        return records.find(frame_id) != records.end();
+    }
+    bool view(FrameIdType frame_id, KeyframeRecordView & view);
+    //Decodes the keyframe; raw images are not stored
+    bool load(FrameIdType frame_id, VisualImageDescArray & frame);
+    std::vector<FrameIdType> frameIds() const;
+    size_t size() const {
+        return records.size();
+    }
+    size_t fileSize() const {
+        return file_size;
+    }
+    //Ratio of the records bytes that are removed or replaced
+    double deadRatio() const;
+    //Rewrites the file with the live records only, then reopens it. Views are invalidated
+    bool compact();
+};
+
+}
@@ -38,6 +38,8 @@ struct LoopCamConfig
     std::string pca_mean;
     double superpoint_thres;
     int superpoint_max_num;
+    int superpoint_grid_rows = 1;
+    int superpoint_grid_cols = 1;
     std::string netvlad_model;
     int self_id = 0;
     bool OUTPUT_RAW_SUPERPOINT_DESC;
@@ -53,6 +55,9 @@ struct LoopCamConfig
     bool cnn_enable_tensorrt = false;
     bool cnn_enable_tensorrt_int8 = false;
     bool cnn_enable_tensorrt_fp16 = true;
+    ONNXExecutionProvider cnn_provider = ONNXExecutionProvider::CUDA;
+    int cnn_intra_op_threads = 1;
+    int cnn_inter_op_threads = 1;
     bool enable_undistort_image; //Undistort image before feature detection
     std::string netvlad_int8_calib_table_name;
     std::string superpoint_int8_calib_table_name;
@@ -76,6 +81,11 @@ public:
     LoopCam(LoopCamConfig config, ros::NodeHandle & nh);
     
     VisualImageDesc extractorImgDescDeepnet(ros::Time stamp, cv::Mat img, int index, int camera_id, bool superpoint_mode=false);
+    std::vector<VisualImageDesc> extractorImgDescDeepnetBatch(ros::Time stamp, const std::vector<cv::Mat> & imgs, 
+            const std::vector<int> & camera_indices, const std::vector<int> & camera_ids);
+    void addLandmarksToImageDesc(VisualImageDesc & vframe, const cv::Mat & img, const std::vector<cv::Point2f> & landmarks_2d);
+    cv::Mat undistortImage(const StereoFrame & msg, int vcam_id);
+    void finishImageDescriptor(const StereoFrame & msg, int vcam_id, const cv::Mat & undist, VisualImageDesc & vframe, cv::Mat &_show);
     std::vector<VisualImageDesc> generateStereoImageDescriptor(const StereoFrame & msg, int i, cv::Mat &_show);
     VisualImageDesc generateGrayDepthImageDescriptor(const StereoFrame & msg, int i, cv::Mat &_show);
     VisualImageDesc generateImageDescriptor(const StereoFrame & msg, int i, cv::Mat &_show);
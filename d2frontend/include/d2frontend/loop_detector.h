@@ -6,9 +6,15 @@
 #include <d2frontend/d2frontend_params.h>
 #include <functional>
 #include <swarm_msgs/Pose.h>
-#include <faiss/IndexFlat.h>
+#include <d2frontend/global_desc_index.h>
+#include <d2frontend/keyframe_store.h>
+#include <d2frontend/loop_verification_pool.h>
+#include <d2frontend/loop_image_cache.h>
 #include <swarm_msgs/drone_trajectory.hpp>
 #include <mutex>
+#include <memory>
+#include <set>
+#include <tuple>
 
 using namespace swarm_msgs;
 #define REMOTE_MAGIN_NUMBER 1000000
@@ -32,6 +38,37 @@ using D2Common::Point2fVector;
 
 class LoopCam;
 
+enum KeyframeEvictionPolicy {
+    KEYFRAME_EVICT_LRU = 0, //Least recently returned by a query
+    KEYFRAME_EVICT_UTILITY //Fewest query hits, least recently used first on ties
+};
+
+struct KeyframeRetentionConfig {
+    bool enable = false;
+    //A local keyframe within min_distance (m) of a retained one with a NetVLAD similarity above max_similarity is not stored
+    double min_distance = 0.5;
+    double max_similarity = 0.9;
+    size_t memory_budget = 0; //Bytes of the keyframe database, 0 for unbounded
+    KeyframeEvictionPolicy policy = KEYFRAME_EVICT_LRU;
+    int protect_recent = 100; //The latest keyframes are never evicted
+};
+
+struct LoopPriorGateConfig {
+    bool enable = false;
+    //Candidates whose odometry prior has a squared Mahalanobis distance above it are not verified; chi2 of 4 DoF at 99.9%
+    double threshold = 18.5;
+};
+
+struct KeyframeDatabaseStats {
+    int frames = 0; //In memory
+    int stored = 0; //In the keyframe store
+    size_t bytes = 0;
+    int64_t index_size = 0;
+    int evicted = 0; //From memory; kept in the keyframe store if any
+    int skipped = 0; //Dropped by the sparsification
+    int64_t neighbours_compared = 0; //Keyframes compared by the sparsification
+};
+
 struct LoopDetectorConfig {
     int match_index_dist;
     int match_index_dist_remote;
@@ -56,7 +93,16 @@ struct LoopDetectorConfig {
     bool enable_knn_match = true;
     double knn_match_ratio = 0.8;
     double gravity_check_thres = 0.06;
+    bool parallel_correspondence = true; //Match the camera directions of a loop candidate in parallel
+    bool enable_prosac = true; //PnP RANSAC samples the best matches first
+    int loop_image_cache_frames = 4; //Keyframes whose images stay decoded for drawing the matches
     std::string superglue_model_path;
+    GlobalIndexConfig global_index;
+    KeyframeRetentionConfig keyframe_retention;
+    std::string keyframe_store_path; //Keyframes are persisted and restored on start when set
+    double keyframe_store_compact_ratio = 0.5; //The store is compacted on start when this ratio of it is dropped keyframes
+    LoopVerificationConfig verification;
+    LoopPriorGateConfig prior_gate;
 };
 
 class SuperGlueOnnx;
@@ -65,19 +111,71 @@ class LoopDetector {
     LoopDetectorConfig _config;
     std::map<LandmarkIdType, LandmarkPerId> landmark_db;
     std::recursive_mutex frame_mutex, landmark_mutex;
+
+    struct KeyframeUsage {
+        int drone_id = -1;
+        int64_t added = 0;
+        int64_t last_access = 0;
+        int hits = 0;
+        size_t bytes = 0;
+        double travel = -1; //Distance the drone traveled up to the keyframe, -1 if unknown
+        bool restored = false; //Restored from the keyframe store, the pose is from another session
+        bool in_cell = false; //In keyframe_cells
+        std::tuple<int, int, int, int> cell;
+        std::vector<int> index_labels;
+    };
+    std::map<int64_t, KeyframeUsage> keyframe_usage; //Guarded by keyframe_database_mutex
+    //Keyframes in memory, first evicted first: hits under the utility policy, last access, added, frame id
+    typedef std::tuple<int, int64_t, int64_t, int64_t> EvictionKey;
+    std::set<EvictionKey> eviction_order;
+    //Keyframes of each drone by cells of keyframe_retention.min_distance, for the redundancy test of a new keyframe.
+    //Key is drone id and cell
+    std::map<std::tuple<int, int, int, int>, std::set<int64_t>> keyframe_cells;
+    int64_t access_count = 0;
+    int64_t added_count = 0;
+    size_t database_bytes = 0;
+    int evicted_num = 0;
+    int skipped_num = 0;
+    int64_t neighbours_compared = 0;
+    KeyframeStore * keyframe_store = nullptr;
+    LoopVerificationPool * verification_pool = nullptr;
+    std::mutex superglue_mutex;
+    void restoreKeyframes();
+    bool isRedundantKeyframe(const VisualImageDescArray & frame);
+    bool isRedundantWith(const VisualImageDescArray & frame, int64_t frame_id);
+    void touchKeyframe(int64_t frame_id);
+    void evictKeyframe(int64_t frame_id);
+    void dropKeyframe(int64_t frame_id);
+    void enforceMemoryBudget();
+    EvictionKey evictionKey(int64_t frame_id, const KeyframeUsage & usage) const;
+    std::tuple<int, int, int, int> keyframeCell(int drone_id, const Swarm::Pose & pose) const;
+    void updateKeyframeCell(int64_t frame_id, KeyframeUsage & usage, const Swarm::Pose & pose);
+    void removeKeyframeCell(int64_t frame_id, KeyframeUsage & usage);
+    size_t keyframeBytes(const VisualImageDescArray & frame) const;
+    std::map<int, std::pair<Swarm::Pose, double>> drone_travel; //Last pose and distance traveled of each drone
+    int prior_gate_checked = 0;
+    int prior_gate_rejected = 0;
+    double updateTravel(const VisualImageDescArray & frame);
 protected:
-    faiss::IndexFlatIP local_index;
-    faiss::IndexFlatIP remote_index;
+    //Keyframe in memory, loaded from the store if needed; caller holds keyframe_database_mutex.
+    //nullptr if unknown or if it fails to load, in which case it is dropped from the database
+    std::shared_ptr<const VisualImageDescArray> keyframe(int64_t frame_id);
+    //Latest pose of a keyframe, updated by the sliding window
+    Swarm::Pose keyframePose(const VisualImageDescArray & frame) const;
+    GlobalDescIndex local_index;
+    GlobalDescIndex remote_index;
     Swarm::DroneTrajectory ego_motion_traj;
     std::map<int, int64_t> index_to_frame_id;
     std::map<int, int> imgid2dir;
     std::map<int, std::map<int, int>> inter_drone_loop_count;
     std::set<int> all_nodes;
 
-    std::map<int64_t, VisualImageDescArray> keyframe_database;
-    std::mutex keyframe_database_mutex;
+    //Immutable once added: queries share them without copying. Poses change and live in keyframe_poses
+    std::map<int64_t, std::shared_ptr<const VisualImageDescArray>> keyframe_database;
+    std::map<int64_t, Swarm::Pose> keyframe_poses;
+    mutable std::mutex keyframe_database_mutex;
 
-    std::map<int64_t, std::vector<cv::Mat>> msgid2cvimgs;
+    LoopImageCache image_cache; //Only filled when params->show
     
     double t0 = -1;
     int loop_count = 0;
@@ -87,22 +185,36 @@ protected:
     bool computeLoop(const VisualImageDescArray & frame_array_a, const VisualImageDescArray & frame_array_b,
             int main_dir_a, int main_dir_b, LoopEdge & ret);
 
+    //match_dists: descriptor distance of each correspondence, lower is better
     bool computeCorrespondFeatures(const VisualImageDesc & new_img_desc, const VisualImageDesc & old_img_desc, 
             std::vector<Vector3d> &lm_pos_a, std::vector<int> &idx_a, std::vector<Vector3d> &lm_norm_3d_b, std::vector<int> &idx_b, 
-            std::vector<int> &cam_indices);
+            std::vector<int> &cam_indices, std::vector<float> &match_dists);
 
     bool computeCorrespondFeaturesOnImageArray(const VisualImageDescArray & frame_array_a,
             const VisualImageDescArray & frame_array_b, int main_dir_a, int main_dir_b,
             std::vector<Vector3d> &lm_pos_a, std::vector<Vector3d> &lm_norm_3d_b, std::vector<int> & cam_indices,
-            std::vector<std::pair<int, int>> &index2dirindex_a, std::vector<std::pair<int, int>> &index2dirindex_b);
+            std::vector<std::pair<int, int>> &index2dirindex_a, std::vector<std::pair<int, int>> &index2dirindex_b,
+            std::vector<float> &match_dists);
 
-    int addImageArrayToDatabase(VisualImageDescArray & new_fisheye_desc, bool add_to_faiss = true);
+    int addImageArrayToDatabase(VisualImageDescArray & new_fisheye_desc, bool add_to_faiss = true, double travel = -1);
     int addImageDescToDatabase(VisualImageDesc & new_img_desc);
-    bool queryImageArrayFromDatabase(const VisualImageDescArray & new_img_desc, VisualImageDescArray & ret, int & camera_index_new, int & camera_index_old);
+    bool queryImageArrayFromDatabase(const VisualImageDescArray & new_img_desc, std::shared_ptr<const VisualImageDescArray> & ret,
+            int & camera_index_new, int & camera_index_old, double * similarity = nullptr);
+    //computeLoop of a loop candidate and publishing of the loop; runs on the verification pool if any
+    void verifyCandidate(const VisualImageDescArray & frame, const VisualImageDescArray & old_frame, int camera_index,
+            int camera_index_old);
+    //Drops the images of a frame that is not in the database, once nothing will draw it
+    void releaseImages(FrameIdType frame_id);
+    FrameIdType processing_frame_id = -1; //Guarded by frame_mutex
     int queryFrameIndexFromDatabase(const VisualImageDesc & new_img_desc, double & similarity);
-    int queryIndexFromDatabase(const VisualImageDesc & new_img_desc, faiss::IndexFlatIP & index, bool remote_db, double thres, int max_index, double & similarity);
+    //Database image matched by each image of the same frame, -1 if none; one index search for all the images
+    std::vector<int> queryFrameIndexFromDatabase(const std::vector<const VisualImageDesc*> & imgs, std::vector<double> & similarity);
+    std::vector<int> queryIndexFromDatabase(const std::vector<const VisualImageDesc*> & imgs, GlobalDescIndex & index, bool remote_db,
+            double thres, int max_index, std::vector<double> & similarity);
 
     bool checkLoopOdometryConsistency(LoopEdge & loop_conn) const;
+    //Rejects a candidate whose odometry poses rule out a loop before its verification; true if the poses are not comparable
+    bool checkLoopPrior(const VisualImageDescArray & frame, const VisualImageDescArray & old_frame, double travel);
     void drawMatched(const VisualImageDescArray & fisheye_desc_a, const VisualImageDescArray & fisheye_desc_b,
             int main_dir_a, int main_dir_b, bool success, std::vector<int> inliers, Swarm::Pose DP_b_to_a,
             std::vector<std::pair<int, int>> index2dirindex_a, std::vector<std::pair<int, int>> index2dirindex_b);
@@ -113,6 +225,7 @@ public:
     std::function<void(VisualImageDescArray&)> broadcast_keyframe_cb;
     int self_id = -1;
     LoopDetector(int self_id, const LoopDetectorConfig & config);
+    ~LoopDetector();
     void processImageArray(VisualImageDescArray & img_des);
     void onLoopConnection(LoopEdge & loop_conn);
     LoopCam * loop_cam = nullptr;
@@ -122,6 +235,10 @@ public:
     bool hasFrame(FrameIdType frame_id);
 
     int databaseSize() const;
+    KeyframeDatabaseStats databaseStats() const;
+    //Waits for the pending loop candidates
+    void waitVerification();
+    LoopVerificationStats verificationStats() const;
 
 };
 
@@ -0,0 +1,41 @@
+#pragma once
+#include <d2common/d2basetypes.h>
+#include <opencv2/core.hpp>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace D2FrontEnd {
+using D2Common::FrameIdType;
+
+// Images of the keyframes for drawing loop matches, kept compressed and decoded only when drawn.
+// The decoded images of the latest drawn frames are held in a LRU of decoded_capacity frames. Thread safe.
+class LoopImageCache {
+    struct Entry {
+        std::vector<std::vector<uint8_t>> compressed; //Per camera, empty for a camera without image
+        size_t bytes = 0;
+    };
+    std::map<FrameIdType, Entry> entries;
+    std::list<std::pair<FrameIdType, std::vector<cv::Mat>>> decoded; //Most recently drawn first
+    size_t decoded_capacity;
+    cv::Size placeholder_size;
+    size_t compressed_bytes = 0;
+    mutable std::mutex lock;
+public:
+    //Cameras without image are drawn as white images of placeholder_size
+    LoopImageCache(size_t decoded_capacity, cv::Size placeholder_size);
+    //Lossless, the image is drawn as is
+    static std::vector<uint8_t> compress(const cv::Mat & img);
+    void add(FrameIdType frame_id, std::vector<std::vector<uint8_t>> && compressed);
+    //Decodes on the first call; the images share the cached data and are read only. False if the frame has no images
+    bool get(FrameIdType frame_id, std::vector<cv::Mat> & imgs);
+    void erase(FrameIdType frame_id);
+    bool has(FrameIdType frame_id) const;
+    //Compressed size of a frame
+    size_t bytes(FrameIdType frame_id) const;
+    size_t compressedBytes() const;
+    size_t decodedBytes() const;
+};
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <d2common/d2basetypes.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace D2FrontEnd {
+using D2Common::FrameIdType;
+
+struct LoopVerificationConfig {
+    int threads = 0; //0 verifies inline in processImageArray, set with loop_verification_threads
+    size_t queue_size = 20; //The lowest priority candidate is dropped when full
+    double latency_budget_ms = 2000; //Candidates waiting longer are cancelled, <= 0 for no limit
+};
+
+struct LoopVerificationJob {
+    FrameIdType frame_id = -1;
+    double similarity = 0; //Of the global descriptors
+    bool inter_drone = false;
+    std::function<void()> run;
+    std::function<void()> on_cancel; //Optional, called instead of run for a dropped or stale candidate
+};
+
+struct LoopVerificationStats {
+    size_t submitted = 0;
+    size_t executed = 0;
+    size_t dropped = 0; //Queue full
+    size_t cancelled = 0; //Stale or cancelled by frame id
+    double max_wait_ms = 0; //Of the executed ones
+};
+
+// Bounded pool verifying loop candidates by priority: inter-drone first, then higher similarity, then older.
+class LoopVerificationPool {
+    struct Entry {
+        LoopVerificationJob job;
+        uint64_t seq;
+        std::chrono::steady_clock::time_point submitted;
+    };
+    struct EntryPriority {
+        bool operator()(const Entry & a, const Entry & b) const {
+            if (a.job.inter_drone != b.job.inter_drone) {
+                return a.job.inter_drone;
+            }
+            if (a.job.similarity != b.job.similarity) {
+                return a.job.similarity > b.job.similarity;
+            }
+            return a.seq < b.seq;
+        }
+    };
+    LoopVerificationConfig config;
+    std::multiset<Entry, EntryPriority> queue; //Highest priority first
+    std::vector<std::thread> workers;
+    mutable std::mutex lock;
+    std::condition_variable not_empty, idle;
+    uint64_t seq = 0;
+    int running = 0;
+    bool closed = false;
+    LoopVerificationStats _stats;
+    void workerLoop();
+    //Caller holds lock; the cancelled jobs are returned to call on_cancel unlocked
+    void takeStale(std::chrono::steady_clock::time_point now, std::vector<LoopVerificationJob> & cancelled);
+    static void cancelJobs(std::vector<LoopVerificationJob> & cancelled);
+public:
+    LoopVerificationPool(const LoopVerificationConfig & config);
+    //Pending candidates are cancelled, running ones finish
+    ~LoopVerificationPool();
+    //Returns false if the candidate was dropped
+    bool submit(LoopVerificationJob job);
+    //Cancels the pending candidates of a frame
+    int cancel(FrameIdType frame_id);
+    //Waits until nothing is pending or running
+    void waitIdle();
+    void close();
+    size_t size() const;
+    LoopVerificationStats stats() const;
+};
+
+}
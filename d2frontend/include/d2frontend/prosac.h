@@ -0,0 +1,166 @@
+#pragma once
+#include <opengv/sac/SampleConsensus.hpp>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace D2FrontEnd {
+
+// PROSAC (Chum and Matas, 2005) over any opengv sample consensus problem.
+// Samples are drawn from a growing prefix of the correspondences sorted by match distance, so good matches are tried first.
+// Stops once the best model has a probability_ confidence for the inlier ratio of the best matches; each new best
+// model is refined on its inliers (local optimization).
+template <typename PROBLEM_T>
+class Prosac: public opengv::sac::SampleConsensus<PROBLEM_T> {
+    typedef opengv::sac::SampleConsensus<PROBLEM_T> Base;
+    typedef typename Base::model_t model_t;
+    std::vector<int> order;
+    std::mt19937 rng;
+    //Samples of the uniform RANSAC needed to draw a whole prefix of n matches; the growth function of PROSAC
+    int growth_max_samples = 200000;
+    //Samples needed for probability_ confidence of not missing a model with this inlier ratio
+    double samplesNeeded(double inlier_ratio, int m) const {
+        double p_no_good_sample = std::min(std::max(1.0 - pow(inlier_ratio, m), 1e-12), 1.0 - 1e-12);
+        return ceil(log(1.0 - probability_) / log(p_no_good_sample));
+    }
+
+    //More inliers out of num than an outlier support rate of non_random_beta explains, with a normal approximation
+    //of the binomial tail at 1%; at least two beyond the sample
+    bool nonRandom(int inliers, int num, int m) const {
+        double mean = (num - m) * non_random_beta;
+        return inliers - m >= std::max(2.0, mean + 2.33 * sqrt(mean * (1 - non_random_beta)));
+    }
+
+    //Adaptive termination on the inliers of the best model among the best matches: the shortest length over the
+    //prefixes, from the current sampling prefix n, whose inliers are unlikely to support a wrong model by chance
+    int terminationLength(int n, int m) {
+        auto indices = sac_model_->getIndices();
+        const int N = indices->size();
+        std::vector<int> inliers;
+        sac_model_->selectWithinDistance(model_coefficients_, threshold_, inliers);
+        std::vector<char> is_inlier(*std::max_element(indices->begin(), indices->end()) + 1, 0);
+        for (auto i : inliers) {
+            is_inlier[i] = 1;
+        }
+        double best = samplesNeeded((double) inliers.size() / N, m);
+        if (!nonRandom(inliers.size(), N, m)) {
+            return std::min<double>(best, max_iterations_);
+        }
+        int inliers_prefix = 0;
+        for (int i = 0; i < N; i++) {
+            inliers_prefix += is_inlier[(*indices)[order[i]]];
+            int prefix = i + 1;
+            if (prefix >= n && nonRandom(inliers_prefix, prefix, m)) {
+                best = std::min(best, samplesNeeded((double) inliers_prefix / prefix, m));
+            }
+        }
+        return std::min<double>(best, max_iterations_);
+    }
+public:
+    //Probability that a wrong model has an outlier within the threshold
+    double non_random_beta = 0.05;
+    using Base::sac_model_;
+    using Base::max_iterations_;
+    using Base::iterations_;
+    using Base::threshold_;
+    using Base::probability_;
+    using Base::model_;
+    using Base::inliers_;
+    using Base::model_coefficients_;
+    int local_optimizations = 0;
+
+    Prosac(int max_iterations = 1000, double threshold = 1.0, double probability = 0.99):
+        Base(max_iterations, threshold, probability), rng(0) {}
+
+    //Distance of each correspondence of the problem, lower is better: the DMatch distance
+    void setMatchDistances(const std::vector<float> & dists) {
+        order.resize(dists.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return dists[a] < dists[b]; });
+    }
+
+    bool computeModel(int debug_verbosity_level = 0) override {
+        auto indices = sac_model_->getIndices();
+        const int N = indices->size();
+        const int m = sac_model_->getSampleSize();
+        iterations_ = 0;
+        local_optimizations = 0;
+        inliers_.clear();
+        if (N < m) {
+            return false;
+        }
+        if (order.size() != N) {
+            //Without distances the input order is used
+            order.resize(N);
+            std::iota(order.begin(), order.end(), 0);
+        }
+        //Growth function: T_n is the expected number of samples from the first n matches among growth_max_samples uniform ones
+        int n = m;
+        double T_n = growth_max_samples;
+        for (int i = 0; i < m; i++) {
+            T_n *= (double)(n - i) / (N - i);
+        }
+        double T_n_prime = 1;
+        int best_count = -1;
+        int k = max_iterations_;
+        std::vector<int> sample(m), picked(m);
+        std::vector<int> inliers;
+        model_t model;
+        while (iterations_ < k && iterations_ < max_iterations_) {
+            iterations_++;
+            if (iterations_ > T_n_prime && n < N) {
+                double T_n_next = T_n * (n + 1) / (n + 1 - m);
+                T_n_prime += ceil(T_n_next - T_n);
+                T_n = T_n_next;
+                n++;
+            }
+            //m - 1 matches from the first n - 1 with the n-th, or m from the first n once the prefix is well sampled
+            int pool = T_n_prime < iterations_ ? n : n - 1;
+            int draw = T_n_prime < iterations_ ? m : m - 1;
+            std::uniform_int_distribution<int> uniform(0, pool - 1);
+            for (int i = 0; i < draw; i++) {
+                int j;
+                do {
+                    j = uniform(rng);
+                } while (std::find(picked.begin(), picked.begin() + i, j) != picked.begin() + i);
+                picked[i] = j;
+                sample[i] = (*indices)[order[j]];
+            }
+            if (draw < m) {
+                sample[m - 1] = (*indices)[order[n - 1]];
+            }
+            if (!sac_model_->isSampleGood(sample) || !sac_model_->computeModelCoefficients(sample, model)) {
+                continue;
+            }
+            int count = sac_model_->countWithinDistance(model, threshold_);
+            if (count <= best_count) {
+                continue;
+            }
+            best_count = count;
+            model_ = sample;
+            model_coefficients_ = model;
+            //Local optimization on the inliers of the new best model
+            if (count > m) {
+                sac_model_->selectWithinDistance(model, threshold_, inliers);
+                model_t optimized;
+                sac_model_->optimizeModelCoefficients(inliers, model, optimized);
+                int optimized_count = sac_model_->countWithinDistance(optimized, threshold_);
+                local_optimizations++;
+                if (optimized_count > best_count) {
+                    best_count = optimized_count;
+                    model_coefficients_ = optimized;
+                }
+            }
+            k = std::min(max_iterations_, terminationLength(n, m));
+        }
+        if (best_count < 0) {
+            return false;
+        }
+        sac_model_->selectWithinDistance(model_coefficients_, threshold_, inliers_);
+        return true;
+    }
+};
+
+}
@@ -39,6 +39,13 @@ cv::Point2f rotate_pt_norm2d(cv::Point2f pt, Eigen::Quaterniond q);
 void detectPoints(const cv::Mat & img, std::vector<cv::Point2f> & n_pts, std::vector<cv::Point2f> & cur_pts, int require_pts, 
     bool enable_cuda=true, bool use_fast=false, int fast_rows=3, int fast_cols=4);
 
+// FAST corners of cols x rows regions detected in parallel, the strongest of each region and then the top features overall
+std::vector<cv::Point2f> detectFastByRegion(cv::InputArray _img, cv::InputArray _mask, int features, int cols, int rows);
+
+// Candidates, in order, that are at least min_dist away from the existing points and the ones selected before, up to max_num
+std::vector<cv::Point2f> selectSparsePoints(const std::vector<cv::Point2f> & candidates, const std::vector<cv::Point2f> & existing,
+    double min_dist, int max_num);
+
 std::vector<cv::cuda::GpuMat> buildImagePyramid(const cv::cuda::GpuMat& prevImg, int maxLevel_=3);
 
 std::vector<cv::Point2f> opticalflowTrack(const cv::Mat & cur_img, const cv::Mat & prev_img, std::vector<cv::Point2f> & prev_pts, 
@@ -50,15 +57,39 @@ std::vector<cv::Point2f> opticalflowTrackPyr(const cv::Mat & cur_img, std::vecto
 std::vector<cv::DMatch> matchKNN(const cv::Mat & desc_a, const cv::Mat & desc_b, double knn_match_ratio=0.8,
         const std::vector<cv::Point2f> pts_a=std::vector<cv::Point2f>(),
         const std::vector<cv::Point2f> pts_b=std::vector<cv::Point2f>(),
-        double search_local_dist = -1);
+        double search_local_dist = -1, std::vector<float> * ratios = nullptr);
+
+struct MatchQuality {
+    int num = 0;
+    double mean_ratio = 1.0; //Of the best to the second best distance
+    double consistency = 1.0; //Ratio of matches close to the prediction, 1 without prediction
+    double score = 0.0; //In [0, 1]
+};
+
+// Confidence of a KNN matching from its size, ratio test margins and agreement with the predicted positions.
+// pts_pred_a may be empty when there is no prediction
+MatchQuality evaluateMatchQuality(const std::vector<cv::DMatch> & matches, const std::vector<float> & ratios,
+        const std::vector<cv::Point2f> & pts_pred_a, const std::vector<cv::Point2f> & pts_b,
+        double knn_match_ratio, int min_matches, double max_pred_dist);
     
 int computeRelativePosePnP(const std::vector<Vector3d> lm_positions_a, const std::vector<Vector3d> lm_3d_norm_b,
         Swarm::Pose extrinsic_b, Swarm::Pose drone_pose_a, Swarm::Pose drone_pose_b, Swarm::Pose & DP_b_to_a,
         std::vector<int> &inliers, bool is_4dof, bool verify_gravity=true);
+// With match_dists (descriptor distance of each correspondence, lower is better) the RANSAC is a PROSAC that samples
+// the best matches first and stops early; otherwise the uniform RANSAC
 Swarm::Pose computePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
-        const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, std::vector<int> &inliers);
+        const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, std::vector<int> &inliers,
+        const std::vector<float> & match_dists=std::vector<float>(), int * iterations=nullptr);
 int computeRelativePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
         const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, 
         Swarm::Pose drone_pose_a, Swarm::Pose drone_pose_b, Swarm::Pose & DP_b_to_a,
-        std::vector<int> &inliers, bool is_4dof, bool verify_gravity=true);
+        std::vector<int> &inliers, bool is_4dof, bool verify_gravity=true,
+        const std::vector<float> & match_dists=std::vector<float>());
+
+// Whether the odometry poses of two frames are comparable: the frames of one drone, or of drones sharing a reference frame
+bool sameReferenceFrame(int drone_id_a, int reference_frame_id_a, int drone_id_b, int reference_frame_id_b);
+// Squared Mahalanobis distance (x, y, z, yaw) of the relative pose predicted by the odometry to the relative poses a loop
+// is accepted at (accept_loop_max_pos and accept_loop_max_yaw). The drift of the odometry grows with travel (m), by
+// pos_covariance_per_meter and yaw_covariance_per_meter
+double loopPriorDistance(const Swarm::Pose & pose_a, const Swarm::Pose & pose_b, double travel);
 }
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+#include <d2common/bounded_queue.h>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace D2FrontEnd {
+//Renders snapshots on its own thread. The mailbox holds only the latest snapshot: when rendering is slower
+//than the producer, older snapshots are dropped, so submit never waits for rendering.
+template <typename T>
+class VisualizationSink {
+    D2Common::BoundedQueue<T> mailbox;
+    std::function<void(T &)> render;
+    std::thread th;
+    mutable std::mutex lock;
+    std::condition_variable rendered_cond;
+    size_t rendered = 0;
+public:
+    VisualizationSink(std::function<void(T &)> _render):
+        mailbox(1, D2Common::QueueFullPolicy::DropOldest), render(_render) {
+        th = std::thread([this] {
+            T snapshot;
+            while (mailbox.pop(snapshot)) {
+                render(snapshot);
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    rendered++;
+                }
+                rendered_cond.notify_all();
+            }
+        });
+    }
+
+    ~VisualizationSink() {
+        mailbox.close();
+        th.join();
+    }
+
+    void submit(T snapshot) {
+        mailbox.push(std::move(snapshot));
+    }
+
+    //Waits until every snapshot submitted so far is rendered or dropped
+    void flush() {
+        std::unique_lock<std::mutex> guard(lock);
+        rendered_cond.wait(guard, [&] { return rendered + mailbox.droppedCount() >= mailbox.pushedCount(); });
+    }
+
+    size_t submittedCount() const {
+        return mailbox.pushedCount();
+    }
+
+    size_t renderedCount() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return rendered;
+    }
+
+    size_t droppedCount() const {
+        return mailbox.droppedCount();
+    }
+};
+}
@@ -34,6 +34,192 @@ void getKeyPoints(const cv::Mat & prob, float threshold, int nms_dist, std::vect
 }
 
 
+struct KeypointCandidate {
+    float score;
+    int x;
+    int y;
+};
+
+static inline bool candidateGreater(const KeypointCandidate & a, const KeypointCandidate & b) {
+    return a.score > b.score;
+}
+
+//Min-heap on score holding the best capacity candidates
+static inline void pushBounded(std::vector<KeypointCandidate> & heap, const KeypointCandidate & c, int capacity) {
+    if (heap.size() < capacity) {
+        heap.push_back(c);
+        std::push_heap(heap.begin(), heap.end(), candidateGreater);
+    } else if (c.score > heap.front().score) {
+        std::pop_heap(heap.begin(), heap.end(), candidateGreater);
+        heap.back() = c;
+        std::push_heap(heap.begin(), heap.end(), candidateGreater);
+    }
+}
+
+static inline bool isLocalMax(const cv::Mat & prob, int x, int y, float v, int r) {
+    int x0 = std::max(x - r, 0), x1 = std::min(x + r, prob.cols - 1);
+    int y0 = std::max(y - r, 0), y1 = std::min(y + r, prob.rows - 1);
+    for (int yy = y0; yy <= y1; yy++) {
+        const float * row = prob.ptr<float>(yy);
+        for (int xx = x0; xx <= x1; xx++) {
+            if (row[xx] > v) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void getKeyPointsGrid(const cv::Mat & prob, float threshold, int nms_dist, int grid_rows, int grid_cols,
+        std::vector<cv::Point2f> &keypoints, std::vector<float>& scores, int max_num) {
+    TicToc tic;
+    keypoints.clear();
+    scores.clear();
+    const int width = prob.cols, height = prob.rows;
+    grid_rows = std::max(std::min(grid_rows, height), 1);
+    grid_cols = std::max(std::min(grid_cols, width), 1);
+    const int cells = grid_rows * grid_cols;
+    if (max_num <= 0) {
+        return;
+    }
+    const int cell_quota = std::max(max_num / cells, 1);
+    //The global fill of the budget left by sparse cells may take all of it from a single cell
+    const int capacity = max_num;
+    //Split each grid row into bands of rows, every band owns its heaps so they are filled without locking
+    const int band_rows = 16;
+    std::vector<std::pair<int, int>> bands;
+    std::vector<int> band_grid_row;
+    for (int gr = 0; gr < grid_rows; gr++) {
+        int y_end = (gr + 1) * height / grid_rows;
+        for (int y = gr * height / grid_rows; y < y_end; y += band_rows) {
+            bands.emplace_back(y, std::min(y + band_rows, y_end));
+            band_grid_row.push_back(gr);
+        }
+    }
+    std::vector<std::vector<KeypointCandidate>> heaps(bands.size() * grid_cols);
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < bands.size(); i++) {
+        auto * band_heaps = heaps.data() + i * grid_cols;
+        for (int y = bands[i].first; y < bands[i].second; y++) {
+            const float * row = prob.ptr<float>(y);
+            for (int x = 0; x < width; x++) {
+                float v = row[x];
+                if (v <= threshold || !isLocalMax(prob, x, y, v, nms_dist)) {
+                    continue;
+                }
+                pushBounded(band_heaps[x * grid_cols / width], KeypointCandidate{v, x, y}, capacity);
+            }
+        }
+    }
+    //Merge the bands of each cell, take the quota of every cell then fill the rest with the best leftovers
+    std::vector<std::vector<KeypointCandidate>> cell_candidates(cells);
+    for (int i = 0; i < bands.size(); i++) {
+        for (int gc = 0; gc < grid_cols; gc++) {
+            auto & cell = cell_candidates[band_grid_row[i] * grid_cols + gc];
+            cell.insert(cell.end(), heaps[i * grid_cols + gc].begin(), heaps[i * grid_cols + gc].end());
+        }
+    }
+    std::vector<KeypointCandidate> selected, leftovers;
+    for (auto & cell : cell_candidates) {
+        std::sort(cell.begin(), cell.end(), candidateGreater);
+        if (cell.size() > capacity) {
+            cell.resize(capacity);
+        }
+        int num = std::min((int)cell.size(), cell_quota);
+        selected.insert(selected.end(), cell.begin(), cell.begin() + num);
+        leftovers.insert(leftovers.end(), cell.begin() + num, cell.end());
+    }
+    std::sort(leftovers.begin(), leftovers.end(), candidateGreater);
+    for (unsigned int i = 0; i < leftovers.size() && selected.size() < max_num; i++) {
+        selected.push_back(leftovers[i]);
+    }
+    std::stable_sort(selected.begin(), selected.end(), candidateGreater);
+    if (selected.size() > max_num) {
+        selected.resize(max_num);
+    }
+    keypoints.reserve(selected.size());
+    scores.reserve(selected.size());
+    for (auto & c : selected) {
+        keypoints.emplace_back(c.x, c.y);
+        scores.push_back(c.score);
+    }
+    if (params->enable_perf_output) {
+        printf(" getKeyPointsGrid %fms keypoints %ld/%d grid %dx%d\n", tic.toc(), keypoints.size(), max_num, grid_rows, grid_cols);
+    }
+}
+
+
+void computeDescriptors(const float * desc_map, const std::vector<cv::Point2f> &keypoints, 
+        std::vector<float> & local_descriptors, int width, int height, 
+        const Eigen::MatrixXf & pca_comp_T, const Eigen::RowVectorXf & pca_mean) {
+    TicToc tic;
+    const int num = keypoints.size();
+    const int channels = SP_DESC_RAW_LEN;
+    const int map_w = width/8, map_h = height/8;
+    const int plane_size = map_w * map_h;
+    //Visit keypoints row by row so each channel plane is read almost sequentially
+    std::vector<int> order(num);
+    for (int i = 0; i < num; i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return keypoints[a].y < keypoints[b].y || (keypoints[a].y == keypoints[b].y && keypoints[a].x < keypoints[b].x);
+    });
+    //Corner offsets and weights, with the same arithmetic as grid_sampler (align_corners=false, zero padding)
+    std::vector<int> offsets(num*4, 0);
+    std::vector<float> weights(num*4, 0.0f);
+    for (int k = 0; k < num; k++) {
+        auto & pt = keypoints[order[k]];
+        float gx = 2.0f * pt.x / width - 1;
+        float gy = 2.0f * pt.y / height - 1;
+        float ix = ((gx + 1) * map_w - 1) / 2;
+        float iy = ((gy + 1) * map_h - 1) / 2;
+        int ix_nw = std::floor(ix), iy_nw = std::floor(iy);
+        float tx = ix - ix_nw, ty = iy - iy_nw;
+        int xs[4] = {ix_nw, ix_nw + 1, ix_nw, ix_nw + 1};
+        int ys[4] = {iy_nw, iy_nw, iy_nw + 1, iy_nw + 1};
+        float ws[4] = {(1 - tx) * (1 - ty), tx * (1 - ty), (1 - tx) * ty, tx * ty};
+        for (int j = 0; j < 4; j++) {
+            if (xs[j] >= 0 && xs[j] < map_w && ys[j] >= 0 && ys[j] < map_h) {
+                offsets[k*4 + j] = ys[j] * map_w + xs[j];
+                weights[k*4 + j] = ws[j];
+            }
+        }
+    }
+    //desc is channels x num, column k is the descriptor of keypoint order[k].
+    //The map is channel-planar, so vectorizing over the channels needs the map transposed to channel-last or the
+    //corner cells gathered first; both measured 2-10x slower than this loop, which walks one cached plane at a time
+    Eigen::MatrixXf desc(channels, num);
+    for (int c = 0; c < channels; c++) {
+        const float * plane = desc_map + c * plane_size;
+        for (int k = 0; k < num; k++) {
+            const int * o = offsets.data() + k*4;
+            const float * w = weights.data() + k*4;
+            desc(c, k) = w[0] * plane[o[0]] + w[1] * plane[o[1]] + w[2] * plane[o[2]] + w[3] * plane[o[3]];
+        }
+    }
+    //As torch::norm(desc, 2, 1) on the [C, N] tensor of the torch path: each channel is normalized across the
+    //keypoints, then each descriptor is normalized after the PCA. PCA components and remote descriptors rely on it
+    desc.array().colwise() /= desc.rowwise().norm().array();
+    Eigen::MatrixXf desc_out;
+    if (pca_comp_T.size() > 0) {
+        desc_out.noalias() = pca_comp_T.transpose() * (desc.colwise() - pca_mean.transpose());
+    } else {
+        desc_out = std::move(desc);
+    }
+    desc_out.colwise().normalize();
+    //Scatter back to the order of keypoints
+    const int dims = desc_out.rows();
+    local_descriptors.resize(num * dims);
+    for (int k = 0; k < num; k++) {
+        memcpy(local_descriptors.data() + order[k] * dims, desc_out.col(k).data(), dims * sizeof(float));
+    }
+    if (params->enable_perf_output) {
+        std::cout << " computeDescriptors full " << tic.toc() << std::endl;
+    }
+}
+
+#ifdef USE_TORCH
 void computeDescriptors(const torch::Tensor & mProb, const torch::Tensor & mDesc, 
         const std::vector<cv::Point2f> &keypoints, 
         std::vector<float> & local_descriptors, int width, int height, 
@@ -82,6 +268,7 @@ void computeDescriptors(const torch::Tensor & mProb, const torch::Tensor & mDesc
         std::cout << " computeDescriptors full " << tic.toc() << std::endl;
     }
 }
+#endif
 
 bool pt_conf_comp(std::pair<cv::Point2f, double> i1, std::pair<cv::Point2f, double> i2)
 {
@@ -2,7 +2,9 @@
 #include <d2frontend/d2frontend_params.h>
 #include <d2frontend/CNN/superpoint_common.h>
 #include <d2frontend/utils.h>
+#ifdef USE_TORCH
 #include "ATen/Parallel.h"
+#endif
 #include "d2common/utils.hpp"
 using D2Common::Utility::TicToc;
 
@@ -13,29 +15,16 @@ SuperPointONNX::SuperPointONNX(std::string engine_path,
     std::string _pca_mean,
     int _width, int _height, 
     float _thres, int _max_num, 
-    bool use_tensorrt, bool use_fp16, bool use_int8, std::string int8_calib_table_name):
-        ONNXInferenceGeneric(engine_path, "image", "semi", _width, _height, use_tensorrt, use_fp16, use_int8, int8_calib_table_name),
-        output_shape_semi_{1, _height, _width},
-        output_shape_desc_{1, SP_DESC_RAW_LEN, _height/8, _width/8},
-        input_shape_{1, 1, _height, _width},
+    const ONNXInferenceConfig & onnx_config):
+        ONNXInferenceGeneric(engine_path, "image", {"semi", "desc"}, _width, _height, onnx_config),
         thres(_thres),
         max_num(_max_num),
         nms_dist(_nms_dist) {
+#ifdef USE_TORCH
     at::set_num_threads(1);
+#endif
     std::cout << "Init SuperPointONNX: " << engine_path << " size " << _width << " " << _height << std::endl;
-
-    input_image = new float[_width*_height];
-    auto memory_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
-    input_tensor_ = Ort::Value::CreateTensor<float>(memory_info, input_image, width*height, input_shape_.data(), 4);
-
-    results_desc_ = new float[1*SP_DESC_RAW_LEN*height/8*width/8];
-    results_semi_ = new float[width*height];
-    //semi
-    output_tensors_.emplace_back(Ort::Value::CreateTensor<float>(memory_info,
-        results_semi_, height*width, output_shape_semi_.data(), output_shape_semi_.size()));
-    //desc
-    output_tensors_.emplace_back(Ort::Value::CreateTensor<float>(memory_info,
-        results_desc_, SP_DESC_RAW_LEN*height/8*width/8, output_shape_desc_.data(), output_shape_desc_.size()));
+    bindBatch(1);
     if (params->enable_pca_superpoint) {
         pca_comp_T = load_csv_mat_eigen(_pca_comp).transpose();
         pca_mean = load_csv_vec_eigen(_pca_mean).transpose();
@@ -45,18 +34,14 @@ SuperPointONNX::SuperPointONNX(std::string engine_path,
     }
 }
 
-void SuperPointONNX::doInference(const unsigned char* input, const uint32_t batchSize) {
-    const char* input_names[] = {m_InputBlobName.c_str()};
-    const char* output_names_[] = {"semi", "desc"};
-    memcpy(input_image, input, width*height*sizeof(float));
-    session_->Run(Ort::RunOptions{nullptr}, input_names, &input_tensor_, 1, output_names_, output_tensors_.data(), 2);
+void SuperPointONNX::bindBatch(int batch) {
+    if (bound_batch_ != batch) {
+        bindTensors({batch, 1, height, width}, {{batch, height, width}, {batch, SP_DESC_RAW_LEN, height/8, width/8}});
+    }
 }
 
-void SuperPointONNX::inference(const cv::Mat & input, std::vector<cv::Point2f> & keypoints, std::vector<float> & local_descriptors, std::vector<float> & scores) {
-    TicToc tic;
+void SuperPointONNX::preprocess(const cv::Mat & input, float * dst) const {
     cv::Mat _input;
-    keypoints.clear();
-    local_descriptors.clear();
     assert(input.rows == height && input.cols == width && "Input image must have same size with network");
     if (input.channels() == 3) {
         cv::cvtColor(input, _input, cv::COLOR_BGR2GRAY);
@@ -66,26 +51,65 @@ void SuperPointONNX::inference(const cv::Mat & input, std::vector<cv::Point2f> &
     if (_input.rows != height || _input.cols != width) {
         cv::resize(_input, _input, cv::Size(width, height));
     } 
-    _input.convertTo(_input, CV_32F, 1/255.0);
-    ((CNNInferenceGeneric*) this)->doInference(_input);
-    double inference_time = tic.toc();
-
-    TicToc tic1;
-    auto options = torch::TensorOptions().dtype(torch::kFloat32);
-    
-    auto mProb = at::from_blob(results_semi_, {1, 1, height, width}, options);
-    auto mDesc = at::from_blob(results_desc_, {1, SP_DESC_RAW_LEN, height/8, width/8}, options);
-    cv::Mat Prob(height, width, CV_32F, results_semi_);
-    double copy_time = tic1.toc();
+    cv::Mat input_bound(height, width, CV_32F, dst);
+    _input.convertTo(input_bound, CV_32F, 1/255.0);
+}
 
+void SuperPointONNX::postprocess(float * results_semi, float * results_desc, std::vector<cv::Point2f> & keypoints, 
+        std::vector<float> & local_descriptors, std::vector<float> & scores) {
+    keypoints.clear();
+    local_descriptors.clear();
+    scores.clear();
+    cv::Mat Prob(height, width, CV_32F, results_semi);
     TicToc tic2;
-    getKeyPoints(Prob, thres, nms_dist, keypoints, scores, width, height, max_num);
+    getKeyPointsGrid(Prob, thres, nms_dist, grid_rows, grid_cols, keypoints, scores, max_num);
     double nms_time = tic2.toc();
-    computeDescriptors(mProb, mDesc, keypoints, local_descriptors, width, height, pca_comp_T, pca_mean);
+    computeDescriptors(results_desc, keypoints, local_descriptors, width, height, pca_comp_T, pca_mean);
     double desc_time = tic2.toc();
     if (params->enable_perf_output) {
-        printf("[SuperPointONNX] inference time: %f ms, copy time: %f ms, nms time: %f ms, desc time: %f ms\n", 
-            inference_time, copy_time, nms_time, desc_time);
+        printf("[SuperPointONNX] nms time: %f ms, desc time: %f ms\n", nms_time, desc_time);
+    }
+}
+
+void SuperPointONNX::inference(const cv::Mat & input, std::vector<cv::Point2f> & keypoints, std::vector<float> & local_descriptors, std::vector<float> & scores) {
+    TicToc tic;
+    bindBatch(1);
+    preprocess(input, inputBuffer());
+    run();
+    double inference_time = tic.toc();
+    postprocess(output_buffers_[0].data(), output_buffers_[1].data(), keypoints, local_descriptors, scores);
+    if (params->enable_perf_output) {
+        printf("[SuperPointONNX] inference time: %f ms\n", inference_time);
+    }
+}
+
+void SuperPointONNX::inference(const std::vector<cv::Mat> & inputs, std::vector<std::vector<cv::Point2f>> & keypoints, 
+        std::vector<std::vector<float>> & local_descriptors, std::vector<std::vector<float>> & scores) {
+    int batch = inputs.size();
+    keypoints.resize(batch);
+    local_descriptors.resize(batch);
+    scores.resize(batch);
+    if (!supportsBatch() || batch <= 1) {
+        for (int i = 0; i < batch; i++) {
+            inference(inputs[i], keypoints[i], local_descriptors[i], scores[i]);
+        }
+        return;
+    }
+    TicToc tic;
+    bindBatch(batch);
+    int semi_size = height*width;
+    int desc_size = SP_DESC_RAW_LEN*height/8*width/8;
+    for (int i = 0; i < batch; i++) {
+        preprocess(inputs[i], inputBuffer() + i*semi_size);
+    }
+    run();
+    double inference_time = tic.toc();
+    for (int i = 0; i < batch; i++) {
+        postprocess(output_buffers_[0].data() + i*semi_size, output_buffers_[1].data() + i*desc_size,
+            keypoints[i], local_descriptors[i], scores[i]);
+    }
+    if (params->enable_perf_output) {
+        printf("[SuperPointONNX] batch %d inference time: %f ms\n", batch, inference_time);
     }
 }
 }
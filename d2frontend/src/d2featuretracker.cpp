@@ -1,5 +1,6 @@
 #include <d2frontend/d2featuretracker.h>
 #include <camodocal/camera_models/Camera.h>
+#include <camodocal/camera_models/BearingLUT.h>
 #include <d2frontend/CNN/superglue_onnx.h>
 #include <d2common/d2vinsframe.h>
 #include <d2frontend/utils.h>
@@ -13,6 +14,7 @@ namespace D2FrontEnd {
 D2FeatureTracker::D2FeatureTracker(D2FTConfig config):
     _config(config) {
     lmanager = new LandmarkManager;
+    lmanager->setRetention(_config.landmark_retention);
     if (config.enable_superglue_local || config.enable_superglue_remote) {
         superglue = new SuperGlueOnnx(config.superglue_model_path);
     }
@@ -25,12 +27,22 @@ D2FeatureTracker::D2FeatureTracker(D2FTConfig config):
     }
     search_radius = _config.search_local_max_dist*image_width;
     reference_frame_id = params->self_id;
+    keyframe_descs.setDims(params->netvlad_dims);
+    if (params->show) {
+        viz_sink = new VisualizationSink<TrackVizFrame>([this] (TrackVizFrame & frame) {
+            renderFrame(frame);
+        });
+    }
+}
+
+D2FeatureTracker::~D2FeatureTracker() {
+    delete viz_sink;
 }
 
 void D2FeatureTracker::updatebySldWin(const std::vector<VINSFrame*> sld_win) {
     //update by sliding window
-    const Guard lock(keyframe_lock);
-    const Guard guard2(lmanager_lock);
+    const UniqueGuard lock(keyframe_lock);
+    const UniqueGuard guard2(lmanager_lock);
     if (current_keyframes.size() == 0 || sld_win.size() == 0)
         return;
     std::map<FrameIdType, Swarm::Pose> sld_win_poses;
@@ -38,13 +50,17 @@ void D2FeatureTracker::updatebySldWin(const std::vector<VINSFrame*> sld_win) {
         sld_win_poses[frame->frame_id] = frame->odom.pose();
     }
     reference_frame_id = sld_win.back()->reference_frame_id;
+    std::vector<LandmarkIdType> removed;
     //Remove the keyframe not in the sliding window except the last one
     for (auto it = current_keyframes.begin(); it != current_keyframes.end();) {
         if (sld_win_poses.find(it->frame_id) == sld_win_poses.end() && it->frame_id != current_keyframes.back().frame_id) {
             if (current_keyframes.size() <= 1 ) {
                 it++;
             } else {
-                lmanager->popFrame(it->frame_id);
+                for (auto & lm : lmanager->popFrame(it->frame_id)) {
+                    removed.push_back(lm.landmark_id);
+                }
+                keyframe_descs.removeFrame(it->frame_id);
                 it = current_keyframes.erase(it);
             }
         } else {
@@ -57,11 +73,14 @@ void D2FeatureTracker::updatebySldWin(const std::vector<VINSFrame*> sld_win) {
             it++;
         }
     }
+    if (_config.landmark_retention.enabled()) {
+        compactRemoteIds(removed);
+    }
 }
 
 void D2FeatureTracker::updatebyLandmarkDB(const std::map<LandmarkIdType, LandmarkPerId> & vins_landmark_db) {
     //update by sliding window
-    const Guard guard2(lmanager_lock);
+    const UniqueGuard guard2(lmanager_lock);
     if (_config.enable_motion_prediction_local || _config.enable_search_local_aera_remote) {
         auto & db = lmanager->getLandmarkDB();
         for (auto & kv : vins_landmark_db) {
@@ -74,15 +93,25 @@ void D2FeatureTracker::updatebyLandmarkDB(const std::map<LandmarkIdType, Landmar
     }
 }
 
+std::mutex & D2FeatureTracker::remoteDroneLock(int drone_id) {
+    const std::lock_guard<std::mutex> lock(remote_drone_locks_lock);
+    auto & drone_lock = remote_drone_locks[drone_id];
+    if (!drone_lock) {
+        drone_lock.reset(new std::mutex);
+    }
+    return *drone_lock;
+}
+
 bool D2FeatureTracker::trackLocalFrames(VisualImageDescArray & frames) {
-    const Guard lock(track_lock);
-    const Guard guard(keyframe_lock);
-    const Guard guard2(lmanager_lock);
+    const std::lock_guard<std::mutex> lock(local_track_lock);
     bool iskeyframe = false;
-    frame_count ++;
+    int count = ++frame_count;
     TrackReport report;
-    landmark_predictions_viz.clear();
-    frames.send_to_backend = (frame_count % _config.frame_step) == 0;
+    {
+        const std::lock_guard<std::mutex> guard(viz_lock);
+        landmark_predictions_viz.clear();
+    }
+    frames.send_to_backend = (count % _config.frame_step) == 0;
     TicToc tic;
     if (!inited) {
         inited = true;
@@ -91,6 +120,9 @@ bool D2FeatureTracker::trackLocalFrames(VisualImageDescArray & frames) {
         frames.send_to_backend = true;
     }
 
+    //Keyframes are only read here, remote frames can be matched against them meanwhile
+    SharedGuard kf_guard(keyframe_lock);
+    UniqueGuard lm_guard(lmanager_lock);
     if (params->camera_configuration == CameraConfig::STEREO_PINHOLE) {
         report.compose(track(frames.images[0], frames.motion_prediction));
         report.compose(track(frames.images[0], frames.images[1]));
@@ -111,17 +143,27 @@ bool D2FeatureTracker::trackLocalFrames(VisualImageDescArray & frames) {
     if (isKeyframe(report) && frames.send_to_backend) {
         iskeyframe = true;
     }
+    lm_guard.unlock();
+    kf_guard.unlock();
     processFrame(frames, iskeyframe);
     report.ft_time = tic.toc();
     if (params->verbose || params->enable_perf_output)
-        printf("[D2FeatureTracker] frame_id: %d, landmark_num: %d, time_cost: %.1fms\n", frames.frame_id, frames.landmarkNum(), report.ft_time);
+        printf("[D2FeatureTracker] frame_id: %d, landmark_num: %d, time_cost: %.1fms superglue %d skipped %d\n", frames.frame_id, frames.landmarkNum(), 
+            report.ft_time, report.superglue_num, report.superglue_skipped_num);
+    if (params->enable_perf_output && count % 100 == 0) {
+        auto stats = memoryStats();
+        printf("[D2FeatureTracker] memory: %ld landmarks %ld observations %ld frames %.1fMB, evicted %ld, keyframes %ld, remote ids %ld/%ld\n",
+            stats.landmarks.landmark_num, stats.landmarks.observation_num, stats.landmarks.frame_num, stats.landmarks.bytes / 1048576.0,
+            stats.landmarks.evicted_num, stats.keyframe_num, stats.remote_to_local_num, stats.local_to_remote_num);
+    }
     if (params->show) {
+        const SharedGuard guard(keyframe_lock);
+        const SharedGuard guard2(lmanager_lock);
         if (params->camera_configuration == CameraConfig::STEREO_PINHOLE) {
             draw(frames.images[0], frames.images[1], iskeyframe, report);
         } else if (params->camera_configuration == CameraConfig::PINHOLE_DEPTH) {
-            for (auto & frame : frames.images) {
-                draw(frame, iskeyframe, report);
-            }
+            //One snapshot for all the cameras, the sink only keeps the latest
+            draw(frames, iskeyframe, report, TrackVizFrame::SIDE_BY_SIDE);
         } else if (params->camera_configuration == CameraConfig::FOURCORNER_FISHEYE) {
             draw(frames, iskeyframe, report);
         }
@@ -130,56 +172,38 @@ bool D2FeatureTracker::trackLocalFrames(VisualImageDescArray & frames) {
 }
 
 bool D2FeatureTracker::getMatchedPrevKeyframe(const VisualImageDescArray & frame_a, VisualImageDescArray& prev, int & dir_a, int & dir_b) {
-    const Guard lock(keyframe_lock);
+    const SharedGuard lock(keyframe_lock);
     if (current_keyframes.size() == 0) {
         return false;
     }
+    //The remote frame is matched by one camera against all cameras of the keyframes, in this order
+    std::vector<int> dirs;
     if (params->camera_configuration == CameraConfig::STEREO_PINHOLE || params->camera_configuration == CameraConfig::PINHOLE_DEPTH) {
-        //Reverse seach in current keyframes
-        for (int i = current_keyframes.size() - 1; i >= 0; i--) {
-            const auto & last = current_keyframes[i];
-            if (frame_a.images.size() == 0 ||
-                frame_a.images[0].image_desc.size() != params->netvlad_dims) {
-                ROS_ERROR("[D2FeatureTracker::trackRemote] Warn: no vaild frame.image_desc.size() frame_id %ld ", frame_a.frame_id);
-                return false;
-            }
-            const Map<const VectorXf> vlad_desc_remote(frame_a.images[0].image_desc.data(), params->netvlad_dims);
-            const Map<const VectorXf> vlad_desc(last.images[0].image_desc.data(), params->netvlad_dims);
-            double netvlad_similar = vlad_desc.dot(vlad_desc_remote);
-            if (netvlad_similar < params->track_remote_netvlad_thres) {
-                // if (params->verbose)
-                //     printf("[D2FeatureTracker::trackRemote@%d] Remote image does not match current image %.2f/%.2f\n", params->self_id, netvlad_similar, params->track_remote_netvlad_thres);
-            } else {
-                if (params->verbose)
-                    printf("[D2FeatureTracker::trackRemote@%d] Remote image match image %d(%ld) %.2f/%.2f\n", params->self_id,
-                            i, last.frame_id, netvlad_similar, params->track_remote_netvlad_thres);
-                prev = last;
-                dir_a = 0;
-                dir_b = 0;
-                return true;
-            }
-        }
-    }
-    if (params->camera_configuration == CameraConfig::FOURCORNER_FISHEYE) {
-        std::vector<int> dirs{2, 3, 0, 1};
+        dir_a = 0;
+        dirs = {0};
+    } else if (params->camera_configuration == CameraConfig::FOURCORNER_FISHEYE) {
         dir_a = 2;
-        // printf("[D2FeatureTracker::getMatchedPrevKeyframe] Remote frame %ld view 2/%ld: gdesc %ld\n", frame_a.frame_id, frame_a.images.size(), frame_a.images[2].image_desc.size());
-        const Map<const VectorXf> vlad_desc_remote(frame_a.images[2].image_desc.data(), params->netvlad_dims);
+        dirs = {2, 3, 0, 1};
+    } else {
+        return false;
+    }
+    if (frame_a.images.size() <= dir_a || frame_a.images[dir_a].image_desc.size() != params->netvlad_dims) {
+        ROS_ERROR("[D2FeatureTracker::trackRemote] Warn: no vaild frame.image_desc.size() frame_id %ld ", frame_a.frame_id);
+        return false;
+    }
+    //One GEMM over all keyframe descriptors, then the newest keyframe above the threshold
+    auto candidates = keyframe_descs.matchNewest(frame_a.images[dir_a].image_desc.data(), 1,
+            params->track_remote_netvlad_thres, 1, dirs);
+    for (auto & candidate : candidates) {
         for (int i = current_keyframes.size() - 1; i >= 0; i--) {
-            const auto & last = current_keyframes[i];
-            for (int j = 0; j < last.images.size(); j++) {
-                const Map<const VectorXf> vlad_desc(last.images[dirs[j]].image_desc.data(), params->netvlad_dims);
-                double netvlad_similar = vlad_desc.dot(vlad_desc_remote);
-                if (netvlad_similar < params->track_remote_netvlad_thres) {
-                } else {
-                    prev = last;
-                    dir_b = dirs[j];
-                    if (params->verbose) {
-                        printf("[D2FeatureTracker::trackRemote@%d] Remote image match image drone %d(%ld) dir %d:%d %.2f/%.2f\n", params->self_id,
-                                i, last.frame_id, dir_a, dir_b, netvlad_similar, params->track_remote_netvlad_thres);
-                    }
-                    return true;
+            if (current_keyframes[i].frame_id == candidate.frame_id) {
+                prev = current_keyframes[i];
+                dir_b = candidate.image_index;
+                if (params->verbose) {
+                    printf("[D2FeatureTracker::trackRemote@%d] Remote image match image %d(%ld) dir %d:%d %.2f/%.2f\n", params->self_id,
+                            i, candidate.frame_id, dir_a, dir_b, candidate.similarity, params->track_remote_netvlad_thres);
                 }
+                return true;
             }
         }
     }
@@ -187,13 +211,13 @@ bool D2FeatureTracker::getMatchedPrevKeyframe(const VisualImageDescArray & frame
 }
 
 bool D2FeatureTracker::trackRemoteFrames(VisualImageDescArray & frames) {
-    const Guard lock(track_lock);
     if (frames.is_lazy_frame || frames.matched_frame >= 0) {
         printf("[D2FeatureTracker::trackRemoteFrames] lazy frame or matched frame, skip\n");
         return false;
     }
+    //Frames from different drones are tracked in parallel
+    const std::lock_guard<std::mutex> lock(remoteDroneLock(frames.drone_id));
     bool matched = false;
-    landmark_predictions_viz.clear();
     frame_count ++;
     TrackReport report;
     TicToc tic;
@@ -234,12 +258,15 @@ bool D2FeatureTracker::trackRemoteFrames(VisualImageDescArray & frames) {
     }
     if (params->show && params->send_whole_img_desc && params->send_img) {
         if (params->camera_configuration == CameraConfig::STEREO_PINHOLE) {
+            const SharedGuard guard(keyframe_lock);
+            const SharedGuard guard2(lmanager_lock);
             drawRemote(frames, report);
         }
     }
     report.ft_time = tic.toc();
     if (params->verbose || params->enable_perf_output)
-        printf("[D2FeatureTracker::trackRemoteFrames] frame %ld, matched %d, time %.2fms\n", frames.frame_id, report.remote_matched_num, report.ft_time);
+        printf("[D2FeatureTracker::trackRemoteFrames] frame %ld, matched %d, time %.2fms superglue %d skipped %d\n", frames.frame_id, 
+            report.remote_matched_num, report.ft_time, report.superglue_num, report.superglue_skipped_num);
     if (report.remote_matched_num > 0) {
         return true;
     } else {
@@ -250,9 +277,12 @@ bool D2FeatureTracker::trackRemoteFrames(VisualImageDescArray & frames) {
 TrackReport D2FeatureTracker::trackRemote(VisualImageDesc & frame, const VisualImageDesc & prev_frame, 
         bool use_motion_predict, const Swarm::Pose & motion_prediction) {
     TrackReport report;
-    if (current_keyframes.size() == 0) {
-        printf("[D2FeatureTracker::trackRemote] waiting for initialization.\n");
-        return report;
+    {
+        const SharedGuard guard(keyframe_lock);
+        if (current_keyframes.size() == 0) {
+            printf("[D2FeatureTracker::trackRemote] waiting for initialization.\n");
+            return report;
+        }
     }
     if (prev_frame.frame_id != frame.frame_id) {
         //Then current keyframe has been assigned, feature tracker by LK.
@@ -266,11 +296,23 @@ TrackReport D2FeatureTracker::trackRemote(VisualImageDesc & frame, const VisualI
         match_param.type = WHOLE_IMG_MATCH;
         match_param.search_radius = search_radius*2; // search radius is 100% larger
         match_param.plot = false;
-        bool success = matchLocalFeatures(prev_frame, frame, ids_b_to_a, match_param);
+        bool success;
+        MatchDecision decision;
+        if (use_motion_predict) {
+            //The prediction reads the local landmark positions
+            const SharedGuard guard(lmanager_lock);
+            success = matchLocalFeatures(prev_frame, frame, ids_b_to_a, match_param, &decision);
+        } else {
+            success = matchLocalFeatures(prev_frame, frame, ids_b_to_a, match_param, &decision);
+        }
+        if (match_param.enable_superglue) {
+            report.addDecision(decision);
+        }
         if (!success) {
             printf("[D2FeatureTracker::trackRemote] matchLocalFeatures failed.\n");
             return report;
         }
+        const UniqueGuard guard(remote_id_lock);
         for (size_t i = 0; i < ids_b_to_a.size(); i++) { 
             if (ids_b_to_a[i] >= 0) {
                 assert(ids_b_to_a[i] < prev_frame.landmarkNum() && "too large");
@@ -309,6 +351,7 @@ TrackReport D2FeatureTracker::trackRemote(VisualImageDesc & frame, const VisualI
 }
 
 void D2FeatureTracker::cvtRemoteLandmarkId(VisualImageDesc & frame) const {
+    const SharedGuard guard(remote_id_lock);
     int count = 0;
     for (auto & lm : frame.landmarks) {
         if (lm.landmark_id > 0 && remote_to_local.find(lm.landmark_id) != remote_to_local.end()) {
@@ -320,6 +363,37 @@ void D2FeatureTracker::cvtRemoteLandmarkId(VisualImageDesc & frame) const {
     // printf("[D2FeatureTracker::cvtRemoteLandmarkId] Remote eff stereo %d\n", count);
 }
 
+void D2FeatureTracker::compactRemoteIds(const std::vector<LandmarkIdType> & removed) {
+    //Drop the associations of local landmarks that are no longer in the landmark manager
+    if (removed.empty()) {
+        return;
+    }
+    const UniqueGuard guard(remote_id_lock);
+    std::unordered_set<LandmarkIdType> removed_set(removed.begin(), removed.end());
+    for (auto landmark_id : removed) {
+        local_to_remote.erase(landmark_id);
+    }
+    for (auto it = remote_to_local.begin(); it != remote_to_local.end();) {
+        if (removed_set.find(it->second) != removed_set.end()) {
+            it = remote_to_local.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+TrackerMemoryStats D2FeatureTracker::memoryStats() const {
+    TrackerMemoryStats stats;
+    const SharedGuard guard(keyframe_lock);
+    const SharedGuard guard2(lmanager_lock);
+    const SharedGuard guard3(remote_id_lock);
+    stats.landmarks = lmanager->memoryStats();
+    stats.keyframe_num = current_keyframes.size();
+    stats.remote_to_local_num = remote_to_local.size();
+    stats.local_to_remote_num = local_to_remote.size();
+    return stats;
+}
+
 
 TrackReport D2FeatureTracker::track(VisualImageDesc & frame, const Swarm::Pose & motion_prediction) {
     TrackReport report;
@@ -335,7 +409,11 @@ TrackReport D2FeatureTracker::track(VisualImageDesc & frame, const Swarm::Pose &
         match_param.pose_b_prediction = motion_prediction;
         match_param.search_radius = search_radius;
         match_param.enable_search_in_local = true;
-        matchLocalFeatures(previous, frame, ids_b_to_a, match_param);
+        MatchDecision decision;
+        matchLocalFeatures(previous, frame, ids_b_to_a, match_param, &decision);
+        if (match_param.enable_superglue) {
+            report.addDecision(decision);
+        }
         for (size_t i = 0; i < ids_b_to_a.size(); i++) { 
             if (ids_b_to_a[i] >= 0) {
                 assert(ids_b_to_a[i] < previous.spLandmarkNum() && "too large");
@@ -347,7 +425,11 @@ TrackReport D2FeatureTracker::track(VisualImageDesc & frame, const Swarm::Pose &
                 cur_lm.velocity = cur_lm.pt3d_norm - prev_lm.pt3d_norm;
                 cur_lm.velocity /= (frame.stamp - current_keyframe.stamp);
                 cur_lm.stamp_discover = prev_lm.stamp_discover;
-                lmanager->updateLandmark(cur_lm);
+                if (!lmanager->updateLandmark(cur_lm)) {
+                    //Evicted, observed again as a new landmark
+                    cur_lm.landmark_id = -1;
+                    continue;
+                }
                 report.sum_parallex += (prev_lm.pt3d_norm - cur_lm.pt3d_norm).norm();
                 // printf("[D2FeatureTracker::track] landmark %ld cam_idx %d<->%d frame_cam_idx %d<->%d parallex %.1f%% prev_2d %.1f %.1f cur_2d %.3f %.3f prev_3d %.3f %.3f %.3f cur_3d %.3f %.3f %.3f\n", 
                 //     landmark_id, prev_lm.camera_index, cur_lm.camera_index, previous.camera_index, frame.camera_index,
@@ -391,6 +473,13 @@ TrackReport D2FeatureTracker::trackLK(VisualImageDesc & frame) {
     }
     auto cur_all_pts = frame.landmarks2D();
     cur_all_pts.insert(cur_all_pts.end(), cur_lk_pts.begin(), cur_lk_pts.end());
+    //Drop the points of evicted landmarks
+    std::vector<unsigned char> alive(cur_lk_ids.size());
+    for (size_t i = 0; i < cur_lk_ids.size(); i++) {
+        alive[i] = lmanager->hasLandmark(cur_lk_ids[i]);
+    }
+    reduceVector(cur_lk_pts, alive);
+    reduceVector(cur_lk_ids, alive);
     for (int i = 0; i < cur_lk_pts.size(); i++) {
         auto ret = createLKLandmark(frame, cur_lk_pts[i], cur_lk_ids[i]);
         if (!ret.first) {
@@ -489,7 +578,11 @@ TrackReport D2FeatureTracker::track(const VisualImageDesc & left_frame, VisualIm
     match_param.enable_prediction = true;
     match_param.prediction_using_extrinsic = true;
     match_param.enable_search_in_local = true;
-    matchLocalFeatures(left_frame, right_frame, ids_b_to_a, match_param);
+    MatchDecision decision;
+    matchLocalFeatures(left_frame, right_frame, ids_b_to_a, match_param, &decision);
+    if (match_param.enable_superglue) {
+        report.addDecision(decision);
+    }
     for (size_t i = 0; i < ids_b_to_a.size(); i++) { 
         if (ids_b_to_a[i] >= 0) {
             assert(ids_b_to_a[i] < left_frame.spLandmarkNum() && "too large");
@@ -500,7 +593,10 @@ TrackReport D2FeatureTracker::track(const VisualImageDesc & left_frame, VisualIm
             cur_lm.landmark_id = landmark_id;
             cur_lm.stamp_discover = prev_lm.stamp_discover;
             cur_lm.velocity = extractPointVelocity(cur_lm);
-            lmanager->updateLandmark(cur_lm);
+            if (!lmanager->updateLandmark(cur_lm)) {
+                cur_lm.landmark_id = -1;
+                continue;
+            }
             report.stereo_point_num ++;
         }
     }
@@ -530,7 +626,9 @@ TrackReport D2FeatureTracker::trackLK(const VisualImageDesc & left_frame, Visual
         auto &lm = ret.second;
         lm.stamp_discover = lmanager->at(cur_lk_ids[i]).stamp_discover;
         lm.velocity = extractPointVelocity(lm);
-        lmanager->updateLandmark(lm);
+        if (!lmanager->updateLandmark(lm)) {
+            continue;
+        }
         right_frame.landmarks.emplace_back(lm);
     }
     report.stereo_point_num = cur_lk_pts.size();
@@ -558,7 +656,11 @@ bool D2FeatureTracker::isKeyframe(const TrackReport & report) {
 
 std::pair<bool, LandmarkPerFrame> D2FeatureTracker::createLKLandmark(const VisualImageDesc & frame, cv::Point2f pt, LandmarkIdType landmark_id) {
     Vector3d pt3d_norm;
-    cams.at(frame.camera_index)->liftProjective(Eigen::Vector2d(pt.x, pt.y), pt3d_norm);
+    if (frame.camera_index < params->bearing_luts.size()) {
+        params->bearing_luts[frame.camera_index]->liftProjective(Eigen::Vector2d(pt.x, pt.y), pt3d_norm);
+    } else {
+        cams.at(frame.camera_index)->liftProjective(Eigen::Vector2d(pt.x, pt.y), pt3d_norm);
+    }
     pt3d_norm.normalize();
     if (pt3d_norm.hasNaN()) {
         return std::make_pair(false, LandmarkPerFrame());
@@ -579,22 +681,27 @@ std::pair<bool, LandmarkPerFrame> D2FeatureTracker::createLKLandmark(const Visua
 }
 
 void D2FeatureTracker::processFrame(VisualImageDescArray & frames, bool is_keyframe) {
+    const UniqueGuard guard(keyframe_lock);
+    const UniqueGuard guard2(lmanager_lock);
     if (current_keyframes.size() > 0 && current_keyframes.back().frame_id == frames.frame_id) {
         return;
     }
     keyframe_count ++;
     for (auto & frame: frames.images) {
         for (unsigned int i = 0; i < frame.landmarkNum(); i++) {
-            if (frame.landmarks[i].landmark_id < 0) {
-                if (params->camera_configuration == CameraConfig::STEREO_PINHOLE && frame.camera_index == 1) {
-                    //We do not create new landmark for right camera
+            if (frame.landmarks[i].landmark_id >= 0) {
+                if (lmanager->updateLandmark(frame.landmarks[i])) {
                     continue;
                 }
-                auto _id = lmanager->addLandmark(frame.landmarks[i]);
-                frame.landmarks[i].setLandmarkId(_id);
-            } else {
-                lmanager->updateLandmark(frame.landmarks[i]);
+                //Evicted, observed again as a new landmark
+                frame.landmarks[i].setLandmarkId(-1);
+            }
+            if (params->camera_configuration == CameraConfig::STEREO_PINHOLE && frame.camera_index == 1) {
+                //We do not create new landmark for right camera
+                continue;
             }
+            auto _id = lmanager->addLandmark(frame.landmarks[i]);
+            frame.landmarks[i].setLandmarkId(_id);
         }
     }
     // Before solve, use motion prediction as pose
@@ -603,110 +710,122 @@ void D2FeatureTracker::processFrame(VisualImageDescArray & frames, bool is_keyfr
     }
     frames.pose_drone = frames.motion_prediction;
     current_keyframes.emplace_back(frames);
+    keyframe_descs.addFrame(frames);
+    compactRemoteIds(lmanager->evict(frames.stamp));
 }
 
-cv::Mat D2FeatureTracker::drawToImage(const VisualImageDesc & frame, bool is_keyframe, const TrackReport & report, bool is_right, bool is_remote) const {
-    // ROS_INFO("Drawing ... %d", keyframe_count);
-    cv::Mat img = frame.raw_image;
-    int width = img.cols;
-    auto & current_keyframe = current_keyframes.back();
+TrackVizImage D2FeatureTracker::snapshotImage(const VisualImageDesc & frame, bool is_right, bool is_remote) const {
+    TrackVizImage viz;
+    viz.image = frame.raw_image;
     if (is_remote) {
-        img = cv::imdecode(frame.image, cv::IMREAD_UNCHANGED);
-        width = img.cols;
+        viz.compressed_image = frame.image;
+    }
+    viz.camera_index = frame.camera_index;
+    viz.drone_id = frame.drone_id;
+    viz.is_right = is_right;
+    viz.is_remote = is_remote;
+    viz.pts = frame.landmarks2D();
+    viz.is_superpoint.resize(viz.pts.size());
+    viz.ids.resize(viz.pts.size(), -1);
+    viz.prev_pts.resize(viz.pts.size());
+    viz.has_prev.resize(viz.pts.size(), false);
+    for (size_t j = 0; j < viz.pts.size(); j++) {
+        viz.is_superpoint[j] = frame.landmarks[j].type == SuperPointLandmark;
+        auto _id = frame.landmarks[j].landmark_id;
+        if (_id < 0 || !lmanager->hasLandmark(_id)) {
+            continue;
+        }
+        viz.ids[j] = _id;
+        auto & pts2d = lmanager->at(_id).track;
+        if (pts2d.size() == 0) 
+            continue;
+        if (is_right || is_remote) {
+            viz.prev_pts[j] = pts2d.back().pt2d;
+            viz.has_prev[j] = true;
+        } else {
+            for (int  index = pts2d.size()-1; index >= 0; index--) {
+                if (pts2d[index].camera_id == frame.camera_id && pts2d[index].frame_id != frame.frame_id) {
+                    viz.prev_pts[j] = pts2d[index].pt2d;
+                    viz.has_prev[j] = true;
+                    break;
+                }
+            }
+        }
+    }
+    const std::lock_guard<std::mutex> guard(viz_lock);
+    if (landmark_predictions_viz.find(frame.camera_id) != landmark_predictions_viz.end()) {
+        viz.predictions = landmark_predictions_viz.at(frame.camera_id);
+        viz.predictions_matched = landmark_predictions_matched_viz.at(frame.camera_id);
+    }
+    return viz;
+}
+
+TrackVizFrame D2FeatureTracker::snapshotFrame(TrackVizFrame::Layout layout, bool is_keyframe, const TrackReport & report) const {
+    TrackVizFrame viz;
+    viz.layout = layout;
+    viz.is_keyframe = is_keyframe;
+    viz.report = report;
+    viz.keyframe_count = keyframe_count;
+    viz.frame_count = frame_count;
+    return viz;
+}
+
+cv::Mat D2FeatureTracker::drawToImage(const TrackVizImage & viz, const TrackVizFrame & frame) const {
+    cv::Mat img;
+    if (viz.is_remote) {
+        img = cv::imdecode(viz.compressed_image, cv::IMREAD_UNCHANGED);
         if (img.empty()) {
             return cv::Mat();
         }
-        // cv::hconcat(img, current_keyframe.images[0].raw_image, img);
+    } else {
+        img = viz.image;
     }
-    auto cur_pts = frame.landmarks2D();
+    //Never draw on the raw image, it is shared with the tracker
     if (img.channels() == 1) {
         cv::cvtColor(img, img, cv::COLOR_GRAY2BGR);
+    } else if (!viz.is_remote) {
+        img = img.clone();
     }
+    auto & report = frame.report;
     char buf[64] = {0};
     int stereo_num = 0;
-    for (size_t j = 0; j < cur_pts.size(); j++) {
+    for (size_t j = 0; j < viz.pts.size(); j++) {
         cv::Scalar color = cv::Scalar(0, 140, 255);
-        if (frame.landmarks[j].type == SuperPointLandmark) {
+        if (viz.is_superpoint[j]) {
             color = cv::Scalar(255, 0, 0); //Superpoint blue
         }
-        cv::circle(img, cur_pts[j], 2, color, 2);
-        auto _id = frame.landmarks[j].landmark_id;
-        if (!lmanager->hasLandmark(_id)) {
+        cv::circle(img, viz.pts[j], 2, color, 2);
+        if (viz.ids[j] < 0 || !viz.has_prev[j]) {
             continue;
         }
-        auto lm = lmanager->at(_id);
-        if (_id >= 0) {
-            cv::Point2f prev;
-            bool prev_found = false;
-            if (!lmanager->hasLandmark(_id)) {
-                continue;
-            }
-            auto & pts2d = lmanager->at(_id).track;
-            if (pts2d.size() == 0) 
-                continue;
-            if (is_right || is_remote) {
-                prev = pts2d.back().pt2d;
-                prev_found = true;
-            } else {
-                for (int  index = pts2d.size()-1; index >= 0; index--) {
-                    if (pts2d[index].camera_id == frame.camera_id && pts2d[index].frame_id != frame.frame_id) {
-                        prev = lmanager->at(_id).track[index].pt2d;
-                        prev_found = true;
-                        break;
-                    }
-                }
-            }
-            if (!prev_found) {
-                continue;
-            }
-            if (is_remote) {
-                // Random color
-                // cv::Scalar color(rand()%255, rand()%255, rand()%255);
-                // cv::line(img, prev + cv::Point2f(width, 0), cur_pts[j], color);
-            } else {
-                cv::arrowedLine(img, prev, cur_pts[j], cv::Scalar(0, 255, 0), 1, 8, 0, 0.2);
-            }
-        }
-        if (frame.landmarks[j].landmark_id >= 0) {
-            stereo_num++;
+        if (!viz.is_remote) {
+            cv::arrowedLine(img, viz.prev_pts[j], viz.pts[j], cv::Scalar(0, 255, 0), 1, 8, 0, 0.2);
         }
-        if (_config.show_feature_id && frame.landmarks[j].landmark_id >= 0) {
-            sprintf(buf, "%d", frame.landmarks[j].landmark_id%MAX_FEATURE_NUM);
-            cv::putText(img, buf, cur_pts[j] - cv::Point2f(5, 0), cv::FONT_HERSHEY_SIMPLEX, 1, color, 1);
+        stereo_num++;
+        if (_config.show_feature_id) {
+            sprintf(buf, "%d", viz.ids[j]%MAX_FEATURE_NUM);
+            cv::putText(img, buf, viz.pts[j] - cv::Point2f(5, 0), cv::FONT_HERSHEY_SIMPLEX, 1, color, 1);
         }
     }
     //Draw predictions
-    if (landmark_predictions_viz.find(frame.camera_id) != landmark_predictions_viz.end()) {
-        //Draw predictions here
-        auto & predictions = landmark_predictions_viz.at(frame.camera_id);
-        auto & prev = landmark_predictions_matched_viz.at(frame.camera_id);
-        for (int i = 0; i < predictions.size(); i++) {
-            cv::circle(img, predictions[i], 3, cv::Scalar(0, 255, 0), 2);
-            cv::line(img, prev[i], predictions[i], cv::Scalar(0, 0, 255), 1, 8, 0);
-            // if (cv::norm(prev[i] - predictions[i]) > 20) {
-            //     //Show the landmark id and flag
-            //     auto lm_id = frame.landmarks[i].landmark_id;
-            //     if (lmanager->hasLandmark(lm_id)) {
-            //         printf("Landmark %ld: flag %d %.2f %.2f err %.2f\n", frame.landmarks[i].landmark_id, 
-            //             lmanager->at(lm_id).flag, prev[i].x, prev[i].y, cv::norm(prev[i] - predictions[i]));
-            //     }
-            // }
-        }
+    for (int i = 0; i < viz.predictions.size(); i++) {
+        cv::circle(img, viz.predictions[i], 3, cv::Scalar(0, 255, 0), 2);
+        cv::line(img, viz.predictions_matched[i], viz.predictions[i], cv::Scalar(0, 0, 255), 1, 8, 0);
     }
     cv::Scalar color = cv::Scalar(255, 0, 0);
-    if (is_keyframe) {
+    if (frame.is_keyframe) {
         color = cv::Scalar(0, 0, 255);
     }
-    if (is_right) {
+    if (viz.is_right) {
         sprintf(buf, "Stereo points: %d", stereo_num);
         cv::putText(img, buf, cv::Point2f(20, 20), cv::FONT_HERSHEY_SIMPLEX, 0.6, color, 2);
-    } else if (is_remote) {
-        sprintf(buf, "Drone %d<->%d Matched points: %d", params->self_id, frame.drone_id, report.remote_matched_num);
+    } else if (viz.is_remote) {
+        sprintf(buf, "Drone %d<->%d Matched points: %d", params->self_id, viz.drone_id, report.remote_matched_num);
         cv::putText(img, buf, cv::Point2f(20, 20), cv::FONT_HERSHEY_SIMPLEX, 0.6, color, 2);
     }
     else {
-        sprintf(buf, "KF/FRAME %d/%d @CAM %d ISKF: %d", keyframe_count, frame_count, 
-            frame.camera_index, is_keyframe);
+        sprintf(buf, "KF/FRAME %d/%d @CAM %d ISKF: %d", frame.keyframe_count, frame.frame_count, 
+            viz.camera_index, frame.is_keyframe);
         cv::putText(img, buf, cv::Point2f(20, 20), cv::FONT_HERSHEY_SIMPLEX, 0.6, color, 2);
         sprintf(buf, "TRACK %.1fms NUM %d LONG %d Parallex %.1f\%/%.1f",
             report.ft_time, report.parallex_num, report.long_track_num, report.meanParallex()*100, _config.parallex_thres*100);
@@ -715,67 +834,76 @@ cv::Mat D2FeatureTracker::drawToImage(const VisualImageDesc & frame, bool is_key
     return img;
 }
 
-void D2FeatureTracker::drawRemote(const VisualImageDescArray & frames, const TrackReport & report) const { 
-    cv::Mat img = drawToImage(frames.images[0], false, report, false, true);
-    cv::Mat img_r = drawToImage(frames.images[1], false, report, true, true);
-    if (img.empty()) {
-        printf("[D2FeatureTracker::drawRemote] Unable to draw remote image, empty image found\n");
-        return;
+void D2FeatureTracker::renderFrame(TrackVizFrame & frame) const {
+    std::vector<cv::Mat> imgs;
+    for (auto & viz : frame.images) {
+        imgs.emplace_back(drawToImage(viz, frame));
+        if (imgs.back().empty()) {
+            printf("[D2FeatureTracker::renderFrame] Unable to draw image, empty image found\n");
+            return;
+        }
     }
+    cv::Mat img = imgs[0];
+    if (frame.layout == TrackVizFrame::SIDE_BY_SIDE) {
+        cv::hconcat(imgs, img);
+    } else if (frame.layout == TrackVizFrame::QUAD) {
+        cv::Mat img1;
+        cv::hconcat(imgs[0], imgs[1], img);
+        cv::hconcat(imgs[2], imgs[3], img1);
+        cv::vconcat(img, img1, img);
+    }
+    bool is_remote = frame.images[0].is_remote;
     char buf[64] = {0};
-    sprintf(buf, "RemoteMatched @ Drone %d", params->self_id);
-    cv::hconcat(img, img_r, img);
+    if (is_remote) {
+        sprintf(buf, "RemoteMatched @ Drone %d", params->self_id);
+    } else {
+        sprintf(buf, "featureTracker @ Drone %d", params->self_id);
+    }
     cv::imshow(buf, img);
     cv::waitKey(1);
     if (_config.write_to_file) {
-        sprintf(buf, "%s/featureTracker_remote%06d.jpg", _config.output_folder.c_str(), frame_count);
+        sprintf(buf, is_remote ? "%s/featureTracker_remote%06d.jpg" : "%s/featureTracker%06d.jpg",
+            _config.output_folder.c_str(), frame.frame_count);
         cv::imwrite(buf, img);
     }
 }
 
+void D2FeatureTracker::drawRemote(const VisualImageDescArray & frames, const TrackReport & report) const { 
+    auto viz = snapshotFrame(TrackVizFrame::SIDE_BY_SIDE, false, report);
+    viz.images.emplace_back(snapshotImage(frames.images[0], false, true));
+    viz.images.emplace_back(snapshotImage(frames.images[1], true, true));
+    viz_sink->submit(std::move(viz));
+}
+
 void D2FeatureTracker::draw(const VisualImageDesc & frame, bool is_keyframe, const TrackReport & report) const {
-    cv::Mat img = drawToImage(frame, is_keyframe, report);
-    char buf[64] = {0};
-    sprintf(buf, "featureTracker @ Drone %d", params->self_id);
-    cv::imshow(buf, img);
-    cv::waitKey(1);
-    if (_config.write_to_file) {
-        sprintf(buf, "%s/featureTracker%06d.jpg", _config.output_folder.c_str(), frame_count);
-        cv::imwrite(buf, img);
-    }
+    auto viz = snapshotFrame(TrackVizFrame::SINGLE, is_keyframe, report);
+    viz.images.emplace_back(snapshotImage(frame));
+    viz_sink->submit(std::move(viz));
 }
 
 void D2FeatureTracker::draw(const VisualImageDesc & lframe, VisualImageDesc & rframe, bool is_keyframe, const TrackReport & report) const {
-    cv::Mat img = drawToImage(lframe, is_keyframe, report);
-    cv::Mat img_r = drawToImage(rframe, is_keyframe, report, true);
-    cv::hconcat(img, img_r, img);
-    char buf[64] = {0};
-    sprintf(buf, "featureTracker @ Drone %d", params->self_id);
-    cv::imshow(buf, img);
-    cv::waitKey(1);
-    if (_config.write_to_file) {
-        sprintf(buf, "%s/featureTracker%06d.jpg", _config.output_folder.c_str(), frame_count);
-        cv::imwrite(buf, img);
-    }
+    auto viz = snapshotFrame(TrackVizFrame::SIDE_BY_SIDE, is_keyframe, report);
+    viz.images.emplace_back(snapshotImage(lframe));
+    viz.images.emplace_back(snapshotImage(rframe, true));
+    viz_sink->submit(std::move(viz));
 }
 
-void D2FeatureTracker::draw(const VisualImageDescArray & frames, bool is_keyframe, const TrackReport & report) const {
-    cv::Mat img = drawToImage(frames.images[0], is_keyframe, report);
-    cv::Mat img_r = drawToImage(frames.images[2], is_keyframe, report);
-    cv::hconcat(img, img_r, img);
-    cv::Mat img1 = drawToImage(frames.images[1], is_keyframe, report);
-    cv::Mat img1_r = drawToImage(frames.images[3], is_keyframe, report);
-    cv::hconcat(img1, img1_r, img1);
-    cv::vconcat(img, img1, img);
-    
-    char buf[64] = {0};
-    sprintf(buf, "featureTracker @ Drone %d", params->self_id);
-    cv::imshow(buf, img);
-    cv::waitKey(1);
-    if (_config.write_to_file) {
-        sprintf(buf, "%s/featureTracker%06d.jpg", _config.output_folder.c_str(), frame_count);
-        cv::imwrite(buf, img);
+void D2FeatureTracker::draw(const VisualImageDescArray & frames, bool is_keyframe, const TrackReport & report,
+        TrackVizFrame::Layout layout) const {
+    auto viz = snapshotFrame(layout, is_keyframe, report);
+    if (layout == TrackVizFrame::QUAD) {
+        for (int i : {0, 2, 1, 3}) {
+            viz.images.emplace_back(snapshotImage(frames.images[i]));
+        }
+    } else {
+        for (auto & frame : frames.images) {
+            viz.images.emplace_back(snapshotImage(frame));
+        }
     }
+    if (viz.images.empty()) {
+        return;
+    }
+    viz_sink->submit(std::move(viz));
 }
 
 std::pair<std::vector<float>, std::vector<cv::Point2f>> getFeatureHalfImg(const std::vector<cv::Point2f> & pts, const std::vector<float> & desc, bool require_left, 
@@ -799,7 +927,7 @@ std::pair<std::vector<float>, std::vector<cv::Point2f>> getFeatureHalfImg(const
 }
 
 bool D2FeatureTracker::matchLocalFeatures(const VisualImageDesc & img_desc_a, const VisualImageDesc & img_desc_b, std::vector<int> & ids_b_to_a, 
-        const D2FeatureTracker::MatchLocalFeatureParams & param) {
+        const D2FeatureTracker::MatchLocalFeatureParams & param, MatchDecision * decision) {
     TicToc tic;
     auto & raw_desc_a = img_desc_a.landmark_descriptor;
     auto & raw_desc_b = img_desc_b.landmark_descriptor;
@@ -829,10 +957,52 @@ bool D2FeatureTracker::matchLocalFeatures(const VisualImageDesc & img_desc_a, co
             search_radius = -1;
         }
     }
-    if (param.enable_superglue) {
+    bool run_superglue = param.enable_superglue;
+    bool knn_accepted = false;
+    if (run_superglue && _config.enable_superglue_gate && param.type == WHOLE_IMG_MATCH) {
+        //KNN with the prediction first, SuperGlue only when the result is not confident
+        const cv::Mat desc_a(raw_desc_a.size()/params->superpoint_dims, params->superpoint_dims, CV_32F, const_cast<float *>(raw_desc_a.data()));
+        const cv::Mat desc_b(raw_desc_b.size()/params->superpoint_dims, params->superpoint_dims, CV_32F, const_cast<float *>(raw_desc_b.data()));
+        std::vector<float> ratios;
+        //Unwindowed: the search window would keep only the matches close to the prediction and hide the inconsistent ones
+        auto matches = matchKNN(desc_a, desc_b, _config.knn_match_ratio, pts_pred_a_on_b, pts_b, -1, &ratios);
+        //Without prediction the positions are only comparable between consecutive frames of the same camera
+        bool has_prediction = param.enable_prediction || 
+            (img_desc_a.drone_id == img_desc_b.drone_id && img_desc_a.camera_id == img_desc_b.camera_id);
+        auto quality = evaluateMatchQuality(matches, ratios, has_prediction ? pts_pred_a_on_b : std::vector<cv::Point2f>(), pts_b,
+            _config.knn_match_ratio, _config.superglue_gate_min_matches, _config.superglue_gate_pred_dist);
+        knn_accepted = quality.score >= _config.superglue_gate_thres;
+        run_superglue = !knn_accepted;
+        if (knn_accepted) {
+            //Same as the windowed matchKNN: the window only drops best matches far from the prediction
+            for (auto & match : matches) {
+                if (search_radius <= 0 || cv::norm(pts_pred_a_on_b[match.queryIdx] - pts_b[match.trainIdx]) <= search_radius) {
+                    _matches.emplace_back(match);
+                }
+            }
+        }
+        if (decision) {
+            decision->knn_quality = quality;
+        }
+    }
+    if (decision) {
+        decision->frame_a = img_desc_a.frame_id;
+        decision->frame_b = img_desc_b.frame_id;
+        decision->drone_b = img_desc_b.drone_id;
+        decision->camera_index_a = img_desc_a.camera_index;
+        decision->camera_index_b = img_desc_b.camera_index;
+        decision->superglue = run_superglue;
+    }
+    if (knn_accepted) {
+        if (params->verbose) {
+            printf("[D2FeatureTracker::matchLocalFeatures] skip SuperGlue %ld:%ld, KNN matched %ld\n", 
+                img_desc_a.frame_id, img_desc_b.frame_id, _matches.size());
+        }
+    } else if (run_superglue) {
         //Superglue only support whole image matching
         auto & scores0 = img_desc_a.landmark_scores;
         auto & scores1 = img_desc_b.landmark_scores;
+        const std::lock_guard<std::mutex> guard(superglue_lock);
         _matches = superglue->inference(pts_a, pts_b, raw_desc_a, raw_desc_b, scores0, scores1);
     } else {
         if (param.type == WHOLE_IMG_MATCH) {
@@ -881,10 +1051,7 @@ bool D2FeatureTracker::matchLocalFeatures(const VisualImageDesc & img_desc_a, co
         }
     }
     std::vector<cv::Point2f> matched_pts_a_normed, matched_pts_b_normed, matched_pts_a, matched_pts_b;
-    if (params->show) {
-        landmark_predictions_viz[img_desc_b.camera_id] = std::vector<cv::Point2f>();
-        landmark_predictions_matched_viz[img_desc_b.camera_id] = std::vector<cv::Point2f>();
-    }
+    std::vector<cv::Point2f> predictions_viz, predictions_matched_viz;
     for (auto match : _matches) {
         ids_a.push_back(match.queryIdx);
         ids_b.push_back(match.trainIdx);
@@ -893,12 +1060,17 @@ bool D2FeatureTracker::matchLocalFeatures(const VisualImageDesc & img_desc_a, co
         matched_pts_a.push_back(pts_a[match.queryIdx]);
         matched_pts_b.push_back(pts_b[match.trainIdx]);
         if (params->show && param.enable_prediction) {
-            landmark_predictions_viz[img_desc_b.camera_id].push_back(pts_pred_a_on_b[match.queryIdx]);
-            landmark_predictions_matched_viz[img_desc_b.camera_id].push_back(pts_b[match.trainIdx]);
+            predictions_viz.push_back(pts_pred_a_on_b[match.queryIdx]);
+            predictions_matched_viz.push_back(pts_b[match.trainIdx]);
             // printf("Point %d: (%f, %f) -> (%f, %f)\n", match.queryIdx, 
             //     pts_pred_a_on_b[match.queryIdx].x, pts_pred_a_on_b[match.queryIdx].y, pts_b[match.trainIdx].x, pts_b[match.trainIdx].y);
         }
     }
+    if (params->show) {
+        const std::lock_guard<std::mutex> guard(viz_lock);
+        landmark_predictions_viz[img_desc_b.camera_id] = predictions_viz;
+        landmark_predictions_matched_viz[img_desc_b.camera_id] = predictions_matched_viz;
+    }
     if (img_desc_a.drone_id != img_desc_b.drone_id &&
             params->ftconfig->check_essential && !param.enable_superglue) {
         //only perform this for remote
@@ -980,6 +1152,9 @@ std::vector<cv::Point2f> D2FeatureTracker::predictLandmarks(const VisualImageDes
     std::vector<cv::Point2f> pts_a_pred_on_b;
     assert(img_desc_a.drone_id == params->self_id);
     auto cam = cams.at(img_desc_a.camera_index);
+    auto pose_b_inv = cam_pose_b.inverse();
+    //Projected in one batch
+    Eigen::Matrix3Xd pos_cam_b_pred(3, img_desc_a.spLandmarkNum());
     for (int i = 0; i < img_desc_a.spLandmarkNum(); i++) {
         auto landmark_id = img_desc_a.landmarks[i].landmark_id;
         //Query 3d landmark position
@@ -996,13 +1171,13 @@ std::vector<cv::Point2f> D2FeatureTracker::predictLandmarks(const VisualImageDes
             Vector3d landmark_pos_cam = img_desc_a.landmarks[i].pt3d_norm * _config.landmark_distance_assumption;
             pt3d = cam_pose_a * landmark_pos_cam;
         }
-        //Predict 2d position on b
-        Vector2d pt2d_pred;
-        Vector3d pos_cam_b_pred = cam_pose_b.inverse() * pt3d;
-        cam->spaceToPlane(pos_cam_b_pred, pt2d_pred);
-        pts_a_pred_on_b.emplace_back(pt2d_pred.x(), pt2d_pred.y());
-        // printf("[D2FT] Frame_a %ld landmark %ld find_pos:%d position %.2f %.2f %.2f pred %.2f %.2f\n", 
-        //     img_desc_a.frame_id, landmark_id, find_position, pt3d.x(), pt3d.y(), pt3d.z(), pt2d_pred.x(), pt2d_pred.y());
+        pos_cam_b_pred.col(i) = pose_b_inv * pt3d;
+    }
+    //Predict 2d position on b
+    Eigen::Matrix2Xd pt2d_pred;
+    cam->spaceToPlaneBatch(pos_cam_b_pred, pt2d_pred);
+    for (int i = 0; i < pt2d_pred.cols(); i++) {
+        pts_a_pred_on_b.emplace_back(pt2d_pred(0, i), pt2d_pred(1, i));
     }
     return pts_a_pred_on_b;
 }
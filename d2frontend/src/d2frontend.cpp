@@ -8,6 +8,7 @@
 #include "d2frontend/loop_detector.h"
 #include <Eigen/Eigen>
 #include <thread>
+#include <limits>
 #include <nav_msgs/Odometry.h>
 #include <mutex>
 #include <swarm_msgs/node_frame.h>
@@ -101,10 +102,17 @@ void D2Frontend::monoImageCallback(const sensor_msgs::ImageConstPtr & image) {
 }
 
 void D2Frontend::processStereoframe(const StereoFrame & stereoframe) {
+    if (params->enable_frontend_pipeline) {
+        raw_frame_queue->push(stereoframe);
+        return;
+    }
     double t_fe_processStereoframe_start = ros::Time::now().toSec();
-    static int count = 0;
     // ROS_INFO("[D2Frontend::processStereoframe] %d", count ++);
     auto vframearry = loop_cam->processStereoframe(stereoframe);
+    trackFrame(vframearry, t_fe_processStereoframe_start);
+}
+
+void D2Frontend::trackFrame(VisualImageDescArray & vframearry, double t_fe_processStereoframe_start) {
     vframearry.motion_prediction = getMotionPredict(vframearry.stamp);
     bool is_keyframe = feature_tracker->trackLocalFrames(vframearry);
     vframearry.prevent_adding_db = !is_keyframe;
@@ -124,11 +132,29 @@ void D2Frontend::processStereoframe(const StereoFrame & stereoframe) {
     }
 }
 
+void D2Frontend::descriptorThread() {
+    StereoFrame stereoframe;
+    while (!stopping && raw_frame_queue->pop(stereoframe)) {
+        desc_frame_queue->push(loop_cam->processStereoframe(stereoframe));
+    }
+}
+
+void D2Frontend::trackingThread() {
+    VisualImageDescArray vframearry;
+    while (!stopping && desc_frame_queue->pop(vframearry)) {
+        //The descriptors of the next frame are extracted meanwhile
+        trackFrame(vframearry, ros::Time::now().toSec());
+        if (params->enable_perf_output) {
+            printf("[D2Frontend] pipeline dropped %ld raw %ld desc frames\n", raw_frame_queue->droppedCount(),
+                desc_frame_queue->droppedCount());
+        }
+    }
+}
+
 void D2Frontend::addToLoopQueue(const VisualImageDescArray & viokf) {
     if (params->enable_loop) {
-        lock_guard guard(loop_lock);
-        Utility::TicToc tic;
-        loop_queue.push(viokf);
+        //Keyframes are never dropped. With the pipeline, the producer waits when the loop detector falls behind
+        loop_queue->push(viokf);
     }
 }
 
@@ -182,20 +208,16 @@ void D2Frontend::processRemoteImage(VisualImageDescArray & frame_desc, bool succ
 
 
 void D2Frontend::loopDetectionThread() {
-    while (ros::ok()) {
-        if (loop_queue.size() > 0) {
-            VisualImageDescArray vframearry;
-            {
-                lock_guard guard(loop_lock);
-                vframearry = loop_queue.front();
-                loop_queue.pop();
-            }
-            if (loop_queue.size() > 10) {
-                ROS_WARN("[D2Frontend] Loop queue size is %d", loop_queue.size());
-            }
-            loop_detector->processImageArray(vframearry);
+    while (ros::ok() && !stopping) {
+        VisualImageDescArray vframearry;
+        //Wake up regularly to check ros::ok()
+        if (!loop_queue->popFor(vframearry, std::chrono::milliseconds(100))) {
+            continue;
+        }
+        if (loop_queue->size() > 10) {
+            ROS_WARN("[D2Frontend] Loop queue size is %d", loop_queue->size());
         }
-        usleep(10000);
+        loop_detector->processImageArray(vframearry);
     }
 }
 
@@ -213,12 +235,44 @@ void D2Frontend::onRemoteFrameROS(const swarm_msgs::ImageArrayDescriptor & remot
 
 D2Frontend::D2Frontend () {}
 
+D2Frontend::~D2Frontend() {
+    stopPipeline();
+}
+
+void D2Frontend::stopPipeline() {
+    if (stopping.exchange(true)) {
+        return;
+    }
+    //Wake up the threads waiting on a queue, a producer blocked on the loop queue included
+    if (raw_frame_queue) {
+        raw_frame_queue->close();
+    }
+    for (auto queue : {desc_frame_queue, loop_queue}) {
+        if (queue) {
+            queue->close();
+        }
+    }
+    for (auto th_ptr : {&th_desc, &th_track, &th_loop_det}) {
+        if (th_ptr->joinable()) {
+            th_ptr->join();
+        }
+    }
+    //Blocked in lcm, which has no way to be interrupted; loop_net is never freed
+    if (th.joinable()) {
+        th.detach();
+    }
+}
+
 void D2Frontend::Init(ros::NodeHandle & nh) {
     //Init Loop Net
     params = new D2FrontendParams(nh);
     it_ = new image_transport::ImageTransport(nh);
     cv::setNumThreads(1);
 
+    //Bounded only with the pipeline, where the tracking thread may wait for the loop detector. Without it the
+    //producers are the image callback and the backend, which must not stall, so the queue grows as before
+    loop_queue = new BoundedQueue<VisualImageDescArray>(params->enable_frontend_pipeline ?
+        params->loop_queue_size : std::numeric_limits<size_t>::max(), QueueFullPolicy::Block);
     loop_net = new LoopNet(params->_lcm_uri, params->send_img, params->send_whole_img_desc, params->recv_msg_duration);
     loop_cam = new LoopCam(*(params->loopcamconfig), nh);
     feature_tracker = new D2FeatureTracker(*(params->ftconfig));
@@ -289,6 +343,13 @@ void D2Frontend::Init(ros::NodeHandle & nh) {
 
     // loop_timer = nh.createTimer(ros::Duration(0.01), &D2Frontend::loopTimerCallback, this);
     th_loop_det = std::thread(&D2Frontend::loopDetectionThread, this);
+    if (params->enable_frontend_pipeline) {
+        //Late frames are useless for tracking, drop the oldest
+        raw_frame_queue = new BoundedQueue<StereoFrame>(params->frontend_queue_size, QueueFullPolicy::DropOldest);
+        desc_frame_queue = new BoundedQueue<VisualImageDescArray>(params->frontend_queue_size, QueueFullPolicy::DropOldest);
+        th_desc = std::thread(&D2Frontend::descriptorThread, this);
+        th_track = std::thread(&D2Frontend::trackingThread, this);
+    }
     th = std::thread([&] {
         while(0 == loop_net->lcmHandle()) {
         }
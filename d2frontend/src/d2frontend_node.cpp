@@ -7,6 +7,11 @@ public:
     {
         Init(nh);
     }
+
+    ~D2FrontendNode()
+    {
+        stopPipeline();
+    }
 };
 
 int main(int argc, char **argv)
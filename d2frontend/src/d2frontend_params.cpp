@@ -7,6 +7,7 @@
 #include <yaml-cpp/yaml.h>
 #include <camodocal/camera_models/CataCamera.h>
 #include <camodocal/camera_models/PinholeCamera.h>
+#include <camodocal/camera_models/BearingLUT.h>
 #include <d2common/fisheye_undistort.h>
 
 namespace D2FrontEnd {
@@ -49,6 +50,12 @@ namespace D2FrontEnd {
 
         //Loopcam configs
         loopcamconfig->superpoint_max_num = (int) fsSettings["max_superpoint_cnt"];
+        if (!fsSettings["superpoint_grid_rows"].empty()) {
+            loopcamconfig->superpoint_grid_rows = (int) fsSettings["superpoint_grid_rows"];
+        }
+        if (!fsSettings["superpoint_grid_cols"].empty()) {
+            loopcamconfig->superpoint_grid_cols = (int) fsSettings["superpoint_grid_cols"];
+        }
         total_feature_num = (int) fsSettings["max_cnt"];
         loopcamconfig->DEPTH_FAR_THRES = fsSettings["depth_far_thres"];
         loopcamconfig->DEPTH_NEAR_THRES = fsSettings["depth_near_thres"];
@@ -77,6 +84,18 @@ namespace D2FrontEnd {
             loopcamconfig->netvlad_int8_calib_table_name = (std::string) fsSettings["netvlad_int8_calib_table_name"];
             loopcamconfig->superpoint_int8_calib_table_name = (std::string) fsSettings["superpoint_int8_calib_table_name"];
         }
+        //cnn_provider: cpu, cuda or tensorrt. Falls back to cnn_enable_tensorrt when not given.
+        std::string cnn_provider = fsSettings["cnn_provider"].empty() ? "" : (std::string) fsSettings["cnn_provider"];
+        if (!parseONNXExecutionProvider(cnn_provider, loopcamconfig->cnn_enable_tensorrt, loopcamconfig->cnn_provider)) {
+            ROS_ERROR("[D2Frontend] Unknown cnn_provider %s, expected cpu, cuda or tensorrt.", cnn_provider.c_str());
+            exit(-1);
+        }
+        if (!fsSettings["cnn_intra_op_threads"].empty()) {
+            loopcamconfig->cnn_intra_op_threads = (int) fsSettings["cnn_intra_op_threads"];
+        }
+        if (!fsSettings["cnn_inter_op_threads"].empty()) {
+            loopcamconfig->cnn_inter_op_threads = (int) fsSettings["cnn_inter_op_threads"];
+        }
 
         nh.param<bool>("lower_cam_as_main", loopcamconfig->right_cam_as_main, false);
         nh.param<double>("triangle_thres", loopcamconfig->TRIANGLE_THRES, 0.006);
@@ -97,6 +116,18 @@ namespace D2FrontEnd {
         ftconfig->double_counting_common_feature = (int) fsSettings["double_counting_common_feature"];
         ftconfig->enable_superglue_local = (int) fsSettings["enable_superglue_local"];
         ftconfig->enable_superglue_remote = (int) fsSettings["enable_superglue_remote"];
+        if (!fsSettings["enable_superglue_gate"].empty()) {
+            ftconfig->enable_superglue_gate = (int) fsSettings["enable_superglue_gate"];
+        }
+        if (!fsSettings["superglue_gate_thres"].empty()) {
+            ftconfig->superglue_gate_thres = fsSettings["superglue_gate_thres"];
+        }
+        if (!fsSettings["superglue_gate_min_matches"].empty()) {
+            ftconfig->superglue_gate_min_matches = fsSettings["superglue_gate_min_matches"];
+        }
+        if (!fsSettings["superglue_gate_pred_dist"].empty()) {
+            ftconfig->superglue_gate_pred_dist = fsSettings["superglue_gate_pred_dist"];
+        }
         ftconfig->ransacReprojThreshold = fsSettings["ransacReprojThreshold"];
         ftconfig->parallex_thres = fsSettings["parallex_thres"];
         ftconfig->knn_match_ratio = fsSettings["knn_match_ratio"];
@@ -119,14 +150,100 @@ namespace D2FrontEnd {
         } else {
             printf("[D2FrontendParams] feature_min_dist not found, use default\n");
         }
+        if (!fsSettings["landmark_max_age_frames"].empty()) {
+            ftconfig->landmark_retention.max_age_frames = fsSettings["landmark_max_age_frames"];
+        }
+        if (!fsSettings["landmark_max_age_sec"].empty()) {
+            ftconfig->landmark_retention.max_age_sec = fsSettings["landmark_max_age_sec"];
+        }
+        if (!fsSettings["landmark_max_num"].empty()) {
+            ftconfig->landmark_retention.max_landmarks = fsSettings["landmark_max_num"];
+        }
         //Loop detector
+        if (!fsSettings["global_index_type"].empty()) {
+            //0 flat, 1 HNSW, 2 IVF
+            loopdetectorconfig->global_index.type = (GlobalIndexType) (int) fsSettings["global_index_type"];
+        }
+        if (!fsSettings["global_index_hnsw_m"].empty()) {
+            loopdetectorconfig->global_index.hnsw_m = (int) fsSettings["global_index_hnsw_m"];
+        }
+        if (!fsSettings["global_index_hnsw_ef_search"].empty()) {
+            loopdetectorconfig->global_index.hnsw_ef_search = (int) fsSettings["global_index_hnsw_ef_search"];
+        }
+        if (!fsSettings["global_index_ivf_nlist"].empty()) {
+            loopdetectorconfig->global_index.ivf_nlist = (int) fsSettings["global_index_ivf_nlist"];
+        }
+        if (!fsSettings["global_index_ivf_nprobe"].empty()) {
+            loopdetectorconfig->global_index.ivf_nprobe = (int) fsSettings["global_index_ivf_nprobe"];
+        }
+        if (!fsSettings["global_index_ivf_train_size"].empty()) {
+            loopdetectorconfig->global_index.ivf_train_size = (int) fsSettings["global_index_ivf_train_size"];
+        }
+        if (!fsSettings["keyframe_retention"].empty()) {
+            loopdetectorconfig->keyframe_retention.enable = (int) fsSettings["keyframe_retention"];
+        }
+        if (!fsSettings["keyframe_min_distance"].empty()) {
+            loopdetectorconfig->keyframe_retention.min_distance = (double) fsSettings["keyframe_min_distance"];
+        }
+        if (!fsSettings["keyframe_max_similarity"].empty()) {
+            loopdetectorconfig->keyframe_retention.max_similarity = (double) fsSettings["keyframe_max_similarity"];
+        }
+        if (!fsSettings["keyframe_memory_budget_mb"].empty()) {
+            loopdetectorconfig->keyframe_retention.memory_budget = (double) fsSettings["keyframe_memory_budget_mb"] * 1024 * 1024;
+        }
+        if (!fsSettings["keyframe_eviction_policy"].empty()) {
+            //0 LRU, 1 utility
+            loopdetectorconfig->keyframe_retention.policy = (KeyframeEvictionPolicy) (int) fsSettings["keyframe_eviction_policy"];
+        }
+        if (!fsSettings["keyframe_protect_recent"].empty()) {
+            loopdetectorconfig->keyframe_retention.protect_recent = (int) fsSettings["keyframe_protect_recent"];
+        }
+        if (!fsSettings["keyframe_store_path"].empty()) {
+            loopdetectorconfig->keyframe_store_path = (std::string) fsSettings["keyframe_store_path"];
+        }
+        if (!fsSettings["keyframe_store_compact_ratio"].empty()) {
+            loopdetectorconfig->keyframe_store_compact_ratio = (double) fsSettings["keyframe_store_compact_ratio"];
+        }
+        if (!fsSettings["loop_verification_threads"].empty()) {
+            loopdetectorconfig->verification.threads = (int) fsSettings["loop_verification_threads"];
+        }
+        if (!fsSettings["loop_verification_queue_size"].empty()) {
+            loopdetectorconfig->verification.queue_size = (int) fsSettings["loop_verification_queue_size"];
+        }
+        if (!fsSettings["loop_verification_latency_budget_ms"].empty()) {
+            loopdetectorconfig->verification.latency_budget_ms = (double) fsSettings["loop_verification_latency_budget_ms"];
+        }
         loopdetectorconfig->enable_homography_test = (int) fsSettings["enable_homography_test"];
         loopdetectorconfig->accept_loop_max_yaw = (double) fsSettings["accept_loop_max_yaw"];
         loopdetectorconfig->accept_loop_max_pos = (double) fsSettings["accept_loop_max_pos"];
         loopdetectorconfig->loop_inlier_feature_num = fsSettings["loop_inlier_feature_num"];
         loopdetectorconfig->knn_match_ratio = fsSettings["knn_match_ratio"];
         loopdetectorconfig->gravity_check_thres = fsSettings["gravity_check_thres"];
+        if (!fsSettings["parallel_correspondence"].empty()) {
+            loopdetectorconfig->parallel_correspondence = (int) fsSettings["parallel_correspondence"];
+        }
+        if (!fsSettings["enable_prosac"].empty()) {
+            loopdetectorconfig->enable_prosac = (int) fsSettings["enable_prosac"];
+        }
+        if (!fsSettings["loop_image_cache_frames"].empty()) {
+            loopdetectorconfig->loop_image_cache_frames = (int) fsSettings["loop_image_cache_frames"];
+        }
+        if (!fsSettings["enable_loop_prior_gate"].empty()) {
+            loopdetectorconfig->prior_gate.enable = (int) fsSettings["enable_loop_prior_gate"];
+        }
+        if (!fsSettings["loop_prior_gate_threshold"].empty()) {
+            loopdetectorconfig->prior_gate.threshold = (double) fsSettings["loop_prior_gate_threshold"];
+        }
         nh.param<bool>("enable_loop", enable_loop, true);
+        if (!fsSettings["enable_frontend_pipeline"].empty()) {
+            enable_frontend_pipeline = (int) fsSettings["enable_frontend_pipeline"];
+        }
+        if (!fsSettings["frontend_queue_size"].empty()) {
+            frontend_queue_size = (int) fsSettings["frontend_queue_size"];
+        }
+        if (!fsSettings["loop_queue_size"].empty()) {
+            loop_queue_size = (int) fsSettings["loop_queue_size"];
+        }
         nh.param<bool>("is_4dof", loopdetectorconfig->is_4dof, true);
         nh.param<int>("match_index_dist", loopdetectorconfig->match_index_dist, 10);
         nh.param<int>("match_index_dist_remote", loopdetectorconfig->match_index_dist_remote, 10);
@@ -198,7 +315,7 @@ namespace D2FrontEnd {
             camera_ptrs.clear();
             for (auto cam: raw_camera_ptrs) { 
                 auto ptr = new FisheyeUndist(cam, 0, undistort_fov, true, FisheyeUndist::UndistortCylindrical, 
-                    width_undistort, height_undistort, photometric);
+                    width_undistort, height_undistort, photometric, undistort_map_cache_dir);
                 auto cylind_cam = ptr->cam_top;
                 camera_ptrs.push_back(cylind_cam);
                 undistortors.emplace_back(ptr);
@@ -212,6 +329,15 @@ namespace D2FrontEnd {
             //     focal_length = static_cast<camodocal::PinholeCamera* >(cam.get())->getParameters().fx();
             // }
         }
+        if (!fsSettings["bearing_lut_step"].empty()) {
+            bearing_lut_step = (int) fsSettings["bearing_lut_step"];
+        }
+        if (bearing_lut_step > 0) {
+            for (auto cam: camera_ptrs) {
+                bearing_luts.emplace_back(new camodocal::BearingLUT(cam, bearing_lut_step));
+            }
+            printf("[D2Frontend] Bearing lookup tables built with step %d\n", bearing_lut_step);
+        }
         printf("[D2Frontend] Focal length initialize to: %.1f\n", focal_length);
     }
 
@@ -221,6 +347,9 @@ namespace D2FrontEnd {
         width_undistort = (int) fsSettings["width_undistort"];
         height_undistort = (int) fsSettings["height_undistort"];
         undistort_fov = fsSettings["undistort_fov"];
+        if (!fsSettings["undistort_map_cache_dir"].empty()) {
+            undistort_map_cache_dir = (std::string) fsSettings["undistort_map_cache_dir"];
+        }
         width = (int) fsSettings["image_width"];
         height = (int) fsSettings["image_height"];
         std::string camera_seq_str = fsSettings["camera_seq"]; // Back-right Back-left Front-left Front-right
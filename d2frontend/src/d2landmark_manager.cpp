@@ -11,25 +11,33 @@ int LandmarkManager::addLandmark(const LandmarkPerFrame & lm) {
     landmark_db[_id] = lm_copy;
     related_landmarks[lm_copy.frame_id][_id] = related_landmarks[lm_copy.frame_id][_id] + 1;
     total_lm_per_frame_num ++;
+    touch(lm_copy);
     return _id;
 }
 
-void LandmarkManager::updateLandmark(const LandmarkPerFrame & lm) {
+bool LandmarkManager::updateLandmark(const LandmarkPerFrame & lm) {
     if (lm.landmark_id < 0) {
-        return;
+        return false;
     }
     if (landmark_db.find(lm.landmark_id) == landmark_db.end()) {
+        if (evicted_ids.count(lm.landmark_id) > 0) {
+            //Re-creating it would start a new track without its history under the old id
+            refused_num ++;
+            return false;
+        }
         landmark_db[lm.landmark_id] = lm;
     } else {
         landmark_db.at(lm.landmark_id).add(lm);
     }
     total_lm_per_frame_num ++;
     related_landmarks[lm.frame_id][lm.landmark_id] = related_landmarks[lm.frame_id][lm.landmark_id] + 1;
-    assert(lm.landmark_id >= 0 && "landmark id must > 0");
+    touch(lm);
+    return true;
 }
 
 void LandmarkManager::removeLandmark(const LandmarkIdType & id) {
     landmark_db.erase(id);
+    forget(id);
 }
 
 std::vector<LandmarkPerId> LandmarkManager::popFrame(FrameIdType frame_id, bool pop_base) {
@@ -60,6 +68,7 @@ std::vector<LandmarkPerId> LandmarkManager::popFrame(FrameIdType frame_id, bool
         if (_size == 0) {
             //Remove this landmark.
             margined_landmarks.emplace_back(lm);
+            forget(_id);
             removeLandmark(_id);
         }
     }
@@ -91,4 +100,118 @@ FrameIdType LandmarkManager::getLandmarkBaseFrame(LandmarkIdType landmark_id) co
     return landmark_db.at(landmark_id).track[0].frame_id;
 }
 
-}
\ No newline at end of file
+void LandmarkManager::touch(const LandmarkPerFrame & lm) {
+    if (!retention.enabled()) {
+        return;
+    }
+    if (lm.frame_id != last_frame_id) {
+        last_frame_id = lm.frame_id;
+        frame_seq ++;
+    }
+    auto it = recency.find(lm.landmark_id);
+    if (it == recency.end()) {
+        lru.push_front(lm.landmark_id);
+        it = recency.emplace(lm.landmark_id, Recency()).first;
+        it->second.it = lru.begin();
+    } else {
+        lru.splice(lru.begin(), lru, it->second.it);
+    }
+    it->second.last_frame_seq = frame_seq;
+    it->second.last_stamp = lm.stamp;
+}
+
+void LandmarkManager::forget(LandmarkIdType landmark_id) {
+    auto it = recency.find(landmark_id);
+    if (it != recency.end()) {
+        lru.erase(it->second.it);
+        recency.erase(it);
+    }
+}
+
+void LandmarkManager::evictLandmark(LandmarkIdType landmark_id) {
+    auto & lm = landmark_db.at(landmark_id);
+    for (auto & lpf : lm.track) {
+        auto it = related_landmarks.find(lpf.frame_id);
+        if (it != related_landmarks.end()) {
+            it->second.erase(landmark_id);
+            if (it->second.empty()) {
+                related_landmarks.erase(it);
+            }
+        }
+    }
+    total_lm_per_frame_num -= lm.track.size();
+    forget(landmark_id);
+    removeLandmark(landmark_id);
+    evicted_num ++;
+    evicted_ids.insert(landmark_id);
+    evicted_order.push_back(landmark_id);
+    while (evicted_order.size() > (size_t) std::max(retention.max_evicted_ids, 0)) {
+        evicted_ids.erase(evicted_order.front());
+        evicted_order.pop_front();
+    }
+}
+
+void LandmarkManager::setRetention(const LandmarkRetention & _retention) {
+    const Guard lock(state_lock);
+    retention = _retention;
+    if (!retention.enabled()) {
+        lru.clear();
+        recency.clear();
+        evicted_ids.clear();
+        evicted_order.clear();
+    }
+}
+
+std::vector<LandmarkIdType> LandmarkManager::evict(double stamp) {
+    const Guard lock(state_lock);
+    std::vector<LandmarkIdType> evicted;
+    if (!retention.enabled()) {
+        return evicted;
+    }
+    //Least recently observed first, stop at the first landmark to keep
+    while (!lru.empty()) {
+        auto landmark_id = lru.back();
+        auto & rec = recency.at(landmark_id);
+        if (rec.last_frame_seq == frame_seq) {
+            //Landmarks of the newest frame are still being tracked
+            break;
+        }
+        bool too_old = (retention.max_age_frames > 0 && frame_seq - rec.last_frame_seq > retention.max_age_frames) ||
+            (retention.max_age_sec > 0 && stamp - rec.last_stamp > retention.max_age_sec);
+        bool over_cap = retention.max_landmarks > 0 && (int) lru.size() > retention.max_landmarks;
+        if (!too_old && !over_cap) {
+            break;
+        }
+        if (landmark_db.find(landmark_id) != landmark_db.end()) {
+            evictLandmark(landmark_id);
+            evicted.push_back(landmark_id);
+        } else {
+            forget(landmark_id);
+        }
+    }
+    return evicted;
+}
+
+LandmarkMemoryStats LandmarkManager::memoryStats() const {
+    const Guard lock(state_lock);
+    //A tree node holds three pointers and the color besides the value
+    const size_t tree_node = 4 * sizeof(void*);
+    LandmarkMemoryStats stats;
+    stats.landmark_num = landmark_db.size();
+    stats.frame_num = related_landmarks.size();
+    stats.evicted_num = evicted_num;
+    stats.refused_num = refused_num;
+    for (auto & it : landmark_db) {
+        stats.observation_num += it.second.track.size();
+        stats.bytes += tree_node + sizeof(it) + it.second.track.capacity() * sizeof(LandmarkPerFrame);
+    }
+    for (auto & it : related_landmarks) {
+        stats.bytes += tree_node + sizeof(it) + it.second.size() * (tree_node + sizeof(std::pair<LandmarkIdType, int>));
+    }
+    stats.bytes += lru.size() * (2 * sizeof(void*) + sizeof(LandmarkIdType));
+    stats.bytes += recency.size() * (2 * sizeof(void*) + sizeof(std::pair<LandmarkIdType, Recency>));
+    stats.bytes += evicted_ids.size() * (2 * sizeof(void*) + sizeof(LandmarkIdType)) + evicted_order.size() * sizeof(LandmarkIdType);
+    return stats;
+}
+
+}
@@ -0,0 +1,162 @@
+#include <d2frontend/global_desc_index.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/MetaIndexes.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <vector>
+#include <stdio.h>
+
+namespace D2FrontEnd {
+
+GlobalDescIndex::GlobalDescIndex(int _dims, const GlobalIndexConfig & _config):
+    dims(_dims), config(_config) {
+    //IVF starts flat
+    storage.reset(createStorage());
+    index.reset(new faiss::IndexIDMap2(storage.get()));
+}
+
+GlobalDescIndex::~GlobalDescIndex() {
+    //The id map references the storage and the IVF index references the quantizer
+    index.reset();
+    storage.reset();
+    quantizer.reset();
+}
+
+faiss::Index * GlobalDescIndex::createStorage() const {
+    if (config.type == GLOBAL_INDEX_HNSW) {
+        auto hnsw = new faiss::IndexHNSWFlat(dims, config.hnsw_m, faiss::METRIC_INNER_PRODUCT);
+        hnsw->hnsw.efConstruction = config.hnsw_ef_construction;
+        hnsw->hnsw.efSearch = config.hnsw_ef_search;
+        return hnsw;
+    }
+    return new faiss::IndexFlatIP(dims);
+}
+
+faiss::idx_t GlobalDescIndex::add(const float * desc) {
+    faiss::idx_t label = next_label++;
+    index->add_with_ids(1, desc, &label);
+    if (config.type == GLOBAL_INDEX_IVF && !quantizer && index->ntotal >= config.ivf_train_size) {
+        trainIVF();
+    }
+    return label;
+}
+
+bool GlobalDescIndex::remove(faiss::idx_t label) {
+    if (label < 0 || label >= next_label || tombstones.count(label) > 0) {
+        return false;
+    }
+    if (config.type == GLOBAL_INDEX_HNSW) {
+        //HNSW nodes can't be deleted: hidden from the results until the next rebuild
+        auto id_map = static_cast<faiss::IndexIDMap2*>(index.get());
+        if (id_map->rev_map.count(label) == 0) {
+            return false;
+        }
+        tombstones.insert(label);
+        if (tombstones.size() > config.hnsw_rebuild_ratio * index->ntotal) {
+            rebuildHNSW();
+        }
+        return true;
+    }
+    faiss::IDSelectorRange sel(label, label + 1);
+    return index->remove_ids(sel) > 0;
+}
+
+void GlobalDescIndex::liveDescriptors(std::vector<faiss::idx_t> & ids, std::vector<float> & descs) const {
+    auto id_map = static_cast<const faiss::IndexIDMap2*>(index.get());
+    ids.clear();
+    descs.resize(id_map->ntotal * dims);
+    for (int64_t i = 0; i < id_map->ntotal; i++) {
+        auto label = id_map->id_map[i];
+        if (tombstones.count(label) > 0) {
+            continue;
+        }
+        storage->reconstruct(i, descs.data() + ids.size() * dims);
+        ids.push_back(label);
+    }
+    descs.resize(ids.size() * dims);
+}
+
+void GlobalDescIndex::rebuildHNSW() {
+    std::vector<faiss::idx_t> ids;
+    std::vector<float> descs;
+    liveDescriptors(ids, descs);
+    index.reset();
+    storage.reset(createStorage());
+    index.reset(new faiss::IndexIDMap2(storage.get()));
+    index->add_with_ids(ids.size(), descs.data(), ids.data());
+    printf("[GlobalDescIndex] HNSW rebuilt without %ld removed descriptors\n", tombstones.size());
+    tombstones.clear();
+}
+
+void GlobalDescIndex::trainIVF() {
+    //Trained once on the warm-up descriptors, which are then added with their labels
+    std::vector<faiss::idx_t> ids;
+    std::vector<float> descs;
+    liveDescriptors(ids, descs);
+    int64_t num = ids.size();
+    quantizer.reset(new faiss::IndexFlatIP(dims));
+    auto ivf = new faiss::IndexIVFFlat(quantizer.get(), dims, config.ivf_nlist, faiss::METRIC_INNER_PRODUCT);
+    ivf->train(num, descs.data());
+    ivf->add_with_ids(num, descs.data(), ids.data());
+    ivf->nprobe = config.ivf_nprobe;
+    index.reset(ivf);
+    storage.reset();
+    printf("[GlobalDescIndex] IVF trained on %ld descriptors with %d lists\n", num, config.ivf_nlist);
+}
+
+void GlobalDescIndex::search(int n, const float * queries, int k, float * similarity, faiss::idx_t * labels) const {
+    if (tombstones.empty()) {
+        index->search(n, queries, k, similarity, labels);
+        return;
+    }
+    //Over-fetch to fill k results after dropping the removed descriptors: twice the expected share of live results,
+    //so HNSW stays a graph search instead of fetching every removed node. Queries left short are searched again wider
+    const int64_t k_max = std::min<int64_t>(k + tombstones.size(), index->ntotal);
+    double live_ratio = std::max(1.0 - (double) tombstones.size() / index->ntotal, 0.01);
+    int64_t k_fetch = std::min<int64_t>(k_max, (int64_t) ceil(2 * k / live_ratio));
+    std::vector<int> pending(n);
+    std::iota(pending.begin(), pending.end(), 0);
+    std::vector<float> pending_queries;
+    while (!pending.empty()) {
+        pending_queries.resize(pending.size() * dims);
+        for (size_t p = 0; p < pending.size(); p++) {
+            memcpy(pending_queries.data() + p * dims, queries + pending[p] * dims, dims * sizeof(float));
+        }
+        std::vector<float> sim_fetch(pending.size() * k_fetch);
+        std::vector<faiss::idx_t> labels_fetch(pending.size() * k_fetch);
+        index->search(pending.size(), pending_queries.data(), k_fetch, sim_fetch.data(), labels_fetch.data());
+        std::vector<int> short_queries;
+        for (size_t p = 0; p < pending.size(); p++) {
+            int q = pending[p];
+            int j = 0;
+            for (int64_t i = p * k_fetch; i < (int64_t)(p + 1) * k_fetch && j < k; i++) {
+                if (labels_fetch[i] < 0 || tombstones.count(labels_fetch[i]) > 0) {
+                    continue;
+                }
+                similarity[q * k + j] = sim_fetch[i];
+                labels[q * k + j] = labels_fetch[i];
+                j++;
+            }
+            if (j < k && k_fetch < k_max) {
+                short_queries.push_back(q);
+                continue;
+            }
+            for (; j < k; j++) {
+                similarity[q * k + j] = -1;
+                labels[q * k + j] = -1;
+            }
+        }
+        pending.swap(short_queries);
+        k_fetch = std::min(k_max, k_fetch * 4);
+    }
+}
+
+bool GlobalDescIndex::isApproximate() const {
+    return config.type == GLOBAL_INDEX_HNSW || quantizer != nullptr;
+}
+
+}
@@ -0,0 +1,111 @@
+#include <d2frontend/keyframe_desc_matrix.h>
+#include <algorithm>
+
+namespace D2FrontEnd {
+
+void KeyframeDescMatrix::setDims(int _dims) {
+    if (_dims != dims) {
+        clear();
+        dims = _dims;
+    }
+}
+
+void KeyframeDescMatrix::clear() {
+    data.clear();
+    row_valid.clear();
+    frames.clear();
+    dead_rows = 0;
+    alive_frames = 0;
+}
+
+void KeyframeDescMatrix::addFrame(const VisualImageDescArray & frame) {
+    FrameEntry entry{frame.frame_id, rows(), (int)frame.images.size(), true};
+    data.resize(data.size() + frame.images.size() * dims, 0.0f);
+    for (auto & img : frame.images) {
+        bool valid = img.image_desc.size() == dims;
+        if (valid) {
+            memcpy(data.data() + row_valid.size() * dims, img.image_desc.data(), dims * sizeof(float));
+        }
+        row_valid.push_back(valid);
+    }
+    frames.emplace_back(entry);
+    alive_frames ++;
+}
+
+void KeyframeDescMatrix::removeFrame(FrameIdType frame_id) {
+    for (auto & entry : frames) {
+        if (entry.alive && entry.frame_id == frame_id) {
+            entry.alive = false;
+            dead_rows += entry.row_num;
+            alive_frames --;
+            break;
+        }
+    }
+    //Removal is mostly from the front, so compact lazily instead of shifting the matrix every time
+    if (dead_rows > rows() / 2) {
+        compact();
+    }
+}
+
+void KeyframeDescMatrix::compact() {
+    int row = 0;
+    std::vector<FrameEntry> new_frames;
+    new_frames.reserve(alive_frames);
+    for (auto & entry : frames) {
+        if (!entry.alive) {
+            continue;
+        }
+        if (entry.row_start != row) {
+            memmove(data.data() + row * dims, data.data() + entry.row_start * dims, entry.row_num * dims * sizeof(float));
+            memmove(row_valid.data() + row, row_valid.data() + entry.row_start, entry.row_num);
+        }
+        new_frames.push_back(FrameEntry{entry.frame_id, row, entry.row_num, true});
+        row += entry.row_num;
+    }
+    data.resize(row * dims);
+    row_valid.resize(row);
+    frames = std::move(new_frames);
+    dead_rows = 0;
+}
+
+Eigen::MatrixXf KeyframeDescMatrix::similarity(const float * queries, int num_query) const {
+    typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMatrixXf;
+    const Eigen::Map<const RowMatrixXf> descs(data.data(), rows(), dims);
+    const Eigen::Map<const Eigen::MatrixXf> query(queries, dims, num_query);
+    Eigen::MatrixXf ret(rows(), num_query);
+    ret.noalias() = descs * query;
+    return ret;
+}
+
+std::vector<KeyframeDescMatch> KeyframeDescMatrix::matchNewest(const float * queries, int num_query, double thres, int k,
+        const std::vector<int> & image_order) const {
+    std::vector<KeyframeDescMatch> ret;
+    if (alive_frames == 0 || dims == 0 || num_query == 0 || k <= 0) {
+        return ret;
+    }
+    Eigen::MatrixXf sims = this->similarity(queries, num_query);
+    for (auto it = frames.rbegin(); it != frames.rend(); it++) {
+        if (!it->alive) {
+            continue;
+        }
+        int num = image_order.size() > 0 ? std::min((int)image_order.size(), it->row_num) : it->row_num;
+        for (int j = 0; j < num; j++) {
+            int index = image_order.size() > 0 ? image_order[j] : j;
+            int row = it->row_start + index;
+            if (index >= it->row_num || !row_valid[row]) {
+                continue;
+            }
+            for (int q = 0; q < num_query; q++) {
+                if (sims(row, q) >= thres) {
+                    ret.emplace_back(KeyframeDescMatch{it->frame_id, index, q, sims(row, q)});
+                    if (ret.size() >= k) {
+                        return ret;
+                    }
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+}
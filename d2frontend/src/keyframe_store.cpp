@@ -0,0 +1,336 @@
+#include <d2frontend/keyframe_store.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+namespace D2FrontEnd {
+
+const uint64_t KEYFRAME_STORE_MAGIC = 0x31304244464b3244ULL; //"D2KFDB01"
+
+struct KeyframeStoreHeader {
+    uint64_t magic;
+    int32_t dims;
+    int32_t reserved;
+};
+
+struct KeyframeRecordHeader {
+    int64_t frame_id;
+    int32_t drone_id;
+    int32_t desc_num;
+    double stamp;
+    double pose[7];
+    uint64_t blob_size;
+};
+
+struct KeyframeIndexEntry {
+    int64_t frame_id;
+    int64_t offset; //-1 for removed
+};
+
+//Records are 8 bytes aligned so that the descriptors can be read in place
+inline size_t align8(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+inline size_t recordSize(const KeyframeRecordHeader & header, int dims) {
+    return sizeof(KeyframeRecordHeader) + align8(header.desc_num * sizeof(int32_t)) +
+        align8(header.desc_num * dims * sizeof(float)) + align8(header.blob_size);
+}
+
+KeyframeStore::KeyframeStore(const std::string & _path, int _dims):
+    path(_path), dims(_dims) {
+}
+
+KeyframeStore::~KeyframeStore() {
+    if (mapped) {
+        munmap((void*)mapped, mapped_size);
+    }
+    if (fd >= 0) {
+        fdatasync(fd);
+        close(fd);
+    }
+    if (idx_fd >= 0) {
+        fdatasync(idx_fd);
+        close(idx_fd);
+    }
+}
+
+bool KeyframeStore::open() {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    idx_fd = ::open((path + ".idx").c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0 || idx_fd < 0) {
+        printf("[KeyframeStore] Failed to open %s\n", path.c_str());
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    file_size = st.st_size;
+    KeyframeStoreHeader header;
+    if (file_size == 0) {
+        header = {KEYFRAME_STORE_MAGIC, dims, 0};
+        if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+            printf("[KeyframeStore] Failed to write %s\n", path.c_str());
+            return false;
+        }
+        file_size = sizeof(header);
+        ftruncate(idx_fd, 0);
+    } else if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != KEYFRAME_STORE_MAGIC ||
+            header.dims != dims) {
+        printf("[KeyframeStore] %s is not a keyframe store of %d dims descriptors\n", path.c_str(), dims);
+        return false;
+    }
+    fstat(idx_fd, &st);
+    std::vector<KeyframeIndexEntry> entries(st.st_size / sizeof(KeyframeIndexEntry));
+    if (pread(idx_fd, entries.data(), entries.size() * sizeof(KeyframeIndexEntry), 0) < 0) {
+        return false;
+    }
+    for (auto & entry : entries) {
+        if (entry.offset < 0) {
+            records.erase(entry.frame_id);
+        } else if (entry.offset + sizeof(KeyframeRecordHeader) <= file_size) {
+            if (records.find(entry.frame_id) == records.end()) {
+                order.push_back(entry.frame_id);
+            }
+            records[entry.frame_id] = {(uint64_t) entry.offset, 0};
+        }
+    }
+    //Drops a partially written entry
+    ftruncate(idx_fd, entries.size() * sizeof(KeyframeIndexEntry));
+    if (!remap()) {
+        return false;
+    }
+    live_bytes = 0;
+    for (auto it = records.begin(); it != records.end();) {
+        auto header = (const KeyframeRecordHeader*)(mapped + it->second.offset);
+        //An entry pointing to another keyframe is left by a compaction interrupted between the renames
+        if (header->frame_id != it->first) {
+            it = records.erase(it);
+            continue;
+        }
+        it->second.size = std::min(recordSize(*header, dims), file_size - it->second.offset);
+        live_bytes += it->second.size;
+        it++;
+    }
+    return true;
+}
+
+bool KeyframeStore::remap() {
+    if (mapped) {
+        munmap((void*)mapped, mapped_size);
+        mapped = nullptr;
+    }
+    void * ptr = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        printf("[KeyframeStore] Failed to map %s\n", path.c_str());
+        mapped_size = 0;
+        return false;
+    }
+    mapped = (const uint8_t*)ptr;
+    mapped_size = file_size;
+    return true;
+}
+
+void KeyframeStore::appendIndex(FrameIdType frame_id, int64_t offset) {
+    KeyframeIndexEntry entry = {frame_id, offset};
+    if (write(idx_fd, &entry, sizeof(entry)) != sizeof(entry)) {
+        printf("[KeyframeStore] Failed to write the index of %s\n", path.c_str());
+    }
+}
+
+bool KeyframeStore::append(const VisualImageDescArray & frame, const std::vector<int> & desc_images) {
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<int32_t> images;
+    for (auto i : desc_images) {
+        if (i >= 0 && i < (int) frame.images.size() && frame.images[i].image_desc.size() == dims) {
+            images.push_back(i);
+        }
+    }
+    //Global descriptors are stored uncompressed beside the blob
+    auto lcm = frame.toLCM(true, false, false);
+    KeyframeRecordHeader header;
+    header.frame_id = frame.frame_id;
+    header.drone_id = frame.drone_id;
+    header.desc_num = images.size();
+    header.stamp = frame.stamp;
+    Swarm::Pose pose = frame.pose_drone;
+    pose.to_vector(header.pose);
+    header.blob_size = lcm.getEncodedSize();
+    size_t images_size = align8(images.size() * sizeof(int32_t));
+    size_t descs_size = align8(images.size() * dims * sizeof(float));
+    std::vector<uint8_t> record(sizeof(header) + images_size + descs_size + align8(header.blob_size), 0);
+    memcpy(record.data(), &header, sizeof(header));
+    memcpy(record.data() + sizeof(header), images.data(), images.size() * sizeof(int32_t));
+    float * descs = (float*)(record.data() + sizeof(header) + images_size);
+    for (size_t i = 0; i < images.size(); i++) {
+        memcpy(descs + i * dims, frame.images[images[i]].image_desc.data(), dims * sizeof(float));
+    }
+    lcm.encode(record.data() + sizeof(header) + images_size + descs_size, 0, header.blob_size);
+    if (pwrite(fd, record.data(), record.size(), file_size) != (ssize_t) record.size()) {
+        printf("[KeyframeStore] Failed to append KF %ld to %s\n", frame.frame_id, path.c_str());
+        return false;
+    }
+    //The index entry goes after the record: a crash in between leaves an unreferenced record
+    appendIndex(frame.frame_id, file_size);
+    auto it = records.find(frame.frame_id);
+    if (it == records.end()) {
+        order.push_back(frame.frame_id);
+    } else {
+        live_bytes -= it->second.size;
+    }
+    records[frame.frame_id] = {file_size, record.size()};
+    live_bytes += record.size();
+    file_size += record.size();
+    return true;
+}
+
+bool KeyframeStore::remove(FrameIdType frame_id) {
+    auto it = records.find(frame_id);
+    if (it == records.end()) {
+        return false;
+    }
+    live_bytes -= it->second.size;
+    records.erase(it);
+    appendIndex(frame_id, -1);
+    return true;
+}
+
+double KeyframeStore::deadRatio() const {
+    if (file_size <= sizeof(KeyframeStoreHeader)) {
+        return 0;
+    }
+    return 1.0 - (double) live_bytes / (file_size - sizeof(KeyframeStoreHeader));
+}
+
+bool KeyframeStore::compact() {
+    if (fd < 0 || (file_size > mapped_size && !remap())) {
+        return false;
+    }
+    //The live records are copied in their first insertion order, so that the restored index labels don't change
+    std::string tmp_path = path + ".compact";
+    int tmp_fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    int tmp_idx_fd = ::open((tmp_path + ".idx").c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    KeyframeStoreHeader header = {KEYFRAME_STORE_MAGIC, dims, 0};
+    bool success = tmp_fd >= 0 && tmp_idx_fd >= 0 && pwrite(tmp_fd, &header, sizeof(header), 0) == sizeof(header);
+    uint64_t offset = sizeof(header);
+    std::vector<KeyframeIndexEntry> entries;
+    for (auto frame_id : frameIds()) {
+        auto & record = records.at(frame_id);
+        success = success && pwrite(tmp_fd, mapped + record.offset, record.size, offset) == (ssize_t) record.size;
+        entries.push_back({frame_id, (int64_t) offset});
+        offset += record.size;
+    }
+    size_t entries_size = entries.size() * sizeof(KeyframeIndexEntry);
+    success = success && write(tmp_idx_fd, entries.data(), entries_size) == (ssize_t) entries_size &&
+        fdatasync(tmp_fd) == 0 && fdatasync(tmp_idx_fd) == 0;
+    if (tmp_fd >= 0) {
+        close(tmp_fd);
+    }
+    if (tmp_idx_fd >= 0) {
+        close(tmp_idx_fd);
+    }
+    if (!success || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        printf("[KeyframeStore] Failed to compact %s\n", path.c_str());
+        unlink(tmp_path.c_str());
+        unlink((tmp_path + ".idx").c_str());
+        return false;
+    }
+    //The old index is stale from here, its entries are checked against the records on open
+    rename((tmp_path + ".idx").c_str(), (path + ".idx").c_str());
+    printf("[KeyframeStore] Compacted %s from %.1fMB to %.1fMB\n", path.c_str(), file_size / 1024.0 / 1024.0,
+        offset / 1024.0 / 1024.0);
+    munmap((void*)mapped, mapped_size);
+    mapped = nullptr;
+    mapped_size = 0;
+    close(fd);
+    close(idx_fd);
+    fd = idx_fd = -1;
+    records.clear();
+    order.clear();
+    return open();
+}
+
+bool KeyframeStore::updatePose(FrameIdType frame_id, const Swarm::Pose & _pose) {
+    auto it = records.find(frame_id);
+    if (it == records.end()) {
+        return false;
+    }
+    double data[7];
+    Swarm::Pose pose = _pose;
+    pose.to_vector(data);
+    return pwrite(fd, data, sizeof(data), it->second.offset + offsetof(KeyframeRecordHeader, pose)) == sizeof(data);
+}
+
+bool KeyframeStore::view(FrameIdType frame_id, KeyframeRecordView & view) {
+    auto it = records.find(frame_id);
+    if (it == records.end()) {
+        return false;
+    }
+    auto offset = it->second.offset;
+    if (offset + sizeof(KeyframeRecordHeader) > mapped_size && !remap()) {
+        return false;
+    }
+    auto header = (const KeyframeRecordHeader*)(mapped + offset);
+    size_t images_size = align8(header->desc_num * sizeof(int32_t));
+    size_t descs_size = align8(header->desc_num * dims * sizeof(float));
+    size_t record_size = sizeof(KeyframeRecordHeader) + images_size + descs_size + header->blob_size;
+    if (offset + record_size > mapped_size) {
+        printf("[KeyframeStore] KF %ld is truncated in %s\n", frame_id, path.c_str());
+        return false;
+    }
+    auto data = mapped + offset + sizeof(KeyframeRecordHeader);
+    view.frame_id = header->frame_id;
+    view.drone_id = header->drone_id;
+    view.stamp = header->stamp;
+    double pose[7];
+    memcpy(pose, header->pose, sizeof(pose));
+    view.pose_drone = Swarm::Pose(pose);
+    view.desc_num = header->desc_num;
+    view.desc_images = (const int32_t*)data;
+    view.descs = (const float*)(data + images_size);
+    view.blob = data + images_size + descs_size;
+    view.blob_size = header->blob_size;
+    return true;
+}
+
+bool KeyframeStore::load(FrameIdType frame_id, VisualImageDescArray & frame) {
+    KeyframeRecordView record;
+    if (!view(frame_id, record)) {
+        return false;
+    }
+    ImageArrayDescriptor_t lcm;
+    if (lcm.decode(record.blob, 0, record.blob_size) < 0) {
+        printf("[KeyframeStore] Failed to decode KF %ld in %s\n", frame_id, path.c_str());
+        return false;
+    }
+    frame = VisualImageDescArray(lcm);
+    frame.stamp = record.stamp;
+    frame.pose_drone = record.pose_drone;
+    for (auto & img : frame.images) {
+        img.pose_drone = record.pose_drone;
+    }
+    for (int i = 0; i < record.desc_num; i++) {
+        if (record.desc_images[i] < (int) frame.images.size()) {
+            frame.images[record.desc_images[i]].image_desc.assign(record.descs + i * dims, record.descs + (i + 1) * dims);
+        }
+    }
+    return true;
+}
+
+std::vector<FrameIdType> KeyframeStore::frameIds() const {
+    std::vector<FrameIdType> ret;
+    for (auto frame_id : order) {
+        if (records.find(frame_id) != records.end()) {
+            ret.push_back(frame_id);
+        }
+    }
+    return ret;
+}
+
+}
@@ -1,5 +1,6 @@
 #include <d2frontend/loop_cam.h>
 #include <camodocal/camera_models/CameraFactory.h>
+#include <camodocal/camera_models/BearingLUT.h>
 #include <cv_bridge/cv_bridge.h>
 #include <opencv2/opencv.hpp>
 #include "opencv2/features2d.hpp"
@@ -24,12 +25,19 @@ LoopCam::LoopCam(LoopCamConfig config, ros::NodeHandle &nh) :
 
     if (config.cnn_use_onnx) {
         printf("[D2FrontEnd::LoopCam] Init CNNs using onnx\n");
-        netvlad_onnx = new MobileNetVLADONNX(config.netvlad_model, img_width, img_height, config.cnn_enable_tensorrt, 
-            config.cnn_enable_tensorrt_fp16, config.cnn_enable_tensorrt_int8, config.netvlad_int8_calib_table_name);
+        ONNXInferenceConfig onnx_config;
+        onnx_config.provider = config.cnn_provider;
+        onnx_config.intra_op_threads = config.cnn_intra_op_threads;
+        onnx_config.inter_op_threads = config.cnn_inter_op_threads;
+        onnx_config.enable_fp16 = config.cnn_enable_tensorrt_fp16;
+        onnx_config.enable_int8 = config.cnn_enable_tensorrt_int8;
+        onnx_config.int8_calib_table_name = config.netvlad_int8_calib_table_name;
+        netvlad_onnx = new MobileNetVLADONNX(config.netvlad_model, img_width, img_height, onnx_config);
+        onnx_config.int8_calib_table_name = config.superpoint_int8_calib_table_name;
         superpoint_onnx = new SuperPointONNX(config.superpoint_model, ((int)(params->feature_min_dist/2)), config.pca_comp, 
-            config.pca_mean, img_width, img_height, config.superpoint_thres, config.superpoint_max_num, 
-            config.cnn_enable_tensorrt, config.cnn_enable_tensorrt_fp16, config.cnn_enable_tensorrt_int8, 
-            config.superpoint_int8_calib_table_name); 
+            config.pca_mean, img_width, img_height, config.superpoint_thres, config.superpoint_max_num, onnx_config); 
+        superpoint_onnx->grid_rows = config.superpoint_grid_rows;
+        superpoint_onnx->grid_cols = config.superpoint_grid_cols;
     }
     undistortors = params->undistortors;
     cams = params->camera_ptrs;
@@ -167,6 +175,16 @@ VisualImageDescArray LoopCam::processStereoframe(const StereoFrame & msg) {
         visual_array.images.resize(4);
     }
 
+    std::vector<VisualImageDesc> batched_descs;
+    std::vector<cv::Mat> undists;
+    if (camera_configuration == CameraConfig::FOURCORNER_FISHEYE && _config.cnn_use_onnx && msg.left_images.size() > 1) {
+        //Run the networks once on all the cameras
+        for (unsigned int i = 0; i < msg.left_images.size(); i ++) {
+            undists.emplace_back(undistortImage(msg, i));
+        }
+        batched_descs = extractorImgDescDeepnetBatch(msg.stamp, undists, msg.left_camera_indices, msg.left_camera_ids);
+    }
+
     for (unsigned int i = 0; i < msg.left_images.size(); i ++) {
         if (camera_configuration == CameraConfig::PINHOLE_DEPTH) {
             visual_array.images.push_back(generateGrayDepthImageDescriptor(msg, i, tmp));
@@ -184,7 +202,12 @@ VisualImageDescArray LoopCam::processStereoframe(const StereoFrame & msg) {
             }
         } else if (camera_configuration == CameraConfig::FOURCORNER_FISHEYE) {
             auto seq = params->camera_seq[i];
-            visual_array.images[seq] = generateImageDescriptor(msg, i, tmp);
+            if (batched_descs.size() > 0) {
+                finishImageDescriptor(msg, i, undists[i], batched_descs[i], tmp);
+                visual_array.images[seq] = batched_descs[i];
+            } else {
+                visual_array.images[seq] = generateImageDescriptor(msg, i, tmp);
+            }
         }
 
         if (_show.cols == 0) {
@@ -223,6 +246,13 @@ VisualImageDesc LoopCam::generateImageDescriptor(const StereoFrame & msg, int vc
         ides.stamp = msg.stamp.toSec();
         return ides;
     }
+    cv::Mat undist = undistortImage(msg, vcam_id);
+    VisualImageDesc vframe = extractorImgDescDeepnet(msg.stamp, undist, msg.left_camera_indices[vcam_id], msg.left_camera_ids[vcam_id], false);
+    finishImageDescriptor(msg, vcam_id, undist, vframe, _show);
+    return vframe;
+}
+
+cv::Mat LoopCam::undistortImage(const StereoFrame & msg, int vcam_id) {
     cv::Mat undist = msg.left_images[vcam_id];
     TicToc tt;
     if (_config.enable_undistort_image) {
@@ -231,8 +261,10 @@ VisualImageDesc LoopCam::generateImageDescriptor(const StereoFrame & msg, int vc
     if (params->enable_perf_output) {
         printf("[D2Frontend::LoopCam] undist image cost %.1fms\n", tt.toc());
     }
-    VisualImageDesc vframe = extractorImgDescDeepnet(msg.stamp, undist, msg.left_camera_indices[vcam_id], msg.left_camera_ids[vcam_id], false);
+    return undist;
+}
 
+void LoopCam::finishImageDescriptor(const StereoFrame & msg, int vcam_id, const cv::Mat & undist, VisualImageDesc & vframe, cv::Mat &_show) {
     if (vframe.image_desc.size() == 0)
     {
         ROS_WARN("Failed on deepnet: vframe.image_desc.size() == 0.");
@@ -277,7 +309,6 @@ VisualImageDesc LoopCam::generateImageDescriptor(const StereoFrame & msg, int vc
         sprintf(text, "Frame %d: %ld Features %d", kf_count, msg.keyframe_id, pts_up.size());
         cv::putText(_show, text, cv::Point2f(20, 30), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 1.5);
     }
-    return vframe;
 }
 
 VisualImageDesc LoopCam::generateGrayDepthImageDescriptor(const StereoFrame & msg, int vcam_id, cv::Mat & _show)
@@ -539,12 +570,63 @@ VisualImageDesc LoopCam::extractorImgDescDeepnet(ros::Time stamp, cv::Mat img, i
             vframe.image_desc = netvlad_onnx->inference(img);
         }
     }
+    addLandmarksToImageDesc(vframe, img, landmarks_2d);
+    return vframe;
+}
 
+std::vector<VisualImageDesc> LoopCam::extractorImgDescDeepnetBatch(ros::Time stamp, const std::vector<cv::Mat> & imgs, 
+        const std::vector<int> & camera_indices, const std::vector<int> & camera_ids)
+{
+    std::vector<VisualImageDesc> vframes(imgs.size());
+    for (unsigned int i = 0; i < imgs.size(); i++) {
+        auto & vframe = vframes[i];
+        vframe.stamp = stamp.toSec();
+        vframe.camera_index = camera_indices[i];
+        vframe.camera_id = camera_ids[i];
+        vframe.drone_id = self_id;
+        if (camera_configuration == CameraConfig::STEREO_FISHEYE) {
+            cv::Mat roi = imgs[i](cv::Rect(0, imgs[i].rows*3/4, imgs[i].cols, imgs[i].rows/4));
+            roi.setTo(cv::Scalar(0, 0, 0));
+        }
+    }
+    std::vector<std::vector<cv::Point2f>> landmarks_2d(imgs.size());
+    if (_config.cnn_use_onnx) {
+        if (_config.superpoint_max_num > 0) {
+            std::vector<std::vector<float>> descs, scores;
+            superpoint_onnx->inference(imgs, landmarks_2d, descs, scores);
+            for (unsigned int i = 0; i < imgs.size(); i++) {
+                vframes[i].landmark_descriptor = std::move(descs[i]);
+                vframes[i].landmark_scores = std::move(scores[i]);
+            }
+        }
+        auto global_descs = netvlad_onnx->inference(imgs);
+        for (unsigned int i = 0; i < imgs.size(); i++) {
+            vframes[i].image_desc = std::move(global_descs[i]);
+        }
+    }
+    for (unsigned int i = 0; i < imgs.size(); i++) {
+        addLandmarksToImageDesc(vframes[i], imgs[i], landmarks_2d[i]);
+    }
+    return vframes;
+}
+
+void LoopCam::addLandmarksToImageDesc(VisualImageDesc & vframe, const cv::Mat & img, const std::vector<cv::Point2f> & landmarks_2d) {
+    auto camera_index = vframe.camera_index;
+    auto camera_id = vframe.camera_id;
+    std::vector<Eigen::Vector3d> bearings;
+    bool use_lut = camera_index < params->bearing_luts.size();
+    if (use_lut) {
+        params->bearing_luts[camera_index]->liftProjectiveBatch(landmarks_2d, bearings);
+    }
     for (unsigned int i = 0; i < landmarks_2d.size(); i++)
     {
         auto pt_up = landmarks_2d[i];
         Eigen::Vector3d pt_up3d;
-        cams.at(camera_index)->liftProjective(Eigen::Vector2d(pt_up.x, pt_up.y), pt_up3d);
+        if (use_lut) {
+            pt_up3d = bearings[i];
+        } else {
+            cams.at(camera_index)->liftProjective(Eigen::Vector2d(pt_up.x, pt_up.y), pt_up3d);
+        }
         LandmarkPerFrame lm;
         lm.pt2d = pt_up;
         pt_up3d.normalize();
@@ -566,7 +648,5 @@ VisualImageDesc LoopCam::extractorImgDescDeepnet(ros::Time stamp, cv::Mat img, i
             fsp << std::endl;
         }
     } 
-
-    return vframe;
 }
 }
\ No newline at end of file
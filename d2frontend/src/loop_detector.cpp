@@ -11,7 +11,6 @@
 #include <opengv/sac/Lmeds.hpp>
 #include <d2frontend/utils.h>
 #include <algorithm>
-#include <faiss/IndexFlat.h>
 
 using namespace std::chrono; 
 using namespace D2Common;
@@ -52,6 +51,7 @@ void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
     }
 
     ego_motion_traj.push(ros::Time(image_array.stamp), image_array.pose_drone);
+    double travel = updateTravel(image_array);
 
     int drone_id = image_array.drone_id;
     int images_num = image_array.images.size();
@@ -60,9 +60,11 @@ void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
     if (is_matched_frame && image_array.matched_drone != self_id) {
         if(!image_array.is_lazy_frame) {
             //Will be cache to databse
-            addImageArrayToDatabase(image_array, false);
-            printf("[LoopDetector@%d] Add KF %ld from drone %d images: %d landmark: %d lazy: %d matched_to %d",
-                self_id, image_array.frame_id, drone_id, image_array.images.size(), image_array.spLandmarkNum(), image_array.is_lazy_frame, image_array.matched_frame);
+            addImageArrayToDatabase(image_array, false, travel);
+            if (params->verbose) {
+                printf("[LoopDetector@%d] Add KF %ld from drone %d images: %d landmark: %d lazy: %d matched_to %d\n",
+                    self_id, image_array.frame_id, drone_id, image_array.images.size(), image_array.spLandmarkNum(), image_array.is_lazy_frame, image_array.matched_frame);
+            }
         }
         // printf("[LoopDetector@%d] Frame %ld matched to drone %ld, giveup\n", self_id, image_array.frame_id, image_array.matched_drone);
         return;
@@ -89,30 +91,31 @@ void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
     }
 
     if (image_array.spLandmarkNum() >= _config.loop_inlier_feature_num || is_lazy_frame) {
-        //Initialize images for visualization
+        //Images for visualization, kept compressed until drawMatched
         if (params->show) {
-            std::vector<cv::Mat> imgs;
+            std::vector<std::vector<uint8_t>> imgs;
             for (unsigned int i = 0; i < images_num; i++) {
                 auto & img_des = image_array.images[i];
                 if (!img_des.raw_image.empty()) {
-                    imgs.emplace_back(img_des.raw_image);
-                } else if (img_des.image.size() != 0) {
-                    imgs.emplace_back(decode_image(img_des));
+                    imgs.emplace_back(LoopImageCache::compress(img_des.raw_image));
                 } else {
-                    // imgs[i] = cv::Mat(height, width, CV_8UC3, cv::Scalar(255, 255, 255));
-                    imgs.emplace_back(cv::Mat(params->height, params->width, CV_8U, cv::Scalar(255)));
+                    //Already compressed, or empty for a white placeholder
+                    imgs.emplace_back(img_des.image);
                 }
                 if (params->camera_configuration == STEREO_PINHOLE) {
                     break;
                 }
             }
-            msgid2cvimgs[image_array.frame_id] = imgs;
+            image_cache.add(image_array.frame_id, std::move(imgs));
         }
+        processing_frame_id = image_array.frame_id;
 
         bool success = false;
-        VisualImageDescArray _old_fisheye_img;
+        double similarity = 1.0; //Candidates matched by the other drone are trusted
+        std::shared_ptr<const VisualImageDescArray> _old_fisheye_img;
         int camera_index = 1;
         int camera_index_old = -1;
+        bool images_in_job = false; //The verification job releases the images of the frame
         if (is_matched_frame) {
             if (!hasFrame(image_array.matched_frame)) {
                 success = false;
@@ -121,25 +124,34 @@ void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
                 // printf("[LoopDetector] frame %ld is matched to local frame %ld in db\n", image_array.frame_id, image_array.matched_frame);
                 success = true;
                 const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
-                _old_fisheye_img = keyframe_database.at(image_array.matched_frame);
+                _old_fisheye_img = keyframe(image_array.matched_frame);
+                if (!_old_fisheye_img) {
+                    success = false;
+                }
+                touchKeyframe(image_array.matched_frame);
                 camera_index = 0; //TODO: this is a hack
                 camera_index_old = 0;
-                if (is_lazy_frame) {
+                if (success && is_lazy_frame) {
                     //In this case, it's a keyframe that has been broadcasted and should be recorded in database
                     printf("[LoopDetector] frame %ld is matched to local frame %ld in db and we find it in cache\n", 
                             image_array.frame_id, image_array.matched_frame);
-                    if (keyframe_database.find(image_array.frame_id) == keyframe_database.end()) {
+                    auto lazy_frame = keyframe(image_array.frame_id);
+                    if (!lazy_frame) {
                         ROS_WARN("[LoopDetector] Lazy frame %ld is matched to local frame %ld in db, but is not in cache", image_array.frame_id, image_array.matched_frame);
                         success = false;
                     } else {
                         printf("[LoopDetector] frame %ld is found in database\n", image_array.frame_id);
-                        image_array = keyframe_database.at(image_array.frame_id);
+                        image_array = *lazy_frame;
+                        image_array.pose_drone = keyframe_poses.at(image_array.frame_id);
                     }
                 }
             }
         } else {
             if (databaseSize() > _config.match_index_dist || drone_id != self_id && databaseSize() > _config.match_index_dist_remote) {
-                success = queryImageArrayFromDatabase(image_array, _old_fisheye_img, camera_index, camera_index_old);
+                success = queryImageArrayFromDatabase(image_array, _old_fisheye_img, camera_index, camera_index_old, &similarity);
+                if (success && _config.prior_gate.enable) {
+                    success = checkLoopPrior(image_array, *_old_fisheye_img, travel);
+                }
                 auto stop = high_resolution_clock::now(); 
             }
         }
@@ -148,26 +160,33 @@ void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
         if (success) {
             if (!is_matched_frame && is_lazy_frame) {
                 //In this case, we need to send the matched frame to the drone
-                _old_fisheye_img.matched_drone = image_array.drone_id;
-                _old_fisheye_img.matched_frame = image_array.frame_id;
                 printf("[LoopDetector@%d] Lazy frame %d is matched with %d try to broadcast this frame\n", 
-                        self_id, image_array.frame_id, _old_fisheye_img.frame_id);
+                        self_id, image_array.frame_id, _old_fisheye_img->frame_id);
                 if (broadcast_keyframe_cb) {
-                    broadcast_keyframe_cb(_old_fisheye_img);
+                    VisualImageDescArray broadcast = *_old_fisheye_img;
+                    broadcast.pose_drone = keyframePose(broadcast);
+                    broadcast.matched_drone = image_array.drone_id;
+                    broadcast.matched_frame = image_array.frame_id;
+                    broadcast_keyframe_cb(broadcast);
                 }
+            } else if (verification_pool) {
+                //The caller keeps its frame: the job owns a copy
+                auto frame = std::make_shared<const VisualImageDescArray>(image_array);
+                LoopVerificationJob job;
+                job.frame_id = image_array.frame_id;
+                job.similarity = similarity;
+                job.inter_drone = image_array.drone_id != _old_fisheye_img->drone_id;
+                job.run = [this, frame, old_frame = _old_fisheye_img, camera_index, camera_index_old] {
+                    verifyCandidate(*frame, *old_frame, camera_index, camera_index_old);
+                    releaseImages(frame->frame_id);
+                };
+                job.on_cancel = [this, frame_id = image_array.frame_id] {
+                    printf("[LoopDetector@%d] Loop candidate of frame %ld cancelled\n", self_id, frame_id);
+                    releaseImages(frame_id);
+                };
+                images_in_job = verification_pool->submit(job);
             } else {
-                printf("Compute loop connection %ld and %ld\n", image_array.frame_id, _old_fisheye_img.frame_id);
-                swarm_msgs::LoopEdge ret;
-                if (_old_fisheye_img.drone_id == self_id) {
-                    success = computeLoop(_old_fisheye_img, image_array, camera_index_old, camera_index, ret);
-                } else if (image_array.drone_id == self_id) {
-                    success = computeLoop(image_array, _old_fisheye_img, camera_index, camera_index_old, ret);
-                } else {
-                    ROS_WARN("[LoopDetector%d] Will not compute loop, drone id is %d", self_id, image_array.drone_id);
-                }
-                if (success) {
-                    onLoopConnection(ret);
-                }
+                verifyCandidate(image_array, *_old_fisheye_img, camera_index, camera_index_old);
             }
         } else {
             if (params->verbose)
@@ -185,11 +204,15 @@ void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
         if (!is_lazy_frame && (!image_array.prevent_adding_db || new_node)) {
             if (image_array.drone_id == self_id) { 
                 //Only add local frame to database
-                addImageArrayToDatabase(image_array, true);
+                addImageArrayToDatabase(image_array, true, travel);
             } else {
-                addImageArrayToDatabase(image_array, false);
+                addImageArrayToDatabase(image_array, false, travel);
             }
         }
+        processing_frame_id = -1;
+        if (!images_in_job) {
+            releaseImages(image_array.frame_id);
+        }
     }
 
     t_sum += tt.toc();
@@ -198,6 +221,50 @@ void LoopDetector::processImageArray(VisualImageDescArray & image_array) {
         printf("[LoopDetector] Full LoopDetect avg %.1fms cur %.1fms\n", t_sum/t_count, tt.toc());
 }
 
+void LoopDetector::verifyCandidate(const VisualImageDescArray & frame, const VisualImageDescArray & old_frame,
+        int camera_index, int camera_index_old) {
+    printf("Compute loop connection %ld and %ld\n", frame.frame_id, old_frame.frame_id);
+    swarm_msgs::LoopEdge ret;
+    bool success = false;
+    if (old_frame.drone_id == self_id) {
+        success = computeLoop(old_frame, frame, camera_index_old, camera_index, ret);
+    } else if (frame.drone_id == self_id) {
+        success = computeLoop(frame, old_frame, camera_index, camera_index_old, ret);
+    } else {
+        ROS_WARN("[LoopDetector%d] Will not compute loop, drone id is %d", self_id, frame.drone_id);
+    }
+    if (success) {
+        std::lock_guard<std::recursive_mutex> guard(frame_mutex);
+        onLoopConnection(ret);
+    }
+}
+
+void LoopDetector::releaseImages(FrameIdType frame_id) {
+    //After processImageArray has decided whether the frame is stored
+    std::lock_guard<std::recursive_mutex> guard(frame_mutex);
+    if (frame_id == processing_frame_id) {
+        //A job cancelled within processImageArray: it releases the images itself
+        return;
+    }
+    if (params->show && !hasFrame(frame_id)) {
+        //Only the stored keyframes are drawn again
+        image_cache.erase(frame_id);
+    }
+}
+
+void LoopDetector::waitVerification() {
+    if (verification_pool) {
+        verification_pool->waitIdle();
+    }
+}
+
+LoopVerificationStats LoopDetector::verificationStats() const {
+    if (verification_pool) {
+        return verification_pool->stats();
+    }
+    return LoopVerificationStats();
+}
+
 
 cv::Mat LoopDetector::decode_image(const VisualImageDesc & _img_desc) {
     
@@ -209,7 +276,19 @@ cv::Mat LoopDetector::decode_image(const VisualImageDesc & _img_desc) {
     return ret;
 }
 
-int LoopDetector::addImageArrayToDatabase(VisualImageDescArray & new_fisheye_desc, bool add_to_faiss) {
+int LoopDetector::addImageArrayToDatabase(VisualImageDescArray & new_fisheye_desc, bool add_to_faiss, double travel) {
+    auto & retention = _config.keyframe_retention;
+    if (retention.enable && add_to_faiss && isRedundantKeyframe(new_fisheye_desc)) {
+        skipped_num++;
+        if (params->verbose) {
+            printf("[LoopDetector] KF %ld is redundant with the database, not stored\n", new_fisheye_desc.frame_id);
+        }
+        return -1;
+    }
+    KeyframeUsage usage;
+    usage.drone_id = new_fisheye_desc.drone_id;
+    usage.travel = travel;
+    std::vector<int> desc_images;
     if (add_to_faiss) {
         for (size_t i = 0; i < new_fisheye_desc.images.size(); i++) {
             auto & img_desc = new_fisheye_desc.images[i];
@@ -217,152 +296,406 @@ int LoopDetector::addImageArrayToDatabase(VisualImageDescArray & new_fisheye_des
                 int index = addImageDescToDatabase(img_desc);
                 index_to_frame_id[index] = new_fisheye_desc.frame_id;
                 imgid2dir[index] = i;
+                usage.index_labels.emplace_back(index);
+                desc_images.emplace_back(i);
                 // ROS_INFO("[LoopDetector] Add keyframe from %d(dir %d) to local keyframe database index: %d", img_desc.drone_id, i, index);
             }
             if (params->camera_configuration == CameraConfig::PINHOLE_DEPTH) {
                 break;
             }
-            const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
         }
     }
-    keyframe_database[new_fisheye_desc.frame_id] = new_fisheye_desc;
-    printf("[LoopDetector] Add KF %ld with %d images from %d to local keyframe database. Total frames: %ld\n", 
-            new_fisheye_desc.frame_id, new_fisheye_desc.images.size(), new_fisheye_desc.drone_id, keyframe_database.size());
+    const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+    if (keyframe_usage.find(new_fisheye_desc.frame_id) != keyframe_usage.end()) {
+        //Re-added: keep the index entries of the previous copy reachable for eviction
+        auto & prev = keyframe_usage.at(new_fisheye_desc.frame_id);
+        usage.index_labels.insert(usage.index_labels.begin(), prev.index_labels.begin(), prev.index_labels.end());
+        usage.hits = prev.hits;
+        database_bytes -= prev.bytes;
+        eviction_order.erase(evictionKey(new_fisheye_desc.frame_id, prev));
+        removeKeyframeCell(new_fisheye_desc.frame_id, prev);
+    }
+    auto stored = std::make_shared<VisualImageDescArray>(new_fisheye_desc);
+    //The matches are drawn from image_cache, the raw images are not kept with the keyframe
+    for (auto & img : stored->images) {
+        img.raw_image = cv::Mat();
+    }
+    keyframe_database[new_fisheye_desc.frame_id] = stored;
+    keyframe_poses[new_fisheye_desc.frame_id] = new_fisheye_desc.pose_drone;
+    usage.added = added_count++;
+    usage.last_access = access_count;
+    usage.bytes = keyframeBytes(*stored);
+    database_bytes += usage.bytes;
+    auto & inserted = keyframe_usage[new_fisheye_desc.frame_id] = usage;
+    eviction_order.insert(evictionKey(new_fisheye_desc.frame_id, inserted));
+    if (retention.enable) {
+        updateKeyframeCell(new_fisheye_desc.frame_id, inserted, new_fisheye_desc.pose_drone);
+    }
+    if (keyframe_store) {
+        keyframe_store->append(new_fisheye_desc, desc_images);
+    }
+    if (params->verbose) {
+        printf("[LoopDetector] Add KF %ld with %d images from %d to local keyframe database. Total frames: %ld %.1fMB\n", 
+            new_fisheye_desc.frame_id, new_fisheye_desc.images.size(), new_fisheye_desc.drone_id, keyframe_database.size(),
+            database_bytes / 1024.0 / 1024.0);
+    }
     // new_fisheye_desc.printSize();
+    if (retention.enable) {
+        enforceMemoryBudget();
+    }
     return new_fisheye_desc.frame_id;
 }
 
+std::tuple<int, int, int, int> LoopDetector::keyframeCell(int drone_id, const Swarm::Pose & pose) const {
+    double size = _config.keyframe_retention.min_distance;
+    return std::make_tuple(drone_id, (int) floor(pose.pos().x() / size), (int) floor(pose.pos().y() / size),
+        (int) floor(pose.pos().z() / size));
+}
+
+void LoopDetector::updateKeyframeCell(int64_t frame_id, KeyframeUsage & usage, const Swarm::Pose & pose) {
+    //Caller holds keyframe_database_mutex. The poses of restored keyframes are from another session
+    if (usage.restored || _config.keyframe_retention.min_distance <= 0) {
+        return;
+    }
+    auto cell = keyframeCell(usage.drone_id, pose);
+    if (usage.in_cell && cell == usage.cell) {
+        return;
+    }
+    removeKeyframeCell(frame_id, usage);
+    keyframe_cells[cell].insert(frame_id);
+    usage.cell = cell;
+    usage.in_cell = true;
+}
+
+void LoopDetector::removeKeyframeCell(int64_t frame_id, KeyframeUsage & usage) {
+    //Caller holds keyframe_database_mutex
+    if (!usage.in_cell) {
+        return;
+    }
+    auto it = keyframe_cells.find(usage.cell);
+    if (it != keyframe_cells.end()) {
+        it->second.erase(frame_id);
+        if (it->second.empty()) {
+            keyframe_cells.erase(it);
+        }
+    }
+    usage.in_cell = false;
+}
+
+bool LoopDetector::isRedundantKeyframe(const VisualImageDescArray & frame) {
+    auto & retention = _config.keyframe_retention;
+    if (retention.min_distance <= 0) {
+        return false;
+    }
+    const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+    //Keyframes within min_distance are in the 27 cells around the frame
+    auto center = keyframeCell(frame.drone_id, frame.pose_drone);
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dz = -1; dz <= 1; dz++) {
+                auto cell = keyframe_cells.find(std::make_tuple(frame.drone_id, std::get<1>(center) + dx,
+                    std::get<2>(center) + dy, std::get<3>(center) + dz));
+                if (cell == keyframe_cells.end()) {
+                    continue;
+                }
+                for (auto frame_id : cell->second) {
+                    neighbours_compared++;
+                    if (isRedundantWith(frame, frame_id)) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool LoopDetector::isRedundantWith(const VisualImageDescArray & frame, int64_t frame_id) {
+    //Caller holds keyframe_database_mutex. Keyframes evicted from memory are read in place from the store
+    auto & retention = _config.keyframe_retention;
+    std::vector<std::pair<int, const float*>> descs;
+    auto pose = keyframe_poses.at(frame_id);
+    if ((pose.pos() - frame.pose_drone.pos()).norm() > retention.min_distance) {
+        return false;
+    }
+    auto kf = keyframe_database.find(frame_id);
+    KeyframeRecordView record;
+    if (kf != keyframe_database.end()) {
+        auto & images = kf->second->images;
+        for (size_t i = 0; i < images.size(); i++) {
+            if (images[i].image_desc.size() == params->netvlad_dims) {
+                descs.emplace_back(i, images[i].image_desc.data());
+            }
+        }
+    } else if (keyframe_store && keyframe_store->view(frame_id, record)) {
+        for (int i = 0; i < record.desc_num; i++) {
+            descs.emplace_back(record.desc_images[i], record.descs + i * params->netvlad_dims);
+        }
+    } else {
+        return false;
+    }
+    //The views of a spatial neighbour must all look alike
+    double min_similarity = 1.0;
+    int compared = 0;
+    for (auto & desc : descs) {
+        if (desc.first >= frame.images.size() || frame.images[desc.first].image_desc.size() != params->netvlad_dims) {
+            continue;
+        }
+        Eigen::Map<const Eigen::VectorXf> a(frame.images[desc.first].image_desc.data(), params->netvlad_dims),
+            b(desc.second, params->netvlad_dims);
+        min_similarity = std::min(min_similarity, (double) a.dot(b));
+        compared++;
+    }
+    return compared > 0 && min_similarity > retention.max_similarity;
+}
+
+void LoopDetector::touchKeyframe(int64_t frame_id) {
+    //Caller holds keyframe_database_mutex
+    auto it = keyframe_usage.find(frame_id);
+    if (it != keyframe_usage.end()) {
+        bool in_memory = eviction_order.erase(evictionKey(frame_id, it->second)) > 0;
+        it->second.last_access = ++access_count;
+        it->second.hits++;
+        if (in_memory) {
+            eviction_order.insert(evictionKey(frame_id, it->second));
+        }
+    }
+}
+
+void LoopDetector::evictKeyframe(int64_t frame_id) {
+    //Caller holds keyframe_database_mutex
+    auto it = keyframe_usage.find(frame_id);
+    if (it == keyframe_usage.end()) {
+        return;
+    }
+    if (keyframe_store && keyframe_store->has(frame_id)) {
+        //Stays in the index, loaded again from the store when queried
+        eviction_order.erase(evictionKey(frame_id, it->second));
+        database_bytes -= it->second.bytes;
+        it->second.bytes = 0;
+        keyframe_database.erase(frame_id);
+        image_cache.erase(frame_id);
+        evicted_num++;
+        return;
+    }
+    dropKeyframe(frame_id);
+    evicted_num++;
+}
+
+void LoopDetector::dropKeyframe(int64_t frame_id) {
+    //Caller holds keyframe_database_mutex
+    auto it = keyframe_usage.find(frame_id);
+    if (it == keyframe_usage.end()) {
+        return;
+    }
+    for (auto label : it->second.index_labels) {
+        if (label >= REMOTE_MAGIN_NUMBER) {
+            remote_index.remove(label - REMOTE_MAGIN_NUMBER);
+        } else {
+            local_index.remove(label);
+        }
+        index_to_frame_id.erase(label);
+        imgid2dir.erase(label);
+    }
+    database_bytes -= it->second.bytes;
+    eviction_order.erase(evictionKey(frame_id, it->second));
+    removeKeyframeCell(frame_id, it->second);
+    keyframe_usage.erase(it);
+    if (keyframe_store) {
+        keyframe_store->remove(frame_id);
+    }
+    keyframe_database.erase(frame_id);
+    keyframe_poses.erase(frame_id);
+    image_cache.erase(frame_id);
+}
+
+void LoopDetector::enforceMemoryBudget() {
+    //Caller holds keyframe_database_mutex
+    auto & retention = _config.keyframe_retention;
+    if (retention.memory_budget == 0) {
+        return;
+    }
+    while (database_bytes > retention.memory_budget) {
+        //The first in eviction order, past the protected latest keyframes
+        auto victim = eviction_order.begin();
+        while (victim != eviction_order.end() && std::get<2>(*victim) >= added_count - retention.protect_recent) {
+            victim++;
+        }
+        if (victim == eviction_order.end()) {
+            //Everything left is protected
+            break;
+        }
+        evictKeyframe(std::get<3>(*victim));
+    }
+}
+
+LoopDetector::EvictionKey LoopDetector::evictionKey(int64_t frame_id, const KeyframeUsage & usage) const {
+    int hits = _config.keyframe_retention.policy == KEYFRAME_EVICT_UTILITY ? usage.hits : 0;
+    return std::make_tuple(hits, usage.last_access, usage.added, frame_id);
+}
+
+size_t LoopDetector::keyframeBytes(const VisualImageDescArray & frame) const {
+    return frame.memorySize() + image_cache.bytes(frame.frame_id);
+}
+
+KeyframeDatabaseStats LoopDetector::databaseStats() const {
+    const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+    KeyframeDatabaseStats stats;
+    stats.frames = keyframe_database.size();
+    stats.stored = keyframe_store ? keyframe_store->size() : 0;
+    stats.bytes = database_bytes;
+    stats.index_size = databaseSize();
+    stats.evicted = evicted_num;
+    stats.skipped = skipped_num;
+    stats.neighbours_compared = neighbours_compared;
+    return stats;
+}
+
 int LoopDetector::addImageDescToDatabase(VisualImageDesc & img_desc_a) {
     if (img_desc_a.drone_id == self_id) {
-        local_index.add(1, img_desc_a.image_desc.data());
-        return local_index.ntotal - 1;
+        return local_index.add(img_desc_a.image_desc.data());
     } else {
-        remote_index.add(1, img_desc_a.image_desc.data());
-        return remote_index.ntotal - 1 + REMOTE_MAGIN_NUMBER;
+        return remote_index.add(img_desc_a.image_desc.data()) + REMOTE_MAGIN_NUMBER;
     }
     return -1;
 }
 
 
 int LoopDetector::queryFrameIndexFromDatabase(const VisualImageDesc & img_desc, double & similarity) {
+    std::vector<double> similarities;
+    auto ret = queryFrameIndexFromDatabase({&img_desc}, similarities);
+    similarity = similarities[0];
+    return ret[0];
+}
+
+std::vector<int> LoopDetector::queryFrameIndexFromDatabase(const std::vector<const VisualImageDesc*> & imgs,
+        std::vector<double> & similarity) {
     double thres = _config.loop_detection_netvlad_thres;
-    int ret = -1;
-    if (img_desc.drone_id == self_id) {
-        //Then this is self drone
-        double similarity_local, similarity_remote;
-        int ret_remote = queryIndexFromDatabase(img_desc, remote_index, true, thres, _config.match_index_dist, similarity_remote);
-        int ret_local = queryIndexFromDatabase(img_desc, local_index, false, thres, _config.match_index_dist, similarity_local);
-        if (ret_remote >=0 && ret_local >= 0) {
-            if (similarity_local > similarity_remote) {
-                similarity = similarity_local;
-                return ret_local;
-            } else {
-                similarity = similarity_remote;
-                return similarity_remote;
-            }
-        } else if (ret_remote >=0) {
-            similarity = similarity_remote;
-            return similarity_remote;
-        } else if (ret_local >= 0) {
-            similarity = similarity_local;
-            return ret_local;
+    if (imgs.empty()) {
+        similarity.clear();
+        return {};
+    }
+    if (imgs[0]->drone_id != self_id) {
+        return queryIndexFromDatabase(imgs, local_index, false, thres, _config.match_index_dist_remote, similarity);
+    }
+    //Then this is self drone
+    std::vector<double> similarity_remote;
+    auto ret = queryIndexFromDatabase(imgs, local_index, false, thres, _config.match_index_dist, similarity);
+    auto ret_remote = queryIndexFromDatabase(imgs, remote_index, true, thres, _config.match_index_dist, similarity_remote);
+    for (size_t i = 0; i < imgs.size(); i++) {
+        if (ret_remote[i] >= 0 && (ret[i] < 0 || similarity_remote[i] >= similarity[i])) {
+            ret[i] = ret_remote[i];
+            similarity[i] = similarity_remote[i];
         }
-    } else {
-        ret = queryIndexFromDatabase(img_desc, local_index, false, thres, _config.match_index_dist_remote, similarity);
     }
     return ret;
 }
 
-int LoopDetector::queryIndexFromDatabase(const VisualImageDesc & img_desc, faiss::IndexFlatIP & index, bool remote_db, 
-        double thres, int max_index, double & similarity) {
-    float similiarity[1024] = {0};
-    faiss::idx_t labels[1024];
-
+std::vector<int> LoopDetector::queryIndexFromDatabase(const std::vector<const VisualImageDesc*> & imgs, GlobalDescIndex & index,
+        bool remote_db, double thres, int max_index, std::vector<double> & similarity) {
+    int num = imgs.size();
+    std::vector<int> ret(num, -1);
+    similarity.assign(num, -1);
     int index_offset = 0;
     if (remote_db) {
         index_offset = REMOTE_MAGIN_NUMBER;
     }
-    for (int i = 0; i < 1000; i++) {
-        labels[i] = -1;
-    }
-    int search_num = std::min(SEARCH_NEAREST_NUM + max_index, (int) index.ntotal);
-    if (search_num <= 0) {
-        return -1;
+    int search_num = std::min(SEARCH_NEAREST_NUM + max_index, (int) index.size());
+    if (search_num <= 0 || num == 0) {
+        return ret;
     }
-    index.search(1, img_desc.image_desc.data(), search_num, similiarity, labels);
-    int return_frame_id = -1, return_drone_id = -1;
-    int k = -1;
-    for (int i = 0; i < search_num; i++) {
-        if (labels[i] < 0) {
-            continue;
-        }
-        if (index_to_frame_id.find(labels[i] + index_offset) == index_to_frame_id.end()) {
-            ROS_WARN("[LoopDetector] Can't find image %d; skipping", labels[i] + index_offset);
-            continue;
+    std::vector<float> queries(num * params->netvlad_dims);
+    for (int i = 0; i < num; i++) {
+        if (imgs[i]->image_desc.size() == params->netvlad_dims) {
+            memcpy(queries.data() + i * params->netvlad_dims, imgs[i]->image_desc.data(), params->netvlad_dims * sizeof(float));
         }
-        // int return_frame_id = index_to_frame_id.at(labels[i] + index_offset);
-        return_frame_id = labels[i] + index_offset;
-        const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
-        return_drone_id = keyframe_database.at(index_to_frame_id.at(return_frame_id)).drone_id;
-        // ROS_INFO("Return Label %d/%d/%d from %d, distance %f/%f", labels[i] + index_offset, index.ntotal, index.ntotal - max_index , return_drone_id, similiarity[i], thres);
-        if (labels[i] <= index.ntotal - max_index && similiarity[i] > thres) {
-            //Is same id, max index make sense
-            k = i;
-            thres = similarity = similiarity[i];
-            return return_frame_id;
+    }
+    std::vector<float> similarities(num * search_num, 0);
+    std::vector<faiss::idx_t> labels(num * search_num, -1);
+    index.search(num, queries.data(), search_num, similarities.data(), labels.data());
+    for (int q = 0; q < num; q++) {
+        for (int i = q * search_num; i < (q + 1) * search_num; i++) {
+            if (labels[i] < 0) {
+                continue;
+            }
+            if (index_to_frame_id.find(labels[i] + index_offset) == index_to_frame_id.end()) {
+                ROS_WARN("[LoopDetector] Can't find image %d; skipping", labels[i] + index_offset);
+                continue;
+            }
+            //Results are in descending similarity: the first old enough one is the best
+            if (labels[i] <= index.nextLabel() - max_index && similarities[i] > thres) {
+                ret[q] = labels[i] + index_offset;
+                similarity[q] = similarities[i];
+                break;
+            }
         }
     }
-    // ROS_INFO("Database return %ld on drone %d, radius %f frame_id %d", labels[k] + index_offset, return_drone_id, similiarity[k], return_frame_id);
-    return -1;
+    return ret;
 }
 
 
 bool LoopDetector::queryImageArrayFromDatabase(const VisualImageDescArray & img_desc_a,
-    VisualImageDescArray & ret, int & camera_index_new, int & camera_index_old) {
+    std::shared_ptr<const VisualImageDescArray> & ret, int & camera_index_new, int & camera_index_old, double * similarity) {
     double best_similarity = -1;
     int best_image_index = -1;
-    //Strict use camera_index 1 now
-    camera_index_new = 0;
-    if (loop_cam->getCameraConfiguration() == CameraConfig::STEREO_FISHEYE) {
-        camera_index_new = 1;
-    } else if (loop_cam->getCameraConfiguration() == CameraConfig::FOURCORNER_FISHEYE) {
-        //If four coner fishe, use camera 2.
-        camera_index_new = 2;
-    } else if (loop_cam->getCameraConfiguration() == CameraConfig::STEREO_PINHOLE ||
-        loop_cam->getCameraConfiguration() == CameraConfig::PINHOLE_DEPTH) {
-        camera_index_new = 0;
+    std::vector<int> cameras;
+    auto camera_configuration = params->camera_configuration;
+    if (camera_configuration == CameraConfig::STEREO_FISHEYE || camera_configuration == CameraConfig::FOURCORNER_FISHEYE) {
+        //Every camera sees a different direction
+        for (size_t i = 0; i < img_desc_a.images.size(); i++) {
+            cameras.emplace_back(i);
+        }
+    } else if (camera_configuration == CameraConfig::STEREO_PINHOLE || camera_configuration == CameraConfig::PINHOLE_DEPTH) {
+        cameras.emplace_back(0);
     } else {
-        ROS_ERROR("[LoopDetector] Camera configuration %d not support yet in queryImageArrayFromDatabase", loop_cam->getCameraConfiguration());
+        ROS_ERROR("[LoopDetector] Camera configuration %d not support yet in queryImageArrayFromDatabase", camera_configuration);
         exit(-1);
     }
-
-    if (img_desc_a.images[camera_index_new].spLandmarkNum() > 0 || img_desc_a.is_lazy_frame) {
-        double similarity = -1;
-        int index = queryFrameIndexFromDatabase(img_desc_a.images.at(camera_index_new), similarity);
-        if (index != -1 && similarity > best_similarity) {
-            best_image_index = index;
-            best_similarity = similarity;
+    std::vector<const VisualImageDesc*> imgs;
+    std::vector<int> img_cameras;
+    for (auto i : cameras) {
+        auto & img = img_desc_a.images.at(i);
+        if ((img.spLandmarkNum() > 0 || img_desc_a.is_lazy_frame) && img.image_desc.size() == params->netvlad_dims) {
+            imgs.emplace_back(&img);
+            img_cameras.emplace_back(i);
         }
+    }
+    std::vector<double> similarities;
+    auto indices = queryFrameIndexFromDatabase(imgs, similarities);
+    for (size_t i = 0; i < imgs.size(); i++) {
+        if (indices[i] != -1 && similarities[i] > best_similarity) {
+            best_image_index = indices[i];
+            best_similarity = similarities[i];
+            camera_index_new = img_cameras[i];
+        }
+    }
 
-        if (best_image_index != -1) {
-            const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
-            int frame_id = index_to_frame_id[best_image_index];
-            camera_index_old = imgid2dir[best_image_index];
-            printf("[LoopDetector] Query image for %ld: ret frame_id %d index %d drone %d with camera %d similarity %f\n", 
-                img_desc_a.frame_id, frame_id, best_image_index, keyframe_database.at(frame_id).drone_id, camera_index_old, best_similarity);
-            ret = keyframe_database.at(frame_id);
-            return true;
+    if (best_image_index != -1) {
+        const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+        int frame_id = index_to_frame_id[best_image_index];
+        camera_index_old = imgid2dir[best_image_index];
+        ret = keyframe(frame_id);
+        if (!ret) {
+            camera_index_old = -1;
+            return false;
+        }
+        printf("[LoopDetector] Query image for %ld: ret frame_id %d index %d drone %d with camera %d->%d similarity %f\n", 
+            img_desc_a.frame_id, frame_id, best_image_index, ret->drone_id, camera_index_new, camera_index_old, best_similarity);
+        touchKeyframe(frame_id);
+        if (similarity) {
+            *similarity = best_similarity;
         }
+        return true;
     }
 
     camera_index_old = -1;
-    ret.frame_id = -1;
+    ret.reset();
     return false;
 }
 
 
 int LoopDetector::databaseSize() const {
-    return local_index.ntotal + remote_index.ntotal;
+    return local_index.size() + remote_index.size();
 }
 
 
@@ -388,12 +721,59 @@ bool LoopDetector::checkLoopOdometryConsistency(LoopEdge & loop_conn) const {
     return true;
 }
 
+double LoopDetector::updateTravel(const VisualImageDescArray & frame) {
+    auto it = drone_travel.find(frame.drone_id);
+    if (it == drone_travel.end()) {
+        drone_travel[frame.drone_id] = std::make_pair(frame.pose_drone, 0.0);
+        return 0;
+    }
+    //Piecewise linear along the frames received; a jump of the reference frame only widens the prior
+    it->second.second += (frame.pose_drone.pos() - it->second.first.pos()).norm();
+    it->second.first = frame.pose_drone;
+    return it->second.second;
+}
+
+bool LoopDetector::checkLoopPrior(const VisualImageDescArray & frame, const VisualImageDescArray & old_frame, double travel) {
+    if (!sameReferenceFrame(frame.drone_id, frame.reference_frame_id, old_frame.drone_id, old_frame.reference_frame_id)) {
+        return true;
+    }
+    double travel_old = -1;
+    {
+        const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+        auto it = keyframe_usage.find(old_frame.frame_id);
+        if (it != keyframe_usage.end()) {
+            travel_old = it->second.travel;
+        }
+    }
+    if (travel < 0 || travel_old < 0) {
+        //Restored from the keyframe store: the poses are from another session
+        return true;
+    }
+    //One drone drifts along the path between the frames; two drones along both their paths in the shared frame
+    double drift_travel = frame.drone_id == old_frame.drone_id ? fabs(travel - travel_old) : travel + travel_old;
+    auto pose = keyframePose(frame), pose_old = keyframePose(old_frame);
+    double md = loopPriorDistance(pose_old, pose, drift_travel);
+    prior_gate_checked++;
+    if (md > _config.prior_gate.threshold) {
+        prior_gate_rejected++;
+        printf("[LoopDetector@%d] Loop candidate %ld->%ld rejected by odometry prior %.1f travel %.1fm dpose %s. Rejected %d/%d\n",
+            self_id, old_frame.frame_id, frame.frame_id, md, drift_travel, Swarm::Pose::DeltaPose(pose_old, pose, true).toStr().c_str(),
+            prior_gate_rejected, prior_gate_checked);
+        return false;
+    }
+    if (params->verbose) {
+        printf("[LoopDetector@%d] Loop candidate %ld->%ld odometry prior OK %.1f travel %.1fm. Rejected %d/%d\n",
+            self_id, old_frame.frame_id, frame.frame_id, md, drift_travel, prior_gate_rejected, prior_gate_checked);
+    }
+    return true;
+}
+
 //Note! here the norms are both projected to main dir's unit sphere.
 //index2dirindex store the dir and the index of the point
 bool LoopDetector::computeCorrespondFeaturesOnImageArray(const VisualImageDescArray & frame_array_a,
     const VisualImageDescArray & frame_array_b, int main_dir_a, int main_dir_b,
     std::vector<Vector3d> &lm_pos_a, std::vector<Vector3d> &lm_norm_3d_b, std::vector<int> &cam_indices, std::vector<std::pair<int, int>> &index2dirindex_a,
-    std::vector<std::pair<int, int>> &index2dirindex_b) {
+    std::vector<std::pair<int, int>> &index2dirindex_b, std::vector<float> &match_dists) {
     std::vector<int> dirs_a;
     std::vector<int> dirs_b;
     
@@ -421,39 +801,52 @@ bool LoopDetector::computeCorrespondFeaturesOnImageArray(const VisualImageDescAr
     Eigen::Quaterniond main_quat_new =  extrinsic_a.att();
     Eigen::Quaterniond main_quat_old =  extrinsic_b.att();
 
-    int matched_dir_count = 0;
+    struct DirCorrespondence {
+        bool valid = true;
+        std::vector<Vector3d> lm_norm_3d_b;
+        std::vector<Vector3d> lm_pos_a;
+        std::vector<int> idx_a;
+        std::vector<int> idx_b;
+        std::vector<int> camera_indices;
+        std::vector<float> match_dists;
+    };
+    std::vector<DirCorrespondence> dir_results(dirs_a.size());
+    //Directions are matched independently; SuperGlue shares one session and stays serial
+    bool parallel = _config.parallel_correspondence && !_config.enable_superglue && dirs_a.size() > 1;
+#pragma omp parallel for schedule(dynamic) if(parallel)
     for (size_t i = 0; i < dirs_a.size(); i++) {
         int dir_a = dirs_a[i];
         int dir_b = dirs_b[i];
-        std::vector<Vector3d> _lm_norm_3d_b;
-        std::vector<Vector3d> _lm_pos_a;
-        std::vector<int> _idx_a;
-        std::vector<int> _idx_b;
-        std::vector<int> _camera_indices;
-
+        auto & ret = dir_results[i];
         if (dir_a < frame_array_a.images.size() && dir_b < frame_array_b.images.size() && dir_a >= 0 && dir_b >= 0) {
-            bool succ = computeCorrespondFeatures(frame_array_a.images[dir_a],frame_array_b.images[dir_b],
-                _lm_pos_a, _idx_a, _lm_norm_3d_b, _idx_b, _camera_indices);
-            // ROS_INFO("[LoopDetector] computeCorrespondFeatures on camera_index %d:%d gives %d common features", dir_b, dir_a, _lm_pos_a.size());
-            if (!succ) {
-                continue;
-            }
+            ret.valid = computeCorrespondFeatures(frame_array_a.images[dir_a],frame_array_b.images[dir_b],
+                ret.lm_pos_a, ret.idx_a, ret.lm_norm_3d_b, ret.idx_b, ret.camera_indices, ret.match_dists);
+            // ROS_INFO("[LoopDetector] computeCorrespondFeatures on camera_index %d:%d gives %d common features", dir_b, dir_a, ret.lm_pos_a.size());
         }
+    }
 
-        if ( _lm_pos_a.size() >= _config.MIN_MATCH_PRE_DIR ) {
-            matched_dir_count ++;            
+    //Merged in direction order so that the output doesn't depend on the scheduling
+    int matched_dir_count = 0;
+    for (size_t i = 0; i < dirs_a.size(); i++) {
+        int dir_a = dirs_a[i];
+        int dir_b = dirs_b[i];
+        auto & ret = dir_results[i];
+        if (!ret.valid) {
+            continue;
         }
 
-        Swarm::Pose _extrinsic_a(frame_array_a.images[dir_a].extrinsic);
-        Swarm::Pose _extrinsic_b(frame_array_b.images[dir_b].extrinsic);
+        if ( ret.lm_pos_a.size() >= _config.MIN_MATCH_PRE_DIR ) {
+            matched_dir_count ++;            
+        }
 
-        for (size_t id = 0; id < _lm_norm_3d_b.size(); id++) {
-            index2dirindex_a.push_back(std::make_pair(dir_a, _idx_a[id]));
-            index2dirindex_b.push_back(std::make_pair(dir_b, _idx_b[id]));
+        for (size_t id = 0; id < ret.lm_norm_3d_b.size(); id++) {
+            index2dirindex_a.push_back(std::make_pair(dir_a, ret.idx_a[id]));
+            index2dirindex_b.push_back(std::make_pair(dir_b, ret.idx_b[id]));
         }
-        lm_pos_a.insert(lm_pos_a.end(), _lm_pos_a.begin(), _lm_pos_a.end());
-        lm_norm_3d_b.insert(lm_norm_3d_b.end(), _lm_norm_3d_b.begin(), _lm_norm_3d_b.end());
-        cam_indices.insert(cam_indices.end(), _camera_indices.begin(), _camera_indices.end());
+        lm_pos_a.insert(lm_pos_a.end(), ret.lm_pos_a.begin(), ret.lm_pos_a.end());
+        lm_norm_3d_b.insert(lm_norm_3d_b.end(), ret.lm_norm_3d_b.begin(), ret.lm_norm_3d_b.end());
+        cam_indices.insert(cam_indices.end(), ret.camera_indices.begin(), ret.camera_indices.end());
+        match_dists.insert(match_dists.end(), ret.match_dists.begin(), ret.match_dists.end());
     }
 
     if(lm_norm_3d_b.size() > _config.loop_inlier_feature_num && matched_dir_count >= _config.MIN_DIRECTION_LOOP) {
@@ -468,7 +861,7 @@ bool LoopDetector::computeCorrespondFeaturesOnImageArray(const VisualImageDescAr
 
 bool LoopDetector::computeCorrespondFeatures(const VisualImageDesc & img_desc_a, const VisualImageDesc & img_desc_b, 
             std::vector<Vector3d> &lm_pos_a, std::vector<int> &idx_a, std::vector<Vector3d> &lm_norm_3d_b, 
-            std::vector<int> &idx_b, std::vector<int> &cam_indices) {
+            std::vector<int> &idx_b, std::vector<int> &cam_indices, std::vector<float> &match_dists) {
     std::vector<cv::DMatch> _matches;
     auto & _a_lms = img_desc_a.landmarks;
     auto & _b_lms = img_desc_b.landmarks;
@@ -480,6 +873,8 @@ bool LoopDetector::computeCorrespondFeatures(const VisualImageDesc & img_desc_a,
         auto & desc1 = img_desc_b.landmark_descriptor;
         auto & scores0 = img_desc_a.landmark_scores;
         auto & scores1 = img_desc_b.landmark_scores;
+        //One session for all the verification workers
+        const std::lock_guard<std::mutex> lock(superglue_mutex);
         _matches = superglue->inference(kpts_a, kpts_b, desc0, desc1, scores0, scores1);
     } else{ 
         assert(img_desc_a.spLandmarkNum() * params->superpoint_dims == img_desc_a.landmark_descriptor.size() && "Desciptor size of new img desc must equal to to landmarks*256!!!");
@@ -519,6 +914,7 @@ bool LoopDetector::computeCorrespondFeatures(const VisualImageDesc & img_desc_a,
             lm_pos_a.push_back(landmark_db.at(landmark_id).position);
             lm_norm_3d_b.push_back(pt3d_norm_b);
             cam_indices.push_back(img_desc_b.camera_index);
+            match_dists.push_back(match.distance);
     }
 
     if (lm_b_2d.size() < 4) {
@@ -531,6 +927,8 @@ bool LoopDetector::computeCorrespondFeatures(const VisualImageDesc & img_desc_a,
         reduceVector(idx_b, mask);
         reduceVector(lm_pos_a, mask);
         reduceVector(lm_norm_3d_b, mask);
+        reduceVector(cam_indices, mask);
+        reduceVector(match_dists, mask);
     }
     return true;
 }
@@ -561,9 +959,14 @@ bool LoopDetector::computeLoop(const VisualImageDescArray & frame_array_a, const
     std::vector<int> inliers;
     std::vector<int> camera_indices;
     std::vector<std::pair<int, int>> index2dirindex_a, index2dirindex_b;
+    std::vector<float> match_dists;
+    auto pose_a = keyframePose(frame_array_a), pose_b = keyframePose(frame_array_b);
+    //The correspondences and the PnP run unlocked on the verification workers; the loop counters,
+    //the odometry and the visualization are shared with processImageArray
+    std::unique_lock<std::recursive_mutex> guard(frame_mutex, std::defer_lock);
     
     success = computeCorrespondFeaturesOnImageArray(frame_array_a, frame_array_b, 
-        main_dir_a, main_dir_b, lm_pos_a, lm_norm_3d_b, camera_indices, index2dirindex_a, index2dirindex_b);
+        main_dir_a, main_dir_b, lm_pos_a, lm_norm_3d_b, camera_indices, index2dirindex_a, index2dirindex_b, match_dists);
     
     if(success) {
         std::vector<Swarm::Pose> extrinsics;
@@ -571,11 +974,13 @@ bool LoopDetector::computeLoop(const VisualImageDescArray & frame_array_a, const
             extrinsics.push_back(img.extrinsic);
         }
         success = computeRelativePosePnPnonCentral(lm_pos_a, lm_norm_3d_b,
-                extrinsics, camera_indices, frame_array_a.pose_drone, frame_array_b.pose_drone, DP_old_to_new, inliers, _config.is_4dof);
+                extrinsics, camera_indices, pose_a, pose_b, DP_old_to_new, inliers, _config.is_4dof, true,
+                _config.enable_prosac ? match_dists : std::vector<float>());
         if (!success) {
             printf("[LoopDetector::computeLoop@%d] Compute relative pose failed!\n", self_id);
             return false;
         }
+        guard.lock();
 
         //setup return loop
         ret.relative_pose = DP_old_to_new.toROS();
@@ -585,8 +990,8 @@ bool LoopDetector::computeLoop(const VisualImageDescArray & frame_array_a, const
         ret.drone_id_b = frame_array_a.drone_id;
         ret.ts_b = ros::Time(frame_array_a.stamp);
 
-        ret.self_pose_a = toROSPose(frame_array_b.pose_drone);
-        ret.self_pose_b = toROSPose(frame_array_a.pose_drone);
+        ret.self_pose_a = toROSPose(pose_b);
+        ret.self_pose_b = toROSPose(pose_a);
 
         ret.keyframe_id_a = frame_array_b.frame_id;
         ret.keyframe_id_b = frame_array_a.frame_id;
@@ -619,6 +1024,9 @@ bool LoopDetector::computeLoop(const VisualImageDescArray & frame_array_a, const
     }
 
     if (params->show) {
+        if (!guard.owns_lock()) {
+            guard.lock();
+        }
         drawMatched(frame_array_a, frame_array_b, main_dir_a, main_dir_b, success, inliers, DP_old_to_new, index2dirindex_a, index2dirindex_b);
     }
 
@@ -633,18 +1041,23 @@ void LoopDetector::drawMatched(const VisualImageDescArray & frame_array_a,
     cv::Mat show;
     char title[100] = {0};
     std::vector<cv::Mat> _matched_imgs;
-    auto & imgs_a = msgid2cvimgs[frame_array_a.frame_id];
-    auto & imgs_b = msgid2cvimgs[frame_array_b.frame_id];
+    std::vector<cv::Mat> imgs_a, imgs_b;
+    image_cache.get(frame_array_a.frame_id, imgs_a);
+    image_cache.get(frame_array_b.frame_id, imgs_b);
     _matched_imgs.resize(imgs_b.size());
     for (size_t i = 0; i < imgs_b.size(); i ++) {
         int dir_a = ((-main_dir_b + main_dir_a + _config.MAX_DIRS) % _config.MAX_DIRS + i)% _config.MAX_DIRS;
-        if (!imgs_b[i].empty() && !imgs_a[dir_a].empty()) {
+        //Keyframes restored from the store have no image
+        if (!imgs_b[i].empty() && dir_a < imgs_a.size() && !imgs_a[dir_a].empty()) {
             cv::vconcat(imgs_b[i], imgs_a[dir_a], _matched_imgs[i]);
             if (_matched_imgs[i].channels() != 3) {
                 cv::cvtColor(_matched_imgs[i], _matched_imgs[i], cv::COLOR_GRAY2BGR);
             }
         }
     } 
+    if (_matched_imgs.empty()) {
+        return;
+    }
     std::set<int> inlier_set(inliers.begin(), inliers.end());
 
     for (int i = 0; i < index2dirindex_a.size(); i ++) {
@@ -655,7 +1068,7 @@ void LoopDetector::drawMatched(const VisualImageDescArray & frame_array_a,
         int new_dir_id = index2dirindex_a[i].first;
         auto pt_old = frame_array_b.images[old_dir_id].landmarks[old_pt_id].pt2d;
         auto pt_new = frame_array_a.images[new_dir_id].landmarks[new_pt_id].pt2d;
-        if (_matched_imgs[old_dir_id].empty()) {
+        if (old_dir_id >= _matched_imgs.size() || _matched_imgs[old_dir_id].empty()) {
             continue;
         }
         cv::Scalar color(rand() % 255, rand() % 255, rand() % 255);
@@ -670,12 +1083,19 @@ void LoopDetector::drawMatched(const VisualImageDescArray & frame_array_a,
     }
     
 
-    show = _matched_imgs[0];
-    for (size_t i = 1; i < _matched_imgs.size(); i ++) {
+    for (size_t i = 0; i < _matched_imgs.size(); i ++) {
         if (_matched_imgs[i].empty()) continue;
+        if (show.empty()) {
+            show = _matched_imgs[i];
+            continue;
+        }
         cv::line(_matched_imgs[i], cv::Point2f(0, 0), cv::Point2f(0, _matched_imgs[i].rows), cv::Scalar(255, 255, 0), 2);
         cv::hconcat(show, _matched_imgs[i], show);
     }
+    if (show.empty()) {
+        //No image of either frame left to draw
+        return;
+    }
 
     double dt = (frame_array_a.stamp - frame_array_b.stamp);
     if (success) {
@@ -688,9 +1108,9 @@ void LoopDetector::drawMatched(const VisualImageDescArray & frame_array_a,
         cv::putText(show, title, cv::Point2f(20, 60), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0), 2);
         sprintf(title, "%d<->%d", frame_array_b.frame_id, frame_array_a.frame_id);
         cv::putText(show, title, cv::Point2f(20, 90), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0), 2);
-        sprintf(title, "Ego A: %s", frame_array_a.pose_drone.toStr().c_str());
+        sprintf(title, "Ego A: %s", keyframePose(frame_array_a).toStr().c_str());
         cv::putText(show, title, cv::Point2f(20, 120), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0), 2);
-        sprintf(title, "Ego B: %s", frame_array_b.pose_drone.toStr().c_str());
+        sprintf(title, "Ego B: %s", keyframePose(frame_array_b).toStr().c_str());
         cv::putText(show, title, cv::Point2f(20, 150), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0), 2);
 
     } else {
@@ -733,26 +1153,119 @@ void LoopDetector::updatebySldWin(const std::vector<VINSFrame*> sld_win) {
     const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
     for (auto frame : sld_win) {
         auto frame_id = frame->frame_id;
-        if (keyframe_database.find(frame_id) != keyframe_database.end()) {
-            keyframe_database.at(frame_id).pose_drone = frame->odom.pose();
+        if (keyframe_poses.find(frame_id) != keyframe_poses.end()) {
+            keyframe_poses.at(frame_id) = frame->odom.pose();
+            auto usage = keyframe_usage.find(frame_id);
+            if (usage != keyframe_usage.end() && usage->second.in_cell) {
+                updateKeyframeCell(frame_id, usage->second, frame->odom.pose());
+            }
+        }
+        if (keyframe_store) {
+            keyframe_store->updatePose(frame_id, frame->odom.pose());
         }
     }
 }
 
 bool LoopDetector::hasFrame(FrameIdType frame_id) {
     const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
-    return keyframe_database.find(frame_id) != keyframe_database.end();
+    return keyframe_usage.find(frame_id) != keyframe_usage.end();
+}
+
+std::shared_ptr<const VisualImageDescArray> LoopDetector::keyframe(int64_t frame_id) {
+    auto it = keyframe_database.find(frame_id);
+    if (it != keyframe_database.end()) {
+        return it->second;
+    }
+    if (!keyframe_store || keyframe_usage.find(frame_id) == keyframe_usage.end()) {
+        return nullptr;
+    }
+    auto frame = std::make_shared<VisualImageDescArray>();
+    if (!keyframe_store->load(frame_id, *frame)) {
+        //Unreadable record: forget the keyframe so it is not returned by the index again
+        ROS_WARN("[LoopDetector@%d] Failed to load keyframe %ld from the store, dropped", self_id, frame_id);
+        dropKeyframe(frame_id);
+        return nullptr;
+    }
+    auto & usage = keyframe_usage.at(frame_id);
+    usage.bytes = keyframeBytes(*frame);
+    database_bytes += usage.bytes;
+    eviction_order.insert(evictionKey(frame_id, usage));
+    return keyframe_database[frame_id] = frame;
+}
+
+Swarm::Pose LoopDetector::keyframePose(const VisualImageDescArray & frame) const {
+    const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+    auto it = keyframe_poses.find(frame.frame_id);
+    if (it != keyframe_poses.end()) {
+        return it->second;
+    }
+    return frame.pose_drone;
+}
+
+void LoopDetector::restoreKeyframes() {
+    TicToc tic;
+    const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+    //Only the ids and the global descriptors are read, the keyframes are loaded when queried
+    for (auto frame_id : keyframe_store->frameIds()) {
+        KeyframeRecordView record;
+        if (!keyframe_store->view(frame_id, record)) {
+            //Not restored on the next start either
+            keyframe_store->remove(frame_id);
+            continue;
+        }
+        KeyframeUsage usage;
+        usage.drone_id = record.drone_id;
+        usage.restored = true;
+        usage.added = added_count++;
+        keyframe_poses[frame_id] = record.pose_drone;
+        for (int i = 0; i < record.desc_num; i++) {
+            auto desc = record.descs + i * params->netvlad_dims;
+            int index = record.drone_id == self_id ? local_index.add(desc) :
+                remote_index.add(desc) + REMOTE_MAGIN_NUMBER;
+            index_to_frame_id[index] = frame_id;
+            imgid2dir[index] = record.desc_images[i];
+            usage.index_labels.emplace_back(index);
+        }
+        keyframe_usage[frame_id] = usage;
+        if (record.drone_id == self_id) {
+            reserveKeyframeId(frame_id, self_id);
+        }
+    }
+    printf("[LoopDetector@%d] Restored %ld keyframes (%.1fMB) from %s in %.1fms\n", self_id, keyframe_usage.size(),
+        keyframe_store->fileSize() / 1024.0 / 1024.0, _config.keyframe_store_path.c_str(), tic.toc());
 }
 
 LoopDetector::LoopDetector(int _self_id, const LoopDetectorConfig & config):
         self_id(_self_id),
         _config(config),
-        local_index(params->netvlad_dims), 
-        remote_index(params->netvlad_dims), 
-    ego_motion_traj(_self_id, true, _config.pos_covariance_per_meter, _config.yaw_covariance_per_meter) {
+        local_index(params->netvlad_dims, config.global_index), 
+        remote_index(params->netvlad_dims, config.global_index), 
+    ego_motion_traj(_self_id, true, _config.pos_covariance_per_meter, _config.yaw_covariance_per_meter),
+        image_cache(config.loop_image_cache_frames, cv::Size(params->width, params->height)) {
     if (_config.enable_superglue) {
         superglue = new SuperGlueOnnx(_config.superglue_model_path);
     }
+    if (!_config.keyframe_store_path.empty()) {
+        keyframe_store = new KeyframeStore(_config.keyframe_store_path, params->netvlad_dims);
+        if (keyframe_store->open()) {
+            if (keyframe_store->deadRatio() > _config.keyframe_store_compact_ratio) {
+                keyframe_store->compact();
+            }
+            restoreKeyframes();
+        } else {
+            delete keyframe_store;
+            keyframe_store = nullptr;
+        }
+    }
+    if (_config.verification.threads > 0) {
+        verification_pool = new LoopVerificationPool(_config.verification);
+    }
+}
+
+LoopDetector::~LoopDetector() {
+    //The workers use the database: stopped first
+    delete verification_pool;
+    delete keyframe_store;
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include <d2frontend/loop_image_cache.h>
+#include <opencv2/imgcodecs.hpp>
+
+namespace D2FrontEnd {
+
+LoopImageCache::LoopImageCache(size_t _decoded_capacity, cv::Size _placeholder_size):
+    decoded_capacity(std::max<size_t>(_decoded_capacity, 1)), placeholder_size(_placeholder_size) {
+}
+
+std::vector<uint8_t> LoopImageCache::compress(const cv::Mat & img) {
+    std::vector<uint8_t> buf;
+    //Fastest PNG level: the images are written once per keyframe and seldom read
+    cv::imencode(".png", img, buf, {cv::IMWRITE_PNG_COMPRESSION, 1});
+    return buf;
+}
+
+void LoopImageCache::add(FrameIdType frame_id, std::vector<std::vector<uint8_t>> && compressed) {
+    Entry entry;
+    entry.compressed = std::move(compressed);
+    for (auto & buf : entry.compressed) {
+        entry.bytes += buf.size();
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = entries.find(frame_id);
+    if (it != entries.end()) {
+        compressed_bytes -= it->second.bytes;
+    }
+    compressed_bytes += entry.bytes;
+    entries[frame_id] = std::move(entry);
+    decoded.remove_if([&](const std::pair<FrameIdType, std::vector<cv::Mat>> & d) { return d.first == frame_id; });
+}
+
+bool LoopImageCache::get(FrameIdType frame_id, std::vector<cv::Mat> & imgs) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto it = decoded.begin(); it != decoded.end(); it++) {
+        if (it->first == frame_id) {
+            decoded.splice(decoded.begin(), decoded, it);
+            imgs = it->second;
+            return true;
+        }
+    }
+    auto it = entries.find(frame_id);
+    if (it == entries.end()) {
+        imgs.clear();
+        return false;
+    }
+    imgs.clear();
+    for (auto & buf : it->second.compressed) {
+        if (buf.empty()) {
+            imgs.emplace_back(placeholder_size, CV_8U, cv::Scalar(255));
+        } else {
+            imgs.emplace_back(cv::imdecode(buf, cv::IMREAD_UNCHANGED));
+        }
+    }
+    decoded.emplace_front(frame_id, imgs);
+    while (decoded.size() > decoded_capacity) {
+        decoded.pop_back();
+    }
+    return true;
+}
+
+void LoopImageCache::erase(FrameIdType frame_id) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = entries.find(frame_id);
+    if (it != entries.end()) {
+        compressed_bytes -= it->second.bytes;
+        entries.erase(it);
+    }
+    decoded.remove_if([&](const std::pair<FrameIdType, std::vector<cv::Mat>> & d) { return d.first == frame_id; });
+}
+
+bool LoopImageCache::has(FrameIdType frame_id) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return entries.find(frame_id) != entries.end();
+}
+
+size_t LoopImageCache::bytes(FrameIdType frame_id) const {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = entries.find(frame_id);
+    return it == entries.end() ? 0 : it->second.bytes;
+}
+
+size_t LoopImageCache::compressedBytes() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return compressed_bytes;
+}
+
+size_t LoopImageCache::decodedBytes() const {
+    std::lock_guard<std::mutex> guard(lock);
+    size_t bytes = 0;
+    for (auto & d : decoded) {
+        for (auto & img : d.second) {
+            bytes += img.total() * img.elemSize();
+        }
+    }
+    return bytes;
+}
+
+}
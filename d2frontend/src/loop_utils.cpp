@@ -2,6 +2,7 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/eigen.hpp>
 #include <fstream>
+#include <cfloat>
 #include <d2common/d2basetypes.h>
 #include <d2common/utils.hpp>
 #include <d2frontend/d2frontend_params.h>
@@ -10,6 +11,7 @@
 #include <opengv/absolute_pose/NoncentralAbsoluteAdapter.hpp>
 #include <opengv/sac/Ransac.hpp>
 #include <opengv/sac/Lmeds.hpp>
+#include <d2frontend/prosac.h>
 #include <d2frontend/loop_detector.h>
 #include <opencv2/cudaoptflow.hpp>
 #include <opencv2/cudaimgproc.hpp>
@@ -25,8 +27,6 @@ using D2Common::Utility::TicToc;
 
 namespace D2FrontEnd {
 
-std::vector<cv::Point2f> detectFastByRegion(cv::InputArray _img, cv::InputArray _mask, int features, int cols, int rows);
-
 cv::Mat getImageFromMsg(const sensor_msgs::CompressedImageConstPtr &img_msg, int flag) {
     return cv::imdecode(img_msg->data, flag);
 }
@@ -220,7 +220,7 @@ bool inBorder(const cv::Point2f &pt, cv::Size shape)
 std::vector<cv::DMatch> matchKNN(const cv::Mat & desc_a, const cv::Mat & desc_b, double knn_match_ratio, 
         const std::vector<cv::Point2f> pts_a,
         const std::vector<cv::Point2f> pts_b,
-        double search_local_dist) {
+        double search_local_dist, std::vector<float> * ratios) {
     //Match descriptors with OpenCV knnMatch
     std::vector<std::vector<cv::DMatch>> matches;
     cv::BFMatcher bfmatcher(cv::NORM_L2);
@@ -237,11 +237,43 @@ std::vector<cv::DMatch> matchKNN(const cv::Mat & desc_a, const cv::Mat & desc_b,
                 }
             }
             good_matches.push_back(match[0]);
+            if (ratios) {
+                ratios->push_back(match[0].distance / match[1].distance);
+            }
         }
     }
     return good_matches;
 }
 
+MatchQuality evaluateMatchQuality(const std::vector<cv::DMatch> & matches, const std::vector<float> & ratios,
+        const std::vector<cv::Point2f> & pts_pred_a, const std::vector<cv::Point2f> & pts_b,
+        double knn_match_ratio, int min_matches, double max_pred_dist) {
+    MatchQuality quality;
+    quality.num = matches.size();
+    if (matches.empty()) {
+        return quality;
+    }
+    double sum_ratio = 0;
+    for (auto ratio : ratios) {
+        sum_ratio += ratio;
+    }
+    quality.mean_ratio = ratios.empty() ? knn_match_ratio : sum_ratio / ratios.size();
+    if (!pts_pred_a.empty()) {
+        int consistent = 0;
+        for (auto & match : matches) {
+            if (cv::norm(pts_pred_a[match.queryIdx] - pts_b[match.trainIdx]) < max_pred_dist) {
+                consistent++;
+            }
+        }
+        quality.consistency = (double) consistent / matches.size();
+    }
+    //Few matches are never trusted; distinctive descriptors do not make up for an inconsistent geometry
+    double count_term = std::min(1.0, (double) quality.num / min_matches);
+    double ratio_term = std::max(0.0, 1.0 - quality.mean_ratio / knn_match_ratio);
+    quality.score = count_term * sqrt(ratio_term * quality.consistency);
+    return quality;
+}
+
 
 std::vector<cv::Point2f> opticalflowTrack(const cv::Mat & cur_img, const cv::Mat & prev_img, std::vector<cv::Point2f> & prev_pts, 
         std::vector<LandmarkIdType> & ids, TrackLRType type, bool enable_cuda) {
@@ -454,6 +486,25 @@ std::vector<cv::Point2f> opticalflowTrackPyr(const cv::Mat & cur_img, std::vecto
 } 
 
 
+//Creating the CUDA detector allocates its buffers, so it is kept per thread and only rebuilt when the settings change
+struct GFTTDetectorCache {
+    cv::Ptr<cv::cuda::CornersDetector> detector;
+    int type = -1;
+    int max_corners = 0;
+    double min_dist = 0;
+};
+
+cv::Ptr<cv::cuda::CornersDetector> getGFTTDetector(int type, int max_corners, double min_dist) {
+    static thread_local GFTTDetectorCache cache;
+    if (cache.detector.empty() || cache.type != type || cache.max_corners != max_corners || cache.min_dist != min_dist) {
+        cache.detector = cv::cuda::createGoodFeaturesToTrackDetector(type, max_corners, 0.01, min_dist);
+        cache.type = type;
+        cache.max_corners = max_corners;
+        cache.min_dist = min_dist;
+    }
+    return cache.detector;
+}
+
 void detectPoints(const cv::Mat & img, std::vector<cv::Point2f> & n_pts, std::vector<cv::Point2f> & cur_pts, 
         int require_pts, bool enable_cuda, bool use_fast, int fast_rows, int fast_cols) {
     int lack_up_top_pts = require_pts - static_cast<int>(cur_pts.size());
@@ -474,8 +525,8 @@ void detectPoints(const cv::Mat & img, std::vector<cv::Point2f> & n_pts, std::ve
         } else {
             //Use goodFeaturesToTrack
             if (enable_cuda) {
-                cv::Ptr<cv::cuda::CornersDetector> detector = cv::cuda::createGoodFeaturesToTrackDetector(
-                    img.type(), num_to_detect, 0.01, params->feature_min_dist);
+                //Corners are sorted by quality, so a detector sized for the largest request gives the same first num_to_detect
+                auto detector = getGFTTDetector(img.type(), require_pts * 2, params->feature_min_dist);
                 cv::cuda::GpuMat d_prevPts_gpu;
                 cv::cuda::GpuMat img_cuda(img);
                 detector->detect(img_cuda, d_prevPts_gpu);
@@ -485,53 +536,128 @@ void detectPoints(const cv::Mat & img, std::vector<cv::Point2f> & n_pts, std::ve
             }
             if(!d_prevPts.empty()) {
                 n_pts_tmp = cv::Mat_<cv::Point2f>(cv::Mat(d_prevPts));
+                if (n_pts_tmp.size() > num_to_detect) {
+                    n_pts_tmp.resize(num_to_detect);
+                }
             }
             else {
                 n_pts_tmp.clear();
             }
         }
+        n_pts = selectSparsePoints(n_pts_tmp, cur_pts, params->feature_min_dist, lack_up_top_pts);
+    } else {
         n_pts.clear();
-        std::vector<cv::Point2f> all_pts = cur_pts;
-        for (auto & pt : n_pts_tmp) {
-            bool has_nearby = false;
-            for (auto &pt_j: all_pts) {
-                if (cv::norm(pt-pt_j) < params->feature_min_dist) {
-                    has_nearby = true;
-                    break;
-                }
-            }
-            if (!has_nearby) {
-                n_pts.push_back(pt);
-                all_pts.push_back(pt);
+    }
+}  
+
+std::vector<cv::Point2f> selectSparsePoints(const std::vector<cv::Point2f> & candidates, const std::vector<cv::Point2f> & existing,
+        double min_dist, int max_num) {
+    std::vector<cv::Point2f> ret;
+    if (min_dist <= 0) {
+        ret.insert(ret.end(), candidates.begin(), candidates.begin() + std::min((int)candidates.size(), std::max(max_num, 0)));
+        return ret;
+    }
+    //Occupancy grid with cells of min_dist, so only the 3x3 neighbouring cells can hold a point closer than min_dist
+    float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+    for (auto pts : {&candidates, &existing}) {
+        for (auto & pt : *pts) {
+            if (std::isfinite(pt.x) && std::isfinite(pt.y)) {
+                min_x = std::min(min_x, pt.x);
+                min_y = std::min(min_y, pt.y);
+                max_x = std::max(max_x, pt.x);
+                max_y = std::max(max_y, pt.y);
             }
-            if (n_pts.size() >= lack_up_top_pts) {
-                break;
+        }
+    }
+    if (min_x > max_x) {
+        return ret;
+    }
+    int grid_cols = (int)((max_x - min_x) / min_dist) + 1;
+    int grid_rows = (int)((max_y - min_y) / min_dist) + 1;
+    std::vector<int> head(grid_cols * grid_rows, -1), next;
+    std::vector<cv::Point2f> grid_pts;
+    next.reserve(existing.size() + max_num);
+    grid_pts.reserve(existing.size() + max_num);
+    auto cellOf = [&](const cv::Point2f & pt, int & cx, int & cy) {
+        cx = std::min((int)((pt.x - min_x) / min_dist), grid_cols - 1);
+        cy = std::min((int)((pt.y - min_y) / min_dist), grid_rows - 1);
+    };
+    auto insert = [&](const cv::Point2f & pt) {
+        int cx, cy;
+        cellOf(pt, cx, cy);
+        next.push_back(head[cy * grid_cols + cx]);
+        head[cy * grid_cols + cx] = grid_pts.size();
+        grid_pts.push_back(pt);
+    };
+    double min_dist2 = min_dist * min_dist;
+    auto hasNearby = [&](const cv::Point2f & pt) {
+        int cx, cy;
+        cellOf(pt, cx, cy);
+        for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, grid_rows - 1); y++) {
+            for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, grid_cols - 1); x++) {
+                for (int k = head[y * grid_cols + x]; k >= 0; k = next[k]) {
+                    double dx = pt.x - grid_pts[k].x, dy = pt.y - grid_pts[k].y;
+                    if (dx * dx + dy * dy < min_dist2) {
+                        return true;
+                    }
+                }
             }
         }
-    } else {
-        n_pts.clear();
+        return false;
+    };
+    for (auto & pt : existing) {
+        if (std::isfinite(pt.x) && std::isfinite(pt.y)) {
+            insert(pt);
+        }
     }
-}  
+    for (auto & pt : candidates) {
+        if (ret.size() >= max_num) {
+            break;
+        }
+        if (!std::isfinite(pt.x) || !std::isfinite(pt.y) || hasNearby(pt)) {
+            continue;
+        }
+        ret.push_back(pt);
+        insert(pt);
+    }
+    return ret;
+}
 
 std::vector<cv::Point2f> detectFastByRegion(cv::InputArray _img, cv::InputArray _mask, int features, int cols, int rows) {
-    int small_width = _img.cols() / cols;
-    int small_height = _img.rows() / rows;
+    cv::Mat img = _img.getMat();
+    cv::Mat mask = _mask.getMat();
+    int small_width = img.cols / cols;
+    int small_height = img.rows / rows;
     int num_features = ceil((double)features*1.5/ ((double) cols * rows));
-    auto fast = cv::cuda::FastFeatureDetector::create(10, true, cv::FastFeatureDetector::TYPE_9_16, features);
-    cv::cuda::GpuMat gpu_img(_img);
-    std::vector<cv::KeyPoint> total_kpts;
-    for (int i = 0; i < cols; i ++) {
-        for (int j = 0; j < rows; j ++) {
-            std::vector<cv::KeyPoint> kpts;
-            cv::Rect roi(small_width*i, small_height*j, small_width, small_height);
-            fast->detect(gpu_img(roi), kpts);
-            // printf("Detect %d features in region %d %d\n", kpts.size(), i, j);
-            for (auto kp : kpts) {
-                kp.pt.x = kp.pt.x + small_width*i;
-                kp.pt.y = kp.pt.y + small_height*j;
-                total_kpts.push_back(kp);
-            }
+    std::vector<std::vector<cv::KeyPoint>> region_kpts(cols * rows);
+    //Regions are small, so CPU FAST in parallel is cheaper than a GPU upload and launch per region
+#pragma omp parallel for schedule(dynamic)
+    for (int k = 0; k < cols * rows; k ++) {
+        int i = k / rows, j = k % rows;
+        //The last column and row of regions take the remainder of the image
+        int width = i == cols - 1 ? img.cols - small_width*i : small_width;
+        int height = j == rows - 1 ? img.rows - small_height*j : small_height;
+        cv::Rect roi(small_width*i, small_height*j, width, height);
+        auto & kpts = region_kpts[k];
+        cv::FAST(img(roi), kpts, 10, true, cv::FastFeatureDetector::TYPE_9_16);
+        if (!mask.empty()) {
+            cv::KeyPointsFilter::runByPixelsMask(kpts, mask(roi));
         }
+        //Keep the strongest ones of each region so that the features spread over the image
+        if (kpts.size() > num_features) {
+            std::nth_element(kpts.begin(), kpts.begin() + num_features, kpts.end(), [](const cv::KeyPoint & a, const cv::KeyPoint & b) {
+                return a.response > b.response;
+            });
+            kpts.resize(num_features);
+        }
+        for (auto & kp : kpts) {
+            kp.pt.x = kp.pt.x + roi.x;
+            kp.pt.y = kp.pt.y + roi.y;
+        }
+    }
+    std::vector<cv::KeyPoint> total_kpts;
+    for (auto & kpts : region_kpts) {
+        total_kpts.insert(total_kpts.end(), kpts.begin(), kpts.end());
     }
     //Sort the keypoints by confidence
     std::vector<cv::Point2f> ret;
@@ -574,6 +700,21 @@ double gravityCheck(const Swarm::Pose & pnp_pose, const Swarm::Pose & ego_motion
     return sin_theta;
 }
 
+bool sameReferenceFrame(int drone_id_a, int reference_frame_id_a, int drone_id_b, int reference_frame_id_b) {
+    //-1 is the odometry frame of each drone
+    return reference_frame_id_a == reference_frame_id_b && (drone_id_a == drone_id_b || reference_frame_id_a >= 0);
+}
+
+double loopPriorDistance(const Swarm::Pose & pose_a, const Swarm::Pose & pose_b, double travel) {
+    auto &_config = (*params->loopdetectorconfig);
+    auto dp = Swarm::Pose::DeltaPose(pose_a, pose_b, true);
+    //The accepted loops are a zero mean prior of the size of the acceptance bounds, widened by the drift
+    double max_yaw = _config.accept_loop_max_yaw * DEG2RAD;
+    double pos_var = _config.accept_loop_max_pos * _config.accept_loop_max_pos + _config.pos_covariance_per_meter * travel;
+    double yaw_var = max_yaw * max_yaw + _config.yaw_covariance_per_meter * travel;
+    return dp.pos().squaredNorm() / pos_var + dp.yaw() * dp.yaw() / yaw_var;
+}
+
 int computeRelativePosePnP(const std::vector<Vector3d> lm_positions_a, const std::vector<Vector3d> lm_3d_norm_b,
             Swarm::Pose extrinsic_b, Swarm::Pose ego_motion_a, Swarm::Pose ego_motion_b, Swarm::Pose & DP_b_to_a, std::vector<int> &inliers, 
             bool is_4dof, bool verify_gravity) {
@@ -613,7 +754,8 @@ int computeRelativePosePnP(const std::vector<Vector3d> lm_positions_a, const std
 }
 
 Swarm::Pose computePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
-        const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, std::vector<int> &inliers) {
+        const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, std::vector<int> &inliers,
+        const std::vector<float> & match_dists, int * iterations) {
     opengv::bearingVectors_t bearings;
     std::vector<int> camCorrespondences;
     opengv::points_t points;
@@ -632,18 +774,37 @@ Swarm::Pose computePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_
     //Solve with GP3P + RANSAC
     opengv::absolute_pose::NoncentralAbsoluteAdapter adapter(
         bearings, camCorrespondences, points, camOffsets, camRotations);
-    opengv::sac::Ransac<
-        opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem> ransac;
     std::shared_ptr<opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem> absposeproblem_ptr(new opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem(
         adapter, opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem::GP3P));
-    ransac.sac_model_ = absposeproblem_ptr;
-    // ransac.threshold_ = 1.0 - cos(atan(sqrt(10.0)*0.5/460.0));
-    ransac.threshold_ = 0.5/params->focal_length;
-    ransac.max_iterations_ = 50;
-    ransac.computeModel();
-    //Obtain relative pose results
-    inliers = ransac.inliers_;
-    auto best_transformation = ransac.model_coefficients_;
+    opengv::transformation_t best_transformation;
+    if (match_dists.size() == lm_positions_a.size() && !match_dists.empty()) {
+        //The best matches first: low inlier ratio candidates converge in a few samples
+        Prosac<opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem> prosac;
+        prosac.sac_model_ = absposeproblem_ptr;
+        prosac.threshold_ = 0.5/params->focal_length;
+        prosac.max_iterations_ = 50;
+        prosac.setMatchDistances(match_dists);
+        prosac.computeModel();
+        inliers = prosac.inliers_;
+        best_transformation = prosac.model_coefficients_;
+        if (iterations) {
+            *iterations = prosac.iterations_;
+        }
+    } else {
+        opengv::sac::Ransac<
+            opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem> ransac;
+        ransac.sac_model_ = absposeproblem_ptr;
+        // ransac.threshold_ = 1.0 - cos(atan(sqrt(10.0)*0.5/460.0));
+        ransac.threshold_ = 0.5/params->focal_length;
+        ransac.max_iterations_ = 50;
+        ransac.computeModel();
+        //Obtain relative pose results
+        inliers = ransac.inliers_;
+        best_transformation = ransac.model_coefficients_;
+        if (iterations) {
+            *iterations = ransac.iterations_;
+        }
+    }
     Matrix3d R = best_transformation.block<3, 3>(0, 0);
     Vector3d t = best_transformation.block<3, 1>(0, 3);
     Swarm::Pose p_drone_old_in_new_init(R, t);
@@ -676,9 +837,11 @@ Swarm::Pose computePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_
 int computeRelativePosePnPnonCentral(const std::vector<Vector3d> & lm_positions_a, const std::vector<Vector3d> & lm_3d_norm_b,
         const std::vector<Swarm::Pose> & cam_extrinsics, const std::vector<int> & camera_indices, 
         Swarm::Pose drone_pose_a, Swarm::Pose ego_motion_b, 
-        Swarm::Pose & DP_b_to_a, std::vector<int> &inliers, bool is_4dof, bool verify_gravity) {
+        Swarm::Pose & DP_b_to_a, std::vector<int> &inliers, bool is_4dof, bool verify_gravity,
+        const std::vector<float> & match_dists) {
     D2Common::Utility::TicToc tic;
-    auto pnp_predict_pose_b = computePosePnPnonCentral(lm_positions_a, lm_3d_norm_b, cam_extrinsics, camera_indices, inliers);
+    auto pnp_predict_pose_b = computePosePnPnonCentral(lm_positions_a, lm_3d_norm_b, cam_extrinsics, camera_indices, inliers,
+        match_dists);
     DP_b_to_a =  Swarm::Pose::DeltaPose(pnp_predict_pose_b, drone_pose_a, is_4dof);
 
     bool success = true;
@@ -0,0 +1,174 @@
+#include <d2frontend/loop_verification_pool.h>
+#include <algorithm>
+#include <iterator>
+
+namespace D2FrontEnd {
+
+LoopVerificationPool::LoopVerificationPool(const LoopVerificationConfig & _config):
+    config(_config) {
+    config.queue_size = std::max<size_t>(config.queue_size, 1);
+    for (int i = 0; i < config.threads; i++) {
+        workers.emplace_back(&LoopVerificationPool::workerLoop, this);
+    }
+}
+
+LoopVerificationPool::~LoopVerificationPool() {
+    close();
+    for (auto & worker : workers) {
+        worker.join();
+    }
+}
+
+void LoopVerificationPool::close() {
+    std::vector<LoopVerificationJob> cancelled;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        for (auto & entry : queue) {
+            cancelled.emplace_back(entry.job);
+        }
+        _stats.cancelled += queue.size();
+        queue.clear();
+    }
+    not_empty.notify_all();
+    idle.notify_all();
+    cancelJobs(cancelled);
+}
+
+void LoopVerificationPool::cancelJobs(std::vector<LoopVerificationJob> & cancelled) {
+    for (auto & job : cancelled) {
+        if (job.on_cancel) {
+            job.on_cancel();
+        }
+    }
+}
+
+void LoopVerificationPool::takeStale(std::chrono::steady_clock::time_point now, std::vector<LoopVerificationJob> & cancelled) {
+    if (config.latency_budget_ms <= 0) {
+        return;
+    }
+    auto budget = std::chrono::duration<double, std::milli>(config.latency_budget_ms);
+    for (auto it = queue.begin(); it != queue.end();) {
+        if (now - it->submitted > budget) {
+            cancelled.emplace_back(it->job);
+            it = queue.erase(it);
+            _stats.cancelled++;
+        } else {
+            it++;
+        }
+    }
+}
+
+bool LoopVerificationPool::submit(LoopVerificationJob job) {
+    std::vector<LoopVerificationJob> cancelled;
+    bool accepted = true;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto now = std::chrono::steady_clock::now();
+        _stats.submitted++;
+        Entry entry{std::move(job), seq++, now};
+        if (closed) {
+            cancelled.emplace_back(std::move(entry.job));
+            _stats.dropped++;
+            accepted = false;
+        } else {
+            takeStale(now, cancelled);
+            if (queue.size() >= config.queue_size) {
+                auto worst = std::prev(queue.end());
+                if (EntryPriority()(*worst, entry)) {
+                    //The new candidate is the least important one
+                    cancelled.emplace_back(std::move(entry.job));
+                    accepted = false;
+                } else {
+                    cancelled.emplace_back(worst->job);
+                    queue.erase(worst);
+                }
+                _stats.dropped++;
+            }
+            if (accepted) {
+                queue.emplace(std::move(entry));
+            }
+        }
+    }
+    if (accepted) {
+        not_empty.notify_one();
+    }
+    cancelJobs(cancelled);
+    return accepted;
+}
+
+int LoopVerificationPool::cancel(FrameIdType frame_id) {
+    std::vector<LoopVerificationJob> cancelled;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (it->job.frame_id == frame_id) {
+                cancelled.emplace_back(it->job);
+                it = queue.erase(it);
+                _stats.cancelled++;
+            } else {
+                it++;
+            }
+        }
+        if (queue.empty() && running == 0) {
+            idle.notify_all();
+        }
+    }
+    cancelJobs(cancelled);
+    return cancelled.size();
+}
+
+void LoopVerificationPool::workerLoop() {
+    while (true) {
+        LoopVerificationJob job;
+        bool popped = false;
+        std::vector<LoopVerificationJob> cancelled;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            not_empty.wait(guard, [&] { return closed || !queue.empty(); });
+            if (closed) {
+                return;
+            }
+            auto now = std::chrono::steady_clock::now();
+            takeStale(now, cancelled);
+            if (!queue.empty()) {
+                auto it = queue.begin();
+                double wait_ms = std::chrono::duration<double, std::milli>(now - it->submitted).count();
+                _stats.max_wait_ms = std::max(_stats.max_wait_ms, wait_ms);
+                job = it->job;
+                queue.erase(it);
+                running++;
+                popped = true;
+            }
+        }
+        cancelJobs(cancelled);
+        if (popped && job.run) {
+            job.run();
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        if (popped) {
+            running--;
+            _stats.executed++;
+        }
+        if (queue.empty() && running == 0) {
+            idle.notify_all();
+        }
+    }
+}
+
+void LoopVerificationPool::waitIdle() {
+    std::unique_lock<std::mutex> guard(lock);
+    idle.wait(guard, [&] { return closed || (queue.empty() && running == 0); });
+}
+
+size_t LoopVerificationPool::size() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return queue.size();
+}
+
+LoopVerificationStats LoopVerificationPool::stats() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return _stats;
+}
+
+}
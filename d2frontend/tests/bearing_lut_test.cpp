@@ -0,0 +1,119 @@
+#include <camodocal/camera_models/BearingLUT.h>
+#include <camodocal/camera_models/EquidistantCamera.h>
+#include <camodocal/camera_models/PinholeCamera.h>
+#include <camodocal/camera_models/PinholeFullCamera.h>
+#include <camodocal/camera_models/CataCamera.h>
+#include <camodocal/camera_models/ScaramuzzaCamera.h>
+#include <camodocal/camera_models/PolyFisheyeCamera.h>
+#include <camodocal/camera_models/CylindricalCamera.h>
+#include <d2common/utils.hpp>
+#include <random>
+
+using namespace camodocal;
+using D2Common::Utility::TicToc;
+
+const int WIDTH = 640;
+const int HEIGHT = 480;
+std::mt19937 gen(0);
+
+std::vector<std::pair<std::string, CameraPtr>> testCameras() {
+    std::vector<std::pair<std::string, CameraPtr>> cams;
+    cams.emplace_back("KANNALA_BRANDT", CameraPtr(new EquidistantCamera(EquidistantCamera::Parameters("kb", WIDTH, HEIGHT,
+        0.01, -0.005, 0.001, -0.0002, 250, 250, 320, 240))));
+    cams.emplace_back("PINHOLE", CameraPtr(new PinholeCamera(PinholeCamera::Parameters("pinhole", WIDTH, HEIGHT,
+        -0.1, 0.02, 0.001, -0.001, 400, 400, 320, 240))));
+    cams.emplace_back("PINHOLE_FULL", CameraPtr(new PinholeFullCamera(PinholeFullCamera::Parameters("pinhole_full", WIDTH, HEIGHT,
+        -0.1, 0.02, 0.0, 0.0, 0.0, 0.0, 0.001, -0.001, 400, 400, 320, 240))));
+    cams.emplace_back("MEI", CameraPtr(new CataCamera(CataCamera::Parameters("mei", WIDTH, HEIGHT,
+        1.5, -0.1, 0.02, 0.001, -0.001, 600, 600, 320, 240))));
+    OCAMCamera::Parameters ocam;
+    ocam.cameraName() = "scaramuzza";
+    ocam.imageWidth() = WIDTH;
+    ocam.imageHeight() = HEIGHT;
+    ocam.C() = 1.0;
+    ocam.center_x() = 320;
+    ocam.center_y() = 240;
+    ocam.poly(0) = -300;
+    ocam.poly(2) = 1e-4;
+    cams.emplace_back("SCARAMUZZA", CameraPtr(new OCAMCamera(ocam)));
+    cams.emplace_back("POLYFISHEYE", CameraPtr(new PolyFisheyeCamera(PolyFisheyeCamera::Parameters("poly", WIDTH, HEIGHT,
+        0.01, -0.005, 0.001, 0.0, 0.0, 0.0, 0.0, 0.0, 250, 0, 250, 320, 240, 0))));
+    cams.emplace_back("CYLINDRICAL", CameraPtr(new CylindricalCamera(CylindricalCamera::Parameters("cylindrical", WIDTH, HEIGHT,
+        200, 200, 320, 240))));
+    return cams;
+}
+
+std::vector<cv::Point2f> randomPoints(int num) {
+    std::uniform_real_distribution<float> dist_x(0, WIDTH - 1), dist_y(0, HEIGHT - 1);
+    std::vector<cv::Point2f> pts;
+    for (int i = 0; i < num; i++) {
+        pts.emplace_back(dist_x(gen), dist_y(gen));
+    }
+    return pts;
+}
+
+double angle(const Eigen::Vector3d & a, const Eigen::Vector3d & b) {
+    return atan2(a.cross(b).norm(), a.dot(b));
+}
+
+//Bilinear interpolation of unit bearings has an error of about step^2/8 times their second derivative
+bool testAccuracy(const std::string & name, const CameraPtr & cam, int step) {
+    BearingLUT lut(cam, step);
+    auto pts = randomPoints(10000);
+    //Integer pixels hit the nodes exactly when step is 1
+    pts.emplace_back(0, 0);
+    pts.emplace_back(WIDTH - 1, HEIGHT - 1);
+    auto bearings = lut.liftProjectiveBatch(pts);
+    double max_err = 0;
+    int invalid = 0;
+    for (unsigned int i = 0; i < pts.size(); i++) {
+        Eigen::Vector3d P;
+        cam->liftProjective(Eigen::Vector2d(pts[i].x, pts[i].y), P);
+        P.normalize();
+        if (P.hasNaN()) {
+            invalid ++;
+            continue;
+        }
+        max_err = std::max(max_err, angle(P, bearings[i]));
+    }
+    double bound = 2e-5 * step * step + 1e-6;
+    bool success = max_err < bound;
+    printf("[bearing_lut_test] %s step %d: max angular error %.2e rad (bound %.2e) invalid %d %s\n", name.c_str(), step,
+        max_err, bound, invalid, success ? "OK" : "FAILED");
+    return success;
+}
+
+void benchmark(const std::string & name, const CameraPtr & cam, int step) {
+    TicToc tic;
+    BearingLUT lut(cam, step);
+    double t_build = tic.toc();
+    auto pts = randomPoints(100000);
+    std::vector<Eigen::Vector3d> bearings;
+    tic.tic();
+    for (auto & pt : pts) {
+        Eigen::Vector3d P;
+        cam->liftProjective(Eigen::Vector2d(pt.x, pt.y), P);
+    }
+    double t_exact = tic.toc();
+    tic.tic();
+    lut.liftProjectiveBatch(pts, bearings);
+    double t_lut = tic.toc();
+    printf("[bearing_lut_test] %s step %d: build %.1fms, %ld points exact %.2fMpts/s lut %.2fMpts/s\n", name.c_str(), step,
+        t_build, pts.size(), pts.size() / t_exact / 1000, pts.size() / t_lut / 1000);
+}
+
+int main(int argc, char** argv) {
+    bool success = true;
+    auto cams = testCameras();
+    for (auto & it : cams) {
+        for (int step : {1, 2, 4, 8}) {
+            success &= testAccuracy(it.first, it.second, step);
+        }
+    }
+    for (auto & it : cams) {
+        benchmark(it.first, it.second, 1);
+        benchmark(it.first, it.second, 4);
+    }
+    printf("[bearing_lut_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
@@ -0,0 +1,126 @@
+#include "d2frontend/d2frontend_params.h"
+#include "d2frontend/utils.h"
+#include "d2common/utils.hpp"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace D2FrontEnd;
+using D2Common::Utility::TicToc;
+D2FrontendParams * D2FrontEnd::params = new D2FrontendParams;
+
+const int WIDTH = 1280;
+const int HEIGHT = 720;
+
+cv::Mat syntheticImage(cv::RNG & rng) {
+    cv::Mat img(HEIGHT, WIDTH, CV_8UC1, cv::Scalar(128));
+    for (int i = 0; i < 1500; i++) {
+        cv::Point p(rng.uniform(0, WIDTH), rng.uniform(0, HEIGHT));
+        cv::Point size(rng.uniform(5, 60), rng.uniform(5, 60));
+        cv::rectangle(img, p, p + size, cv::Scalar(rng.uniform(0, 256)), cv::FILLED);
+    }
+    cv::GaussianBlur(img, img, cv::Size(3, 3), 0);
+    return img;
+}
+
+//Previous deduplication of detectPoints
+std::vector<cv::Point2f> selectSparsePointsBruteForce(const std::vector<cv::Point2f> & candidates,
+        const std::vector<cv::Point2f> & existing, double min_dist, int max_num) {
+    std::vector<cv::Point2f> ret, all_pts = existing;
+    for (auto & pt : candidates) {
+        bool has_nearby = false;
+        for (auto & pt_j : all_pts) {
+            if (cv::norm(pt - pt_j) < min_dist) {
+                has_nearby = true;
+                break;
+            }
+        }
+        if (!has_nearby) {
+            ret.push_back(pt);
+            all_pts.push_back(pt);
+        }
+        if (ret.size() >= max_num) {
+            break;
+        }
+    }
+    return ret;
+}
+
+bool respectsMinDist(const std::vector<cv::Point2f> & n_pts, const std::vector<cv::Point2f> & cur_pts, double min_dist) {
+    for (unsigned int i = 0; i < n_pts.size(); i++) {
+        for (unsigned int j = 0; j < n_pts.size(); j++) {
+            if (i != j && cv::norm(n_pts[i] - n_pts[j]) < min_dist) {
+                return false;
+            }
+        }
+        for (auto & pt : cur_pts) {
+            if (cv::norm(n_pts[i] - pt) < min_dist) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool testDedup(cv::RNG & rng) {
+    bool success = true;
+    for (double min_dist : {5.0, 20.0, 50.0}) {
+        std::vector<cv::Point2f> candidates, existing;
+        for (int i = 0; i < 2000; i++) {
+            candidates.emplace_back(rng.uniform(0.f, (float)WIDTH), rng.uniform(0.f, (float)HEIGHT));
+        }
+        for (int i = 0; i < 300; i++) {
+            existing.emplace_back(rng.uniform(0.f, (float)WIDTH), rng.uniform(0.f, (float)HEIGHT));
+        }
+        TicToc tic;
+        auto ref = selectSparsePointsBruteForce(candidates, existing, min_dist, 1000);
+        double t_ref = tic.toc();
+        tic.tic();
+        auto ret = selectSparsePoints(candidates, existing, min_dist, 1000);
+        double t_grid = tic.toc();
+        bool same = ref.size() == ret.size() && std::equal(ref.begin(), ref.end(), ret.begin());
+        printf("[detect_points_test] dedup min_dist %.0f: %ld selected, brute force %.2fms grid %.2fms %s\n", min_dist,
+            ret.size(), t_ref, t_grid, same ? "OK" : "FAILED");
+        success &= same;
+    }
+    return success;
+}
+
+bool testDetect(const cv::Mat & img, cv::RNG & rng, bool use_fast) {
+    std::vector<cv::Point2f> cur_pts;
+    for (int i = 0; i < 100; i++) {
+        cur_pts.emplace_back(rng.uniform(0.f, (float)WIDTH), rng.uniform(0.f, (float)HEIGHT));
+    }
+    int require_pts = 400;
+    int lack = require_pts - cur_pts.size();
+    std::vector<cv::Point2f> n_pts;
+    TicToc tic;
+    detectPoints(img, n_pts, cur_pts, require_pts, false, use_fast);
+    double dt = tic.toc();
+    bool min_dist_ok = respectsMinDist(n_pts, cur_pts, params->feature_min_dist);
+    //The synthetic image has enough corners to fill most of the lack
+    bool count_ok = n_pts.size() <= lack && n_pts.size() >= lack * 0.8;
+    printf("[detect_points_test] %s: %ld/%d new points in %.2fms, min dist %s count %s\n", use_fast ? "FAST" : "GFTT",
+        n_pts.size(), lack, dt, min_dist_ok ? "OK" : "FAILED", count_ok ? "OK" : "FAILED");
+    return min_dist_ok && count_ok;
+}
+
+int main(int argc, char** argv) {
+    cv::RNG rng(0);
+    params->feature_min_dist = 20;
+    cv::Mat img = syntheticImage(rng);
+    bool success = testDedup(rng);
+    success &= testDetect(img, rng, false);
+    success &= testDetect(img, rng, true);
+    //Parallel regions must give the same features regardless of the thread count
+    auto fast_a = detectFastByRegion(img, cv::noArray(), 800, 4, 3);
+#ifdef _OPENMP
+    omp_set_num_threads(1);
+#endif
+    auto fast_b = detectFastByRegion(img, cv::noArray(), 800, 4, 3);
+    bool stable = fast_a.size() == fast_b.size() && std::equal(fast_a.begin(), fast_a.end(), fast_b.begin());
+    printf("[detect_points_test] FAST by region: %ld features %s\n", fast_a.size(), stable ? "OK" : "FAILED");
+    success &= stable;
+    printf("[detect_points_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
@@ -0,0 +1,228 @@
+// Tracks local frames, frames of two remote drones and sliding window updates concurrently on one D2FeatureTracker.
+// CPU only (KNN matching, no LK). Build with -fsanitize=thread to check the locking of the tracker.
+#include <d2frontend/d2featuretracker.h>
+#include <d2frontend/d2frontend_params.h>
+#include <d2common/d2vinsframe.h>
+#include <d2common/utils.hpp>
+#include <camodocal/camera_models/PinholeCamera.h>
+#include <random>
+#include <thread>
+
+using namespace D2FrontEnd;
+using D2Common::VINSFrame;
+using D2Common::Utility::TicToc;
+
+const int WIDTH = 640;
+const int HEIGHT = 480;
+const int SELF_ID = 1;
+const int SCENE_SIZE = 450;
+const int WINDOW = 150;
+const int LOCAL_FRAMES = 300;
+const int REMOTE_FRAMES = 100;
+const int SLD_WIN_SIZE = 10;
+const std::vector<int> REMOTE_DRONES{2, 3};
+
+//Landmarks observed by all the drones
+struct Scene {
+    std::vector<std::vector<float>> descs;
+    std::vector<cv::Point2f> pts;
+    std::vector<float> image_desc;
+};
+
+std::vector<float> randomUnit(std::mt19937 & gen, int dims) {
+    std::normal_distribution<float> dist(0, 1);
+    Eigen::VectorXf v(dims);
+    for (int i = 0; i < dims; i++) {
+        v(i) = dist(gen);
+    }
+    v.normalize();
+    return std::vector<float>(v.data(), v.data() + dims);
+}
+
+Scene createScene() {
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> x(0, WIDTH - WINDOW), y(0, HEIGHT);
+    Scene scene;
+    for (int i = 0; i < SCENE_SIZE; i++) {
+        scene.descs.emplace_back(randomUnit(gen, params->superpoint_dims));
+        scene.pts.emplace_back(x(gen), y(gen));
+    }
+    scene.image_desc = randomUnit(gen, params->netvlad_dims);
+    return scene;
+}
+
+//Observation of the landmarks [start, start + WINDOW) of the scene; remote landmarks come with their own ids
+VisualImageDescArray createFrame(const Scene & scene, int start, FrameIdType frame_id, int drone_id, std::mt19937 & gen) {
+    std::normal_distribution<float> noise(0, 0.02);
+    VisualImageDescArray frames;
+    frames.frame_id = frame_id;
+    frames.drone_id = drone_id;
+    frames.reference_frame_id = SELF_ID;
+    frames.stamp = frame_id * 0.05;
+    VisualImageDesc img;
+    img.frame_id = frame_id;
+    img.drone_id = drone_id;
+    img.stamp = frames.stamp;
+    img.image_desc = scene.image_desc;
+    for (int i = start; i < start + WINDOW && i < SCENE_SIZE; i++) {
+        cv::Point2f pt = scene.pts[i] + cv::Point2f(0.5 * (start % WINDOW), 0);
+        Eigen::Vector3d pt3d_norm((pt.x - WIDTH / 2) / 400.0, (pt.y - HEIGHT / 2) / 400.0, 1.0);
+        LandmarkIdType landmark_id = drone_id == SELF_ID ? -1 : drone_id * MAX_FEATURE_NUM + i;
+        auto lm = LandmarkPerFrame::createLandmarkPerFrame(landmark_id, frame_id, frames.stamp,
+            LandmarkType::SuperPointLandmark, drone_id, 0, 0, pt, pt3d_norm.normalized());
+        lm.stamp_discover = frames.stamp;
+        img.landmarks.emplace_back(lm);
+        Eigen::Map<const Eigen::VectorXf> desc(scene.descs[i].data(), params->superpoint_dims);
+        Eigen::VectorXf desc_noisy = desc;
+        for (int j = 0; j < desc_noisy.size(); j++) {
+            desc_noisy(j) += noise(gen);
+        }
+        desc_noisy.normalize();
+        img.landmark_descriptor.insert(img.landmark_descriptor.end(), desc_noisy.data(), desc_noisy.data() + desc_noisy.size());
+        img.landmark_scores.push_back(1.0);
+    }
+    frames.images.emplace_back(img);
+    return frames;
+}
+
+struct StressResult {
+    double dt = 0;
+    int remote_matched = 0;
+    int inconsistent = 0;
+};
+
+StressResult runStress(const Scene & scene, bool concurrent) {
+    D2FeatureTracker * tracker = new D2FeatureTracker(*params->ftconfig);
+    tracker->cams.emplace_back(new camodocal::PinholeCamera(camodocal::PinholeCamera::Parameters("pinhole", WIDTH, HEIGHT,
+        0, 0, 0, 0, 400, 400, WIDTH / 2, HEIGHT / 2)));
+    std::atomic<int> local_done(-1);
+    std::atomic<bool> finished(false);
+    std::map<LandmarkIdType, int> local_lm_scene; //Local landmark id -> scene landmark
+    std::vector<std::pair<LandmarkIdType, int>> remote_lm_scene; //Local id matched by a remote landmark -> scene landmark
+    std::mutex result_lock;
+    StressResult result;
+
+    auto trackLocal = [&] (int k) {
+        std::mt19937 gen(k);
+        auto frames = createFrame(scene, k / 2, k, SELF_ID, gen);
+        tracker->trackLocalFrames(frames);
+        std::lock_guard<std::mutex> guard(result_lock);
+        for (size_t i = 0; i < frames.images[0].landmarks.size(); i++) {
+            auto landmark_id = frames.images[0].landmarks[i].landmark_id;
+            int scene_id = k / 2 + i;
+            if (local_lm_scene.find(landmark_id) != local_lm_scene.end() && local_lm_scene[landmark_id] != scene_id) {
+                result.inconsistent++;
+            }
+            local_lm_scene[landmark_id] = scene_id;
+        }
+        local_done = k;
+    };
+    auto trackRemote = [&] (int drone_id, int j) {
+        std::mt19937 gen(drone_id * 1000 + j);
+        int start = std::max(local_done.load(), 0) / 2;
+        auto frames = createFrame(scene, start, drone_id * 100000 + j, drone_id, gen);
+        bool matched = tracker->trackRemoteFrames(frames);
+        std::lock_guard<std::mutex> guard(result_lock);
+        result.remote_matched += matched;
+        for (size_t i = 0; i < frames.images[0].landmarks.size(); i++) {
+            auto landmark_id = frames.images[0].landmarks[i].landmark_id;
+            if (landmark_id / MAX_FEATURE_NUM == SELF_ID) {
+                remote_lm_scene.emplace_back(landmark_id, start + i);
+            }
+        }
+    };
+    //Backend margining keyframes out of the sliding window
+    std::thread sld_win([&] {
+        while (!finished) {
+            int last = local_done;
+            if (last >= 0) {
+                std::vector<VINSFrame> frames(SLD_WIN_SIZE);
+                std::vector<VINSFrame*> sld_win;
+                for (int i = 0; i < SLD_WIN_SIZE; i++) {
+                    frames[i].frame_id = last - SLD_WIN_SIZE + 1 + i;
+                    frames[i].reference_frame_id = SELF_ID;
+                    sld_win.push_back(&frames[i]);
+                }
+                tracker->updatebySldWin(sld_win);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    });
+
+    TicToc tic;
+    if (concurrent) {
+        std::vector<std::thread> threads;
+        threads.emplace_back([&] {
+            for (int k = 0; k < LOCAL_FRAMES; k++) {
+                trackLocal(k);
+            }
+        });
+        for (int drone_id : REMOTE_DRONES) {
+            threads.emplace_back([&, drone_id] {
+                while (local_done < 0) {
+                    std::this_thread::yield();
+                }
+                for (int j = 0; j < REMOTE_FRAMES; j++) {
+                    trackRemote(drone_id, j);
+                }
+            });
+        }
+        for (auto & th : threads) {
+            th.join();
+        }
+    } else {
+        int remote_count = 0;
+        for (int k = 0; k < LOCAL_FRAMES; k++) {
+            trackLocal(k);
+            for (; remote_count < REMOTE_FRAMES * (k + 1) / LOCAL_FRAMES; remote_count++) {
+                for (int drone_id : REMOTE_DRONES) {
+                    trackRemote(drone_id, remote_count);
+                }
+            }
+        }
+    }
+    result.dt = tic.toc();
+    finished = true;
+    sld_win.join();
+    delete tracker;
+    //Remote landmarks must be associated to the local landmark of the same scene point
+    for (auto & kv : remote_lm_scene) {
+        if (local_lm_scene.find(kv.first) == local_lm_scene.end() || local_lm_scene[kv.first] != kv.second) {
+            result.inconsistent++;
+        }
+    }
+    return result;
+}
+
+void printResult(const char * name, const StressResult & ret) {
+    int remote_total = REMOTE_FRAMES * REMOTE_DRONES.size();
+    printf("[feature_tracker_stress_test] %s: %d local %d remote frames in %.1fms, %.1f frames/s, remote matched %d inconsistent %d\n",
+        name, LOCAL_FRAMES, remote_total, ret.dt, (LOCAL_FRAMES + remote_total) / ret.dt * 1000, ret.remote_matched, ret.inconsistent);
+}
+
+int main(int argc, char** argv) {
+    params = new D2FrontendParams;
+    params->self_id = SELF_ID;
+    params->camera_configuration = CameraConfig::PINHOLE_DEPTH;
+    params->width = WIDTH;
+    params->height = HEIGHT;
+    params->netvlad_dims = 128;
+    params->camera_seq = {0};
+    params->show = false;
+    params->ftconfig = new D2FTConfig;
+    params->ftconfig->enable_lk_optical_flow = false;
+    params->ftconfig->enable_search_local_aera = false;
+    params->ftconfig->enable_motion_prediction_local = false;
+    params->ftconfig->enable_search_local_aera_remote = true; //Remote matching reads the landmark manager
+    params->ftconfig->frame_step = 1;
+    Scene scene = createScene();
+    auto serial = runStress(scene, false);
+    auto concurrent = runStress(scene, true);
+    int remote_total = REMOTE_FRAMES * REMOTE_DRONES.size();
+    printResult("serial", serial);
+    printResult("concurrent", concurrent);
+    bool success = serial.inconsistent == 0 && concurrent.inconsistent == 0 &&
+        serial.remote_matched > remote_total / 2 && concurrent.remote_matched > remote_total / 2;
+    printf("[feature_tracker_stress_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
@@ -0,0 +1,189 @@
+#include "d2common/bounded_queue.h"
+#include "d2common/utils.hpp"
+#include <thread>
+#include <atomic>
+#include <vector>
+
+using namespace D2Common;
+using D2Common::Utility::TicToc;
+
+//Stub of a pipeline stage taking ms milliseconds
+void work(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+bool isIncreasing(const std::vector<int> & seq) {
+    for (unsigned int i = 1; i < seq.size(); i++) {
+        if (seq[i] <= seq[i - 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//A slow consumer on a drop-oldest queue gets increasing ids, the last one included, and loses the rest
+bool testDropOldest() {
+    const int num = 200;
+    BoundedQueue<int> queue(2, QueueFullPolicy::DropOldest);
+    std::vector<int> received;
+    std::thread consumer([&] {
+        int id;
+        while (queue.pop(id)) {
+            received.push_back(id);
+            work(2);
+        }
+    });
+    for (int i = 0; i < num; i++) {
+        queue.push(i);
+        work(0);
+    }
+    queue.close();
+    consumer.join();
+    bool success = isIncreasing(received) && !received.empty() && received.back() == num - 1 &&
+        received.size() + queue.droppedCount() == num && queue.droppedCount() > 0;
+    printf("[frontend_pipeline_test] drop oldest: received %ld dropped %ld %s\n", received.size(), queue.droppedCount(),
+        success ? "OK" : "FAILED");
+    return success;
+}
+
+//A blocking queue applies back-pressure: everything arrives in order
+bool testBlock() {
+    const int num = 200;
+    BoundedQueue<int> queue(2, QueueFullPolicy::Block);
+    std::vector<int> received;
+    std::thread consumer([&] {
+        int id;
+        while (queue.pop(id)) {
+            received.push_back(id);
+            if (id % 20 == 0) {
+                work(2);
+            }
+        }
+    });
+    for (int i = 0; i < num; i++) {
+        queue.push(i);
+    }
+    queue.close();
+    consumer.join();
+    bool success = isIncreasing(received) && received.size() == num && queue.droppedCount() == 0;
+    printf("[frontend_pipeline_test] block: received %ld dropped %ld %s\n", received.size(), queue.droppedCount(),
+        success ? "OK" : "FAILED");
+    return success;
+}
+
+//decode/undistort -> descriptors -> tracking -> keyframe dispatch, with the durations of the stub stages
+std::vector<int> runPipeline(int num, int period_ms, const std::vector<int> & stage_ms, size_t & dropped, double & dt) {
+    BoundedQueue<int> raw_queue(2, QueueFullPolicy::DropOldest);
+    BoundedQueue<int> desc_queue(2, QueueFullPolicy::DropOldest);
+    BoundedQueue<int> keyframe_queue(100, QueueFullPolicy::Block);
+    std::vector<int> tracked;
+    TicToc tic;
+    std::thread descriptor([&] {
+        int id;
+        while (raw_queue.pop(id)) {
+            work(stage_ms[1]);
+            desc_queue.push(id);
+        }
+        desc_queue.close();
+    });
+    std::thread tracking([&] {
+        int id;
+        while (desc_queue.pop(id)) {
+            work(stage_ms[2]);
+            tracked.push_back(id);
+            if (id % 5 == 0) {
+                keyframe_queue.push(id);
+            }
+        }
+        keyframe_queue.close();
+    });
+    std::vector<int> keyframes;
+    std::thread loop_detection([&] {
+        int id;
+        while (keyframe_queue.pop(id)) {
+            keyframes.push_back(id);
+        }
+    });
+    for (int i = 0; i < num; i++) {
+        work(std::max(stage_ms[0], period_ms));
+        raw_queue.push(i);
+    }
+    raw_queue.close();
+    descriptor.join();
+    tracking.join();
+    loop_detection.join();
+    dt = tic.toc();
+    dropped = raw_queue.droppedCount() + desc_queue.droppedCount();
+    //All the keyframes of the tracked frames reach the loop detector
+    size_t tracked_keyframes = std::count_if(tracked.begin(), tracked.end(), [](int id) { return id % 5 == 0; });
+    if (keyframes.size() != tracked_keyframes || !isIncreasing(keyframes)) {
+        tracked.clear();
+    }
+    return tracked;
+}
+
+//Timing only decides how many frames are dropped: the tracked frames stay in order, every frame is either
+//tracked or counted as dropped and the newest one is always tracked
+bool checkTracked(const std::vector<int> & tracked, size_t dropped, int num) {
+    return !tracked.empty() && isIncreasing(tracked) && tracked.size() + dropped == num && tracked.back() == num - 1;
+}
+
+bool testPipeline() {
+    const int num = 100;
+    size_t dropped;
+    double t_pipeline;
+    //Frames arrive about as fast as the slowest stage
+    auto tracked = runPipeline(num, 10, {2, 8, 6}, dropped, t_pipeline);
+    bool success = checkTracked(tracked, dropped, num);
+    printf("[frontend_pipeline_test] pipeline: %.1f fps (serial %.1f fps), tracked %ld dropped %ld %s\n",
+        num / t_pipeline * 1000, 1000.0 / 16, tracked.size(), dropped, success ? "OK" : "FAILED");
+    //Overloaded: the camera is much faster than the CNN, late frames are dropped
+    tracked = runPipeline(num, 2, {2, 8, 6}, dropped, t_pipeline);
+    bool success_overload = checkTracked(tracked, dropped, num) && dropped > 0;
+    printf("[frontend_pipeline_test] overloaded pipeline: %.1f fps, tracked %ld dropped %ld %s\n",
+        tracked.size() / t_pipeline * 1000, tracked.size(), dropped, success_overload ? "OK" : "FAILED");
+    return success && success_overload;
+}
+
+//Shutdown as D2Frontend::stopPipeline: a stage waiting for input and a stage blocked on a full keyframe queue
+//with no loop detector left both exit once the queues are closed
+bool testShutdown() {
+    BoundedQueue<int> raw_queue(2, QueueFullPolicy::DropOldest);
+    BoundedQueue<int> keyframe_queue(1, QueueFullPolicy::Block);
+    std::atomic<bool> stopping{false};
+    std::atomic<int> exited{0};
+    std::thread descriptor([&] {
+        int id;
+        while (!stopping && raw_queue.pop(id)) {
+        }
+        exited++;
+    });
+    std::thread tracking([&] {
+        for (int id = 0; !stopping; id++) {
+            if (!keyframe_queue.push(id)) {
+                break;
+            }
+        }
+        exited++;
+    });
+    work(20);
+    TicToc tic;
+    stopping = true;
+    raw_queue.close();
+    keyframe_queue.close();
+    descriptor.join();
+    tracking.join();
+    double dt = tic.toc();
+    bool success = exited == 2;
+    printf("[frontend_pipeline_test] shutdown: joined in %.2fms %s\n", dt, success ? "OK" : "FAILED");
+    return success;
+}
+
+int main(int argc, char** argv) {
+    bool success = testDropOldest();
+    success &= testBlock();
+    success &= testPipeline();
+    success &= testShutdown();
+    printf("[frontend_pipeline_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
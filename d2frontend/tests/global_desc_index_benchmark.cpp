@@ -0,0 +1,167 @@
+// Recall@k and latency of the global descriptor indices against the exhaustive flat index. CPU only.
+// Usage: global_desc_index_benchmark [descriptors.bin dims]
+// descriptors.bin holds recorded NetVLAD descriptors as raw float32, one per row; the last 10% are the queries.
+#include <d2frontend/global_desc_index.h>
+#include <d2common/utils.hpp>
+#include <Eigen/Dense>
+#include <fstream>
+#include <random>
+#include <set>
+
+using namespace D2FrontEnd;
+using D2Common::Utility::TicToc;
+
+const int K = 15; //SEARCH_NEAREST_NUM + match_index_dist with the default config
+
+struct Dataset {
+    std::string name;
+    int dims;
+    std::vector<float> database; //num x dims
+    std::vector<float> queries;
+    int num() const {
+        return database.size() / dims;
+    }
+    int queryNum() const {
+        return queries.size() / dims;
+    }
+};
+
+//A mission revisiting places: each keyframe is a noisy view of one of the places
+Dataset syntheticDataset(int num, int places, int dims, int query_num) {
+    std::mt19937 gen(0);
+    std::normal_distribution<float> normal(0, 1);
+    std::uniform_int_distribution<int> place(0, places - 1);
+    std::vector<Eigen::VectorXf> centers;
+    for (int i = 0; i < places; i++) {
+        Eigen::VectorXf c(dims);
+        for (int j = 0; j < dims; j++) {
+            c(j) = normal(gen);
+        }
+        centers.emplace_back(c.normalized());
+    }
+    auto view = [&] (std::vector<float> & out) {
+        Eigen::VectorXf d = centers[place(gen)];
+        for (int j = 0; j < dims; j++) {
+            d(j) += 0.5 / sqrt(dims) * normal(gen);
+        }
+        d.normalize();
+        out.insert(out.end(), d.data(), d.data() + dims);
+    };
+    Dataset data;
+    data.name = "synthetic " + std::to_string(num) + "x" + std::to_string(dims);
+    data.dims = dims;
+    for (int i = 0; i < num; i++) {
+        view(data.database);
+    }
+    for (int i = 0; i < query_num; i++) {
+        view(data.queries);
+    }
+    return data;
+}
+
+bool recordedDataset(const std::string & path, int dims, Dataset & data) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        printf("[global_desc_index_benchmark] can't open %s\n", path.c_str());
+        return false;
+    }
+    size_t num = file.tellg() / (sizeof(float) * dims);
+    std::vector<float> descs(num * dims);
+    file.seekg(0);
+    file.read((char*)descs.data(), descs.size() * sizeof(float));
+    size_t query_num = std::max<size_t>(num / 10, 1);
+    data.name = path;
+    data.dims = dims;
+    data.database.assign(descs.begin(), descs.end() - query_num * dims);
+    data.queries.assign(descs.end() - query_num * dims, descs.end());
+    return true;
+}
+
+struct BenchmarkResult {
+    double add_ms = 0;
+    double query_ms = 0;
+    std::vector<std::vector<faiss::idx_t>> labels;
+};
+
+//With removed, 40% of the descriptors are removed after they are added
+BenchmarkResult run(const Dataset & data, const GlobalIndexConfig & config, bool removed = false) {
+    BenchmarkResult ret;
+    GlobalDescIndex index(data.dims, config);
+    TicToc tic;
+    for (int i = 0; i < data.num(); i++) {
+        index.add(data.database.data() + i * data.dims);
+    }
+    ret.add_ms = tic.toc();
+    for (int i = 0; removed && i < data.num(); i++) {
+        if (i % 5 < 2) {
+            index.remove(i);
+        }
+    }
+    std::vector<float> similarity(K);
+    std::vector<faiss::idx_t> labels(K);
+    tic.tic();
+    for (int i = 0; i < data.queryNum(); i++) {
+        index.search(data.queries.data() + i * data.dims, K, similarity.data(), labels.data());
+        ret.labels.push_back(labels);
+    }
+    ret.query_ms = tic.toc() / data.queryNum();
+    return ret;
+}
+
+double recall(const BenchmarkResult & exact, const BenchmarkResult & approx, int k) {
+    int found = 0;
+    for (size_t i = 0; i < exact.labels.size(); i++) {
+        std::set<faiss::idx_t> truth(exact.labels[i].begin(), exact.labels[i].begin() + k);
+        for (int j = 0; j < k; j++) {
+            found += truth.count(approx.labels[i][j]);
+        }
+    }
+    return (double) found / (exact.labels.size() * k);
+}
+
+void benchmark(const Dataset & data) {
+    printf("[global_desc_index_benchmark] %s: %d descriptors, %d queries\n", data.name.c_str(), data.num(), data.queryNum());
+    GlobalIndexConfig flat;
+    auto exact = run(data, flat);
+    printf("[global_desc_index_benchmark]   flat: add %.1fms query %.3fms\n", exact.add_ms, exact.query_ms);
+    std::vector<std::pair<std::string, GlobalIndexConfig>> configs;
+    for (int ef : {16, 64, 128}) {
+        GlobalIndexConfig config;
+        config.type = GLOBAL_INDEX_HNSW;
+        config.hnsw_ef_search = ef;
+        configs.emplace_back("hnsw ef " + std::to_string(ef), config);
+    }
+    for (int nprobe : {4, 8, 16}) {
+        GlobalIndexConfig config;
+        config.type = GLOBAL_INDEX_IVF;
+        config.ivf_nprobe = nprobe;
+        config.ivf_train_size = std::min(config.ivf_train_size, data.num());
+        configs.emplace_back("ivf nprobe " + std::to_string(nprobe), config);
+    }
+    for (auto & it : configs) {
+        auto ret = run(data, it.second);
+        printf("[global_desc_index_benchmark]   %s: add %.1fms query %.3fms (%.1fx) recall@1 %.3f recall@5 %.3f recall@%d %.3f\n",
+            it.first.c_str(), ret.add_ms, ret.query_ms, exact.query_ms / ret.query_ms, recall(exact, ret, 1), recall(exact, ret, 5),
+            K, recall(exact, ret, K));
+    }
+    //Removed HNSW nodes stay in the graph until the rebuild, the queries skip them
+    auto exact_removed = run(data, flat, true);
+    GlobalIndexConfig hnsw;
+    hnsw.type = GLOBAL_INDEX_HNSW;
+    auto ret = run(data, hnsw, true);
+    printf("[global_desc_index_benchmark]   hnsw ef %d, 40%% removed: query %.3fms (%.1fx) recall@1 %.3f recall@%d %.3f\n",
+        hnsw.hnsw_ef_search, ret.query_ms, exact_removed.query_ms / ret.query_ms, recall(exact_removed, ret, 1), K,
+        recall(exact_removed, ret, K));
+}
+
+int main(int argc, char** argv) {
+    benchmark(syntheticDataset(5000, 500, 1024, 200));
+    benchmark(syntheticDataset(50000, 5000, 1024, 200));
+    if (argc >= 3) {
+        Dataset recorded;
+        if (recordedDataset(argv[1], atoi(argv[2]), recorded)) {
+            benchmark(recorded);
+        }
+    }
+    return 0;
+}
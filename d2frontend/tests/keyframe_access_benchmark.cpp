@@ -0,0 +1,129 @@
+// Latency and heap allocation volume of loop database queries: shared keyframes against the deep copy they replaced. CPU only.
+#include <d2frontend/loop_detector.h>
+#include <d2common/d2frontend_types.h>
+#include <d2common/utils.hpp>
+#include <atomic>
+#include <new>
+#include <random>
+
+using namespace D2FrontEnd;
+using namespace D2Common;
+using D2Common::Utility::TicToc;
+
+std::atomic<size_t> allocated_bytes(0);
+
+void * operator new(size_t size) {
+    allocated_bytes += size;
+    void * ptr = malloc(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void * ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void * ptr, size_t) noexcept {
+    free(ptr);
+}
+
+const int CAMS = 4;
+const int LANDMARKS = 400;
+std::mt19937 gen(0);
+
+class TestLoopDetector: public LoopDetector {
+public:
+    TestLoopDetector(const LoopDetectorConfig & config): LoopDetector(params->self_id, config) {}
+    void add(VisualImageDescArray & frame) {
+        addImageArrayToDatabase(frame, true);
+    }
+    bool query(const VisualImageDescArray & frame, std::shared_ptr<const VisualImageDescArray> & ret) {
+        int camera_index_new, camera_index_old;
+        return queryImageArrayFromDatabase(frame, ret, camera_index_new, camera_index_old);
+    }
+};
+
+VisualImageDescArray createFrame(FrameIdType frame_id, const std::vector<Eigen::VectorXf> & descs, int landmarks) {
+    std::normal_distribution<float> noise(0, 1);
+    VisualImageDescArray frame;
+    frame.frame_id = frame_id;
+    frame.drone_id = params->self_id;
+    for (int i = 0; i < CAMS; i++) {
+        VisualImageDesc img;
+        img.frame_id = frame_id;
+        img.drone_id = params->self_id;
+        img.image_desc.assign(descs[i].data(), descs[i].data() + descs[i].size());
+        for (int j = 0; j < landmarks; j++) {
+            img.landmarks.emplace_back(LandmarkPerFrame::createLandmarkPerFrame(j, frame_id, 0.0, LandmarkType::SuperPointLandmark,
+                params->self_id, i, i, cv::Point2f(j, j), Eigen::Vector3d(0, 0, 1)));
+        }
+        img.landmark_descriptor.resize(landmarks * params->superpoint_dims, 0.1);
+        img.landmark_scores.resize(landmarks, 1.0);
+        frame.images.emplace_back(img);
+    }
+    return frame;
+}
+
+Eigen::VectorXf randomDesc() {
+    std::normal_distribution<float> normal(0, 1);
+    Eigen::VectorXf desc(params->netvlad_dims);
+    for (int j = 0; j < desc.size(); j++) {
+        desc(j) = normal(gen);
+    }
+    return desc.normalized();
+}
+
+int main(int argc, char** argv) {
+    params = new D2FrontendParams;
+    params->self_id = 1;
+    params->netvlad_dims = 1024;
+    params->camera_configuration = CameraConfig::FOURCORNER_FISHEYE;
+    LoopDetectorConfig config;
+    config.match_index_dist = 0;
+    config.loop_detection_netvlad_thres = 0.5;
+    TestLoopDetector detector(config);
+    std::vector<std::vector<Eigen::VectorXf>> places;
+    for (int i = 0; i < 200; i++) {
+        std::vector<Eigen::VectorXf> descs;
+        for (int j = 0; j < CAMS; j++) {
+            descs.emplace_back(randomDesc());
+        }
+        places.emplace_back(descs);
+        auto frame = createFrame(i, descs, LANDMARKS);
+        detector.add(frame);
+    }
+    //Revisits of the database places, without landmarks to keep the query frames cheap
+    std::vector<VisualImageDescArray> queries;
+    for (int i = 0; i < 200; i++) {
+        queries.emplace_back(createFrame(10000 + i, places[i], 1));
+    }
+    const int repeat = 5;
+    double t_shared = 0, t_copy = 0;
+    size_t bytes_shared = 0, bytes_copy = 0;
+    int found = 0;
+    for (int k = 0; k < repeat; k++) {
+        for (auto & q : queries) {
+            std::shared_ptr<const VisualImageDescArray> ret;
+            size_t bytes = allocated_bytes;
+            TicToc tic;
+            found += detector.query(q, ret);
+            t_shared += tic.toc();
+            bytes_shared += allocated_bytes - bytes;
+            //The copy out of the database done before
+            bytes = allocated_bytes;
+            tic.tic();
+            detector.query(q, ret);
+            VisualImageDescArray copy = *ret;
+            t_copy += tic.toc();
+            bytes_copy += allocated_bytes - bytes;
+        }
+    }
+    int num = repeat * queries.size();
+    printf("[keyframe_access_benchmark] %d keyframes x %d cameras x %d landmarks, %d/%d queries matched\n", 200, CAMS, LANDMARKS,
+        found, num);
+    printf("[keyframe_access_benchmark] deep copy: %.3fms %.1fkB allocated per query\n", t_copy / num, bytes_copy / 1024.0 / num);
+    printf("[keyframe_access_benchmark] shared: %.3fms %.1fkB allocated per query\n", t_shared / num, bytes_shared / 1024.0 / num);
+    return found == num ? 0 : -1;
+}
@@ -0,0 +1,144 @@
+// Memory accounting of the loop detector keyframe database with sparsification and a memory budget. CPU only.
+#include <d2frontend/loop_detector.h>
+#include <d2common/d2frontend_types.h>
+#include <random>
+
+using namespace D2FrontEnd;
+using namespace D2Common;
+
+const int PLACES = 100;
+const int LANDMARKS = 100;
+std::mt19937 gen(0);
+
+class TestLoopDetector: public LoopDetector {
+public:
+    TestLoopDetector(const LoopDetectorConfig & config): LoopDetector(params->self_id, config) {}
+    int add(VisualImageDescArray & frame) {
+        return addImageArrayToDatabase(frame, true);
+    }
+    bool indexConsistent() const {
+        const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+        for (auto & it : index_to_frame_id) {
+            if (keyframe_database.find(it.second) == keyframe_database.end()) {
+                return false;
+            }
+        }
+        return (int64_t) index_to_frame_id.size() == databaseSize();
+    }
+    size_t bytesOfDatabase() const {
+        const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+        size_t bytes = 0;
+        for (auto & it : keyframe_database) {
+            bytes += it.second->memorySize();
+        }
+        return bytes;
+    }
+};
+
+//A drone circling PLACES places with a radius of 10m; the global descriptor is the place descriptor with noise
+VisualImageDescArray createKeyframe(FrameIdType frame_id, double angle, const std::vector<Eigen::VectorXf> & places,
+        double desc_noise) {
+    std::normal_distribution<float> noise(0, 1);
+    VisualImageDescArray frame;
+    frame.frame_id = frame_id;
+    frame.drone_id = params->self_id;
+    frame.pose_drone = Swarm::Pose(Eigen::Matrix3d::Identity(), Eigen::Vector3d(10 * cos(angle), 10 * sin(angle), 0));
+    VisualImageDesc img;
+    img.frame_id = frame_id;
+    img.drone_id = params->self_id;
+    img.pose_drone = frame.pose_drone;
+    int place = ((int) round(angle / (2 * M_PI) * PLACES)) % PLACES;
+    Eigen::VectorXf desc = places[place];
+    for (int j = 0; j < desc.size(); j++) {
+        desc(j) += desc_noise / sqrt(desc.size()) * noise(gen);
+    }
+    desc.normalize();
+    img.image_desc.assign(desc.data(), desc.data() + desc.size());
+    for (int i = 0; i < LANDMARKS; i++) {
+        img.landmarks.emplace_back(LandmarkPerFrame::createLandmarkPerFrame(i, frame_id, 0.0, LandmarkType::SuperPointLandmark,
+            params->self_id, 0, 0, cv::Point2f(i, i), Eigen::Vector3d(0, 0, 1)));
+    }
+    img.landmark_descriptor.resize(LANDMARKS * params->superpoint_dims);
+    img.landmark_scores.resize(LANDMARKS);
+    frame.images.emplace_back(img);
+    return frame;
+}
+
+struct RetentionCase {
+    const char * name;
+    bool enable;
+    size_t memory_budget;
+    KeyframeEvictionPolicy policy;
+    double desc_noise;
+};
+
+bool run(const RetentionCase & c, const std::vector<Eigen::VectorXf> & places, int num) {
+    LoopDetectorConfig config;
+    config.keyframe_retention.enable = c.enable;
+    config.keyframe_retention.memory_budget = c.memory_budget;
+    config.keyframe_retention.policy = c.policy;
+    config.keyframe_retention.protect_recent = 20;
+    TestLoopDetector detector(config);
+    size_t max_bytes = 0;
+    //Five laps, 0.25m between keyframes
+    for (int i = 0; i < num; i++) {
+        auto frame = createKeyframe(i, i * 0.025, places, c.desc_noise);
+        detector.add(frame);
+        max_bytes = std::max(max_bytes, detector.databaseStats().bytes);
+    }
+    auto stats = detector.databaseStats();
+    bool success = stats.bytes == detector.bytesOfDatabase() && detector.indexConsistent() &&
+        stats.frames + stats.skipped + stats.evicted == num;
+    if (c.memory_budget > 0) {
+        success &= max_bytes <= c.memory_budget && stats.evicted > 0;
+        //The latest keyframes are protected
+        for (int i = num - config.keyframe_retention.protect_recent; i < num; i++) {
+            success &= detector.hasFrame(i) || stats.skipped > 0;
+        }
+    }
+    if (c.enable) {
+        //Only the spatial neighbours are compared; a scan of the database compares about num^2 / 2 pairs
+        success &= stats.neighbours_compared < (int64_t) num * num / 20;
+    }
+    if (c.enable && c.desc_noise < 0.5) {
+        //Revisits look like the first lap, unless it was evicted
+        success &= c.memory_budget > 0 ? stats.skipped > 0 : stats.skipped > num / 2;
+    } else {
+        success &= stats.skipped == 0;
+    }
+    printf("[keyframe_database_test] %s: %d frames %.1fMB (max %.1fMB) index %ld evicted %d skipped %d compared %.1f/frame %s\n",
+        c.name, stats.frames, stats.bytes / 1024.0 / 1024.0, max_bytes / 1024.0 / 1024.0, stats.index_size, stats.evicted,
+        stats.skipped, (double) stats.neighbours_compared / num, success ? "OK" : "FAILED");
+    return success;
+}
+
+int main(int argc, char** argv) {
+    params = new D2FrontendParams;
+    params->self_id = 1;
+    params->netvlad_dims = 1024;
+    params->camera_configuration = CameraConfig::PINHOLE_DEPTH;
+    std::normal_distribution<float> normal(0, 1);
+    std::vector<Eigen::VectorXf> places;
+    for (int i = 0; i < PLACES; i++) {
+        Eigen::VectorXf c(params->netvlad_dims);
+        for (int j = 0; j < c.size(); j++) {
+            c(j) = normal(gen);
+        }
+        places.emplace_back(c.normalized());
+    }
+    const size_t budget = 10 * 1024 * 1024;
+    std::vector<RetentionCase> cases = {
+        {"unbounded", false, 0, KEYFRAME_EVICT_LRU, 0.1},
+        {"sparsified", true, 0, KEYFRAME_EVICT_LRU, 0.1},
+        {"sparsified with LRU budget", true, budget, KEYFRAME_EVICT_LRU, 0.1},
+        //Appearance changes everywhere: nothing is redundant, only the budget bounds the database
+        {"distinct appearance with LRU budget", true, budget, KEYFRAME_EVICT_LRU, 4.0},
+        {"distinct appearance with utility budget", true, budget, KEYFRAME_EVICT_UTILITY, 4.0},
+    };
+    bool success = true;
+    for (auto & c : cases) {
+        success &= run(c, places, 1257);
+    }
+    printf("[keyframe_database_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
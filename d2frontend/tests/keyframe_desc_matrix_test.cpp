@@ -0,0 +1,213 @@
+#include <d2frontend/keyframe_desc_matrix.h>
+#include <d2common/d2frontend_types.h>
+#include <d2common/utils.hpp>
+#include <random>
+
+using namespace D2FrontEnd;
+using D2Common::VisualImageDesc;
+using D2Common::Utility::TicToc;
+
+const int DIMS = 4096;
+std::mt19937 gen(0);
+
+std::vector<float> randomDesc() {
+    std::normal_distribution<float> dist(0, 1);
+    Eigen::VectorXf desc(DIMS);
+    for (int i = 0; i < DIMS; i++) {
+        desc(i) = dist(gen);
+    }
+    desc.normalize();
+    return std::vector<float>(desc.data(), desc.data() + DIMS);
+}
+
+// Noisy copy of desc, so it matches with a high similarity
+std::vector<float> perturbDesc(const std::vector<float> & desc, float noise) {
+    auto ret = randomDesc();
+    Eigen::Map<Eigen::VectorXf> v(ret.data(), DIMS);
+    v = Eigen::Map<const Eigen::VectorXf>(desc.data(), DIMS) + noise * v;
+    v.normalize();
+    return ret;
+}
+
+VisualImageDescArray randomFrame(FrameIdType frame_id, int cam_num) {
+    VisualImageDescArray frame;
+    frame.frame_id = frame_id;
+    for (int i = 0; i < cam_num; i++) {
+        VisualImageDesc img;
+        img.camera_index = i;
+        img.frame_id = frame_id;
+        img.image_desc = randomDesc();
+        frame.images.emplace_back(img);
+    }
+    return frame;
+}
+
+// The per-keyframe loop of D2FeatureTracker::getMatchedPrevKeyframe before the matrix
+bool previousMatch(const std::vector<VisualImageDescArray> & keyframes, const std::vector<float> & query,
+        const std::vector<int> & dirs, double thres, FrameIdType & frame_id, int & dir) {
+    const Eigen::Map<const Eigen::VectorXf> q(query.data(), DIMS);
+    for (int i = keyframes.size() - 1; i >= 0; i--) {
+        auto & last = keyframes[i];
+        for (int j = 0; j < dirs.size() && j < last.images.size(); j++) {
+            const Eigen::Map<const Eigen::VectorXf> desc(last.images[dirs[j]].image_desc.data(), DIMS);
+            if (desc.dot(q) >= thres) {
+                frame_id = last.frame_id;
+                dir = dirs[j];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// The same loop continued to the first k matches of several queries
+std::vector<KeyframeDescMatch> bruteForceMatch(const std::vector<VisualImageDescArray> & keyframes,
+        const std::vector<std::vector<float>> & queries, const std::vector<int> & dirs, double thres, int k) {
+    std::vector<KeyframeDescMatch> ret;
+    for (int i = keyframes.size() - 1; i >= 0; i--) {
+        auto & last = keyframes[i];
+        for (int j = 0; j < dirs.size() && j < last.images.size(); j++) {
+            const Eigen::Map<const Eigen::VectorXf> desc(last.images[dirs[j]].image_desc.data(), DIMS);
+            for (int q = 0; q < queries.size(); q++) {
+                double sim = desc.dot(Eigen::Map<const Eigen::VectorXf>(queries[q].data(), DIMS));
+                if (sim >= thres) {
+                    ret.emplace_back(KeyframeDescMatch{last.frame_id, dirs[j], q, sim});
+                    if (ret.size() >= k) {
+                        return ret;
+                    }
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+std::vector<float> stack(const std::vector<std::vector<float>> & queries) {
+    std::vector<float> ret;
+    for (auto & q : queries) {
+        ret.insert(ret.end(), q.begin(), q.end());
+    }
+    return ret;
+}
+
+bool sameMatches(const std::vector<KeyframeDescMatch> & ref, const std::vector<KeyframeDescMatch> & ret) {
+    if (ref.size() != ret.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < ref.size(); i++) {
+        if (ref[i].frame_id != ret[i].frame_id || ref[i].image_index != ret[i].image_index ||
+                ref[i].query_index != ret[i].query_index || fabs(ref[i].similarity - ret[i].similarity) > 1e-4) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// num_query queries per step; the first query is also checked against the previous selection of the keyframe
+bool testMatch(int cam_num, const std::vector<int> & dirs, int num_query, int k) {
+    KeyframeDescMatrix matrix(DIMS);
+    std::vector<VisualImageDescArray> keyframes;
+    std::uniform_int_distribution<int> pick(0, 1000);
+    double thres = 0.6;
+    int failed = 0, matched = 0, trials = 0, multiple = 0;
+    FrameIdType frame_id = 0;
+    for (int step = 0; step < 300; step++) {
+        auto frame = randomFrame(frame_id++, cam_num);
+        if (keyframes.size() > 0 && pick(gen) % 5 == 0) {
+            //Revisit of a keyframe, so a query has several candidates
+            auto & revisited = keyframes[pick(gen) % keyframes.size()];
+            for (int i = 0; i < cam_num; i++) {
+                frame.images[i].image_desc = perturbDesc(revisited.images[i].image_desc, 0.3);
+            }
+        }
+        keyframes.emplace_back(frame);
+        matrix.addFrame(frame);
+        //Remove keyframes like a sliding window, occasionally from the middle
+        if (keyframes.size() > 40) {
+            int idx = pick(gen) % 10 == 0 ? pick(gen) % keyframes.size() : 0;
+            matrix.removeFrame(keyframes[idx].frame_id);
+            keyframes.erase(keyframes.begin() + idx);
+        }
+        //Perturbed descriptors of random keyframe images, or random descriptors
+        std::vector<std::vector<float>> queries;
+        for (int i = 0; i < num_query; i++) {
+            auto & target = keyframes[pick(gen) % keyframes.size()];
+            queries.emplace_back(pick(gen) % 4 == 0 ? randomDesc() :
+                perturbDesc(target.images[dirs[pick(gen) % dirs.size()]].image_desc, 0.5));
+        }
+        FrameIdType prev_frame_id = -1;
+        int prev_dir = -1;
+        bool prev_matched = previousMatch(keyframes, queries[0], dirs, thres, prev_frame_id, prev_dir);
+        auto first = matrix.matchNewest(queries[0].data(), 1, thres, 1, dirs);
+        bool same_selection = first.size() == prev_matched &&
+            (!prev_matched || (first[0].frame_id == prev_frame_id && first[0].image_index == prev_dir));
+        auto ref = bruteForceMatch(keyframes, queries, dirs, thres, k);
+        auto ret = matrix.matchNewest(stack(queries).data(), num_query, thres, k, dirs);
+        trials ++;
+        matched += prev_matched;
+        multiple += ref.size() > 1;
+        if (!same_selection || !sameMatches(ref, ret)) {
+            printf("[keyframe_desc_matrix_test] mismatch at step %d: previous selection %ld dir %d, matrix %ld dir %d\n", step,
+                    prev_matched ? prev_frame_id : -1, prev_dir, first.size() ? first[0].frame_id : -1,
+                    first.size() ? first[0].image_index : -1);
+            for (size_t i = 0; i < ref.size() || i < ret.size(); i++) {
+                if (i < ref.size()) {
+                    printf("    ref %ld img %d query %d %.4f\n", ref[i].frame_id, ref[i].image_index, ref[i].query_index, ref[i].similarity);
+                }
+                if (i < ret.size()) {
+                    printf("    matrix %ld img %d query %d %.4f\n", ret[i].frame_id, ret[i].image_index, ret[i].query_index, ret[i].similarity);
+                }
+            }
+            failed ++;
+        }
+    }
+    if (matrix.frameNum() != keyframes.size()) {
+        printf("[keyframe_desc_matrix_test] frame num %d != %ld\n", matrix.frameNum(), keyframes.size());
+        failed ++;
+    }
+    bool success = failed == 0 && matched > trials / 2 && (k == 1 || multiple > 0);
+    printf("[keyframe_desc_matrix_test] cams %d dirs %ld queries %d first %d: %d/%d queries matched, %d with several matches, %d mismatches %s\n",
+            cam_num, dirs.size(), num_query, k, matched, trials, multiple, failed, success ? "OK" : "FAILED");
+    return success;
+}
+
+void benchmark(int keyframe_num, int cam_num) {
+    KeyframeDescMatrix matrix(DIMS);
+    std::vector<VisualImageDescArray> keyframes;
+    for (int i = 0; i < keyframe_num; i++) {
+        auto frame = randomFrame(i, cam_num);
+        keyframes.emplace_back(frame);
+        matrix.addFrame(frame);
+    }
+    //One query with no match, as getMatchedPrevKeyframe in the worst case
+    std::vector<int> dirs{2, 3, 0, 1};
+    auto query = randomDesc();
+    int repeat = 100;
+    TicToc tic;
+    for (int i = 0; i < repeat; i++) {
+        FrameIdType frame_id;
+        int dir;
+        previousMatch(keyframes, query, dirs, 1.0, frame_id, dir);
+    }
+    double t_loop = tic.toc() / repeat;
+    tic.tic();
+    for (int i = 0; i < repeat; i++) {
+        matrix.matchNewest(query.data(), 1, 1.0, 1, dirs);
+    }
+    double t_matrix = tic.toc() / repeat;
+    printf("[keyframe_desc_matrix_test] %d keyframes x %d cams: loop %.3fms matrix %.3fms\n", keyframe_num, cam_num, t_loop, t_matrix);
+}
+
+int main(int argc, char** argv) {
+    bool success = true;
+    //As getMatchedPrevKeyframe: one query, the newest match
+    success &= testMatch(1, {0}, 1, 1);
+    success &= testMatch(4, {2, 3, 0, 1}, 1, 1);
+    success &= testMatch(4, {2, 3, 0, 1}, 1, 3);
+    success &= testMatch(4, {2, 3, 0, 1}, 4, 5);
+    success &= testMatch(4, {0}, 4, 5);
+    benchmark(100, 4);
+    benchmark(1000, 4);
+    printf("[keyframe_desc_matrix_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
@@ -0,0 +1,287 @@
+// Restart of the loop detector from a keyframe store: identical queries and lazy startup. CPU only.
+#include <d2frontend/loop_detector.h>
+#include <d2common/d2frontend_types.h>
+#include <d2common/utils.hpp>
+#include <random>
+#include <unistd.h>
+
+using namespace D2FrontEnd;
+using namespace D2Common;
+using D2Common::Utility::TicToc;
+
+const int PLACES = 200;
+std::mt19937 gen(0);
+
+class TestLoopDetector: public LoopDetector {
+public:
+    TestLoopDetector(const LoopDetectorConfig & config): LoopDetector(params->self_id, config) {}
+    void add(VisualImageDescArray & frame) {
+        addImageArrayToDatabase(frame, true);
+    }
+    //Frame id of the best match, -1 if none
+    int64_t query(const VisualImageDesc & img, double & similarity) {
+        int index = queryFrameIndexFromDatabase(img, similarity);
+        if (index < 0) {
+            return -1;
+        }
+        const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+        return index_to_frame_id.at(index);
+    }
+    bool get(int64_t frame_id, VisualImageDescArray & frame) {
+        const std::lock_guard<std::mutex> lock(keyframe_database_mutex);
+        auto ret = keyframe(frame_id);
+        if (!ret) {
+            return false;
+        }
+        frame = *ret;
+        return true;
+    }
+};
+
+//Overwrites the image count in the record header of frame_id, so the record reads as truncated
+bool corruptRecord(const std::string & path, int64_t frame_id) {
+    FILE * idx = fopen((path + ".idx").c_str(), "rb");
+    int64_t entry[2], offset = -1;
+    while (idx && fread(entry, sizeof(entry), 1, idx) == 1) {
+        if (entry[0] == frame_id) {
+            offset = entry[1];
+        }
+    }
+    if (idx) {
+        fclose(idx);
+    }
+    FILE * file = fopen(path.c_str(), "r+b");
+    if (offset < 0 || !file) {
+        return false;
+    }
+    int32_t desc_num = 1 << 30;
+    fseek(file, offset + sizeof(int64_t) + sizeof(int32_t), SEEK_SET);
+    bool ret = fwrite(&desc_num, sizeof(desc_num), 1, file) == 1;
+    fclose(file);
+    return ret;
+}
+
+VisualImageDesc createImage(FrameIdType frame_id, const std::vector<Eigen::VectorXf> & places, int place, int landmarks) {
+    std::normal_distribution<float> noise(0, 1);
+    std::uniform_real_distribution<float> u(0, 1);
+    VisualImageDesc img;
+    img.frame_id = frame_id;
+    img.drone_id = params->self_id;
+    Eigen::VectorXf desc = places[place];
+    for (int j = 0; j < desc.size(); j++) {
+        desc(j) += 0.5 / sqrt(desc.size()) * noise(gen);
+    }
+    desc.normalize();
+    img.image_desc.assign(desc.data(), desc.data() + desc.size());
+    for (int i = 0; i < landmarks; i++) {
+        img.landmarks.emplace_back(LandmarkPerFrame::createLandmarkPerFrame(i, frame_id, 0.0, LandmarkType::SuperPointLandmark,
+            params->self_id, 0, 0, cv::Point2f(u(gen) * 640, u(gen) * 480), Eigen::Vector3d(0, 0, 1)));
+        for (size_t j = 0; j < params->superpoint_dims; j++) {
+            img.landmark_descriptor.push_back(noise(gen));
+        }
+        img.landmark_scores.push_back(u(gen));
+    }
+    return img;
+}
+
+VisualImageDescArray createKeyframe(FrameIdType frame_id, const std::vector<Eigen::VectorXf> & places, int landmarks) {
+    std::uniform_int_distribution<int> place(0, PLACES - 1);
+    VisualImageDescArray frame;
+    frame.frame_id = frame_id;
+    frame.drone_id = params->self_id;
+    frame.stamp = frame_id * 0.1;
+    frame.pose_drone = Swarm::Pose(Eigen::Matrix3d::Identity(), Eigen::Vector3d(frame_id, 0, 0));
+    frame.images.emplace_back(createImage(frame_id, places, place(gen), landmarks));
+    return frame;
+}
+
+bool sameKeyframe(const VisualImageDescArray & a, const VisualImageDescArray & b) {
+    if (a.frame_id != b.frame_id || a.drone_id != b.drone_id || a.images.size() != b.images.size() ||
+            (a.pose_drone.pos() - b.pose_drone.pos()).norm() > 1e-9) {
+        return false;
+    }
+    for (size_t i = 0; i < a.images.size(); i++) {
+        auto & img_a = a.images[i];
+        auto & img_b = b.images[i];
+        if (img_a.image_desc != img_b.image_desc || img_a.landmark_descriptor != img_b.landmark_descriptor ||
+                img_a.landmark_scores != img_b.landmark_scores || img_a.landmarks.size() != img_b.landmarks.size()) {
+            return false;
+        }
+        for (size_t j = 0; j < img_a.landmarks.size(); j++) {
+            if (img_a.landmarks[j].pt2d != img_b.landmarks[j].pt2d) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+struct StoreResult {
+    bool success = true;
+    double open_ms = 0;
+    double size_mb = 0;
+};
+
+StoreResult run(int num, int landmarks, const std::vector<Eigen::VectorXf> & places) {
+    StoreResult ret;
+    std::string path = "/tmp/keyframe_store_test_" + std::to_string(getpid()) + ".d2kf";
+    LoopDetectorConfig config;
+    config.match_index_dist = 0;
+    config.loop_detection_netvlad_thres = 0.5;
+    config.keyframe_store_path = path;
+    std::vector<VisualImageDescArray> frames;
+    std::vector<VisualImageDesc> queries;
+    std::uniform_int_distribution<int> place(0, PLACES - 1);
+    for (int i = 0; i < 100; i++) {
+        queries.emplace_back(createImage(-1, places, place(gen), 0));
+    }
+    std::vector<std::pair<int64_t, double>> results;
+    {
+        TestLoopDetector detector(config);
+        for (int i = 0; i < num; i++) {
+            frames.emplace_back(createKeyframe(params->self_id * 1000000 + i, places, landmarks));
+            detector.add(frames.back());
+        }
+        for (auto & q : queries) {
+            double similarity = 0;
+            auto frame_id = detector.query(q, similarity);
+            results.emplace_back(frame_id, similarity);
+        }
+    }
+    TicToc tic;
+    config.keyframe_retention.enable = true;
+    TestLoopDetector restored(config);
+    ret.open_ms = tic.toc();
+    auto stats = restored.databaseStats();
+    ret.success &= stats.stored == num && stats.index_size == num && stats.frames == 0;
+    //Same labels in the same order: identical results
+    int mismatch = 0;
+    for (size_t i = 0; i < queries.size(); i++) {
+        double similarity = 0;
+        auto frame_id = restored.query(queries[i], similarity);
+        mismatch += frame_id != results[i].first || (frame_id >= 0 && similarity != results[i].second);
+    }
+    ret.success &= mismatch == 0;
+    //Lazy load of a few keyframes
+    for (int i = 0; i < num; i += num / 10) {
+        VisualImageDescArray frame;
+        ret.success &= restored.get(frames[i].frame_id, frame) && sameKeyframe(frame, frames[i]);
+    }
+    ret.success &= restored.databaseStats().frames == 10;
+    //A record that fails to load is dropped from the database and the index
+    auto & broken = frames[num / 10 + 1];
+    VisualImageDescArray frame;
+    double similarity = 0;
+    bool drop_ok = corruptRecord(path, broken.frame_id) && !restored.get(broken.frame_id, frame) &&
+        !restored.hasFrame(broken.frame_id) && restored.databaseStats().index_size == num - 1 &&
+        restored.databaseStats().stored == num - 1 && restored.query(broken.images[0], similarity) != broken.frame_id;
+    ret.success &= drop_ok;
+    //Restored keyframes are from another session, a revisit of their place is not redundant
+    auto revisit = frames[num / 2];
+    revisit.frame_id = frames.back().frame_id + 1;
+    restored.add(revisit);
+    bool retention_ok = restored.hasFrame(revisit.frame_id) && restored.databaseStats().skipped == 0;
+    ret.success &= retention_ok;
+    //New keyframe ids don't collide with the restored ones
+    ret.success &= generateKeyframeId(ros::Time(0), params->self_id) > frames.back().frame_id;
+    FILE * file = fopen(path.c_str(), "rb");
+    fseek(file, 0, SEEK_END);
+    ret.size_mb = ftell(file) / 1024.0 / 1024.0;
+    fclose(file);
+    printf("[keyframe_store_test] %d keyframes x %d landmarks: store %.1fMB, restored in %.1fms, %d/%ld query mismatches, "
+        "unreadable record %s, restored not redundant %s %s\n", num, landmarks, ret.size_mb, ret.open_ms, mismatch, queries.size(),
+        drop_ok ? "dropped" : "FAILED", retention_ok ? "OK" : "FAILED", ret.success ? "OK" : "FAILED");
+    remove(path.c_str());
+    remove((path + ".idx").c_str());
+    return ret;
+}
+
+//Dropped and replaced keyframes are removed from the file by the compaction on start
+bool testCompaction(const std::vector<Eigen::VectorXf> & places) {
+    std::string path = "/tmp/keyframe_store_test_" + std::to_string(getpid()) + "_compact.d2kf";
+    const int num = 200;
+    std::vector<VisualImageDescArray> frames;
+    size_t size_before = 0;
+    {
+        KeyframeStore store(path, params->netvlad_dims);
+        store.open();
+        for (int i = 0; i < num; i++) {
+            frames.emplace_back(createKeyframe(params->self_id * 1000000 + i, places, 20));
+            store.append(frames.back(), {0});
+        }
+        //Replaced: the latest record is kept
+        for (int i = 0; i < num; i += 4) {
+            frames[i].images[0] = createImage(frames[i].frame_id, places, 0, 20);
+            store.append(frames[i], {0});
+        }
+        for (int i = 1; i < num; i += 2) {
+            store.remove(frames[i].frame_id);
+        }
+        size_before = store.fileSize();
+    }
+    std::vector<VisualImageDescArray> live;
+    for (int i = 0; i < num; i += 2) {
+        live.emplace_back(frames[i]);
+    }
+    LoopDetectorConfig config;
+    config.keyframe_store_path = path;
+    config.keyframe_store_compact_ratio = 0.5;
+    size_t size_after = 0;
+    bool success = true;
+    {
+        TestLoopDetector detector(config);
+        auto stats = detector.databaseStats();
+        success &= stats.stored == (int) live.size() && stats.index_size == (int64_t) live.size();
+        for (auto & frame : live) {
+            VisualImageDescArray loaded;
+            success &= detector.get(frame.frame_id, loaded) && sameKeyframe(loaded, frame);
+        }
+    }
+    //Reopened after the compaction: same keyframes in the same order
+    KeyframeStore store(path, params->netvlad_dims);
+    success &= store.open() && store.deadRatio() < 1e-6;
+    size_after = store.fileSize();
+    auto ids = store.frameIds();
+    success &= ids.size() == live.size();
+    for (size_t i = 0; i < ids.size() && i < live.size(); i++) {
+        success &= ids[i] == live[i].frame_id;
+    }
+    success &= size_after < size_before * 0.5;
+    printf("[keyframe_store_test] compaction: %.1fMB to %.1fMB, %ld keyframes %s\n", size_before / 1024.0 / 1024.0,
+        size_after / 1024.0 / 1024.0, ids.size(), success ? "OK" : "FAILED");
+    remove(path.c_str());
+    remove((path + ".idx").c_str());
+    return success;
+}
+
+int main(int argc, char** argv) {
+    params = new D2FrontendParams;
+    params->self_id = 1;
+    params->netvlad_dims = 1024;
+    params->camera_configuration = CameraConfig::PINHOLE_DEPTH;
+    std::normal_distribution<float> normal(0, 1);
+    std::vector<Eigen::VectorXf> places;
+    for (int i = 0; i < PLACES; i++) {
+        Eigen::VectorXf c(params->netvlad_dims);
+        for (int j = 0; j < c.size(); j++) {
+            c(j) = normal(gen);
+        }
+        places.emplace_back(c.normalized());
+    }
+    bool success = true;
+    auto small = run(1000, 20, places);
+    auto many = run(4000, 20, places);
+    auto large = run(1000, 320, places);
+    success &= small.success && many.success && large.success;
+    //The restore time follows the number of keyframes, not the store size: the keyframe payload is not read at startup
+    bool by_keyframes = many.open_ms < 2 * 4 * small.open_ms + 10;
+    printf("[keyframe_store_test] 4x keyframes: store %.1fx larger, restore %.1fx slower %s\n", many.size_mb / small.size_mb,
+        many.open_ms / small.open_ms, by_keyframes ? "OK" : "FAILED");
+    bool by_payload = large.open_ms < 3 * small.open_ms + 10;
+    printf("[keyframe_store_test] 16x landmarks: store %.1fx larger, restore %.1fx slower %s\n", large.size_mb / small.size_mb,
+        large.open_ms / small.open_ms, by_payload ? "OK" : "FAILED");
+    success &= by_keyframes && by_payload;
+    success &= testCompaction(places);
+    printf("[keyframe_store_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
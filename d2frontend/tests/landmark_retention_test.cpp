@@ -0,0 +1,137 @@
+#include <d2frontend/d2landmark_manager.h>
+#include <d2frontend/d2frontend_params.h>
+#include <d2common/utils.hpp>
+
+using namespace D2FrontEnd;
+using D2Common::Utility::TicToc;
+
+const int FRAMES = 20000;
+const int TRACKED = 120; //Landmarks tracked from the previous frame
+const int NEW_PER_FRAME = 30;
+const double DT = 0.05;
+
+LandmarkPerFrame observation(LandmarkIdType landmark_id, FrameIdType frame_id) {
+    LandmarkPerFrame lm;
+    lm.landmark_id = landmark_id;
+    lm.frame_id = frame_id;
+    lm.stamp = frame_id * DT;
+    lm.stamp_discover = lm.stamp;
+    lm.pt2d = cv::Point2f(frame_id % 640, landmark_id % 480);
+    lm.pt3d_norm = Eigen::Vector3d(0, 0, 1);
+    return lm;
+}
+
+//A long mission without backend: each frame tracks the newest landmarks and discovers new ones. Returns the memory
+//stats sampled every 1000 frames
+std::vector<LandmarkMemoryStats> runMission(const LandmarkRetention & retention, int frames, double & dt) {
+    LandmarkManager lmanager;
+    lmanager.setRetention(retention);
+    std::vector<LandmarkMemoryStats> samples;
+    std::vector<LandmarkIdType> tracked;
+    TicToc tic;
+    for (FrameIdType frame_id = 0; frame_id < frames; frame_id++) {
+        std::vector<LandmarkIdType> cur;
+        for (auto landmark_id : tracked) {
+            lmanager.updateLandmark(observation(landmark_id, frame_id));
+            cur.push_back(landmark_id);
+        }
+        for (int i = 0; i < NEW_PER_FRAME; i++) {
+            cur.push_back(lmanager.addLandmark(observation(-1, frame_id)));
+        }
+        lmanager.evict(frame_id * DT);
+        //Oldest landmarks are lost
+        tracked.assign(cur.end() - std::min<int>(TRACKED, cur.size()), cur.end());
+        if ((frame_id + 1) % 1000 == 0) {
+            samples.push_back(lmanager.memoryStats());
+        }
+    }
+    dt = tic.toc();
+    return samples;
+}
+
+bool testBounded(const char * name, const LandmarkRetention & retention, int max_landmarks) {
+    double dt;
+    auto samples = runMission(retention, FRAMES, dt);
+    auto & last = samples.back();
+    //Memory must stop growing once the retention window is full
+    bool bounded = last.bytes <= samples[samples.size() / 4].bytes * 1.05 && last.landmark_num <= (size_t) max_landmarks;
+    printf("[landmark_retention_test] %s: %ld landmarks %ld observations %ld frames %.2fMB evicted %ld in %.1fms %s\n", name,
+        last.landmark_num, last.observation_num, last.frame_num, last.bytes / 1048576.0, last.evicted_num, dt,
+        bounded ? "OK" : "FAILED");
+    return bounded;
+}
+
+//Landmarks not observed within max_age_frames are evicted, the others are kept with all their observations
+bool testAge() {
+    LandmarkManager lmanager;
+    LandmarkRetention retention;
+    retention.max_age_frames = 5;
+    lmanager.setRetention(retention);
+    auto lost = lmanager.addLandmark(observation(-1, 0));
+    auto kept = lmanager.addLandmark(observation(-1, 0));
+    bool success = true;
+    for (FrameIdType frame_id = 1; frame_id <= 10; frame_id++) {
+        lmanager.updateLandmark(observation(kept, frame_id));
+        auto evicted = lmanager.evict(frame_id * DT);
+        //lost was last observed at frame 0
+        success &= lmanager.hasLandmark(lost) == (frame_id < 6);
+        success &= evicted.size() == (frame_id == 6 ? 1 : 0);
+    }
+    success &= lmanager.hasLandmark(kept) && lmanager.at(kept).track.size() == 11;
+    success &= lmanager.getRelatedLandmarks(0).count(lost) == 0 && lmanager.getRelatedLandmarks(0).count(kept) == 1;
+    printf("[landmark_retention_test] age: %s\n", success ? "OK" : "FAILED");
+    return success;
+}
+
+//A late observation of an evicted landmark is refused instead of re-creating it without its track, as long as its id
+//is among the max_evicted_ids latest evicted
+bool testLateObservation() {
+    LandmarkManager lmanager;
+    LandmarkRetention retention;
+    retention.max_age_frames = 5;
+    retention.max_evicted_ids = 1;
+    lmanager.setRetention(retention);
+    auto first = lmanager.addLandmark(observation(-1, 0));
+    auto second = lmanager.addLandmark(observation(-1, 1));
+    auto kept = lmanager.addLandmark(observation(-1, 1));
+    bool success = true;
+    for (FrameIdType frame_id = 2; frame_id <= 7; frame_id++) {
+        success &= lmanager.updateLandmark(observation(kept, frame_id));
+        lmanager.evict(frame_id * DT);
+    }
+    success &= !lmanager.hasLandmark(first) && !lmanager.hasLandmark(second);
+    //second is remembered, first was pushed out by it
+    bool refused = !lmanager.updateLandmark(observation(second, 8)) && !lmanager.hasLandmark(second);
+    bool recreated = lmanager.updateLandmark(observation(first, 8)) && lmanager.at(first).track.size() == 1;
+    //Landmarks first seen through updateLandmark, like the remote ones, are still created
+    bool created = lmanager.updateLandmark(observation(12345, 8)) && lmanager.hasLandmark(12345);
+    auto stats = lmanager.memoryStats();
+    success &= refused && recreated && created && stats.refused_num == 1 && stats.evicted_num == 2;
+    printf("[landmark_retention_test] late observation of evicted landmarks: refused %d re-created after the limit %d, "
+        "refused %ld %s\n", refused, recreated, stats.refused_num, success ? "OK" : "FAILED");
+    return success;
+}
+
+int main(int argc, char** argv) {
+    params = new D2FrontendParams;
+    params->self_id = 1;
+    bool success = testAge();
+    success &= testLateObservation();
+    LandmarkRetention disabled;
+    double dt;
+    //Short run, the memory grows linearly without retention
+    auto samples = runMission(disabled, 1000, dt);
+    printf("[landmark_retention_test] unbounded: %ld landmarks %.2fMB after 1000 frames in %.1fms\n", samples.back().landmark_num,
+        samples.back().bytes / 1048576.0, dt);
+    LandmarkRetention by_frames;
+    by_frames.max_age_frames = 100;
+    success &= testBounded("max 100 frames", by_frames, (TRACKED + NEW_PER_FRAME) * 101);
+    LandmarkRetention by_time;
+    by_time.max_age_sec = 2.0;
+    success &= testBounded("max 2s", by_time, (TRACKED + NEW_PER_FRAME) * 41);
+    LandmarkRetention by_cap;
+    by_cap.max_landmarks = 2000;
+    success &= testBounded("max 2000 landmarks", by_cap, 2000);
+    printf("[landmark_retention_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
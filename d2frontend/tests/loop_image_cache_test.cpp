@@ -0,0 +1,116 @@
+// Compressed keyframe images for drawing loop matches: memory held per keyframe, lossless drawing and the bounded decode LRU. CPU only.
+#include <d2frontend/loop_image_cache.h>
+#include <d2common/utils.hpp>
+#include <opencv2/imgproc.hpp>
+#include <random>
+#include <stdio.h>
+
+using namespace D2FrontEnd;
+using D2Common::Utility::TicToc;
+
+const int CAMS = 4;
+const int FRAMES = 20;
+const cv::Size IMAGE_SIZE(640, 480);
+std::mt19937 gen(0);
+
+//Smooth background with some textured blobs, like a camera image
+cv::Mat createImage() {
+    std::uniform_int_distribution<int> u(0, 255);
+    cv::Mat img(IMAGE_SIZE, CV_8U);
+    for (int y = 0; y < img.rows; y++) {
+        for (int x = 0; x < img.cols; x++) {
+            img.at<uint8_t>(y, x) = (x / 3 + y / 5) % 256;
+        }
+    }
+    for (int i = 0; i < 30; i++) {
+        cv::circle(img, cv::Point(u(gen) * 2.5, u(gen) * 1.8), u(gen) / 8 + 5, cv::Scalar(u(gen)), -1);
+    }
+    cv::Mat noise(IMAGE_SIZE, CV_8U);
+    cv::randu(noise, 0, 2);
+    return img + noise;
+}
+
+bool identical(const cv::Mat & a, const cv::Mat & b) {
+    return a.size() == b.size() && a.type() == b.type() && cv::norm(a, b, cv::NORM_INF) == 0;
+}
+
+//The drawing of LoopDetector::drawMatched for a pair of images, with fixed colors
+cv::Mat draw(const cv::Mat & img_a, const cv::Mat & img_b) {
+    cv::Mat show;
+    cv::vconcat(img_b, img_a, show);
+    cv::cvtColor(show, show, cv::COLOR_GRAY2BGR);
+    for (int i = 0; i < 50; i++) {
+        cv::Point2f pt_old(i * 12, i * 9), pt_new(i * 12 + 5, i * 9 + img_b.rows);
+        cv::Scalar color(i * 5, 255 - i * 5, 128);
+        cv::line(show, pt_old, pt_new, color, 1);
+        cv::circle(show, pt_old, 3, color, 1);
+        cv::circle(show, pt_new, 3, color, 1);
+    }
+    return show;
+}
+
+int main(int argc, char** argv) {
+    const int decoded_capacity = 3;
+    LoopImageCache cache(decoded_capacity, IMAGE_SIZE);
+    std::map<FrameIdType, std::vector<cv::Mat>> originals;
+    size_t raw_bytes = 0, expected_bytes = 0;
+    bool memory_ok = true;
+    TicToc tic;
+    for (int frame_id = 0; frame_id < FRAMES; frame_id++) {
+        std::vector<std::vector<uint8_t>> compressed;
+        size_t frame_bytes = 0;
+        for (int i = 0; i < CAMS; i++) {
+            if (frame_id % 5 == 4 && i == CAMS - 1) {
+                //A camera without image
+                compressed.emplace_back();
+                originals[frame_id].emplace_back(IMAGE_SIZE, CV_8U, cv::Scalar(255));
+                continue;
+            }
+            auto img = createImage();
+            raw_bytes += img.total() * img.elemSize();
+            compressed.emplace_back(LoopImageCache::compress(img));
+            frame_bytes += compressed.back().size();
+            originals[frame_id].emplace_back(img);
+        }
+        size_t before = cache.compressedBytes();
+        cache.add(frame_id, std::move(compressed));
+        expected_bytes += frame_bytes;
+        //Nothing is decoded until drawn
+        memory_ok &= cache.compressedBytes() - before == frame_bytes && cache.bytes(frame_id) == frame_bytes &&
+            cache.decodedBytes() == 0;
+    }
+    double add_ms = tic.toc();
+    memory_ok &= cache.compressedBytes() == expected_bytes && expected_bytes < raw_bytes / 2;
+    printf("[loop_image_cache_test] memory: %d frames raw %.1fMB stored %.1fMB (%.1f%%) compress %.2fms/image %s\n", FRAMES,
+        raw_bytes / 1024.0 / 1024.0, expected_bytes / 1024.0 / 1024.0, 100.0 * expected_bytes / raw_bytes,
+        add_ms / (FRAMES * CAMS), memory_ok ? "OK" : "FAILED");
+
+    bool drawing_ok = true;
+    tic.tic();
+    for (int frame_id = 1; frame_id < FRAMES; frame_id++) {
+        std::vector<cv::Mat> imgs_a, imgs_b;
+        drawing_ok &= cache.get(frame_id, imgs_a) && cache.get(frame_id - 1, imgs_b);
+        drawing_ok &= imgs_a.size() == CAMS && imgs_b.size() == CAMS;
+        for (int i = 0; i < imgs_a.size() && i < imgs_b.size(); i++) {
+            drawing_ok &= identical(imgs_a[i], originals[frame_id][i]);
+            drawing_ok &= identical(draw(imgs_a[i], imgs_b[i]), draw(originals[frame_id][i], originals[frame_id - 1][i]));
+        }
+    }
+    double get_ms = tic.toc();
+    size_t frame_raw = IMAGE_SIZE.area() * CAMS;
+    bool lru_ok = cache.decodedBytes() <= decoded_capacity * frame_raw && cache.decodedBytes() > 0;
+    printf("[loop_image_cache_test] drawing: identical %s decode %.2fms/frame, decoded %.1fMB for at most %d frames %s\n",
+        drawing_ok ? "OK" : "FAILED", get_ms / (2 * (FRAMES - 1)), cache.decodedBytes() / 1024.0 / 1024.0, decoded_capacity,
+        lru_ok ? "OK" : "FAILED");
+
+    std::vector<cv::Mat> imgs;
+    size_t before = cache.compressedBytes(), frame_bytes = cache.bytes(FRAMES - 1);
+    cache.erase(FRAMES - 1);
+    bool erase_ok = !cache.has(FRAMES - 1) && !cache.get(FRAMES - 1, imgs) && imgs.empty() &&
+        cache.compressedBytes() == before - frame_bytes;
+    printf("[loop_image_cache_test] erase %s\n", erase_ok ? "OK" : "FAILED");
+
+    bool success = memory_ok && drawing_ok && lru_ok && erase_ok;
+    printf("[loop_image_cache_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
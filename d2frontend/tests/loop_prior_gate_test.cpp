@@ -0,0 +1,162 @@
+// Odometry prior gate of loop candidates on synthetic drifting trajectories with known loops: true loops kept, false candidates rejected. CPU only.
+#include <d2frontend/loop_detector.h>
+#include <d2frontend/utils.h>
+#include <random>
+#include <stdio.h>
+
+using namespace D2FrontEnd;
+
+std::mt19937 gen(0);
+
+struct State {
+    Vector3d pos;
+    double yaw;
+};
+
+struct Trajectory {
+    std::vector<State> truth;
+    std::vector<Swarm::Pose> odometry;
+    std::vector<double> travel; //By the odometry, as LoopDetector::updateTravel
+};
+
+double wrapAngle(double angle) {
+    return atan2(sin(angle), cos(angle));
+}
+
+Swarm::Pose toPose(const State & state) {
+    return Swarm::Pose(Eigen::AngleAxisd(state.yaw, Eigen::Vector3d::UnitZ()).toRotationMatrix(), state.pos);
+}
+
+//Relative position in the frame of a and relative yaw
+std::pair<Vector3d, double> delta(const State & a, const State & b) {
+    return std::make_pair(Eigen::AngleAxisd(-a.yaw, Eigen::Vector3d::UnitZ()) * (b.pos - a.pos), wrapAngle(b.yaw - a.yaw));
+}
+
+//Laps of a 30x20m rectangle with keyframes every meter from start (m along the path); each lap is shifted a little.
+//The odometry integrates the increments with noise of pos_sigma and yaw_sigma per square root of meter
+Trajectory createTrajectory(int laps, double start, double pos_sigma, double yaw_sigma) {
+    const double W = 30, H = 20, perimeter = 2 * (W + H);
+    std::uniform_real_distribution<double> u(-0.7, 0.7);
+    std::normal_distribution<double> n(0, 1);
+    Trajectory traj;
+    for (int lap = 0; lap < laps; lap++) {
+        Vector3d offset(u(gen), u(gen), 0);
+        for (double s = 0; s < perimeter; s += 1.0) {
+            double l = fmod(s + start, perimeter);
+            State state;
+            if (l < W) {
+                state = {Vector3d(l, 0, 0), 0};
+            } else if (l < W + H) {
+                state = {Vector3d(W, l - W, 0), M_PI / 2};
+            } else if (l < 2 * W + H) {
+                state = {Vector3d(2 * W + H - l, H, 0), M_PI};
+            } else {
+                state = {Vector3d(0, perimeter - l, 0), -M_PI / 2};
+            }
+            state.pos += offset + Vector3d(0, 0, 1.5 + 0.3 * sin(l / 5));
+            state.yaw = wrapAngle(state.yaw + 0.05 * n(gen));
+            traj.truth.emplace_back(state);
+        }
+    }
+    State odom = traj.truth[0];
+    traj.odometry.emplace_back(toPose(odom));
+    traj.travel.emplace_back(0);
+    for (size_t i = 1; i < traj.truth.size(); i++) {
+        auto d = delta(traj.truth[i - 1], traj.truth[i]);
+        double dist = d.first.norm();
+        Vector3d dpos = d.first + Vector3d(n(gen), n(gen), n(gen)) * pos_sigma * sqrt(dist);
+        double dyaw = d.second + n(gen) * yaw_sigma * sqrt(dist);
+        State next = {odom.pos + Eigen::AngleAxisd(odom.yaw, Eigen::Vector3d::UnitZ()) * dpos, wrapAngle(odom.yaw + dyaw)};
+        traj.travel.emplace_back(traj.travel.back() + (next.pos - odom.pos).norm());
+        traj.odometry.emplace_back(toPose(next));
+        odom = next;
+    }
+    return traj;
+}
+
+//Within the bounds of pnp_result_verify
+bool isLoop(const State & a, const State & b) {
+    auto &_config = (*params->loopdetectorconfig);
+    auto d = delta(a, b);
+    return d.first.norm() < _config.accept_loop_max_pos && fabs(d.second) < _config.accept_loop_max_yaw * DEG2RAD;
+}
+
+struct GateResult {
+    int loops = 0;
+    int loops_kept = 0;
+    int false_candidates = 0;
+    int false_rejected = 0;
+    double max_loop_distance = 0;
+};
+
+//A candidate from b to a known loop of it in a, and one to a random keyframe of a more than 5m away (aliasing)
+GateResult runGate(const Trajectory & a, const Trajectory & b, bool same_drone, int min_gap, double threshold) {
+    GateResult ret;
+    for (size_t i = 0; i < b.truth.size(); i++) {
+        int num = same_drone ? (int) i - min_gap : a.truth.size();
+        if (num <= 0) {
+            continue;
+        }
+        auto travel = [&](int j) {
+            return same_drone ? fabs(b.travel[i] - a.travel[j]) : b.travel[i] + a.travel[j];
+        };
+        std::vector<int> loops;
+        for (int j = 0; j < num; j++) {
+            if (isLoop(a.truth[j], b.truth[i])) {
+                loops.emplace_back(j);
+            }
+        }
+        if (loops.size() > 0) {
+            int j = loops[std::uniform_int_distribution<int>(0, loops.size() - 1)(gen)];
+            double md = loopPriorDistance(a.odometry[j], b.odometry[i], travel(j));
+            ret.loops++;
+            ret.loops_kept += md <= threshold;
+            ret.max_loop_distance = std::max(ret.max_loop_distance, md);
+        }
+        int j = std::uniform_int_distribution<int>(0, num - 1)(gen);
+        if ((a.truth[j].pos - b.truth[i].pos).norm() > 5) {
+            ret.false_candidates++;
+            ret.false_rejected += loopPriorDistance(a.odometry[j], b.odometry[i], travel(j)) > threshold;
+        }
+    }
+    return ret;
+}
+
+bool check(const char * name, const GateResult & ret) {
+    bool success = ret.loops > 50 && ret.loops_kept == ret.loops && ret.false_rejected > 0.8 * ret.false_candidates;
+    printf("[loop_prior_gate_test] %s: loops kept %d/%d (max distance %.1f) false candidates rejected %d/%d %s\n", name,
+        ret.loops_kept, ret.loops, ret.max_loop_distance, ret.false_rejected, ret.false_candidates, success ? "OK" : "FAILED");
+    return success;
+}
+
+int main(int argc, char** argv) {
+    params = new D2FrontendParams;
+    params->loopdetectorconfig = new LoopDetectorConfig;
+    auto &_config = (*params->loopdetectorconfig);
+    _config.accept_loop_max_pos = 1.5;
+    _config.accept_loop_max_yaw = 15;
+    _config.pos_covariance_per_meter = 0.01;
+    _config.yaw_covariance_per_meter = 0.003;
+    double threshold = LoopPriorGateConfig().threshold;
+    bool success = true;
+
+    //Poses are comparable in the odometry frame of one drone, or in a reference frame shared by two
+    success &= sameReferenceFrame(1, -1, 1, -1) && sameReferenceFrame(1, 3, 2, 3);
+    success &= !sameReferenceFrame(1, -1, 2, -1) && !sameReferenceFrame(1, 3, 2, 4) && !sameReferenceFrame(1, 2, 1, 3);
+    printf("[loop_prior_gate_test] reference frames %s\n", success ? "OK" : "FAILED");
+
+    //Drift within the model: the position drift, with the part caused by the yaw drift, stays below pos_covariance_per_meter
+    for (double yaw_sigma : {0.002, 0.005}) {
+        char name[100] = {0};
+        //One drone revisiting its path, the loops are at least 50 keyframes apart
+        auto traj = createTrajectory(3, 0, 0.05, yaw_sigma);
+        sprintf(name, "single drone, yaw drift %.3f", yaw_sigma);
+        success &= check(name, runGate(traj, traj, true, 50, threshold));
+        //A second drone starting elsewhere on the path in the reference frame of the first
+        auto traj2 = createTrajectory(2, 37, 0.05, yaw_sigma);
+        sprintf(name, "two drones, yaw drift %.3f", yaw_sigma);
+        success &= check(name, runGate(traj, traj2, false, 0, threshold));
+    }
+    printf("[loop_prior_gate_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
@@ -0,0 +1,128 @@
+// Loop candidate verification pool with a delay-injected verifier: priority order, cancellation of stale candidates and throughput. CPU only.
+#include <d2frontend/loop_verification_pool.h>
+#include <d2common/utils.hpp>
+#include <atomic>
+#include <stdio.h>
+
+using namespace D2FrontEnd;
+using D2Common::Utility::TicToc;
+
+void sleepMs(double ms) {
+    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms));
+}
+
+LoopVerificationJob createJob(FrameIdType frame_id, double similarity, bool inter_drone, std::function<void()> run) {
+    LoopVerificationJob job;
+    job.frame_id = frame_id;
+    job.similarity = similarity;
+    job.inter_drone = inter_drone;
+    job.run = run;
+    return job;
+}
+
+bool testOrdering() {
+    LoopVerificationConfig config;
+    config.threads = 1;
+    config.latency_budget_ms = 0;
+    LoopVerificationPool pool(config);
+    std::mutex order_lock;
+    std::vector<FrameIdType> order;
+    auto record = [&](FrameIdType frame_id) {
+        return [&, frame_id] {
+            std::lock_guard<std::mutex> guard(order_lock);
+            order.push_back(frame_id);
+        };
+    };
+    //Keeps the worker busy while the candidates queue up
+    std::atomic<bool> release(false);
+    pool.submit(createJob(0, 0, false, [&] {
+        while (!release) {
+            sleepMs(1);
+        }
+    }));
+    sleepMs(10);
+    pool.submit(createJob(1, 0.80, false, record(1)));
+    pool.submit(createJob(2, 0.95, false, record(2)));
+    pool.submit(createJob(3, 0.70, true, record(3)));
+    pool.submit(createJob(4, 0.80, false, record(4)));
+    pool.submit(createJob(5, 0.90, true, record(5)));
+    pool.submit(createJob(6, 0.99, true, record(6)));
+    int cancelled = pool.cancel(6);
+    release = true;
+    pool.waitIdle();
+    //Inter-drone first, then by similarity, then the older one
+    std::vector<FrameIdType> expected = {5, 3, 2, 1, 4};
+    bool success = order == expected && cancelled == 1;
+    printf("[loop_verification_pool_test] ordering:");
+    for (auto frame_id : order) {
+        printf(" %ld", frame_id);
+    }
+    printf(" %s\n", success ? "OK" : "FAILED");
+    return success;
+}
+
+bool testCancellation() {
+    LoopVerificationConfig config;
+    config.threads = 1;
+    config.queue_size = 8;
+    config.latency_budget_ms = 50;
+    const double delay_ms = 10;
+    const int num = 30;
+    std::atomic<int> cancelled(0), executed(0);
+    bool success = true;
+    {
+        LoopVerificationPool pool(config);
+        //A burst of candidates arriving faster than they are verified
+        for (int i = 0; i < num; i++) {
+            auto job = createJob(i, 0.9, false, [&] {
+                sleepMs(delay_ms);
+                executed++;
+            });
+            job.on_cancel = [&] {
+                cancelled++;
+            };
+            pool.submit(job);
+            sleepMs(2);
+        }
+        pool.waitIdle();
+        auto stats = pool.stats();
+        success &= stats.submitted == num && stats.executed == executed && stats.executed + stats.dropped + stats.cancelled == num;
+        success &= cancelled == num - executed && stats.max_wait_ms < config.latency_budget_ms + delay_ms && stats.cancelled > 1;
+        printf("[loop_verification_pool_test] cancellation: %ld executed %ld dropped %ld cancelled, max wait %.1fms %s\n",
+            stats.executed, stats.dropped, stats.cancelled, stats.max_wait_ms, success ? "OK" : "FAILED");
+    }
+    return success;
+}
+
+double runThroughput(int threads, int num, double delay_ms) {
+    LoopVerificationConfig config;
+    config.threads = threads;
+    config.queue_size = num;
+    config.latency_budget_ms = 0;
+    LoopVerificationPool pool(config);
+    TicToc tic;
+    for (int i = 0; i < num; i++) {
+        pool.submit(createJob(i, 0.9, false, [&] { sleepMs(delay_ms); }));
+    }
+    pool.waitIdle();
+    return tic.toc();
+}
+
+bool testThroughput() {
+    const int num = 40;
+    const double delay_ms = 10;
+    double t_single = runThroughput(1, num, delay_ms);
+    double t_pool = runThroughput(4, num, delay_ms);
+    bool success = t_single / t_pool > 2.5;
+    printf("[loop_verification_pool_test] throughput: %d candidates of %.0fms, 1 worker %.1fms 4 workers %.1fms speed-up %.1fx %s\n",
+        num, delay_ms, t_single, t_pool, t_single / t_pool, success ? "OK" : "FAILED");
+    return success;
+}
+
+int main(int argc, char** argv) {
+    bool success = testOrdering();
+    success &= testCancellation();
+    success &= testThroughput();
+    printf("[loop_verification_pool_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
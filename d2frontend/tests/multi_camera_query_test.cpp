@@ -0,0 +1,146 @@
+// Loop detector database query with every camera of a quad fisheye frame in one batch. CPU only.
+#include <d2frontend/loop_detector.h>
+#include <d2common/d2frontend_types.h>
+#include <d2common/utils.hpp>
+#include <random>
+
+using namespace D2FrontEnd;
+using namespace D2Common;
+using D2Common::Utility::TicToc;
+
+const int CAMS = 4;
+std::mt19937 gen(0);
+
+class TestLoopDetector: public LoopDetector {
+public:
+    TestLoopDetector(const LoopDetectorConfig & config): LoopDetector(params->self_id, config) {}
+    void add(VisualImageDescArray & frame) {
+        addImageArrayToDatabase(frame, true);
+    }
+    bool query(const VisualImageDescArray & frame, std::shared_ptr<const VisualImageDescArray> & ret, int & camera_index_new,
+            int & camera_index_old) {
+        return queryImageArrayFromDatabase(frame, ret, camera_index_new, camera_index_old);
+    }
+    int querySingle(const VisualImageDesc & img, double & similarity) {
+        return queryFrameIndexFromDatabase(img, similarity);
+    }
+    std::vector<int> queryBatch(const VisualImageDescArray & frame, std::vector<double> & similarity) {
+        std::vector<const VisualImageDesc*> imgs;
+        for (auto & img : frame.images) {
+            imgs.emplace_back(&img);
+        }
+        return queryFrameIndexFromDatabase(imgs, similarity);
+    }
+};
+
+Eigen::VectorXf randomDesc() {
+    std::normal_distribution<float> normal(0, 1);
+    Eigen::VectorXf desc(params->netvlad_dims);
+    for (int j = 0; j < desc.size(); j++) {
+        desc(j) = normal(gen);
+    }
+    return desc.normalized();
+}
+
+//Same place seen again: the descriptor with noise
+Eigen::VectorXf revisit(const std::vector<float> & desc) {
+    Eigen::VectorXf ret = Eigen::Map<const Eigen::VectorXf>(desc.data(), desc.size()) + 0.5 * randomDesc();
+    return ret.normalized();
+}
+
+VisualImageDescArray createFrame(FrameIdType frame_id, const std::vector<Eigen::VectorXf> & descs) {
+    VisualImageDescArray frame;
+    frame.frame_id = frame_id;
+    frame.drone_id = params->self_id;
+    for (int i = 0; i < CAMS; i++) {
+        VisualImageDesc img;
+        img.frame_id = frame_id;
+        img.drone_id = params->self_id;
+        img.camera_index = i;
+        img.image_desc.assign(descs[i].data(), descs[i].data() + descs[i].size());
+        img.landmarks.emplace_back(LandmarkPerFrame::createLandmarkPerFrame(0, frame_id, 0.0, LandmarkType::SuperPointLandmark,
+            params->self_id, i, i, cv::Point2f(0, 0), Eigen::Vector3d(0, 0, 1)));
+        frame.images.emplace_back(img);
+    }
+    return frame;
+}
+
+VisualImageDescArray randomFrame(FrameIdType frame_id) {
+    std::vector<Eigen::VectorXf> descs;
+    for (int i = 0; i < CAMS; i++) {
+        descs.emplace_back(randomDesc());
+    }
+    return createFrame(frame_id, descs);
+}
+
+int main(int argc, char** argv) {
+    params = new D2FrontendParams;
+    params->self_id = 1;
+    params->netvlad_dims = 1024;
+    params->camera_configuration = CameraConfig::FOURCORNER_FISHEYE;
+    LoopDetectorConfig config;
+    config.match_index_dist = 0;
+    config.loop_detection_netvlad_thres = 0.6;
+    TestLoopDetector detector(config);
+    std::vector<VisualImageDescArray> database;
+    for (int i = 0; i < 1000; i++) {
+        database.emplace_back(randomFrame(i));
+        detector.add(database.back());
+    }
+    bool success = true;
+    //A revisit of keyframe 17 after a turn: its camera 2 place is now seen by camera 0 only
+    auto query = createFrame(10000, {revisit(database[17].images[2].image_desc), randomDesc(), randomDesc(), randomDesc()});
+    std::shared_ptr<const VisualImageDescArray> ret;
+    int camera_index_new = -1, camera_index_old = -1;
+    bool found = detector.query(query, ret, camera_index_new, camera_index_old);
+    bool ok = found && ret->frame_id == 17 && camera_index_new == 0 && camera_index_old == 2;
+    printf("[multi_camera_query_test] match only in camera 0: found %d frame %ld camera %d->%d %s\n", found, ret->frame_id,
+        camera_index_new, camera_index_old, ok ? "OK" : "FAILED");
+    success &= ok;
+    //Camera 2 alone, as queried before, misses it
+    double similarity;
+    ok = detector.querySingle(query.images[2], similarity) < 0;
+    printf("[multi_camera_query_test] camera 2 alone misses the loop %s\n", ok ? "OK" : "FAILED");
+    success &= ok;
+    //The best of several matching cameras wins
+    query = createFrame(10001, {revisit(database[40].images[1].image_desc), randomDesc(), randomDesc(), randomDesc()});
+    query.images[2].image_desc = database[300].images[3].image_desc;
+    found = detector.query(query, ret, camera_index_new, camera_index_old);
+    ok = found && ret->frame_id == 300 && camera_index_new == 2 && camera_index_old == 3;
+    printf("[multi_camera_query_test] best of two matching cameras: frame %ld camera %d->%d %s\n", ret->frame_id,
+        camera_index_new, camera_index_old, ok ? "OK" : "FAILED");
+    success &= ok;
+    //The batch returns what the cameras one by one return
+    int mismatch = 0;
+    for (int k = 0; k < 50; k++) {
+        auto & kf = database[k * 20 + 3];
+        query = createFrame(20000 + k, {revisit(kf.images[k % CAMS].image_desc), randomDesc(),
+            revisit(kf.images[(k + 1) % CAMS].image_desc), randomDesc()});
+        std::vector<double> similarities;
+        auto batch = detector.queryBatch(query, similarities);
+        for (int i = 0; i < CAMS; i++) {
+            int single = detector.querySingle(query.images[i], similarity);
+            mismatch += single != batch[i] || (single >= 0 && similarity != similarities[i]);
+        }
+    }
+    printf("[multi_camera_query_test] batch vs single queries: %d mismatches %s\n", mismatch, mismatch == 0 ? "OK" : "FAILED");
+    success &= mismatch == 0;
+    const int repeat = 200;
+    TicToc tic;
+    for (int k = 0; k < repeat; k++) {
+        for (int i = 0; i < CAMS; i++) {
+            detector.querySingle(query.images[i], similarity);
+        }
+    }
+    double t_single = tic.toc() / repeat;
+    tic.tic();
+    for (int k = 0; k < repeat; k++) {
+        std::vector<double> similarities;
+        detector.queryBatch(query, similarities);
+    }
+    double t_batch = tic.toc() / repeat;
+    printf("[multi_camera_query_test] %d cameras over %d images: one by one %.3fms batch %.3fms\n", CAMS, detector.databaseSize(),
+        t_single, t_batch);
+    printf("[multi_camera_query_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
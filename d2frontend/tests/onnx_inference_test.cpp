@@ -0,0 +1,380 @@
+#include "d2frontend/d2frontend_params.h"
+#include "d2frontend/CNN/onnx_generic.h"
+#include "d2frontend/CNN/superpoint_onnx.h"
+#include "d2frontend/CNN/superpoint_common.h"
+#include "d2frontend/CNN/mobilenetvlad_onnx.h"
+#include <fstream>
+#include <random>
+
+using namespace D2FrontEnd;
+D2FrontendParams * D2FrontEnd::params = new D2FrontendParams;
+
+// Minimal protobuf writer, enough to generate a tiny ONNX model without the onnx python package.
+class ProtoWriter {
+    std::string buf;
+public:
+    void varint(uint64_t v) {
+        while (v >= 0x80) {
+            buf.push_back((char)(v | 0x80));
+            v >>= 7;
+        }
+        buf.push_back((char)v);
+    }
+    void tag(int field, int wire_type) {
+        varint((field << 3) | wire_type);
+    }
+    void int64(int field, int64_t v) {
+        tag(field, 0);
+        varint(v);
+    }
+    void bytes(int field, const std::string & s) {
+        tag(field, 2);
+        varint(s.size());
+        buf += s;
+    }
+    void message(int field, const ProtoWriter & m) {
+        bytes(field, m.buf);
+    }
+    const std::string & str() const {
+        return buf;
+    }
+};
+
+// ValueInfoProto of a float tensor, negative dims are the dynamic "batch" dimension.
+ProtoWriter valueInfo(const std::string & name, const std::vector<int64_t> & dims) {
+    ProtoWriter shape;
+    for (auto d : dims) {
+        ProtoWriter dim;
+        if (d < 0) {
+            dim.bytes(2, "batch");
+        } else {
+            dim.int64(1, d);
+        }
+        shape.message(1, dim);
+    }
+    ProtoWriter tensor_type;
+    tensor_type.int64(1, 1); //FLOAT
+    tensor_type.message(2, shape);
+    ProtoWriter type;
+    type.message(1, tensor_type);
+    ProtoWriter info;
+    info.bytes(1, name);
+    info.message(2, type);
+    return info;
+}
+
+ProtoWriter node(const std::string & op_type, const std::vector<std::string> & inputs, const std::vector<std::string> & outputs,
+        const std::vector<ProtoWriter> & attributes = {}) {
+    ProtoWriter n;
+    for (auto & input : inputs) {
+        n.bytes(1, input);
+    }
+    for (auto & output : outputs) {
+        n.bytes(2, output);
+    }
+    n.bytes(3, outputs[0] + "_node");
+    n.bytes(4, op_type);
+    for (auto & attr : attributes) {
+        n.message(5, attr);
+    }
+    return n;
+}
+
+ProtoWriter attributeInts(const std::string & name, const std::vector<int64_t> & values) {
+    ProtoWriter attr;
+    attr.bytes(1, name);
+    for (auto v : values) {
+        attr.int64(8, v);
+    }
+    attr.int64(20, 7); //INTS
+    return attr;
+}
+
+ProtoWriter attributeInt(const std::string & name, int64_t value) {
+    ProtoWriter attr;
+    attr.bytes(1, name);
+    attr.int64(3, value);
+    attr.int64(20, 2); //INT
+    return attr;
+}
+
+ProtoWriter initializer(const std::string & name, const std::vector<int64_t> & dims, const std::vector<float> & data) {
+    ProtoWriter tensor;
+    for (auto d : dims) {
+        tensor.int64(1, d);
+    }
+    tensor.int64(2, 1); //FLOAT
+    tensor.bytes(8, name);
+    tensor.bytes(9, std::string((const char*)data.data(), data.size()*sizeof(float)));
+    return tensor;
+}
+
+std::string model(const ProtoWriter & graph) {
+    ProtoWriter opset;
+    opset.bytes(1, "");
+    opset.int64(2, 11);
+    ProtoWriter model;
+    model.int64(1, 6); //ir_version
+    model.bytes(2, "d2frontend_test");
+    model.message(7, graph);
+    model.message(8, opset);
+    return model.str();
+}
+
+std::vector<float> randomWeights(int num, std::mt19937 & gen) {
+    std::normal_distribution<float> dist(0, 1);
+    std::vector<float> w(num);
+    for (auto & v : w) {
+        v = dist(gen);
+    }
+    return w;
+}
+
+// Model with input "image" [batch, 1, height, width] and outputs
+// "neg" = -image with the same shape and "sum" = per-image sum [batch].
+std::string generateTinyModel(int width, int height, bool dynamic_batch) {
+    int64_t batch = dynamic_batch ? -1 : 1;
+    ProtoWriter graph;
+    graph.message(1, node("Neg", {"image"}, {"neg"}));
+    graph.message(1, node("ReduceSum", {"image"}, {"sum"}, {attributeInts("axes", {1, 2, 3}), attributeInt("keepdims", 0)}));
+    graph.bytes(2, "tiny");
+    graph.message(11, valueInfo("image", {batch, 1, height, width}));
+    graph.message(12, valueInfo("neg", {batch, 1, height, width}));
+    graph.message(12, valueInfo("sum", {batch}));
+    return model(graph);
+}
+
+// Same inputs and outputs as SuperPoint: "semi" = relu(image - 0.9), "desc" = 8x8 stride 8 conv to SP_DESC_RAW_LEN channels.
+std::string generateSuperPointLikeModel(int width, int height, bool dynamic_batch, std::mt19937 & gen) {
+    int64_t batch = dynamic_batch ? -1 : 1;
+    ProtoWriter graph;
+    graph.message(1, node("Sub", {"image", "offset"}, {"shifted"}));
+    graph.message(1, node("Relu", {"shifted"}, {"relu"}));
+    graph.message(1, node("Squeeze", {"relu"}, {"semi"}, {attributeInts("axes", {1})}));
+    graph.message(1, node("Conv", {"image", "conv_w"}, {"desc"}, {attributeInts("kernel_shape", {8, 8}), attributeInts("strides", {8, 8})}));
+    graph.bytes(2, "superpoint_like");
+    graph.message(5, initializer("offset", {}, {0.9f}));
+    graph.message(5, initializer("conv_w", {SP_DESC_RAW_LEN, 1, 8, 8}, randomWeights(SP_DESC_RAW_LEN*64, gen)));
+    graph.message(11, valueInfo("image", {batch, 1, height, width}));
+    graph.message(12, valueInfo("semi", {batch, height, width}));
+    graph.message(12, valueInfo("desc", {batch, SP_DESC_RAW_LEN, height/8, width/8}));
+    return model(graph);
+}
+
+// Same inputs and outputs as MobileNetVLAD: "descriptor:0" = flatten("image:0") * W.
+std::string generateNetVLADLikeModel(int width, int height, bool dynamic_batch, std::mt19937 & gen) {
+    int64_t batch = dynamic_batch ? -1 : 1;
+    ProtoWriter graph;
+    graph.message(1, node("Flatten", {"image:0"}, {"flatten"}, {attributeInt("axis", 1)}));
+    graph.message(1, node("MatMul", {"flatten", "proj_w"}, {"descriptor:0"}));
+    graph.bytes(2, "netvlad_like");
+    graph.message(5, initializer("proj_w", {width*height, NETVLAD_DESC_RAW_SIZE}, randomWeights(width*height*NETVLAD_DESC_RAW_SIZE, gen)));
+    graph.message(11, valueInfo("image:0", {batch, height, width, 1}));
+    graph.message(12, valueInfo("descriptor:0", {batch, NETVLAD_DESC_RAW_SIZE}));
+    return model(graph);
+}
+
+std::string writeModel(const std::string & path, const std::string & model) {
+    std::ofstream ofs(path, std::ios::binary);
+    ofs << model;
+    return path;
+}
+
+cv::Mat randomImage(int width, int height, std::mt19937 & gen) {
+    cv::Mat img(height, width, CV_32F);
+    std::uniform_real_distribution<float> dist(0, 1);
+    for (int i = 0; i < width * height; i++) {
+        img.at<float>(i) = dist(gen);
+    }
+    return img;
+}
+
+bool checkOutputs(const float * input, const float * neg, float sum, int num) {
+    double sum_ref = 0;
+    for (int i = 0; i < num; i++) {
+        if (neg[i] != -input[i]) {
+            printf("[onnx_inference_test] neg mismatch at %d: %f vs %f\n", i, neg[i], -input[i]);
+            return false;
+        }
+        sum_ref += input[i];
+    }
+    if (fabs(sum - sum_ref) > 1e-3 * num) {
+        printf("[onnx_inference_test] sum mismatch %f vs %f\n", sum, sum_ref);
+        return false;
+    }
+    return true;
+}
+
+// Bound buffers on the CPU provider: preprocessing writes into inputBuffer(), doInference copies.
+bool testCPUBinding(const std::string & model_path, int width, int height) {
+    ONNXInferenceConfig config;
+    config.provider = ONNXExecutionProvider::CPU;
+    config.intra_op_threads = 2;
+    ONNXInferenceGeneric net(model_path, "image", {"neg", "sum"}, width, height, config);
+    net.bindTensors({1, 1, height, width}, {{1, 1, height, width}, {1}});
+    std::mt19937 gen(0);
+    for (int i = 0; i < 5; i++) {
+        cv::Mat img = randomImage(width, height, gen);
+        cv::Mat input_bound(height, width, CV_32F, net.inputBuffer());
+        img.convertTo(input_bound, CV_32F);
+        net.run();
+        if (!checkOutputs((float*)img.data, net.outputBuffer(0), net.outputBuffer(1)[0], width * height)) {
+            return false;
+        }
+        img = randomImage(width, height, gen);
+        net.doInference(img.data, 1);
+        if (!checkOutputs((float*)img.data, net.outputBuffer(0), net.outputBuffer(1)[0], width * height)) {
+            return false;
+        }
+    }
+    printf("[onnx_inference_test] CPU binding OK\n");
+    return true;
+}
+
+cv::Mat randomGrayImage(int width, int height, std::mt19937 & gen) {
+    cv::Mat img(height, width, CV_8U);
+    std::uniform_int_distribution<int> dist(0, 255);
+    for (int i = 0; i < width * height; i++) {
+        img.at<uint8_t>(i) = dist(gen);
+    }
+    return img;
+}
+
+bool compareVector(const std::vector<float> & a, const std::vector<float> & b, double tol, const std::string & name) {
+    if (a.size() != b.size()) {
+        printf("[onnx_inference_test] %s size mismatch %ld vs %ld\n", name.c_str(), a.size(), b.size());
+        return false;
+    }
+    for (unsigned int i = 0; i < a.size(); i++) {
+        if (fabs(a[i] - b[i]) > tol) {
+            printf("[onnx_inference_test] %s mismatch at %d: %f vs %f\n", name.c_str(), i, a[i], b[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// A batched run of a dynamic batch model must give the same outputs as per-image runs.
+bool testGenericBatch(const std::string & model_path, int width, int height, int batch) {
+    ONNXInferenceConfig config;
+    config.provider = ONNXExecutionProvider::CPU;
+    ONNXInferenceGeneric net(model_path, "image", {"neg", "sum"}, width, height, config);
+    if (!net.supportsBatch()) {
+        printf("[onnx_inference_test] dynamic batch not detected\n");
+        return false;
+    }
+    std::mt19937 gen(1);
+    std::vector<cv::Mat> imgs;
+    for (int i = 0; i < batch; i++) {
+        imgs.emplace_back(randomImage(width, height, gen));
+    }
+    net.bindTensors({batch, 1, height, width}, {{batch, 1, height, width}, {batch}});
+    for (int i = 0; i < batch; i++) {
+        memcpy(net.inputBuffer() + i*width*height, imgs[i].data, width*height*sizeof(float));
+    }
+    net.run();
+    std::vector<float> neg_batch(net.outputBuffer(0), net.outputBuffer(0) + batch*width*height);
+    std::vector<float> sum_batch(net.outputBuffer(1), net.outputBuffer(1) + batch);
+    net.bindTensors({1, 1, height, width}, {{1, 1, height, width}, {1}});
+    for (int i = 0; i < batch; i++) {
+        net.doInference(imgs[i].data, 1);
+        if (!checkOutputs((float*)imgs[i].data, neg_batch.data() + i*width*height, sum_batch[i], width * height) ||
+            !compareVector({sum_batch[i]}, {net.outputBuffer(1)[0]}, 1e-3, "sum")) {
+            return false;
+        }
+    }
+    printf("[onnx_inference_test] generic batch %d OK\n", batch);
+    return true;
+}
+
+bool testSuperPointBatch(const std::string & model_path, int width, int height, int batch) {
+    ONNXInferenceConfig config;
+    config.provider = ONNXExecutionProvider::CPU;
+    SuperPointONNX sp(model_path, 4, "", "", width, height, 0.015, 100, config);
+    std::mt19937 gen(2);
+    std::vector<cv::Mat> imgs;
+    for (int i = 0; i < batch; i++) {
+        imgs.emplace_back(randomGrayImage(width, height, gen));
+    }
+    std::vector<std::vector<cv::Point2f>> kpts_batch;
+    std::vector<std::vector<float>> descs_batch, scores_batch;
+    sp.inference(imgs, kpts_batch, descs_batch, scores_batch);
+    for (int i = 0; i < batch; i++) {
+        std::vector<cv::Point2f> kpts;
+        std::vector<float> descs, scores;
+        sp.inference(imgs[i], kpts, descs, scores);
+        if (kpts.size() == 0 || kpts.size() != kpts_batch[i].size()) {
+            printf("[onnx_inference_test] superpoint keypoint num mismatch %ld vs %ld\n", kpts_batch[i].size(), kpts.size());
+            return false;
+        }
+        for (unsigned int j = 0; j < kpts.size(); j++) {
+            if (kpts[j] != kpts_batch[i][j]) {
+                printf("[onnx_inference_test] superpoint keypoint mismatch at %d\n", j);
+                return false;
+            }
+        }
+        if (!compareVector(descs_batch[i], descs, 1e-5, "superpoint desc") ||
+            !compareVector(scores_batch[i], scores, 1e-6, "superpoint scores")) {
+            return false;
+        }
+    }
+    printf("[onnx_inference_test] SuperPointONNX batch %d (batch supported %d) OK\n", batch, sp.supportsBatch());
+    return true;
+}
+
+bool testNetVLADBatch(const std::string & model_path, int width, int height, int batch) {
+    ONNXInferenceConfig config;
+    config.provider = ONNXExecutionProvider::CPU;
+    MobileNetVLADONNX netvlad(model_path, width, height, config);
+    std::mt19937 gen(3);
+    std::vector<cv::Mat> imgs;
+    for (int i = 0; i < batch; i++) {
+        imgs.emplace_back(randomGrayImage(width, height, gen));
+    }
+    auto descs_batch = netvlad.inference(imgs);
+    for (int i = 0; i < batch; i++) {
+        //Raw outputs are not normalized, compare with a relative tolerance
+        auto desc = netvlad.inference(imgs[i]);
+        Eigen::Map<const Eigen::VectorXf> a(desc.data(), desc.size()), b(descs_batch[i].data(), descs_batch[i].size());
+        if (desc.size() != descs_batch[i].size() || (a - b).norm() > 1e-5 * a.norm()) {
+            printf("[onnx_inference_test] netvlad desc mismatch on image %d\n", i);
+            return false;
+        }
+    }
+    printf("[onnx_inference_test] MobileNetVLADONNX batch %d (batch supported %d) OK\n", batch, netvlad.supportsBatch());
+    return true;
+}
+
+bool testParseProvider() {
+    ONNXExecutionProvider provider;
+    bool success = parseONNXExecutionProvider("cpu", true, provider) && provider == ONNXExecutionProvider::CPU;
+    success &= parseONNXExecutionProvider("CUDA", true, provider) && provider == ONNXExecutionProvider::CUDA;
+    success &= parseONNXExecutionProvider("tensorrt", false, provider) && provider == ONNXExecutionProvider::TensorRT;
+    success &= parseONNXExecutionProvider("", false, provider) && provider == ONNXExecutionProvider::CUDA;
+    success &= parseONNXExecutionProvider("", true, provider) && provider == ONNXExecutionProvider::TensorRT;
+    //A typo is rejected instead of falling back to the GPU
+    provider = ONNXExecutionProvider::CPU;
+    success &= !parseONNXExecutionProvider("cuda ", false, provider) && !parseONNXExecutionProvider("tensorrrt", true, provider) &&
+        provider == ONNXExecutionProvider::CPU;
+    printf("[onnx_inference_test] parse provider %s\n", success ? "OK" : "FAILED");
+    return success;
+}
+
+int main(int argc, char** argv) {
+    int width = 64, height = 48;
+    std::string folder = argc > 1 ? argv[1] : "/tmp/";
+    std::mt19937 gen(0);
+    auto model_path = writeModel(folder + "/d2frontend_tiny.onnx", generateTinyModel(width, height, false));
+    bool success = testParseProvider();
+    success &= testCPUBinding(model_path, width, height);
+    model_path = writeModel(folder + "/d2frontend_tiny_batch.onnx", generateTinyModel(width, height, true));
+    success &= testGenericBatch(model_path, width, height, 4);
+    for (bool dynamic_batch : {true, false}) {
+        model_path = writeModel(folder + "/d2frontend_superpoint_like.onnx", generateSuperPointLikeModel(width, height, dynamic_batch, gen));
+        success &= testSuperPointBatch(model_path, width, height, 4);
+        model_path = writeModel(folder + "/d2frontend_netvlad_like.onnx", generateNetVLADLikeModel(16, 12, dynamic_batch, gen));
+        success &= testNetVLADBatch(model_path, 16, 12, 4);
+    }
+    printf("[onnx_inference_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
@@ -0,0 +1,152 @@
+// Correspondences of a four camera loop candidate matched per direction in parallel: same output as serial, and the speed-up. CPU only.
+#include <d2frontend/loop_detector.h>
+#include <d2common/d2frontend_types.h>
+#include <d2common/utils.hpp>
+#include <algorithm>
+#include <random>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace D2FrontEnd;
+using namespace D2Common;
+using D2Common::Utility::TicToc;
+
+const int CAMS = 4;
+const int LANDMARKS = 800;
+std::mt19937 gen(0);
+
+struct Correspondences {
+    bool success = false;
+    std::vector<Vector3d> lm_pos_a;
+    std::vector<Vector3d> lm_norm_3d_b;
+    std::vector<int> cam_indices;
+    std::vector<std::pair<int, int>> index2dirindex_a;
+    std::vector<std::pair<int, int>> index2dirindex_b;
+    std::vector<float> match_dists;
+    bool operator==(const Correspondences & other) const {
+        return success == other.success && lm_pos_a == other.lm_pos_a && lm_norm_3d_b == other.lm_norm_3d_b &&
+            cam_indices == other.cam_indices && index2dirindex_a == other.index2dirindex_a &&
+            index2dirindex_b == other.index2dirindex_b && match_dists == other.match_dists;
+    }
+};
+
+class TestLoopDetector: public LoopDetector {
+public:
+    TestLoopDetector(const LoopDetectorConfig & config): LoopDetector(params->self_id, config) {}
+    Correspondences match(const VisualImageDescArray & frame_a, const VisualImageDescArray & frame_b, int main_dir_a, int main_dir_b) {
+        Correspondences ret;
+        ret.success = computeCorrespondFeaturesOnImageArray(frame_a, frame_b, main_dir_a, main_dir_b, ret.lm_pos_a, ret.lm_norm_3d_b,
+            ret.cam_indices, ret.index2dirindex_a, ret.index2dirindex_b, ret.match_dists);
+        return ret;
+    }
+};
+
+//Frame b sees the landmarks of frame a in a shuffled order with noisy descriptors
+void createFrames(VisualImageDescArray & frame_a, VisualImageDescArray & frame_b, std::map<LandmarkIdType, LandmarkPerId> & landmark_db) {
+    std::normal_distribution<float> noise(0, 1);
+    std::uniform_real_distribution<float> u(0, 1);
+    frame_a.frame_id = 1;
+    frame_b.frame_id = 2;
+    frame_a.drone_id = frame_b.drone_id = params->self_id;
+    for (int i = 0; i < CAMS; i++) {
+        VisualImageDesc img_a, img_b;
+        img_a.frame_id = frame_a.frame_id;
+        img_b.frame_id = frame_b.frame_id;
+        img_a.drone_id = img_b.drone_id = params->self_id;
+        img_a.camera_index = img_b.camera_index = i;
+        std::vector<int> order(LANDMARKS);
+        for (int j = 0; j < LANDMARKS; j++) {
+            order[j] = j;
+        }
+        std::shuffle(order.begin(), order.end(), gen);
+        std::vector<std::vector<float>> descs(LANDMARKS);
+        for (int j = 0; j < LANDMARKS; j++) {
+            LandmarkIdType landmark_id = i * LANDMARKS + j;
+            cv::Point2f pt(u(gen) * 640, u(gen) * 480);
+            img_a.landmarks.emplace_back(LandmarkPerFrame::createLandmarkPerFrame(landmark_id, frame_a.frame_id, 0.0,
+                LandmarkType::SuperPointLandmark, params->self_id, i, i, pt, Eigen::Vector3d(0, 0, 1)));
+            Eigen::VectorXf desc(params->superpoint_dims);
+            for (int k = 0; k < desc.size(); k++) {
+                desc(k) = noise(gen);
+            }
+            desc.normalize();
+            img_a.landmark_descriptor.insert(img_a.landmark_descriptor.end(), desc.data(), desc.data() + desc.size());
+            img_a.landmark_scores.push_back(u(gen));
+            for (int k = 0; k < desc.size(); k++) {
+                desc(k) += 0.2 / sqrt(desc.size()) * noise(gen);
+            }
+            descs[j].assign(desc.data(), desc.data() + desc.size());
+            //Part of the landmarks are not triangulated yet
+            LandmarkPerId lm;
+            lm.landmark_id = landmark_id;
+            lm.drone_id = params->self_id;
+            lm.position = Eigen::Vector3d(u(gen), u(gen), u(gen)) * 10;
+            lm.flag = u(gen) < 0.8 ? LandmarkFlag::INITIALIZED : LandmarkFlag::UNINITIALIZED;
+            landmark_db[landmark_id] = lm;
+        }
+        for (int j = 0; j < LANDMARKS; j++) {
+            int k = order[j];
+            img_b.landmarks.emplace_back(LandmarkPerFrame::createLandmarkPerFrame(-1, frame_b.frame_id, 0.0,
+                LandmarkType::SuperPointLandmark, params->self_id, i, i, img_a.landmarks[k].pt2d + cv::Point2f(5, 5),
+                Eigen::Vector3d(u(gen), u(gen), 1).normalized()));
+            img_b.landmark_descriptor.insert(img_b.landmark_descriptor.end(), descs[k].begin(), descs[k].end());
+            img_b.landmark_scores.push_back(u(gen));
+        }
+        frame_a.images.emplace_back(img_a);
+        frame_b.images.emplace_back(img_b);
+    }
+}
+
+int main(int argc, char** argv) {
+    params = new D2FrontendParams;
+    params->self_id = 1;
+    params->camera_configuration = CameraConfig::FOURCORNER_FISHEYE;
+    //The matcher's own threads would blur the per-direction gain
+    cv::setNumThreads(1);
+    LoopDetectorConfig config;
+    config.MAX_DIRS = CAMS;
+    config.MIN_DIRECTION_LOOP = 3;
+    config.MIN_MATCH_PRE_DIR = 15;
+    config.loop_inlier_feature_num = 50;
+    config.match_index_dist = 0;
+    config.loop_detection_netvlad_thres = 0.5;
+    config.parallel_correspondence = false;
+    TestLoopDetector serial(config);
+    config.parallel_correspondence = true;
+    TestLoopDetector parallel(config);
+    VisualImageDescArray frame_a, frame_b;
+    std::map<LandmarkIdType, LandmarkPerId> landmark_db;
+    createFrames(frame_a, frame_b, landmark_db);
+    serial.updatebyLandmarkDB(landmark_db);
+    parallel.updatebyLandmarkDB(landmark_db);
+
+    const int repeat = 10;
+    double t_serial = 0, t_parallel = 0;
+    bool success = true;
+    for (int k = 0; k < repeat; k++) {
+        for (int main_dir = 0; main_dir < CAMS; main_dir++) {
+            TicToc tic;
+            auto ret_serial = serial.match(frame_a, frame_b, main_dir, main_dir);
+            t_serial += tic.toc();
+            tic.tic();
+            auto ret_parallel = parallel.match(frame_a, frame_b, main_dir, main_dir);
+            t_parallel += tic.toc();
+            success &= ret_serial.success && ret_serial == ret_parallel;
+        }
+    }
+    int num = repeat * CAMS;
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    double speedup = t_serial / t_parallel;
+    printf("[parallel_correspondence_test] %d cameras x %d landmarks, %d threads: serial %.2fms parallel %.2fms speed-up %.1fx\n",
+        CAMS, LANDMARKS, threads, t_serial / num, t_parallel / num, speedup);
+    //Four directions on at least four cores should give a clear gain
+    if (threads >= CAMS) {
+        success &= speedup > 1.5;
+    }
+    printf("[parallel_correspondence_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
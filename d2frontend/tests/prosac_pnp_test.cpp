@@ -0,0 +1,139 @@
+// PROSAC against the uniform RANSAC on synthetic non-central PnP problems with controlled outlier ratios. CPU only.
+#include <d2frontend/prosac.h>
+#include <d2frontend/utils.h>
+#include <d2common/utils.hpp>
+#include <opengv/absolute_pose/NoncentralAbsoluteAdapter.hpp>
+#include <opengv/absolute_pose/methods.hpp>
+#include <opengv/sac/Ransac.hpp>
+#include <opengv/sac_problems/absolute_pose/AbsolutePoseSacProblem.hpp>
+#include <random>
+
+using namespace D2FrontEnd;
+using D2Common::Utility::TicToc;
+using opengv::sac_problems::absolute_pose::AbsolutePoseSacProblem;
+
+const int CAMS = 4;
+const int POINTS = 300;
+std::mt19937 gen(0);
+
+struct Problem {
+    Swarm::Pose pose; //Drone in the frame of the points
+    std::vector<Swarm::Pose> extrinsics;
+    std::vector<Vector3d> points;
+    std::vector<Vector3d> bearings;
+    std::vector<int> camera_indices;
+    std::vector<float> match_dists;
+};
+
+//Four cameras looking around; outliers have random bearings and, on average, worse descriptor distances
+Problem createProblem(double outlier_ratio) {
+    std::uniform_real_distribution<double> u(-1, 1);
+    std::normal_distribution<double> noise(0, 1.0 / params->focal_length);
+    Problem problem;
+    problem.pose = Swarm::Pose(Eigen::AngleAxisd(u(gen) * M_PI, Eigen::Vector3d::UnitZ()).toRotationMatrix(),
+        Eigen::Vector3d(u(gen), u(gen), u(gen)));
+    for (int i = 0; i < CAMS; i++) {
+        Eigen::Matrix3d R = Eigen::AngleAxisd(i * M_PI / 2, Eigen::Vector3d::UnitZ()) *
+            Eigen::AngleAxisd(-M_PI / 2, Eigen::Vector3d::UnitX()).toRotationMatrix();
+        problem.extrinsics.emplace_back(R, R * Eigen::Vector3d(0, 0, 0.1));
+    }
+    for (int i = 0; i < POINTS; i++) {
+        int cam = i % CAMS;
+        auto & ext = problem.extrinsics[cam];
+        Eigen::Vector3d pt_cam(u(gen) * 3, u(gen) * 3, 4 + u(gen) * 2);
+        problem.points.emplace_back(problem.pose.R() * (ext.R() * pt_cam + ext.pos()) + problem.pose.pos());
+        Eigen::Vector3d bearing = pt_cam.normalized();
+        bool outlier = (u(gen) + 1) / 2 < outlier_ratio;
+        if (outlier) {
+            bearing = Eigen::Vector3d(u(gen), u(gen), 1).normalized();
+        } else {
+            bearing = (bearing + Eigen::Vector3d(noise(gen), noise(gen), noise(gen))).normalized();
+        }
+        problem.bearings.emplace_back(bearing);
+        problem.camera_indices.emplace_back(cam);
+        problem.match_dists.emplace_back(outlier ? 0.4 + 0.6 * (u(gen) + 1) / 2 : 0.6 * (u(gen) + 1) / 2);
+    }
+    return problem;
+}
+
+struct SolveResult {
+    int iterations = 0;
+    double pos_err = 0;
+    double ang_err = 0;
+    double ms = 0;
+};
+
+//Same model, threshold and refinement for both samplers
+template <typename SAC_T>
+SolveResult solve(const Problem & problem, SAC_T & sac) {
+    opengv::bearingVectors_t bearings(problem.bearings.begin(), problem.bearings.end());
+    opengv::points_t points(problem.points.begin(), problem.points.end());
+    opengv::rotations_t rotations;
+    opengv::translations_t offsets;
+    for (auto & ext : problem.extrinsics) {
+        rotations.push_back(ext.R());
+        offsets.push_back(ext.pos());
+    }
+    opengv::absolute_pose::NoncentralAbsoluteAdapter adapter(bearings, problem.camera_indices, points, offsets, rotations);
+    TicToc tic;
+    sac.sac_model_.reset(new AbsolutePoseSacProblem(adapter, AbsolutePoseSacProblem::GP3P));
+    sac.threshold_ = 0.5 / params->focal_length;
+    sac.computeModel();
+    adapter.setR(sac.model_coefficients_.template block<3, 3>(0, 0));
+    adapter.sett(sac.model_coefficients_.template block<3, 1>(0, 3));
+    opengv::transformation_t refined = opengv::absolute_pose::optimize_nonlinear(adapter, sac.inliers_);
+    SolveResult ret;
+    ret.ms = tic.toc();
+    Swarm::Pose pose(Matrix3d(refined.block<3, 3>(0, 0)), Vector3d(refined.block<3, 1>(0, 3)));
+    auto dp = Swarm::Pose::DeltaPose(problem.pose, pose);
+    ret.iterations = sac.iterations_;
+    ret.pos_err = dp.pos().norm();
+    ret.ang_err = Eigen::AngleAxisd(dp.R()).angle() * 180 / M_PI;
+    return ret;
+}
+
+//Returns whether the pose is accurate
+bool accumulate(const SolveResult & ret, SolveResult & sum) {
+    sum.iterations += ret.iterations;
+    sum.pos_err += ret.pos_err;
+    sum.ang_err += ret.ang_err;
+    sum.ms += ret.ms;
+    return ret.pos_err < 0.05 && ret.ang_err < 1.0;
+}
+
+int main(int argc, char** argv) {
+    params = new D2FrontendParams;
+    params->self_id = 1;
+    params->focal_length = 384;
+    const int trials = 20;
+    const int max_iterations = 2000;
+    bool success = true;
+    for (double outlier_ratio : {0.3, 0.5, 0.7}) {
+        SolveResult ransac_sum, prosac_sum;
+        int ransac_ok = 0, prosac_ok = 0, production_ok = 0;
+        for (int k = 0; k < trials; k++) {
+            auto problem = createProblem(outlier_ratio);
+            opengv::sac::Ransac<AbsolutePoseSacProblem> ransac;
+            ransac.max_iterations_ = max_iterations;
+            Prosac<AbsolutePoseSacProblem> prosac(max_iterations);
+            prosac.setMatchDistances(problem.match_dists);
+            ransac_ok += accumulate(solve(problem, ransac), ransac_sum);
+            prosac_ok += accumulate(solve(problem, prosac), prosac_sum);
+            //The loop detector path with its iteration cap
+            std::vector<int> inliers;
+            auto pose = computePosePnPnonCentral(problem.points, problem.bearings, problem.extrinsics, problem.camera_indices,
+                inliers, problem.match_dists);
+            auto dp = Swarm::Pose::DeltaPose(problem.pose, pose);
+            production_ok += dp.pos().norm() < 0.05 && Eigen::AngleAxisd(dp.R()).angle() * 180 / M_PI < 1.0;
+        }
+        printf("[prosac_pnp_test] outliers %.0f%%: RANSAC %.1f iterations %.2fms err %.3fm %.2fdeg ok %d/%d | "
+            "PROSAC %.1f iterations %.2fms err %.3fm %.2fdeg ok %d/%d | loop detector ok %d/%d\n", outlier_ratio * 100,
+            (double) ransac_sum.iterations / trials, ransac_sum.ms / trials, ransac_sum.pos_err / trials, ransac_sum.ang_err / trials,
+            ransac_ok, trials, (double) prosac_sum.iterations / trials, prosac_sum.ms / trials, prosac_sum.pos_err / trials,
+            prosac_sum.ang_err / trials, prosac_ok, trials, production_ok, trials);
+        //Fewer samples for the same accuracy
+        success &= prosac_sum.iterations < ransac_sum.iterations && prosac_ok + 1 >= ransac_ok && production_ok == trials;
+    }
+    printf("[prosac_pnp_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
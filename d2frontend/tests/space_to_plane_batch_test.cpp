@@ -0,0 +1,145 @@
+#include <camodocal/camera_models/EquidistantCamera.h>
+#include <camodocal/camera_models/PinholeCamera.h>
+#include <camodocal/camera_models/CataCamera.h>
+#include <camodocal/camera_models/ScaramuzzaCamera.h>
+#include <camodocal/camera_models/PolyFisheyeCamera.h>
+#include <d2common/utils.hpp>
+#include <random>
+
+using namespace camodocal;
+using D2Common::Utility::TicToc;
+
+const int WIDTH = 640;
+const int HEIGHT = 480;
+const int POINTS = 10000;
+std::mt19937 gen(0);
+
+struct TestCamera {
+    std::string name;
+    CameraPtr cam;
+    double max_theta; //Half field of view of the sampled points
+    CameraPtr exact; //Model whose spaceToPlane is differentiated for the jacobians when cam approximates it, else cam
+};
+
+std::vector<TestCamera> testCameras() {
+    std::vector<TestCamera> cams;
+    cams.push_back({"KANNALA_BRANDT", CameraPtr(new EquidistantCamera(EquidistantCamera::Parameters("kb", WIDTH, HEIGHT,
+        0.01, -0.005, 0.001, -0.0002, 250, 250, 320, 240))), 1.5});
+    cams.push_back({"PINHOLE", CameraPtr(new PinholeCamera(PinholeCamera::Parameters("pinhole", WIDTH, HEIGHT,
+        -0.1, 0.02, 0.001, -0.001, 400, 400, 320, 240))), 0.7});
+    cams.push_back({"PINHOLE_NO_DISTORTION", CameraPtr(new PinholeCamera(PinholeCamera::Parameters("pinhole", WIDTH, HEIGHT,
+        0, 0, 0, 0, 400, 400, 320, 240))), 0.7});
+    cams.push_back({"MEI", CameraPtr(new CataCamera(CataCamera::Parameters("mei", WIDTH, HEIGHT,
+        1.5, -0.1, 0.02, 0.001, -0.001, 600, 600, 320, 240))), 1.5});
+    cams.push_back({"POLYFISHEYE", CameraPtr(new PolyFisheyeCamera(PolyFisheyeCamera::Parameters("poly", WIDTH, HEIGHT,
+        0.01, -0.005, 0.001, 0.0, 0.0, 0.0, 0.0, 0.0, 250, 0.5, 250, 320, 240, 0))), 1.5});
+    //Table lookup of r(theta), the jacobians are of the polynomial
+    cams.push_back({"POLYFISHEYE_FAST", CameraPtr(new PolyFisheyeCamera(PolyFisheyeCamera::Parameters("poly", WIDTH, HEIGHT,
+        0.01, -0.005, 0.001, 0.0, 0.0, 0.0, 0.0, 0.0, 250, 0.5, 250, 320, 240, 1))), 1.5,
+        cams.back().cam});
+    cams.push_back({"POLYFISHEYE_NO_DISTORTION", CameraPtr(new PolyFisheyeCamera(PolyFisheyeCamera::Parameters("poly", WIDTH, HEIGHT,
+        0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 250, 0, 250, 320, 240, 0))), 1.5});
+    //No batch implementation, falls back to Camera::spaceToPlaneBatch
+    OCAMCamera::Parameters ocam;
+    ocam.cameraName() = "scaramuzza";
+    ocam.imageWidth() = WIDTH;
+    ocam.imageHeight() = HEIGHT;
+    ocam.C() = 1.0;
+    ocam.center_x() = 320;
+    ocam.center_y() = 240;
+    ocam.poly(0) = -300;
+    ocam.poly(2) = 1e-4;
+    cams.push_back({"SCARAMUZZA", CameraPtr(new OCAMCamera(ocam)), 1.2});
+    return cams;
+}
+
+//Points at 0.5 to 10m within max_theta of the optical axis, and one on the axis
+Eigen::Matrix3Xd randomPoints(int num, double max_theta) {
+    std::uniform_real_distribution<double> dist_theta(0, max_theta), dist_phi(-M_PI, M_PI), dist_depth(0.5, 10);
+    Eigen::Matrix3Xd P(3, num);
+    for (int i = 0; i < num; i++) {
+        double theta = dist_theta(gen), phi = dist_phi(gen);
+        P.col(i) = Eigen::Vector3d(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta)) * dist_depth(gen);
+    }
+    P.col(0) = Eigen::Vector3d(0, 0, 2);
+    return P;
+}
+
+bool testEquivalence(const TestCamera & c) {
+    auto P = randomPoints(POINTS, c.max_theta);
+    Eigen::Matrix2Xd p;
+    Camera::BatchJacobian J;
+    c.cam->spaceToPlaneBatch(P, p, &J);
+    Eigen::Matrix2Xd p_nojac;
+    c.cam->spaceToPlaneBatch(P, p_nojac);
+    double max_err = 0, max_jac_err = 0;
+    for (int i = 0; i < POINTS; i++) {
+        Eigen::Vector2d p_ref;
+        c.cam->spaceToPlane(P.col(i), p_ref);
+        //acos of spaceToPlane is not accurate (or NaN) on the optical axis
+        if (i > 0) {
+            max_err = std::max(max_err, (p_ref - p.col(i)).norm());
+        }
+        //Jacobian against central differences of spaceToPlane, off the axis where its acos is accurate
+        if (i == 0) {
+            continue;
+        }
+        auto & exact = c.exact ? c.exact : c.cam;
+        double h = 1e-6 * P.col(i).norm();
+        for (int k = 0; k < 3; k++) {
+            Eigen::Vector3d P_plus = P.col(i), P_minus = P.col(i);
+            P_plus(k) += h;
+            P_minus(k) -= h;
+            Eigen::Vector2d p_plus, p_minus;
+            exact->spaceToPlane(P_plus, p_plus);
+            exact->spaceToPlane(P_minus, p_minus);
+            Eigen::Vector2d J_num = (p_plus - p_minus) / (2 * h);
+            double err = std::max(fabs(J_num(0) - J(i, k)), fabs(J_num(1) - J(i, 3 + k))) / std::max(1.0, J_num.norm());
+            max_jac_err = std::max(max_jac_err, err);
+        }
+    }
+    bool success = max_err < 1e-6 && (p - p_nojac).norm() == 0 && max_jac_err < 1e-5 && !p.hasNaN();
+    printf("[space_to_plane_batch_test] %s: max error %.2e px, max relative jacobian error %.2e %s\n", c.name.c_str(), max_err,
+        max_jac_err, success ? "OK" : "FAILED");
+    return success;
+}
+
+void benchmark(const TestCamera & c) {
+    auto P = randomPoints(POINTS, c.max_theta);
+    const int repeat = 20;
+    TicToc tic;
+    for (int k = 0; k < repeat; k++) {
+        for (int i = 0; i < POINTS; i++) {
+            Eigen::Vector2d p;
+            c.cam->spaceToPlane(P.col(i), p);
+        }
+    }
+    double t_single = tic.toc() / repeat;
+    Eigen::Matrix2Xd p;
+    Camera::BatchJacobian J;
+    tic.tic();
+    for (int k = 0; k < repeat; k++) {
+        c.cam->spaceToPlaneBatch(P, p);
+    }
+    double t_batch = tic.toc() / repeat;
+    tic.tic();
+    for (int k = 0; k < repeat; k++) {
+        c.cam->spaceToPlaneBatch(P, p, &J);
+    }
+    double t_jac = tic.toc() / repeat;
+    printf("[space_to_plane_batch_test] %s: %d points spaceToPlane %.3fms batch %.3fms (%.1fx) batch with jacobians %.3fms\n",
+        c.name.c_str(), POINTS, t_single, t_batch, t_single / t_batch, t_jac);
+}
+
+int main(int argc, char** argv) {
+    bool success = true;
+    auto cams = testCameras();
+    for (auto & c : cams) {
+        success &= testEquivalence(c);
+    }
+    for (auto & c : cams) {
+        benchmark(c);
+    }
+    printf("[space_to_plane_batch_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
@@ -0,0 +1,147 @@
+// Checks when matchLocalFeatures falls back to SuperGlue, with a stub network counting the calls. CPU only.
+#include <d2frontend/d2featuretracker.h>
+#include <d2frontend/CNN/superglue_onnx.h>
+#include <d2frontend/utils.h>
+#include <random>
+
+using namespace D2FrontEnd;
+
+const int WIDTH = 640;
+const int HEIGHT = 480;
+std::mt19937 gen(0);
+
+//Matches by the landmark index, as a perfect network would
+class StubSuperGlue: public SuperGlueOnnx {
+public:
+    int calls = 0;
+    std::vector<cv::DMatch> inference(const std::vector<cv::Point2f> kpts0, const std::vector<cv::Point2f> kpts1,
+            const std::vector<float> & desc0, const std::vector<float> & desc1, const std::vector<float> & scores0,
+            const std::vector<float> & scores1) override {
+        calls++;
+        std::vector<cv::DMatch> matches;
+        for (size_t i = 0; i < std::min(kpts0.size(), kpts1.size()); i++) {
+            matches.emplace_back(i, i, 0.f);
+        }
+        return matches;
+    }
+};
+
+class GateTracker: public D2FeatureTracker {
+public:
+    StubSuperGlue * stub;
+    GateTracker(D2FTConfig config): D2FeatureTracker(config) {
+        stub = new StubSuperGlue;
+        superglue = stub;
+    }
+
+    MatchDecision match(const VisualImageDesc & a, const VisualImageDesc & b, int & matched) {
+        MatchLocalFeatureParams param;
+        param.enable_superglue = true;
+        param.enable_search_in_local = true;
+        //The production search window around the prediction
+        param.search_radius = params->ftconfig->search_local_max_dist * WIDTH;
+        std::vector<int> ids_b_to_a;
+        MatchDecision decision;
+        matchLocalFeatures(a, b, ids_b_to_a, param, &decision);
+        matched = 0;
+        for (size_t i = 0; i < ids_b_to_a.size(); i++) {
+            matched += ids_b_to_a[i] == (int) i;
+        }
+        return decision;
+    }
+};
+
+//num landmarks with descriptors perturbed by desc_noise, moved by shift pixels; a shuffled fraction of them is moved anywhere
+VisualImageDesc createImage(const std::vector<Eigen::VectorXf> & descs, const std::vector<cv::Point2f> & pts, int num,
+        FrameIdType frame_id, double desc_noise, float shift, double shuffled = 0) {
+    std::normal_distribution<float> noise(0, 1);
+    std::uniform_real_distribution<float> u(0, 1);
+    VisualImageDesc img;
+    img.frame_id = frame_id;
+    img.drone_id = params->self_id;
+    for (int i = 0; i < num; i++) {
+        cv::Point2f pt = pts[i] + cv::Point2f(shift, 0);
+        if (u(gen) < shuffled) {
+            pt = cv::Point2f(u(gen) * WIDTH, u(gen) * HEIGHT);
+        }
+        auto lm = LandmarkPerFrame::createLandmarkPerFrame(i, frame_id, 0.0, LandmarkType::SuperPointLandmark,
+            params->self_id, 0, 0, pt, Eigen::Vector3d(0, 0, 1));
+        img.landmarks.emplace_back(lm);
+        Eigen::VectorXf desc = descs[i];
+        for (int j = 0; j < desc.size(); j++) {
+            desc(j) += desc_noise * noise(gen);
+        }
+        desc.normalize();
+        img.landmark_descriptor.insert(img.landmark_descriptor.end(), desc.data(), desc.data() + desc.size());
+        img.landmark_scores.push_back(1.0);
+    }
+    return img;
+}
+
+struct GateCase {
+    const char * name;
+    int num;
+    double desc_noise;
+    float shift;
+    double shuffled;
+    bool expect_superglue;
+};
+
+int main(int argc, char** argv) {
+    params = new D2FrontendParams;
+    params->self_id = 1;
+    params->width = WIDTH;
+    params->camera_configuration = CameraConfig::PINHOLE_DEPTH;
+    params->ftconfig = new D2FTConfig;
+    params->ftconfig->enable_search_local_aera = true;
+    params->ftconfig->enable_superglue_gate = true;
+    params->ftconfig->remote_min_match_num = 0;
+    std::vector<Eigen::VectorXf> descs;
+    std::vector<cv::Point2f> pts;
+    std::uniform_real_distribution<float> u(0, 1);
+    for (int i = 0; i < 300; i++) {
+        descs.emplace_back(Eigen::VectorXf::Random(params->superpoint_dims).normalized());
+        pts.emplace_back(u(gen) * WIDTH, u(gen) * HEIGHT);
+    }
+    //Noise of 0.1 per dimension is about the size of the descriptor itself: the ratio test becomes ambiguous
+    std::vector<GateCase> cases = {
+        {"easy consecutive frames", 200, 0.005, 3, 0, false},
+        {"ambiguous descriptors", 200, 0.1, 3, 0, true},
+        {"few features", 20, 0.005, 3, 0, true},
+        {"inconsistent with prediction", 200, 0.005, 3, 1, true},
+        //The matches left in the search window all agree with the prediction, the others do not
+        {"mostly inconsistent with prediction", 200, 0.005, 3, 0.85, true},
+    };
+    bool success = true;
+    for (bool gate : {true, false}) {
+        params->ftconfig->enable_superglue_gate = gate;
+        GateTracker tracker(*params->ftconfig);
+        int expected_calls = 0;
+        for (auto & c : cases) {
+            auto a = createImage(descs, pts, c.num, 0, c.desc_noise, 0);
+            auto b = createImage(descs, pts, c.num, 1, c.desc_noise, c.shift, c.shuffled);
+            int calls = tracker.stub->calls;
+            int matched;
+            auto decision = tracker.match(a, b, matched);
+            bool expect = !gate || c.expect_superglue;
+            expected_calls += expect;
+            bool ok = decision.superglue == expect && tracker.stub->calls - calls == (int) expect &&
+                decision.frame_a == 0 && decision.frame_b == 1;
+            //Whichever matcher ran, the easy case is matched correctly
+            if (c.shuffled == 0 && c.desc_noise < 0.01 && c.num >= 200) {
+                ok &= matched > c.num * 0.95;
+            }
+            printf("[superglue_gate_test] gate %d %s: KNN %d matches ratio %.2f consistency %.2f score %.2f superglue %d matched %d %s\n",
+                gate, c.name, decision.knn_quality.num, decision.knn_quality.mean_ratio, decision.knn_quality.consistency,
+                decision.knn_quality.score, decision.superglue, matched, ok ? "OK" : "FAILED");
+            success &= ok;
+        }
+        success &= tracker.stub->calls == expected_calls;
+        printf("[superglue_gate_test] gate %d: %d SuperGlue calls for %ld pairs\n", gate, tracker.stub->calls, cases.size());
+    }
+    //An empty matching is never confident
+    auto quality = evaluateMatchQuality({}, {}, {}, {}, 0.8, 50, 20);
+    success &= quality.score == 0;
+    printf("[superglue_gate_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
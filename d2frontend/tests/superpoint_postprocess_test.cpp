@@ -0,0 +1,344 @@
+#include "d2frontend/d2frontend_params.h"
+#include "d2frontend/CNN/superpoint_common.h"
+#include "d2common/utils.hpp"
+#include <random>
+#include <tuple>
+
+using namespace D2FrontEnd;
+using D2Common::Utility::TicToc;
+D2FrontendParams * D2FrontEnd::params = new D2FrontendParams;
+
+std::mt19937 gen(0);
+
+//Channels have different scales, so normalizing per channel and per keypoint give different descriptors
+std::vector<float> randomDescMap(int width, int height) {
+    std::normal_distribution<float> dist(0, 1);
+    const int plane_size = (height/8) * (width/8);
+    std::vector<float> desc_map(SP_DESC_RAW_LEN * plane_size);
+    for (unsigned int i = 0; i < desc_map.size(); i++) {
+        desc_map[i] = dist(gen) * (0.2f + (float)(i / plane_size) / SP_DESC_RAW_LEN);
+    }
+    return desc_map;
+}
+
+std::vector<cv::Point2f> randomKeypoints(int width, int height, int num) {
+    std::uniform_int_distribution<int> dist_x(0, width - 1), dist_y(0, height - 1);
+    std::vector<cv::Point2f> kpts;
+    for (int i = 0; i < num; i++) {
+        kpts.emplace_back(dist_x(gen), dist_y(gen));
+    }
+    //Corners exercise the zero padding
+    kpts.emplace_back(0, 0);
+    kpts.emplace_back(width - 1, height - 1);
+    return kpts;
+}
+
+// Straightforward grid_sampler (bilinear, zero padding, align_corners=false) in double precision, followed by the
+// normalization of the torch path: dim 1 of the [C, N] tensor (each channel across the keypoints), then each
+// descriptor after the PCA
+std::vector<float> referenceDescriptors(const std::vector<float> & desc_map, const std::vector<cv::Point2f> & kpts, int width, int height,
+        const Eigen::MatrixXf & pca_comp_T, const Eigen::RowVectorXf & pca_mean) {
+    int map_w = width/8, map_h = height/8;
+    Eigen::MatrixXd descs = Eigen::MatrixXd::Zero(SP_DESC_RAW_LEN, kpts.size());
+    for (unsigned int i = 0; i < kpts.size(); i++) {
+        auto & pt = kpts[i];
+        double ix = ((2.0 * pt.x / width) * map_w - 1) / 2;
+        double iy = ((2.0 * pt.y / height) * map_h - 1) / 2;
+        int x0 = std::floor(ix), y0 = std::floor(iy);
+        for (int dy = 0; dy < 2; dy++) {
+            for (int dx = 0; dx < 2; dx++) {
+                int x = x0 + dx, y = y0 + dy;
+                if (x < 0 || x >= map_w || y < 0 || y >= map_h) {
+                    continue;
+                }
+                double w = (dx ? ix - x0 : 1 - (ix - x0)) * (dy ? iy - y0 : 1 - (iy - y0));
+                for (int c = 0; c < SP_DESC_RAW_LEN; c++) {
+                    descs(c, i) += w * desc_map[(c * map_h + y) * map_w + x];
+                }
+            }
+        }
+    }
+    for (int c = 0; c < SP_DESC_RAW_LEN; c++) {
+        descs.row(c) /= descs.row(c).norm();
+    }
+    std::vector<float> ret;
+    for (unsigned int i = 0; i < kpts.size(); i++) {
+        Eigen::VectorXd desc = descs.col(i);
+        if (pca_comp_T.size() > 0) {
+            desc = pca_comp_T.cast<double>().transpose() * (desc - pca_mean.cast<double>().transpose());
+        }
+        desc.normalize();
+        for (int c = 0; c < desc.size(); c++) {
+            ret.push_back(desc(c));
+        }
+    }
+    return ret;
+}
+
+double maxDiff(const std::vector<float> & a, const std::vector<float> & b) {
+    if (a.size() != b.size()) {
+        return 1e10;
+    }
+    double max_diff = 0;
+    for (unsigned int i = 0; i < a.size(); i++) {
+        max_diff = std::max(max_diff, (double)fabs(a[i] - b[i]));
+    }
+    return max_diff;
+}
+
+bool testDescriptorSampling(int width, int height, bool use_pca) {
+    auto desc_map = randomDescMap(width, height);
+    auto kpts = randomKeypoints(width, height, 300);
+    Eigen::MatrixXf pca_comp_T;
+    Eigen::RowVectorXf pca_mean;
+    if (use_pca) {
+        pca_comp_T = Eigen::MatrixXf::Random(SP_DESC_RAW_LEN, 64);
+        pca_mean = Eigen::RowVectorXf::Random(SP_DESC_RAW_LEN) * 0.01;
+    }
+    std::vector<float> descs;
+    TicToc tic;
+    computeDescriptors(desc_map.data(), kpts, descs, width, height, pca_comp_T, pca_mean);
+    double t_native = tic.toc();
+    auto descs_ref = referenceDescriptors(desc_map, kpts, width, height, pca_comp_T, pca_mean);
+    double diff_ref = maxDiff(descs, descs_ref);
+    bool success = diff_ref < 1e-5;
+    printf("[superpoint_postprocess_test] descriptors %dx%d pca %d: native %.3fms, max diff to reference %.2e\n",
+        width, height, use_pca, t_native, diff_ref);
+#ifdef USE_TORCH
+    auto options = torch::TensorOptions().dtype(torch::kFloat32);
+    auto mDesc = at::from_blob(desc_map.data(), {1, SP_DESC_RAW_LEN, height/8, width/8}, options);
+    std::vector<float> descs_torch;
+    tic.tic();
+    computeDescriptors(mDesc, mDesc, kpts, descs_torch, width, height, pca_comp_T, pca_mean);
+    double t_torch = tic.toc();
+    double diff_torch = maxDiff(descs, descs_torch);
+    success = success && diff_torch < 1e-5;
+    printf("[superpoint_postprocess_test] torch %.3fms, max diff to torch %.2e\n", t_torch, diff_torch);
+#endif
+    return success;
+}
+
+// Score map with 3x3 bumps over a noise floor below the threshold. With clusters, some peaks have a weaker peak
+// (adjacent) or a peak of the same score (plateau) within nms_dist, and some lie on the image border.
+// Clusters are far enough apart not to interact; peaks are the points that must survive the NMS.
+cv::Mat syntheticScoreMap(int width, int height, int nms_dist, float thres, int num_peaks, std::vector<cv::Point> & peaks,
+        bool clusters = false) {
+    std::uniform_real_distribution<float> noise(0, thres), peak_score(thres * 2, 1);
+    std::uniform_int_distribution<int> dist_x(0, width - 1), dist_y(0, height - 1), kind(0, 3), offset(-nms_dist, nms_dist);
+    cv::Mat prob(height, width, CV_32F);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            prob.at<float>(y, x) = noise(gen);
+        }
+    }
+    auto inside = [&](const cv::Point & pt) {
+        return pt.x >= 0 && pt.x < width && pt.y >= 0 && pt.y < height;
+    };
+    auto bump = [&](const cv::Point & pt, float score) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                if (inside(pt + cv::Point(dx, dy))) {
+                    prob.at<float>(pt.y + dy, pt.x + dx) = std::max(prob.at<float>(pt.y + dy, pt.x + dx), score * 0.7f);
+                }
+            }
+        }
+    };
+    std::vector<cv::Point> centers;
+    peaks.clear();
+    for (int i = 0; i < num_peaks * 20 && centers.size() < num_peaks; i++) {
+        cv::Point pt(dist_x(gen), dist_y(gen));
+        int type = clusters ? kind(gen) : 0;
+        if (clusters && kind(gen) == 0) {
+            //Snap to one of the borders
+            int side = kind(gen);
+            pt.x = side == 0 ? 0 : (side == 1 ? width - 1 : pt.x);
+            pt.y = side == 2 ? 0 : (side == 3 ? height - 1 : pt.y);
+        }
+        bool isolated = true;
+        for (auto & p : centers) {
+            if (std::max(abs(p.x - pt.x), abs(p.y - pt.y)) <= (clusters ? 3 * nms_dist + 3 : 2 * nms_dist + 2)) {
+                isolated = false;
+                break;
+            }
+        }
+        if (!isolated) {
+            continue;
+        }
+        float score = peak_score(gen);
+        cv::Point second = pt;
+        //The weaker peak and its bump stay within nms_dist of the peak, so NMS2 suppresses them whatever the raster order
+        int max_offset = type == 1 ? nms_dist - 1 : nms_dist;
+        if (type == 1 || type == 2) {
+            for (int j = 0; j < 20 && (second == pt || !inside(second)); j++) {
+                second = pt + cv::Point(offset(gen), offset(gen));
+                if (std::max(abs(second.x - pt.x), abs(second.y - pt.y)) > max_offset) {
+                    second = pt;
+                }
+            }
+        }
+        float second_score = type == 1 ? score * 0.8f : score;
+        bump(pt, score);
+        if (second != pt && inside(second)) {
+            bump(second, second_score);
+            prob.at<float>(second.y, second.x) = second_score;
+            if (type == 2) {
+                peaks.emplace_back(second);
+            }
+        }
+        prob.at<float>(pt.y, pt.x) = score;
+        centers.emplace_back(pt);
+        peaks.emplace_back(pt);
+    }
+    return prob;
+}
+
+// Same keypoints with the same scores, in any order among equal scores. Keypoints with the lowest score may be
+// different ones when equal scores are cut by max_num
+bool sameKeyPoints(const std::vector<cv::Point2f> & kpts_a, const std::vector<float> & scores_a,
+        const std::vector<cv::Point2f> & kpts_b, const std::vector<float> & scores_b) {
+    if (kpts_a.size() != kpts_b.size()) {
+        return false;
+    }
+    typedef std::tuple<float, float, float> Keypoint;
+    std::vector<Keypoint> a, b;
+    for (unsigned int i = 0; i < kpts_a.size(); i++) {
+        a.emplace_back(-scores_a[i], kpts_a[i].y, kpts_a[i].x);
+        b.emplace_back(-scores_b[i], kpts_b[i].y, kpts_b[i].x);
+    }
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    for (unsigned int i = 0; i < a.size(); i++) {
+        if (std::get<0>(a[i]) != std::get<0>(b[i]) || (a[i] != b[i] && std::get<0>(a[i]) != std::get<0>(a.back()))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool testKeyPointsGlobal(int width, int height, int nms_dist, int max_num, bool clusters) {
+    float thres = 0.015;
+    std::vector<cv::Point> peaks;
+    cv::Mat prob = syntheticScoreMap(width, height, nms_dist, thres, 400, peaks, clusters);
+    std::vector<cv::Point2f> kpts_ref, kpts;
+    std::vector<float> scores_ref, scores;
+    TicToc tic;
+    getKeyPoints(prob, thres, nms_dist, kpts_ref, scores_ref, width, height, max_num);
+    double t_ref = tic.toc();
+    tic.tic();
+    getKeyPointsGrid(prob, thres, nms_dist, 1, 1, kpts, scores, max_num);
+    double t_grid = tic.toc();
+    bool success = sameKeyPoints(kpts_ref, scores_ref, kpts, scores);
+    //Every expected peak is found when the budget allows
+    int found = 0;
+    for (auto & p : peaks) {
+        found += std::find(kpts.begin(), kpts.end(), cv::Point2f(p.x, p.y)) != kpts.end();
+    }
+    success &= found == std::min((int)peaks.size(), max_num) && kpts.size() == found;
+    int border = 0;
+    for (auto & p : kpts) {
+        border += p.x == 0 || p.y == 0 || p.x == width - 1 || p.y == height - 1;
+    }
+    printf("[superpoint_postprocess_test] keypoints %dx%d peaks %ld (%d on border) clusters %d max_num %d: NMS2 %ld %.3fms grid 1x1 %ld %.3fms %s\n",
+        width, height, peaks.size(), border, clusters, max_num, kpts_ref.size(), t_ref, kpts.size(), t_grid, success ? "same" : "different");
+    return success;
+}
+
+// Three peaks in a row, nms_dist apart and decreasing. The local maximum test suppresses the third by the second like the
+// max-pool NMS of SuperPoint, while NMS2 keeps it because it visits the second only after the first has suppressed it
+bool testKeyPointsChain(int nms_dist) {
+    float thres = 0.015;
+    cv::Mat prob(64, 64, CV_32F);
+    for (int y = 0; y < prob.rows; y++) {
+        for (int x = 0; x < prob.cols; x++) {
+            prob.at<float>(y, x) = 0;
+        }
+    }
+    prob.at<float>(20, 20) = 0.9;
+    prob.at<float>(20, 20 + nms_dist) = 0.8;
+    prob.at<float>(20, 20 + 2 * nms_dist) = 0.7;
+    std::vector<cv::Point2f> kpts_ref, kpts;
+    std::vector<float> scores_ref, scores;
+    getKeyPoints(prob, thres, nms_dist, kpts_ref, scores_ref, prob.cols, prob.rows, 10);
+    getKeyPointsGrid(prob, thres, nms_dist, 1, 1, kpts, scores, 10);
+    bool success = kpts.size() == 1 && kpts[0] == cv::Point2f(20, 20);
+    printf("[superpoint_postprocess_test] chain of peaks nms_dist %d: NMS2 %ld grid %ld keypoints %s\n", nms_dist,
+        kpts_ref.size(), kpts.size(), success ? "OK" : "FAILED");
+    return success;
+}
+
+bool testKeyPointsBucketed(int width, int height, int nms_dist, int grid_rows, int grid_cols, int max_num) {
+    float thres = 0.015;
+    std::vector<cv::Point> peaks;
+    cv::Mat prob = syntheticScoreMap(width, height, nms_dist, thres, 400, peaks);
+    //Make the top left quarter much stronger, a global top-k would take most features from it
+    for (auto & p : peaks) {
+        if (p.x < width / 2 && p.y < height / 2) {
+            prob.at<float>(p.y, p.x) += 10;
+        }
+    }
+    std::vector<cv::Point2f> kpts;
+    std::vector<float> scores;
+    getKeyPointsGrid(prob, thres, nms_dist, grid_rows, grid_cols, kpts, scores, max_num);
+    int cells = grid_rows * grid_cols;
+    int quota = std::max(max_num / cells, 1);
+    std::vector<int> peaks_in_cell(cells, 0), kpts_in_cell(cells, 0);
+    auto cellOf = [&](int x, int y) {
+        return (y * grid_rows / height) * grid_cols + x * grid_cols / width;
+    };
+    for (auto & p : peaks) {
+        peaks_in_cell[cellOf(p.x, p.y)] ++;
+    }
+    bool success = kpts.size() == std::min((int)peaks.size(), max_num);
+    for (unsigned int i = 0; i < kpts.size(); i++) {
+        //Every keypoint must be one of the peaks and sorted by score
+        success &= std::find(peaks.begin(), peaks.end(), cv::Point(kpts[i].x, kpts[i].y)) != peaks.end();
+        success &= i == 0 || scores[i] <= scores[i - 1];
+        kpts_in_cell[cellOf(kpts[i].x, kpts[i].y)] ++;
+    }
+    for (int i = 0; i < cells; i++) {
+        success &= kpts_in_cell[i] >= std::min(quota, peaks_in_cell[i]);
+    }
+    printf("[superpoint_postprocess_test] keypoints grid %dx%d max_num %d: %ld keypoints %s\n",
+        grid_rows, grid_cols, max_num, kpts.size(), success ? "spread" : "not spread");
+    return success;
+}
+
+// All the peaks in a quarter of the image: the cells there fill the budget left by the empty ones
+bool testKeyPointsClustered(int width, int height, int nms_dist, int grid_rows, int grid_cols, int max_num) {
+    float thres = 0.015;
+    std::vector<cv::Point> peaks;
+    cv::Mat quarter = syntheticScoreMap(width / 2, height / 2, nms_dist, thres, 400, peaks);
+    cv::Mat prob = cv::Mat::zeros(height, width, CV_32F);
+    quarter.copyTo(prob(cv::Rect(0, 0, width / 2, height / 2)));
+    std::vector<cv::Point2f> kpts;
+    std::vector<float> scores;
+    getKeyPointsGrid(prob, thres, nms_dist, grid_rows, grid_cols, kpts, scores, max_num);
+    bool success = kpts.size() == std::min((int)peaks.size(), max_num);
+    for (unsigned int i = 0; i < kpts.size(); i++) {
+        success &= std::find(peaks.begin(), peaks.end(), cv::Point(kpts[i].x, kpts[i].y)) != peaks.end();
+        success &= i == 0 || scores[i] <= scores[i - 1];
+    }
+    printf("[superpoint_postprocess_test] clustered keypoints grid %dx%d max_num %d: %ld keypoints of %ld peaks %s\n",
+        grid_rows, grid_cols, max_num, kpts.size(), peaks.size(), success ? "OK" : "FAILED");
+    return success;
+}
+
+int main(int argc, char** argv) {
+    bool success = true;
+    success &= testDescriptorSampling(640, 480, false);
+    success &= testDescriptorSampling(640, 480, true);
+    success &= testDescriptorSampling(800, 400, true);
+    success &= testKeyPointsGlobal(640, 480, 4, 200, false);
+    success &= testKeyPointsGlobal(640, 480, 4, 1000, false);
+    success &= testKeyPointsGlobal(320, 240, 2, 100, false);
+    success &= testKeyPointsGlobal(640, 480, 4, 200, true);
+    success &= testKeyPointsGlobal(640, 480, 4, 1000, true);
+    success &= testKeyPointsGlobal(320, 240, 2, 1000, true);
+    success &= testKeyPointsChain(4);
+    success &= testKeyPointsBucketed(640, 480, 4, 4, 4, 200);
+    success &= testKeyPointsBucketed(640, 480, 4, 3, 5, 100);
+    success &= testKeyPointsClustered(640, 480, 4, 4, 4, 200);
+    success &= testKeyPointsClustered(640, 480, 4, 3, 5, 300);
+    printf("[superpoint_postprocess_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
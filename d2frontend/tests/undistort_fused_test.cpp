@@ -0,0 +1,109 @@
+#include "d2common/fisheye_undistort.h"
+#include <d2common/remap_fused.h>
+#include <camodocal/camera_models/CataCamera.h>
+
+using D2Common::FisheyeUndist;
+using D2Common::Utility::TicToc;
+
+const int WIDTH = 1280;
+const int HEIGHT = 720;
+const int CAMERA_NUM = 4;
+
+//Previous path of undist_all: gray conversion, remap and photometric gain as separate passes
+cv::Mat separate(const cv::Mat & img, const cv::Mat & map1, const cv::Mat & map2, const cv::Mat & gain, bool to_gray) {
+    cv::Mat input = img, output;
+    if (to_gray && img.channels() == 3) {
+        cv::cvtColor(img, input, cv::COLOR_BGR2GRAY);
+    }
+    cv::remap(input, output, map1, map2, cv::INTER_LINEAR);
+    if (!gain.empty()) {
+        cv::Mat gains = gain;
+        if (output.channels() == 3) {
+            cv::cvtColor(gain, gains, cv::COLOR_GRAY2BGR);
+        }
+        output.convertTo(output, CV_32F);
+        cv::multiply(output, gains, output);
+        output.convertTo(output, CV_8U);
+    }
+    return output;
+}
+
+bool compare(const std::string & name, const cv::Mat & a, const cv::Mat & b, double max_allowed) {
+    if (a.size() != b.size() || a.type() != b.type()) {
+        printf("[undistort_fused_test] %s: size or type differs\n", name.c_str());
+        return false;
+    }
+    cv::Mat diff;
+    cv::absdiff(a.reshape(1), b.reshape(1), diff);
+    double max_diff;
+    cv::minMaxLoc(diff, nullptr, &max_diff);
+    int total = diff.rows * diff.cols;
+    int exact = total - cv::countNonZero(diff);
+    bool success = max_diff <= max_allowed;
+    printf("[undistort_fused_test] %s: max diff %.0f, %d/%d exact %s\n", name.c_str(), max_diff, exact, total,
+        success ? "OK" : "FAILED");
+    return success;
+}
+
+int main(int argc, char** argv) {
+    camodocal::CameraPtr cam(new camodocal::CataCamera(camodocal::CataCamera::Parameters("fisheye", WIDTH, HEIGHT,
+        2.2, -0.2, 0.05, 0.0001, -0.0002, 1150, 1150, 640, 360)));
+    FisheyeUndist undist(cam, 0, 200, false, FisheyeUndist::UndistortPinhole5, 600, 300);
+    cv::RNG rng(0);
+    std::vector<cv::Mat> imgs(CAMERA_NUM), gains;
+    for (auto & img : imgs) {
+        img.create(HEIGHT, WIDTH, CV_8UC3);
+        rng.fill(img, cv::RNG::UNIFORM, 0, 256);
+    }
+    for (auto & map : undist.undistMaps) {
+        cv::Mat gain(map.first.size(), CV_32FC1);
+        rng.fill(gain, cv::RNG::UNIFORM, 0.8, 1.6);
+        gains.push_back(gain);
+    }
+
+    bool success = true;
+    for (unsigned int i = 0; i < undist.undistMaps.size(); i++) {
+        auto & map = undist.undistMaps[i];
+        std::string view = "view " + std::to_string(i);
+        cv::Mat fused;
+        D2Common::remapFused(imgs[0], fused, map.first, map.second);
+        success &= compare(view + " bgr", separate(imgs[0], map.first, map.second, cv::Mat(), false), fused, 0);
+        D2Common::remapFused(imgs[0], fused, map.first, map.second, cv::Mat(), true);
+        success &= compare(view + " gray", separate(imgs[0], map.first, map.second, cv::Mat(), true), fused, 1);
+        D2Common::remapFused(imgs[0], fused, map.first, map.second, gains[i], true);
+        success &= compare(view + " gray+gain", separate(imgs[0], map.first, map.second, gains[i], true), fused, 1);
+        D2Common::remapFused(imgs[0], fused, map.first, map.second, gains[i], false);
+        success &= compare(view + " bgr+gain", separate(imgs[0], map.first, map.second, gains[i], false), fused, 1);
+    }
+
+    //Gray + photometric output of all views for 4x 1280x720
+    const int rounds = 20;
+    std::vector<cv::Mat> outputs(undist.undistMaps.size());
+    TicToc tic;
+    for (int k = 0; k < rounds; k++) {
+        for (auto & img : imgs) {
+            cv::Mat gray;
+            cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+#pragma omp parallel for num_threads(5)
+            for (unsigned int i = 0; i < undist.undistMaps.size(); i++) {
+                auto & map = undist.undistMaps[i];
+                outputs[i] = separate(gray, map.first, map.second, gains[i], false);
+            }
+        }
+    }
+    double t_separate = tic.toc() / rounds;
+    tic.tic();
+    for (int k = 0; k < rounds; k++) {
+        for (auto & img : imgs) {
+            for (unsigned int i = 0; i < undist.undistMaps.size(); i++) {
+                auto & map = undist.undistMaps[i];
+                D2Common::remapFused(img, outputs[i], map.first, map.second, gains[i], true);
+            }
+        }
+    }
+    double t_fused = tic.toc() / rounds;
+    printf("[undistort_fused_test] %dx %dx%d to %ld views: separate %.2fms fused %.2fms\n", CAMERA_NUM, WIDTH, HEIGHT,
+        undist.undistMaps.size(), t_separate, t_fused);
+    printf("[undistort_fused_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
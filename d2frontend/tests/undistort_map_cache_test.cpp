@@ -0,0 +1,131 @@
+#include "d2common/fisheye_undistort.h"
+#include <camodocal/camera_models/CataCamera.h>
+#include <random>
+
+using D2Common::FisheyeUndist;
+using D2Common::Utility::TicToc;
+
+bool sameMat(const cv::Mat & a, const cv::Mat & b) {
+    if (a.size() != b.size() || a.type() != b.type()) {
+        return false;
+    }
+    if (a.empty()) {
+        return true;
+    }
+    cv::Mat diff;
+    cv::compare(a.reshape(1), b.reshape(1), diff, cv::CMP_NE);
+    return cv::countNonZero(diff) == 0;
+}
+
+bool sameMaps(const FisheyeUndist & a, const FisheyeUndist & b) {
+    if (a.undistMaps.size() != b.undistMaps.size()) {
+        return false;
+    }
+    for (unsigned int i = 0; i < a.undistMaps.size(); i++) {
+        if (!sameMat(a.undistMaps[i].first, b.undistMaps[i].first) || !sameMat(a.undistMaps[i].second, b.undistMaps[i].second)) {
+            return false;
+        }
+    }
+    return sameMat(a.fisheye2cam_pt, b.fisheye2cam_pt) && sameMat(a.fisheye2cam_id, b.fisheye2cam_id);
+}
+
+bool testMode(camodocal::CameraPtr cam, FisheyeUndist::UndistortType mode, const std::string & name,
+        int width, int height, const std::string & cache_dir) {
+    double fov = 200;
+    TicToc tic;
+    FisheyeUndist fresh(cam, 0, fov, false, mode, width, height);
+    double t_fresh = tic.toc();
+    tic.tic();
+    FisheyeUndist writer(cam, 0, fov, false, mode, width, height, cv::Mat(), cache_dir);
+    double t_write = tic.toc();
+    tic.tic();
+    FisheyeUndist reader(cam, 0, fov, false, mode, width, height, cv::Mat(), cache_dir);
+    double t_read = tic.toc();
+    bool success = sameMaps(fresh, writer) && sameMaps(fresh, reader);
+    printf("[undistort_map_cache_test] %s: fresh %.1fms write cache %.1fms load cache %.1fms maps %s\n", name.c_str(),
+        t_fresh, t_write, t_read, success ? "identical" : "different");
+
+    //Remapping with the fixed point maps must give the same image as the float maps
+    cv::Mat img(cam->imageHeight(), cam->imageWidth(), CV_8UC3);
+    cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(255));
+    auto imgs = reader.undist_all(img, true);
+    for (unsigned int i = 0; i < fresh.undistMaps.size(); i++) {
+        cv::Mat map_float;
+        if (mode == FisheyeUndist::UndistortCylindrical) {
+            map_float = fresh.genOneUndistMap(i, cam, fresh.cam_top, fresh.t[i], width, height).first;
+        } else {
+            int h = (mode == FisheyeUndist::UndistortPinhole5 && i == 0) ? width : fresh.sideImgHeight;
+            double f = (mode == FisheyeUndist::UndistortPinhole5 && i == 0) ? fresh.f_center : fresh.f_side;
+            map_float = fresh.genOneUndistMap(i, cam, fresh.t[i], width, h, f).first;
+        }
+        cv::Mat out_float;
+        cv::remap(img, out_float, map_float, cv::Mat(), REMAP_FUNC);
+        bool same = sameMat(out_float, imgs[i]);
+        if (!same) {
+            printf("[undistort_map_cache_test] %s: remap of view %d differs\n", name.c_str(), i);
+        }
+        success &= same;
+    }
+    return success;
+}
+
+uint64_t fnv1a(const void * data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    auto bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//Cache key of the cylindrical map before the keys had a version
+uint64_t unversionedCylinderKey(const FisheyeUndist & undist, camodocal::CameraPtr cam, unsigned width, unsigned height) {
+    auto hashCamera = [](camodocal::CameraPtr p_cam, uint64_t hash) {
+        std::vector<double> params;
+        p_cam->writeParameters(params);
+        int header[3] = {(int)p_cam->modelType(), p_cam->imageWidth(), p_cam->imageHeight()};
+        hash = fnv1a(header, sizeof(header), hash);
+        return fnv1a(params.data(), params.size() * sizeof(double), hash);
+    };
+    int kind = 1;
+    unsigned size[2] = {width, height};
+    uint64_t key = fnv1a(&kind, sizeof(kind));
+    key = hashCamera(cam, key);
+    key = hashCamera(undist.cam_top, key);
+    key = fnv1a(undist.t[0].coeffs().data(), 4 * sizeof(double), key);
+    key = fnv1a(size, sizeof(size), key);
+    return fnv1a(&undist.fov, sizeof(undist.fov), key);
+}
+
+//A map cached by an older build under the unversioned key must not be loaded
+bool testStaleCache(camodocal::CameraPtr cam, int width, int height, const std::string & cache_dir) {
+    FisheyeUndist fresh(cam, 0, 200, false, FisheyeUndist::UndistortCylindrical, width, height);
+    uint64_t key = unversionedCylinderKey(fresh, cam, width, height);
+    char name[64];
+    snprintf(name, sizeof(name), "/undist_map_%016lx.bin", (unsigned long)key);
+    mkdir(cache_dir.c_str(), 0755);
+    std::ofstream file(cache_dir + name, std::ios::binary);
+    int header[3] = {height, width, CV_32FC2};
+    cv::Mat stale(height, width, CV_32FC2, cv::Scalar(1, 1));
+    file.write((const char *)&key, sizeof(key));
+    file.write((const char *)header, sizeof(header));
+    file.write((const char *)stale.data, stale.total() * stale.elemSize());
+    file.close();
+    FisheyeUndist reader(cam, 0, 200, false, FisheyeUndist::UndistortCylindrical, width, height, cv::Mat(), cache_dir);
+    bool success = sameMaps(fresh, reader);
+    printf("[undistort_map_cache_test] stale unversioned cache %s\n", success ? "ignored" : "loaded");
+    return success;
+}
+
+int main(int argc, char** argv) {
+    std::string cache_dir = "/tmp/undistort_map_cache_test_" + std::to_string(getpid());
+    camodocal::CameraPtr cam(new camodocal::CataCamera(camodocal::CataCamera::Parameters("fisheye", 1280, 720,
+        2.2, -0.2, 0.05, 0.0001, -0.0002, 1150, 1150, 640, 360)));
+    bool success = true;
+    success &= testMode(cam, FisheyeUndist::UndistortCylindrical, "cylindrical", 800, 400, cache_dir);
+    success &= testMode(cam, FisheyeUndist::UndistortPinhole5, "pinhole5", 600, 200, cache_dir);
+    success &= testMode(cam, FisheyeUndist::UndistortPinhole2, "pinhole2", 400, 300, cache_dir);
+    success &= testStaleCache(cam, 320, 160, cache_dir + "_stale");
+    printf("[undistort_map_cache_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
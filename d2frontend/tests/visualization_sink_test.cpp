@@ -0,0 +1,121 @@
+#include "d2frontend/visualization_sink.h"
+#include "d2common/utils.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+using namespace D2FrontEnd;
+using D2Common::Utility::TicToc;
+
+const int FRAMES = 100;
+const int TRACK_MS = 3;
+const int RENDER_MS = 20;
+
+//Keypoints, ids and matches of a tracked frame
+struct Snapshot {
+    int frame_id = -1;
+    std::vector<float> pts;
+    std::vector<int> ids;
+};
+
+void work(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+Snapshot track(int frame_id) {
+    work(TRACK_MS);
+    Snapshot snapshot;
+    snapshot.frame_id = frame_id;
+    snapshot.pts.resize(2 * 300, 1.0);
+    snapshot.ids.resize(300, frame_id);
+    return snapshot;
+}
+
+//Returns the time spent on the tracking thread
+double runTracking(bool enable_viz, bool off_thread, std::vector<int> & rendered, size_t & dropped) {
+    auto render = [&] (Snapshot & snapshot) {
+        work(RENDER_MS);
+        rendered.push_back(snapshot.frame_id);
+    };
+    dropped = 0;
+    VisualizationSink<Snapshot> * sink = nullptr;
+    if (enable_viz && off_thread) {
+        sink = new VisualizationSink<Snapshot>(render);
+    }
+    TicToc tic;
+    for (int i = 0; i < FRAMES; i++) {
+        auto snapshot = track(i);
+        if (enable_viz) {
+            if (off_thread) {
+                sink->submit(std::move(snapshot));
+            } else {
+                render(snapshot);
+            }
+        }
+    }
+    double dt = tic.toc();
+    if (sink) {
+        sink->flush();
+        dropped = sink->droppedCount();
+        delete sink;
+    }
+    return dt;
+}
+
+//The renderer is held on the first snapshot while the others are submitted: submit must return at once,
+//only the newest one waits in the mailbox and it is rendered once the renderer is released
+bool testSlowRenderer() {
+    std::mutex lock;
+    std::condition_variable cond;
+    bool started = false, released = false;
+    std::vector<int> rendered;
+    VisualizationSink<Snapshot> sink([&] (Snapshot & snapshot) {
+        std::unique_lock<std::mutex> guard(lock);
+        started = true;
+        cond.notify_all();
+        cond.wait(guard, [&] { return released; });
+        rendered.push_back(snapshot.frame_id);
+    });
+    Snapshot snapshot;
+    snapshot.frame_id = 0;
+    sink.submit(snapshot);
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        cond.wait(guard, [&] { return started; });
+    }
+    for (int i = 1; i < FRAMES; i++) {
+        snapshot.frame_id = i;
+        sink.submit(snapshot);
+    }
+    bool success = sink.renderedCount() == 0 && sink.droppedCount() == FRAMES - 2;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        released = true;
+    }
+    cond.notify_all();
+    sink.flush();
+    success &= sink.renderedCount() == 2 && rendered.size() == 2 && rendered[0] == 0 && rendered[1] == FRAMES - 1;
+    printf("[visualization_sink_test] renderer held: %ld submitted, %ld dropped, rendered %ld %s\n", sink.submittedCount(),
+        sink.droppedCount(), rendered.size(), success ? "OK" : "FAILED");
+    return success;
+}
+
+int main(int argc, char** argv) {
+    std::vector<int> rendered;
+    size_t dropped;
+    double t_disabled = runTracking(false, false, rendered, dropped);
+    double t_inline = runTracking(true, false, rendered, dropped);
+    rendered.clear();
+    double t_enabled = runTracking(true, true, rendered, dropped);
+    bool increasing = true;
+    for (unsigned int i = 1; i < rendered.size(); i++) {
+        increasing &= rendered[i] > rendered[i - 1];
+    }
+    //The newest frame is always shown. The timings are informative, testSlowRenderer checks that submit doesn't wait
+    bool success = !rendered.empty() && rendered.back() == FRAMES - 1 && increasing && rendered.size() + dropped == FRAMES;
+    printf("[visualization_sink_test] tracking %d frames: viz disabled %.1fms, inline %.1fms, off thread %.1fms; rendered %ld dropped %ld\n",
+        FRAMES, t_disabled, t_inline, t_enabled, rendered.size(), dropped);
+    success &= testSlowRenderer();
+    printf("[visualization_sink_test] %s\n", success ? "PASSED" : "FAILED");
+    return success ? 0 : -1;
+}
@@ -262,6 +262,11 @@ public:
     D2VINSNode(ros::NodeHandle & nh) {
         Init(nh);
     }
+
+    ~D2VINSNode() {
+        //The tracking thread calls the overrides above, stop it before the members are gone
+        stopPipeline();
+    }
 };
 
 int main(int argc, char **argv)
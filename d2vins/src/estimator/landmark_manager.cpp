@@ -15,7 +15,9 @@ void D2LandmarkManager::addKeyframe(const VisualImageDescArray & images, double
                 continue;
             }
             lm.cur_td = td;
-            updateLandmark(lm);
+            if (!updateLandmark(lm)) {
+                continue;
+            }
             if (landmark_state.find(lm.landmark_id) == landmark_state.end()) {
                 if (params->landmark_param == D2VINSConfig::LM_INV_DEP) {
                     landmark_state[lm.landmark_id] = new state_type[INV_DEP_SIZE];
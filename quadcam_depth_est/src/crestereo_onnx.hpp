@@ -46,21 +46,17 @@ inline void hwc_to_chw(const cv::Mat & src, float * buf) {
 
 class CREStereoONNX: public D2FrontEnd::ONNXInferenceGeneric {
 protected:
-    float * results_;
-    std::array<int64_t, 4> output_shape_;
     std::array<int64_t, 4> input_shape;
     std::array<int64_t, 4> input_shape_half;
-    float* input_l, *input_r, * input_l_half, *input_r_half;
+    float* input_l, *input_r, * input_l_half = nullptr, *input_r_half = nullptr;
     std::vector<Ort::Value> inputs;
     bool combined = false;
     Ort::MemoryInfo memory_info;
     void setInputs(Ort::MemoryInfo & memory_info, int width, int height) {
         inputs.clear();
-        const std::array<int,3> dims = {3, height, width};                         
         input_l = new float[width*height*3];
         input_r = new float[width*height*3];
         if (combined) {
-            const std::array<int,3> dims = {3, height/2, width/2};
             input_l_half = new float[width/2*height/2*3];
             input_r_half = new float[width/2*height/2*3];
             inputs.emplace_back(Ort::Value::CreateTensor<float>(memory_info,
@@ -73,10 +69,29 @@ protected:
         inputs.emplace_back(Ort::Value::CreateTensor<float>(memory_info,
                input_r, 3*width*height, input_shape.data(), 4));
     }
+
+    //The model has two or four inputs, bound here instead of the single input of bindTensors
+    void bindInputs(int width, int height) {
+        const std::vector<int64_t> output_shape{1, 2, height, width}; //Output shape is 2 channels, height, width
+        output_buffers_.assign(1, std::vector<float>(2*width*height));
+        output_tensors_.clear();
+        output_tensors_.emplace_back(Ort::Value::CreateTensor<float>(memory_info,
+            output_buffers_[0].data(), output_buffers_[0].size(), output_shape.data(), output_shape.size()));
+        std::vector<std::string> input_names{"left", "right"};
+        if (combined) {
+            input_names = {"init_left", "init_right", "next_left", "next_right"};
+            output_names_ = {"next_output"};
+        }
+        io_binding_->ClearBoundInputs();
+        io_binding_->ClearBoundOutputs();
+        for (unsigned int i = 0; i < inputs.size(); i++) {
+            io_binding_->BindInput(input_names[i].c_str(), inputs[i]);
+        }
+        io_binding_->BindOutput(output_names_[0].c_str(), output_tensors_[0]);
+    }
 public:
     CREStereoONNX(std::string engine_path, int _width, int _height, bool use_tensorrt = true, bool use_fp16 = true, bool use_int8 = false): 
-            ONNXInferenceGeneric(engine_path, "left", "output", _width, _height, use_tensorrt, use_fp16, use_int8),
-            output_shape_{1, 2, _height, _width}, //Output shape is 2 channels, height, width
+            ONNXInferenceGeneric(engine_path, "left", {"output"}, _width, _height, gpuONNXConfig(use_tensorrt, use_fp16, use_int8)),
             input_shape{1, 3, _height, _width}, //CREStereo is batch channel height width
             input_shape_half{1, 3, _height/2, _width/2}, //CREStereo is batch channel height width
             memory_info(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)) {
@@ -87,9 +102,7 @@ public:
             combined = true;
         }
         setInputs(memory_info, _width, _height);
-        results_ = new float[2*width*height];
-        output_tensor_ = Ort::Value::CreateTensor<float>(memory_info,
-            results_, 2*width*height, output_shape_.data(), output_shape_.size());
+        bindInputs(_width, _height);
 
         if (!combined) {
             printf("CREStereoONNX Init initialized\n");
@@ -98,19 +111,6 @@ public:
         }
     }
 
-    virtual void doInference() {
-        const char* input_names[] = {"init_left", "init_right", "next_left", "next_right"};
-        const char* output_names[] = {"next_output"};
-        if (combined) {
-            session_->Run(Ort::RunOptions{nullptr}, input_names, inputs.data(), 4, output_names, &output_tensor_, 1);
-        } else {
-            input_names[0] = "left";
-            input_names[1] = "right";
-            output_names[0] = "output";
-            session_->Run(Ort::RunOptions{nullptr}, input_names, inputs.data(), 2, output_names, &output_tensor_, 1);
-        } 
-    }
-
     cv::Mat inference(const cv::Mat & input_left, const cv::Mat & input_right) {
         cv::Mat _input_left, _input_right;
         if (input_left.channels() != 3) {
@@ -124,15 +124,17 @@ public:
             cv::resize(_input_left, _input_left, cv::Size(width, height));
             cv::resize(_input_right, _input_right, cv::Size(width, height));
         } 
-        cv::Mat input_half_left, input_half_right;
-        cv::resize(_input_left, input_half_left, cv::Size(width/2, height/2));
-        cv::resize(_input_right, input_half_right, cv::Size(width/2, height/2));
         hwc_to_chw(_input_left, input_l);
         hwc_to_chw(_input_right, input_r);
-        hwc_to_chw(input_half_left, input_l_half);
-        hwc_to_chw(input_half_right, input_r_half);
-        doInference();
-        cv::Mat res(height, width, CV_32F, results_);
+        if (combined) {
+            cv::Mat input_half_left, input_half_right;
+            cv::resize(_input_left, input_half_left, cv::Size(width/2, height/2));
+            cv::resize(_input_right, input_half_right, cv::Size(width/2, height/2));
+            hwc_to_chw(input_half_left, input_l_half);
+            hwc_to_chw(input_half_right, input_r_half);
+        }
+        run();
+        cv::Mat res(height, width, CV_32F, output_buffers_[0].data());
         return res;
     }
 };
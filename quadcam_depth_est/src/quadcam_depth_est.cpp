@@ -192,6 +192,10 @@ void QuadCamDepthEst::loadCameraConfig(YAML::Node & config, std::string configPa
     if (config["photometric_calib_1"]) {
         photometric_inv_1 = readVingette(configPath + "/" + config["photometric_calib_1"].as<std::string>(), avg_brightness);
     }
+    std::string map_cache_dir;
+    if (config["undistort_map_cache_dir"]) {
+        map_cache_dir = config["undistort_map_cache_dir"].as<std::string>();
+    }
     std::string calib_file_path = config["calib_file_path"].as<std::string>();
     printf("[QuadCamDepthEst] Load camera config from %s\n", calib_file_path.c_str());
     calib_file_path = configPath + "/" + calib_file_path;
@@ -206,7 +210,7 @@ void QuadCamDepthEst::loadCameraConfig(YAML::Node & config, std::string configPa
         if (camera_config == CameraConfig::FOURCORNER_FISHEYE) {
             double fov = config["fov"].as<double>();
             undistortors.push_back(new D2Common::FisheyeUndist(ret.first, 0, fov, true,
-                D2Common::FisheyeUndist::UndistortPinhole2, width, height, photometric_inv));
+                D2Common::FisheyeUndist::UndistortPinhole2, width, height, photometric_inv, map_cache_dir));
         }
         raw_cam_extrinsics.emplace_back(ret.second);
     }